@@ -64,6 +64,8 @@ static struct option longopts[] = {
 { "alternateos",    required_argument,      0,              kalternateos},
 { "alternateOS",    required_argument,      0,              kalternateos},
 { "allowUI",        no_argument,            0,              kallowui},
+{ "apply-plan",     required_argument,      0,              kapplyplan},
+{ "all-boot-options",no_argument,           0,              kallbootoptions},
 { "bootinfo",       optional_argument,      0,              kbootinfo},
 { "bootefi",        optional_argument,      0,              kbootefi},
 { "booter",         required_argument,      0,              kbooter },
@@ -94,12 +96,14 @@ static struct option longopts[] = {
 { "passpromt",      no_argument,            0,              kpasspromt },
 { "payload",        required_argument,      0,              kpayload },
 { "personalize",    no_argument,            0,              kpersonalize },
+{ "plan",           no_argument,            0,              kplan },
 { "plist",          no_argument,            0,              kplist },
 { "quiet",          no_argument,            0,              kquiet },
 { "recovery",        no_argument,           0,              krecovery },
 { "reset",          no_argument,            0,              kreset },
 { "save9",          no_argument,            0,              ksave9 },
 { "saveX",          no_argument,            0,              ksaveX },
+{ "scan-images",    required_argument,      0,              kscanimages },
 { "server",         required_argument,      0,              kserver },
 { "setBoot",        no_argument,            0,              ksetboot },
 { "setboot",        no_argument,            0,              ksetboot },
@@ -158,10 +162,172 @@ static void blessHandleArgument(char * argv[], struct clarg *actarg, struct opti
 }
 
 
+/*
+ * Run the one mode this invocation asked for.  Every mode returns here,
+ * so that main() can release the NVRAM session and volume index (and
+ * report their statistics) whichever one ran.
+ */
+static int blessDispatch(BLContextPtr context)
+{
+    /* Scanning image files doesn't depend on the firmware of this machine */
+    if (actargs[kscanimages].present) {
+        return modeScanImages(context, actargs);
+    }
+
+    /* There are 5 public modes of execution: info, device, folder, netboot, unbless
+     * There is 1 private mode: firmware
+     * These are all one-way function jumps.
+     */
+    if (firmwareType == kBLPreBootEnvType_iBoot) {
+        /* External TDM devices are treated as standalone devices.
+         * In order to use a TDM device as an external media to boot the current Apple silicon device use
+         * the '--use-tdm-as-external' option.
+         * For external/removable devices which are not TDM devices the following rules apply:
+         * '--folder', '--file' and '--info' are used to boot/bless and get information based on x86 architecture
+         * with the intent that this external/removable device will be used for booting an x86 Mac.
+         * All other options are used to boot/bless and get information based on arm64e architecture
+         * with the intent that this external/removable device will be used for booting this Apple Silicon Mac.
+         */
+        bool tdm = false;
+        bool external = false;
+        bool removable = false;
+        char bsdName[BSD_NAME_SIZE];
+        int ret = 0;
+
+        if (!actargs[kgetboot].present) {
+            if (actargs[kinfo].present) {
+                ret = BLGetCommonMountPoint(context, actargs[kinfo].argument, "", actargs[kmount].argument);
+            } else if (actargs[kunbless].present) {
+                ret = BLGetCommonMountPoint(context, actargs[kunbless].argument, "", actargs[kmount].argument);
+            } else if (actargs[kfolder].present) {
+                ret = extractMountPoint(context, actargs);
+            }
+            if (ret) {
+                return ret;
+            }
+            if (actargs[kdevice].present) {
+                strlcpy(bsdName, actargs[kdevice].argument + strlen(_PATH_DEV), sizeof(bsdName));
+            } else if ((ret = extractDiskFromMountPoint(context, actargs[kmount].argument, bsdName, BSD_NAME_SIZE)) != 0) {
+                blesscontextprintf(context, kBLLogLevelError, "Could not extract BSD name from mount point %s\n", actargs[kmount].argument);
+                return ret;
+            }
+
+            ret = isMediaTDM(context, bsdName, &tdm);
+            if (ret) {
+                return ret;
+            }
+            ret = isMediaExternal(context, bsdName, &external);
+            if (ret) {
+                return ret;
+            }
+            ret = isMediaRemovable(context, bsdName, &removable);
+            if (ret) {
+                return ret;
+            }
+        }
+
+        /* '--setboot' and '--nextonly' relevant only for booting current internal Apple Silicon device
+         * '--folder' is used to boot device based on Intel Atchitecture. Therefore those options
+         * are not relevant.
+         */
+        if (actargs[kfolder].present) {
+            if (actargs[ksetboot].present) {
+                errx(1, "For Apple Silicon Macs, 'setboot' option is not supported in Folder mode");
+            }
+            if (actargs[knextonly].present) {
+                errx(1, "For Apple Silicon Macs, 'nextonly' option is not supported in Folder mode");
+            }
+        }
+
+        /* Handle Info mode (--info, --getBoot):
+         * TDM is also considered an external devices
+         */
+        if (actargs[kgetboot].present ||
+            (actargs[kinfo].present && external) ||
+            (actargs[kinfo].present && removable)) {
+            /* If it was requested, print out the Finder Info words */
+            return modeInfo(context, actargs);
+        } else if (actargs[kinfo].present) {
+            errx(1, "For Apple Silicon Macs, the 'info' option is only supported for external devices.");
+        }
+
+        /* Handle TDM devices (Device mode, Unbless mode, File/Folder mode, Mount mode,
+         * Info mode is handled above):
+         */
+        if (tdm && !actargs[kusetdmasexternal].present) {
+            if (actargs[kdevice].present) {
+                return modeDevice(context, actargs);
+            }
+            if (actargs[kunbless].present) {
+                return modeUnbless(context, actargs);
+            }
+            return modeFolder(context, actargs);
+        }
+
+        /* Handle external and removable devices not in TDM (Folder mode): */
+        if (!tdm && (external || removable)) {
+            if (actargs[kfolder].present) {
+                return modeFolder(context, actargs);
+            }
+        }
+
+        if (actargs[kunbless].present) {
+            errx(1, "For Apple Silicon Macs, the 'unbless' option is only supported for Intel architecture based devices in TDM");
+        }
+        if (actargs[kfolder].present) {
+            errx(1, "For Apple Silicon Macs, the 'folder' option is only supported for external devices");
+        }
+        if (actargs[kfile].present) {
+            errx(1, "For Apple Silicon Macs, the 'file' option is supported for external devices in Folder mode only");
+        }
+
+        /* Handle AS devices (Device mode, Mount mode,
+         * Info mode is handled above):
+         */
+        return blessViaBootability(context, actargs);
+
+    } else {
+        /* --plan runs any other mode without changing anything */
+        if(actargs[kapplyplan].present) {
+            return modeApplyPlan(context, actargs);
+        }
+
+        if(actargs[kplan].present) {
+            return modePlan(context, actargs);
+        }
+
+        /* If it was requested, print out the Finder Info words */
+        if(actargs[kinfo].present || actargs[kgetboot].present) {
+            return modeInfo(context, actargs);
+        }
+
+        if(actargs[kdevice].present) {
+            return modeDevice(context, actargs);
+        }
+
+        if(actargs[kfirmware].present) {
+            return modeFirmware(context, actargs);
+        }
+
+        if(actargs[knetboot].present) {
+            return modeNetboot(context, actargs);
+        }
+
+        if (actargs[kunbless].present) {
+            return modeUnbless(context, actargs);
+        }
+
+        /* default */
+        return modeFolder(context, actargs);
+    }
+}
+
+
 int main (int argc, char * argv[])
 {
 
     int ch, longindex;
+    int ret;
     BLContext context;
     struct blesscon bcon;
 
@@ -171,9 +337,12 @@ int main (int argc, char * argv[])
     bcon.quiet = 0;
     bcon.verbose = 0;
 
-    context.version = 0;
+    context.version = kBLContextVersionPlan;
     context.logstring = blesslog;
     context.logrefcon = &bcon;
+    context.nvram = NULL;
+    context.volumeIndex = NULL;
+    context.plan = NULL;
     
     if (BLGetPreBootEnvironmentType(&context, &firmwareType)) {
         errx(1, "Could not determine firmware environment");
@@ -250,6 +419,15 @@ int main (int argc, char * argv[])
                 case kserver:
                     errx(1, "The 'server' option is not supported on Apple Silicon devices.");
                     break;
+                case kallbootoptions:
+                    errx(1, "The 'all-boot-options' option is not supported on Apple Silicon devices.");
+                    break;
+                case kplan:
+                    errx(1, "The 'plan' option is not supported on Apple Silicon devices.");
+                    break;
+                case kapplyplan:
+                    errx(1, "The 'apply-plan' option is not supported on Apple Silicon devices.");
+                    break;
                 case ksave9:
                     warnx("The 'save9' option is deprecated\n");
                     break;
@@ -311,144 +489,30 @@ int main (int argc, char * argv[])
     }
     argc -= optind;
     argc += optind;
-    
-    /* There are 5 public modes of execution: info, device, folder, netboot, unbless
-     * There is 1 private mode: firmware
-     * These are all one-way function jumps.
-     */
-    if (firmwareType == kBLPreBootEnvType_iBoot) {
-        /* External TDM devices are treated as standalone devices.
-         * In order to use a TDM device as an external media to boot the current Apple silicon device use
-         * the '--use-tdm-as-external' option.
-         * For external/removable devices which are not TDM devices the following rules apply:
-         * '--folder', '--file' and '--info' are used to boot/bless and get information based on x86 architecture
-         * with the intent that this external/removable device will be used for booting an x86 Mac.
-         * All other options are used to boot/bless and get information based on arm64e architecture
-         * with the intent that this external/removable device will be used for booting this Apple Silicon Mac.
-         */
-        bool tdm = false;
-        bool external = false;
-        bool removable = false;
-        char bsdName[BSD_NAME_SIZE];
-        int ret = 0;
-
-        if (!actargs[kgetboot].present) {
-            if (actargs[kinfo].present) {
-                ret = BLGetCommonMountPoint(&context, actargs[kinfo].argument, "", actargs[kmount].argument);
-            } else if (actargs[kunbless].present) {
-                ret = BLGetCommonMountPoint(&context, actargs[kunbless].argument, "", actargs[kmount].argument);
-            } else if (actargs[kfolder].present) {
-                ret = extractMountPoint(&context, actargs);
-            }
-            if (ret) {
-                return ret;
-            }
-            if (actargs[kdevice].present) {
-                strlcpy(bsdName, actargs[kdevice].argument + strlen(_PATH_DEV), sizeof(bsdName));
-            } else if ((ret = extractDiskFromMountPoint(&context, actargs[kmount].argument, bsdName, BSD_NAME_SIZE)) != 0) {
-                blesscontextprintf(&context, kBLLogLevelError, "Could not extract BSD name from mount point %s\n", actargs[kmount].argument);
-                return ret;
-            }
-
-            ret = isMediaTDM(&context, bsdName, &tdm);
-            if (ret) {
-                return ret;
-            }
-            ret = isMediaExternal(&context, bsdName, &external);
-            if (ret) {
-                return ret;
-            }
-            ret = isMediaRemovable(&context, bsdName, &removable);
-            if (ret) {
-                return ret;
-            }
-        }
-
-        /* '--setboot' and '--nextonly' relevant only for booting current internal Apple Silicon device
-         * '--folder' is used to boot device based on Intel Atchitecture. Therefore those options
-         * are not relevant.
-         */
-        if (actargs[kfolder].present) {
-            if (actargs[ksetboot].present) {
-                errx(1, "For Apple Silicon Macs, 'setboot' option is not supported in Folder mode");
-            }
-            if (actargs[knextonly].present) {
-                errx(1, "For Apple Silicon Macs, 'nextonly' option is not supported in Folder mode");
-            }
-        }
-
-        /* Handle Info mode (--info, --getBoot):
-         * TDM is also considered an external devices
-         */
-        if (actargs[kgetboot].present ||
-            (actargs[kinfo].present && external) ||
-            (actargs[kinfo].present && removable)) {
-            /* If it was requested, print out the Finder Info words */
-            return modeInfo(&context, actargs);
-        } else if (actargs[kinfo].present) {
-            errx(1, "For Apple Silicon Macs, the 'info' option is only supported for external devices.");
-        }
-
-        /* Handle TDM devices (Device mode, Unbless mode, File/Folder mode, Mount mode,
-         * Info mode is handled above):
-         */
-        if (tdm && !actargs[kusetdmasexternal].present) {
-            if (actargs[kdevice].present) {
-                return modeDevice(&context, actargs);
-            }
-            if (actargs[kunbless].present) {
-                return modeUnbless(&context, actargs);
-            }
-            return modeFolder(&context, actargs);
-        }
-
-        /* Handle external and removable devices not in TDM (Folder mode): */
-        if (!tdm && (external || removable)) {
-            if (actargs[kfolder].present) {
-                return modeFolder(&context, actargs);
-            }
-        }
 
-        if (actargs[kunbless].present) {
-            errx(1, "For Apple Silicon Macs, the 'unbless' option is only supported for Intel architecture based devices in TDM");
-        }
-        if (actargs[kfolder].present) {
-            errx(1, "For Apple Silicon Macs, the 'folder' option is only supported for external devices");
-        }
-        if (actargs[kfile].present) {
-            errx(1, "For Apple Silicon Macs, the 'file' option is supported for external devices in Folder mode only");
-        }
-
-        /* Handle AS devices (Device mode, Mount mode,
-         * Info mode is handled above):
-         */
-        return blessViaBootability(&context, actargs);
-
-    } else {
-        /* If it was requested, print out the Finder Info words */
-        if(actargs[kinfo].present || actargs[kgetboot].present) {
-            return modeInfo(&context, actargs);
-        }
-
-        if(actargs[kdevice].present) {
-            return modeDevice(&context, actargs);
-        }
+    /* --all-boot-options only changes what --info prints */
+    if (actargs[kallbootoptions].present && !actargs[kinfo].present) {
+        warnx("Option \"all-boot-options\" requires \"info\"");
+        usage_short();
+    }
 
-        if(actargs[kfirmware].present) {
-            return modeFirmware(&context, actargs);
-        }
+    /* All NVRAM access for this invocation goes through one session */
+    if (BLNVRAMSessionCreate(&context, &kBLNVRAMBackendIOKit, NULL, &context.nvram)) {
+        errx(1, "Could not create NVRAM session");
+    }
 
-        if(actargs[knetboot].present) {
-            return modeNetboot(&context, actargs);
-        }
+    // resolving boot device strings may look up many volume UUIDs;
+    // the index is only built if one is actually needed
+    if (BLVolumeIndexCreate(&context, &context.volumeIndex)) {
+        errx(1, "Could not create volume index");
+    }
+    
+    ret = blessDispatch(&context);
 
-        if (actargs[kunbless].present) {
-            return modeUnbless(&context, actargs);
-        }
+    BLVolumeIndexRelease(&context, context.volumeIndex);
+    BLNVRAMSessionRelease(&context, context.nvram);
+    return ret;
 
-        /* default */
-        return modeFolder(&context, actargs);
-    }
 }
 
 
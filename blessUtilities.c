@@ -11,10 +11,12 @@
 #include <errno.h>
 #include <paths.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/param.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/mount.h>
+#include <sys/resource.h>
 #include <IOKit/IOKitLib.h>
 #include <IOKit/storage/IOMedia.h>
 #include <IOKit/storage/IOStorageProtocolCharacteristics.h>
@@ -38,15 +40,87 @@ enum {
 	kIsInvisible                  = 0x4000, /* Files and folders */
 };
 
-
-static int DeleteHierarchy(char *path, int pathMax);
+#define kMaxKCCopyThreads	4
+
+typedef struct {
+	char		from[MAXPATHLEN];
+	char		to[MAXPATHLEN];
+	struct stat	sb;
+} KCCopyJob;
+
+typedef struct {
+	BLContextPtr	context;
+	pthread_mutex_t	lock;
+	KCCopyJob		*jobs;
+	int				count;
+	int				next;		// next job to hand to a worker
+	int				ret;		// the first failure stops the rest
+} KCCopyQueue;
+
+#define kMaxDeleteThreads		4
+#define kMaxQueuedDeleteDirs	256
+#define kMaxOpenDeleteDirs		64		// and no more than a quarter of RLIMIT_NOFILE
+
+// A directory being emptied.  It's removed from its parent once its own
+// listing is done and every subdirectory found in it has been removed.
+typedef struct DeleteDir {
+	struct DeleteDir	*parent;
+	struct DeleteDir	*next;		// in the queue
+	int					fd;			// -1 until it is opened
+	int					pending;	// its listing, plus each subdirectory not yet removed
+	char				name[];		// within the parent
+} DeleteDir;
+
+typedef struct {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	DeleteDir		*queue;		// directories waiting for a worker
+	int				queued;
+	int				open;		// directories holding a descriptor
+	int				maxOpen;	// once open plus queued reaches this, subdirectories are emptied inline
+	int				busy;		// workers with a directory in hand
+	int				ret;		// the first failure stops the rest
+	uint64_t		files;
+	uint64_t		dirs;
+	off_t			bytes;
+} DeleteQueue;
+
+// One entry of a directory listing
+typedef struct {
+	uint32_t	name;		// offset into the listing's names
+	mode_t		type;		// S_IFMT bits
+} DirEntry;
+
+// A directory read once.  Names share one growing buffer rather than being
+// allocated one by one, and the entries are sorted by name.
+typedef struct {
+	DirEntry	*entries;
+	int			count;
+	int			capacity;
+	char		*names;		// NUL-terminated, one after another
+	size_t		namesLength;
+	size_t		namesCapacity;
+} DirListing;
+
+#define DirListingName(listing, i)	((listing)->names + (listing)->entries[i].name)
+
+
+static int DeleteHierarchy(BLContextPtr context, const char *path);
+static void *DeleteHierarchyWorker(void *arg);
+static int DeleteDirContents(DeleteQueue *queue, DeleteDir *dir);
+static int DeleteFileAt(DeleteQueue *queue, int dirfd, const char *name);
+static DeleteDir *DeleteDirCreate(DeleteDir *parent, const char *name);
+static void DeleteDirRelease(DeleteQueue *queue, DeleteDir *dir);
 static int DeleteFileWithPrejudice(const char *path, struct stat *sb);
 static int CopyKernelCollectionFiles(BLContextPtr context, const char *systemKCPath, const char *prebootKCPath);
-static int GetFilesInDirWithPrefix(const char *directory, const char *prefix, char ***outFileList, int *outNumFiles);
-static int CopyKCFile(BLContextPtr context, const char *from, const char *to);
+static int ListDirectory(int dirfd, const char *directory, const char *prefix, mode_t type, int statFlags, DirListing *listing);
+static void FreeDirListing(DirListing *listing);
+static int CompareDirEntries(void *names, const void *a, const void *b);
+static int KCFileIsCurrent(BLContextPtr context, const char *from, const struct stat *fromSB, const char *to, bool *current);
+static int ReplaceKCFiles(BLContextPtr context, KCCopyJob *jobs, int count);
+static void *ReplaceKCFileWorker(void *arg);
 static bool StringHasSuffix(const char *str, const char *suffix);
-static void FreeFileList(char **list, int num);
-static int StringCompare(const void *a, const void *b);
+static void RemoveStaleKCTempFiles(BLContextPtr context, const char *prebootKCPath);
 static int GenerateSnapshotOption(BLContextPtr context,
 								  struct clarg actargs[klast],
 								  const char *systemDev,
@@ -75,7 +149,8 @@ int BlessPrebootVolume(BLContextPtr context, const char *rootBSD, const char *bo
     char            prebootFolderPath[MAXPATHLEN];
     char            prebootKCPath[MAXPATHLEN];
     bool            mustUnmount = false;
-    uint64_t        blessIDs[2];
+    uint64_t        blessIDs[2] = { 0, 0 };
+    char            prebootCoreServicesPath[MAXPATHLEN];
     char            bootEFIloc[MAXPATHLEN];
     CFDataRef       booterData = NULL;
     struct statfs   sfs;
@@ -224,14 +299,8 @@ int BlessPrebootVolume(BLContextPtr context, const char *rootBSD, const char *bo
         *pathEnd = '\0';
     }
     
-    if (setIDs) {
-        ret = BLGetAPFSInodeNum(context, prebootFolderPath, &blessIDs[1]);
-        if (ret) {
-            blesscontextprintf(context, kBLLogLevelError, "Preboot folder path \"%s\" doesn't exist.\n", prebootFolderPath);
-            ret = 6;
-            goto exit;
-        }
-    }
+    // the IDs are taken once boot.efi is in place
+    strlcpy(prebootCoreServicesPath, prebootFolderPath, sizeof prebootCoreServicesPath);
     strlcat(prebootFolderPath, "/boot.efi", sizeof prebootFolderPath);
     if (createSnapshot || sealedSnapshot || snapshot || snapshotName) {
         ret = GenerateSnapshotOption(context,
@@ -430,16 +499,13 @@ int BlessPrebootVolume(BLContextPtr context, const char *rootBSD, const char *bo
     }
 
     if (setIDs) {
-		ret = BLGetAPFSInodeNum(context, prebootFolderPath, &blessIDs[0]);
-		if (ret) {
-			blesscontextprintf(context, kBLLogLevelError, "Preboot booter path \"%s\" doesn't exist.", prebootFolderPath);
-			ret = 6;
-			goto exit;
-		}
-        ret = BLSetAPFSBlessData(context,  prebootMountPoint, blessIDs);
+        // looked up when the data is set, which for a plan is after boot.efi has been written
+        ret = BLSetBlessIDsFromPaths(context, kBLPlanActionSetAPFSBlessData, prebootMountPoint, blessIDs, 2,
+                                     prebootFolderPath, prebootCoreServicesPath, kBLBlessIDsRequired);
         if (ret) {
-            blesscontextprintf(context, kBLLogLevelError,  "Can't set bless data for preboot volume: %s\n", strerror(errno));
-            return 2;
+            blesscontextprintf(context, kBLLogLevelError,  "Can't set bless data for preboot volume: %s\n", strerror(ret));
+            ret = 2;
+            goto exit;
         }
     }
 
@@ -774,19 +840,17 @@ int WriteLabelFile(BLContextPtr context, const char *path, CFDataRef labeldata,
 
 
 
-int DeleteFileOrDirectory(const char *path)
+int DeleteFileOrDirectory(BLContextPtr context, const char *path)
 {
 	int			ret = 0;
 	struct stat sb;
-	char		modPath[MAXPATHLEN];
 	
 	if (stat(path, &sb) < 0) {
 		ret = errno;
 		goto exit;
 	}
 	if (S_ISDIR(sb.st_mode)) {
-		strlcpy(modPath, path, sizeof modPath);
-		ret = DeleteHierarchy(modPath, sizeof modPath);
+		ret = DeleteHierarchy(context, path);
 	} else {
 		ret = DeleteFileWithPrejudice(path, &sb);
 	}
@@ -797,49 +861,241 @@ exit:
 
 
 
-static int DeleteHierarchy(char *path, int pathMax)
+// Everything below path is reached relative to its directory's descriptor,
+// so no full paths are built.  Subdirectories are handed to a few worker
+// threads as they are found; a worker with none to hand off empties them
+// itself.
+static int DeleteHierarchy(BLContextPtr context, const char *path)
 {
-	int				ret;
-	DIR				*dp = NULL;
-	struct dirent	*dirent;
-	struct stat		sb;
-	int				endIdx;
+	DeleteQueue	queue;
+	DeleteDir	*top;
+	DeleteDir	*dir;
+	pthread_t	threads[kMaxDeleteThreads];
+	struct rlimit	limit;
+	int			nthreads;
+	int			i;
 	
-	dp = opendir(path);
-	if (!dp) {
-		ret = errno;
-		goto exit;
+	top = DeleteDirCreate(NULL, "");
+	if (!top) return ENOMEM;
+	top->fd = open(path, O_RDONLY|O_DIRECTORY);
+	if (top->fd < 0) {
+		free(top);
+		return errno;
 	}
-	readdir(dp);
-	readdir(dp);
-	if (path[strlen(path)-1] != '/') strlcat(path, "/", pathMax);
-	endIdx = (int)strlen(path);
-	ret = 0;
-	while ((dirent = readdir(dp)) != NULL) {
-		if (endIdx + dirent->d_namlen >= pathMax) continue;
-		strlcpy(path + endIdx, dirent->d_name, pathMax - endIdx);
-		if (stat(path, &sb) < 0) {
+	
+	memset(&queue, 0, sizeof queue);
+	pthread_mutex_init(&queue.lock, NULL);
+	pthread_cond_init(&queue.cond, NULL);
+	queue.queue = top;
+	queue.queued = 1;
+	queue.open = 1;
+	
+	// Every directory waiting on its subdirectories keeps its descriptor.
+	// Past the cap, subdirectories are emptied inline, depth first, which
+	// closes each one before moving on to the next.
+	queue.maxOpen = kMaxOpenDeleteDirs;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+		limit.rlim_cur / 4 < (rlim_t)queue.maxOpen) {
+		queue.maxOpen = (int)(limit.rlim_cur / 4);
+	}
+	
+	for (nthreads = 0; nthreads < kMaxDeleteThreads; nthreads++) {
+		if (pthread_create(&threads[nthreads], NULL, DeleteHierarchyWorker, &queue)) break;
+	}
+	if (nthreads == 0) {
+		// no threads at all; delete inline
+		DeleteHierarchyWorker(&queue);
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	
+	// after a failure, let go of whatever was never reached
+	while ((dir = queue.queue) != NULL) {
+		queue.queue = dir->next;
+		DeleteDirRelease(&queue, dir);
+	}
+	
+	pthread_cond_destroy(&queue.cond);
+	pthread_mutex_destroy(&queue.lock);
+	
+	if (!queue.ret) rmdir(path);
+	blesscontextprintf(context, kBLLogLevelVerbose, "Deleted %s: %llu files (%lld bytes), %llu directories\n", path,
+					   (unsigned long long)queue.files, (long long)queue.bytes, (unsigned long long)queue.dirs);
+	return queue.ret;
+}
+
+
+
+static void *DeleteHierarchyWorker(void *arg)
+{
+	DeleteQueue	*queue = arg;
+	DeleteDir	*dir;
+	int			ret;
+	
+	pthread_mutex_lock(&queue->lock);
+	for (;;) {
+		// more directories may turn up while any worker is still busy
+		while (!queue->queue && queue->busy > 0 && !queue->ret) {
+			pthread_cond_wait(&queue->cond, &queue->lock);
+		}
+		if (!queue->queue || queue->ret) break;
+		
+		dir = queue->queue;
+		queue->queue = dir->next;
+		queue->queued--;
+		queue->busy++;
+		pthread_mutex_unlock(&queue->lock);
+		
+		ret = DeleteDirContents(queue, dir);
+		
+		pthread_mutex_lock(&queue->lock);
+		if (ret && !queue->ret) queue->ret = ret;
+		queue->busy--;
+		pthread_cond_broadcast(&queue->cond);
+	}
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+	
+	return NULL;
+}
+
+
+
+static int DeleteDirContents(DeleteQueue *queue, DeleteDir *dir)
+{
+	int			ret = 0;
+	DirListing	listing;
+	DeleteDir	*child;
+	int			i;
+	
+	memset(&listing, 0, sizeof listing);
+	if (dir->fd < 0) {
+		dir->fd = openat(dir->parent->fd, dir->name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW);
+		if (dir->fd < 0) {
 			ret = errno;
+			goto exit;
+		}
+		pthread_mutex_lock(&queue->lock);
+		queue->open++;
+		pthread_mutex_unlock(&queue->lock);
+	}
+	
+	// read it all before removing anything, so the removals can't disturb the listing
+	ret = ListDirectory(dir->fd, ".", "", 0, AT_SYMLINK_NOFOLLOW, &listing);
+	if (ret) goto exit;
+	
+	for (i = 0; i < listing.count; i++) {
+		if (!S_ISDIR(listing.entries[i].type)) {
+			ret = DeleteFileAt(queue, dir->fd, DirListingName(&listing, i));
+			if (ret) break;
+			continue;
+		}
+		
+		child = DeleteDirCreate(dir, DirListingName(&listing, i));
+		if (!child) {
+			ret = ENOMEM;
 			break;
 		}
-		if (S_ISDIR(sb.st_mode)) {
-			ret = DeleteHierarchy(path, pathMax);
-		} else {
-			ret = DeleteFileWithPrejudice(path, &sb);
+		pthread_mutex_lock(&queue->lock);
+		dir->pending++;
+		if (queue->queued < kMaxQueuedDeleteDirs && queue->open + queue->queued < queue->maxOpen) {
+			child->next = queue->queue;
+			queue->queue = child;
+			queue->queued++;
+			pthread_cond_signal(&queue->cond);
+			child = NULL;
+		}
+		pthread_mutex_unlock(&queue->lock);
+		
+		if (child) {
+			ret = DeleteDirContents(queue, child);
+			if (ret) break;
 		}
-		if (ret) break;
 	}
-	if (ret) goto exit;
-	path[endIdx] = '\0';
-	rmdir(path);
 	
 exit:
-	if (dp) closedir(dp);
+	FreeDirListing(&listing);
+	DeleteDirRelease(queue, dir);
 	return ret;
 }
 
 
 
+static int DeleteFileAt(DeleteQueue *queue, int dirfd, const char *name)
+{
+	struct stat	sb;
+	int			fd;
+	
+	if (fstatat(dirfd, name, &sb, AT_SYMLINK_NOFOLLOW) < 0) return errno;
+	if ((sb.st_flags & UF_IMMUTABLE) != 0) {
+		// through a descriptor, so a link swapped in can't redirect it
+		fd = openat(dirfd, name, O_RDONLY|O_NOFOLLOW|O_NONBLOCK);
+		if (fd >= 0) {
+			fchflags(fd, sb.st_flags & ~UF_IMMUTABLE);
+			close(fd);
+		}
+	}
+	if (unlinkat(dirfd, name, 0) < 0) return errno;
+	
+	pthread_mutex_lock(&queue->lock);
+	queue->files++;
+	queue->bytes += sb.st_size;
+	pthread_mutex_unlock(&queue->lock);
+	return 0;
+}
+
+
+
+static DeleteDir *DeleteDirCreate(DeleteDir *parent, const char *name)
+{
+	DeleteDir	*dir;
+	size_t		nameLength = strlen(name) + 1;
+	
+	dir = malloc(sizeof *dir + nameLength);
+	if (!dir) return NULL;
+	dir->parent = parent;
+	dir->next = NULL;
+	dir->fd = -1;
+	dir->pending = 1;
+	memcpy(dir->name, name, nameLength);
+	return dir;
+}
+
+
+
+// One piece of dir is finished.  If that was the last, remove it, which may
+// in turn finish its parent.
+static void DeleteDirRelease(DeleteQueue *queue, DeleteDir *dir)
+{
+	DeleteDir	*parent;
+	bool		done;
+	
+	while (dir) {
+		pthread_mutex_lock(&queue->lock);
+		done = (--dir->pending == 0);
+		pthread_mutex_unlock(&queue->lock);
+		if (!done) break;
+		
+		parent = dir->parent;
+		if (dir->fd >= 0) {
+			close(dir->fd);
+			pthread_mutex_lock(&queue->lock);
+			queue->open--;
+			pthread_mutex_unlock(&queue->lock);
+		}
+		if (parent && unlinkat(parent->fd, dir->name, AT_REMOVEDIR) == 0) {
+			pthread_mutex_lock(&queue->lock);
+			queue->dirs++;
+			pthread_mutex_unlock(&queue->lock);
+		}
+		free(dir);
+		dir = parent;
+	}
+}
+
+
+
 static int DeleteFileWithPrejudice(const char *path, struct stat *sb)
 {
 	if ((sb->st_flags & UF_IMMUTABLE) != 0) {
@@ -852,46 +1108,56 @@ static int DeleteFileWithPrejudice(const char *path, struct stat *sb)
 // We have two tasks: copy any appropriate files from the system location,
 // and delete any files in the target location that aren't getting copied.
 // We'll first make lists of the files in each location that meet our criteria.
-// We'll just delete all the files in the target location, then unconditionally
-// copy all the files in the system location.
+// Both lists are sorted, so one pass over them pairs up the files by name.
+// A target file with the same size and modification time as its system file
+// is left alone; if only the time differs, the contents are compared.
+// Changed files are copied to a temporary name and renamed into place, so
+// the target never holds a partial KC. Target files with no system file are
+// deleted, except for manifests.
 static int CopyKernelCollectionFiles(BLContextPtr context, const char *systemKCPath, const char *prebootKCPath)
 {
 	int		ret;
-	char	**systemList = NULL;
-	int		numSysFiles;
-	char	**prebootList = NULL;
-	int		numPrebootFiles;
-	int		i;
+	DirListing	systemFiles;
+	DirListing	prebootFiles;
+	int		sysIdx = 0;
+	int		prebootIdx = 0;
+	int		cmp;
+	bool	current;
 	char	systemFullPath[MAXPATHLEN];
 	char	*systemPathEnd;
 	char	prebootFullPath[MAXPATHLEN];
 	char	*prebootPathEnd;
+	struct stat	systemSB;
+	KCCopyJob	*jobs = NULL;
+	int		numJobs = 0;
+	int		i;
+	int		numCopied = 0, numSkipped = 0, numDeleted = 0;
+	off_t	bytesCopied = 0, bytesSkipped = 0;
+	
+	memset(&systemFiles, 0, sizeof systemFiles);
+	memset(&prebootFiles, 0, sizeof prebootFiles);
 	
     // First get a list of the relevant files in each location
-	ret = GetFilesInDirWithPrefix(systemKCPath, kBL_NAME_BOOTKERNELEXTENSIONS, &systemList, &numSysFiles);
+	ret = ListDirectory(AT_FDCWD, systemKCPath, kBL_NAME_BOOTKERNELEXTENSIONS, S_IFREG, 0, &systemFiles);
 	if (ret && ret != ENOENT) {
 		blesscontextprintf(context, kBLLogLevelError, "Couldn't get system kernel collection files - %s\n", strerror(ret));
 		goto exit;
 	}
 	if (ret) {
-		// No kernel collection directory in system.  Just fake up an empty list of files.
+		// No kernel collection directory in system.  Just use an empty list of files.
 		blesscontextprintf(context, kBLLogLevelVerbose, "No KernelCollections directory in system volume\n");
-		systemList = malloc(sizeof(char *));
-		numSysFiles = 0;
 		ret = 0;
 	}
 	
-	ret = GetFilesInDirWithPrefix(prebootKCPath, kBL_NAME_BOOTKERNELEXTENSIONS, &prebootList, &numPrebootFiles);
+	ret = ListDirectory(AT_FDCWD, prebootKCPath, kBL_NAME_BOOTKERNELEXTENSIONS, S_IFREG, 0, &prebootFiles);
 	if (ret && ret != ENOENT) {
 		blesscontextprintf(context, kBLLogLevelError, "Couldn't get preboot kernel collection files - %s\n", strerror(ret));
 		goto exit;
 	}
 	if (ret) {
-		// No kernel collection directory in preboot.  Create one if necessary, and fake up an emptry list of files.
+		// No kernel collection directory in preboot.  Create one if necessary, and use an empty list of files.
 		blesscontextprintf(context, kBLLogLevelVerbose, "No KernelCollections directory in preboot volume\n");
-		prebootList = malloc(sizeof(char *));
-		numPrebootFiles = 0;
-		if (numSysFiles > 0) {
+		if (systemFiles.count > 0 && !BLPlanIsRecording(context)) {
 			ret = mkpath_np(prebootKCPath, 0755);
 			if (ret) {
 				blesscontextprintf(context, kBLLogLevelError, "Couldn't create kernel collections directory (%s) in preboot - %s\n",
@@ -900,213 +1166,387 @@ static int CopyKernelCollectionFiles(BLContextPtr context, const char *systemKCP
 			}
 		}
 		ret = 0;
-	} else {
-		// We don't want to delete any manifests!  Let's remove them from this list.
-		for (i = 0; i < numPrebootFiles; i++) {
-			if (StringHasSuffix(prebootList[i], ".im4m")) {
-				free(prebootList[i]);
-				memmove(prebootList + i, prebootList + i + 1, (numPrebootFiles - i - 1) * sizeof *prebootList);
-				numPrebootFiles--;
-				i--;
-			}
-		}
+	} else if (!BLPlanIsRecording(context)) {
+		RemoveStaleKCTempFiles(context, prebootKCPath);
 	}
 	
-	// Delete all the files in the target location
+	strlcpy(systemFullPath, systemKCPath, sizeof systemFullPath);
+	strlcat(systemFullPath, "/", sizeof systemFullPath);
+	systemPathEnd = systemFullPath + strlen(systemFullPath);
 	strlcpy(prebootFullPath, prebootKCPath, sizeof prebootFullPath);
 	strlcat(prebootFullPath, "/", sizeof prebootFullPath);
 	prebootPathEnd = prebootFullPath + strlen(prebootFullPath);
-	for (i = 0; i < numPrebootFiles; i++) {
-		strlcpy(prebootPathEnd, prebootList[i], prebootFullPath + sizeof prebootFullPath - prebootPathEnd);
-		if (unlink(prebootFullPath) < 0) {
+	
+	while (sysIdx < systemFiles.count || prebootIdx < prebootFiles.count) {
+		if (sysIdx == systemFiles.count) {
+			cmp = 1;
+		} else if (prebootIdx == prebootFiles.count) {
+			cmp = -1;
+		} else {
+			cmp = strcmp(DirListingName(&systemFiles, sysIdx), DirListingName(&prebootFiles, prebootIdx));
+		}
+		
+		if (cmp > 0) {
+			// Only in the target location.  We don't want to delete any manifests!
+			strlcpy(prebootPathEnd, DirListingName(&prebootFiles, prebootIdx++), prebootFullPath + sizeof prebootFullPath - prebootPathEnd);
+			if (StringHasSuffix(prebootFullPath, ".im4m")) continue;
+			if (BLPlanIsRecording(context)) {
+				ret = BLPlanRecordDeleteFile(context, prebootFullPath);
+				if (ret) goto exit;
+				numDeleted++;
+				continue;
+			}
+			if (unlink(prebootFullPath) < 0) {
+				ret = errno;
+				blesscontextprintf(context, kBLLogLevelError, "Couldn't delete file %s - %s\n", prebootFullPath, strerror(ret));
+				goto exit;
+			}
+			blesscontextprintf(context, kBLLogLevelVerbose, "Deleted KC file %s\n", prebootFullPath);
+			numDeleted++;
+			continue;
+		}
+		
+		strlcpy(systemPathEnd, DirListingName(&systemFiles, sysIdx++), systemFullPath + sizeof systemFullPath - systemPathEnd);
+		strlcpy(prebootPathEnd, systemPathEnd, prebootFullPath + sizeof prebootFullPath - prebootPathEnd);
+		if (stat(systemFullPath, &systemSB) < 0) {
 			ret = errno;
-			blesscontextprintf(context, kBLLogLevelError, "Couldn't delete file %s - %s\n", prebootFullPath, strerror(ret));
+			blesscontextprintf(context, kBLLogLevelError, "Couldn't stat KC file %s - %s\n", systemFullPath, strerror(ret));
 			goto exit;
 		}
-		blesscontextprintf(context, kBLLogLevelVerbose, "Deleted KC file %s\n", prebootFullPath);
+		current = false;
+		if (cmp == 0) {
+			prebootIdx++;
+			ret = KCFileIsCurrent(context, systemFullPath, &systemSB, prebootFullPath, &current);
+			if (ret) goto exit;
+		}
+		if (current) {
+			blesscontextprintf(context, kBLLogLevelVerbose, "KC file %s is up to date in preboot\n", systemFullPath);
+			numSkipped++;
+			bytesSkipped += systemSB.st_size;
+			continue;
+		}
+		if (BLPlanIsRecording(context)) {
+			// the copy creates the directory if it has to
+			ret = BLPlanRecordCopyFile(context, systemFullPath, prebootFullPath);
+			if (ret) goto exit;
+			numCopied++;
+			bytesCopied += systemSB.st_size;
+			continue;
+		}
+		if ((numJobs & 7) == 0) {
+			KCCopyJob *newJobs = realloc(jobs, (numJobs + 8) * sizeof *jobs);
+			if (!newJobs) {
+				ret = ENOMEM;
+				goto exit;
+			}
+			jobs = newJobs;
+		}
+		strlcpy(jobs[numJobs].from, systemFullPath, sizeof jobs[numJobs].from);
+		strlcpy(jobs[numJobs].to, prebootFullPath, sizeof jobs[numJobs].to);
+		jobs[numJobs].sb = systemSB;
+		numJobs++;
 	}
 	
-	// Copy all the files in the source location
-	strlcpy(systemFullPath, systemKCPath, sizeof systemFullPath);
-	strlcat(systemFullPath, "/", sizeof systemFullPath);
-	systemPathEnd = systemFullPath + strlen(systemFullPath);
-	for (i = 0; i < numSysFiles; i++) {
-		strlcpy(systemPathEnd, systemList[i], systemFullPath + sizeof systemFullPath - systemPathEnd);
-		strlcpy(prebootPathEnd, systemList[i], prebootFullPath + sizeof prebootFullPath - prebootPathEnd);
-		ret = CopyKCFile(context, systemFullPath, prebootFullPath);
-		if (ret) {
-			blesscontextprintf(context, kBLLogLevelError, "Error %d copying KC file %s\n", ret, systemFullPath);
-			goto exit;
-		}
-		blesscontextprintf(context, kBLLogLevelVerbose, "Copied KC file %s to preboot\n", systemFullPath);
+	// The changed files are copied together once the listings have been walked
+	ret = ReplaceKCFiles(context, jobs, numJobs);
+	if (ret) goto exit;
+	for (i = 0; i < numJobs; i++) {
+		numCopied++;
+		bytesCopied += jobs[i].sb.st_size;
 	}
-
+	
+	blesscontextprintf(context, kBLLogLevelVerbose, "KC files: %d copied (%lld bytes), %d unchanged (%lld bytes skipped), %d deleted\n",
+					   numCopied, (long long)bytesCopied, numSkipped, (long long)bytesSkipped, numDeleted);
 	
 exit:
-	if (systemList) FreeFileList(systemList, numSysFiles);
-	if (prebootList) FreeFileList(prebootList, numPrebootFiles);
+	FreeDirListing(&systemFiles);
+	FreeDirListing(&prebootFiles);
+	if (jobs) free(jobs);
 	return ret;
 }
 
 
 
-static int GetFilesInDirWithPrefix(const char *directory, const char *prefix, char ***outFileList, int *outNumFiles)
+// Whether the target already holds what the system file does.  If only the
+// modification time differs and the contents match, the time is brought across
+// so the next run needn't read either file.
+static int KCFileIsCurrent(BLContextPtr context, const char *from, const struct stat *fromSB, const char *to, bool *current)
 {
 	int				ret = 0;
-	DIR				*dp = NULL;
-	struct dirent	*dirent;
-	struct stat		sb;
-	char			path[MAXPATHLEN];
-	int				endIdx;
-	int				prefixLen = (int)strlen(prefix);
-	char			**list = NULL;
-	int				numFiles = 0;
-	int				listSize = 10;
-
-	list = malloc(listSize * sizeof(char *));
-	if (!list) {
+	struct stat		toSB;
+	char			*buffers = NULL;
+	int				fdFrom = -1;
+	int				fdTo = -1;
+	off_t			remaining;
+	ssize_t			bytes;
+	struct timespec	times[2];
+	
+	*current = false;
+	if (lstat(to, &toSB) < 0) {
+		return errno == ENOENT ? 0 : errno;
+	}
+	if (!S_ISREG(toSB.st_mode) || toSB.st_size != fromSB->st_size) return 0;
+	if (toSB.st_mtimespec.tv_sec == fromSB->st_mtimespec.tv_sec &&
+		toSB.st_mtimespec.tv_nsec == fromSB->st_mtimespec.tv_nsec) {
+		*current = true;
+		return 0;
+	}
+	
+	buffers = malloc(2 * 0x100000);	// 1 MiB each
+	if (!buffers) {
 		ret = errno;
 		goto exit;
 	}
-	dp = opendir(directory);
-	if (!dp) {
-		ret = errno;
+	fdFrom = open(from, O_RDONLY);
+	fdTo = open(to, O_RDONLY);
+	if (fdFrom < 0 || fdTo < 0) {
+		// we'll just copy it
 		goto exit;
 	}
-	readdir(dp); readdir(dp);
-	strlcpy(path, directory, sizeof path);
-	if (path[strlen(path)-1] != '/') strlcat(path, "/", sizeof path);
-	endIdx = (int)strlen(path);
-	while ((dirent = readdir(dp)) != NULL) {
-		if (strncmp(dirent->d_name, prefix, prefixLen) != 0) continue;
-		if (endIdx + dirent->d_namlen >= sizeof path) continue;
-		strlcpy(path + endIdx, dirent->d_name, sizeof path - endIdx);
-		if (stat(path, &sb) < 0) {
-			ret = errno;
-			goto exit;
-		}
-		if (!S_ISREG(sb.st_mode)) continue;
-		if (numFiles == listSize) {
-			listSize *= 2;
-			list = realloc(list, listSize * sizeof(char *));
-			if (!list) {
-				ret = errno;
-				goto exit;
-			}
+	for (remaining = fromSB->st_size; remaining > 0; remaining -= bytes) {
+		bytes = (ssize_t)MIN(remaining, 0x100000);
+		if (read(fdFrom, buffers, bytes) != bytes || read(fdTo, buffers + 0x100000, bytes) != bytes) goto exit;
+		if (memcmp(buffers, buffers + 0x100000, bytes) != 0) goto exit;
+	}
+	*current = true;
+	
+	if (!BLPlanIsRecording(context)) {
+		times[0] = fromSB->st_atimespec;
+		times[1] = fromSB->st_mtimespec;
+		if (utimensat(AT_FDCWD, to, times, AT_SYMLINK_NOFOLLOW) < 0) {
+			blesscontextprintf(context, kBLLogLevelVerbose, "Couldn't set time for %s: %s\n", to, strerror(errno));
 		}
-		list[numFiles++] = strdup(dirent->d_name);
 	}
-	qsort(list, numFiles, sizeof list[0], StringCompare);
-	*outFileList = list;
-	*outNumFiles = numFiles;
 	
 exit:
-	if (dp) closedir(dp);
-	if (ret && list) {
-		FreeFileList(list, numFiles);
-	}
+	if (buffers) free(buffers);
+	if (fdFrom >= 0) close(fdFrom);
+	if (fdTo >= 0) close(fdTo);
 	return ret;
 }
 
 
 
-static void FreeFileList(char **list, int num)
+// Copy the jobs on a few threads at once; each thread keeps one pair of
+// buffers for all the files it copies.
+static int ReplaceKCFiles(BLContextPtr context, KCCopyJob *jobs, int count)
 {
-	int i;
+	KCCopyQueue	queue;
+	pthread_t	threads[kMaxKCCopyThreads];
+	int			nthreads;
+	int			i;
+	
+	if (count == 0) return 0;
+	
+	queue.context = context;
+	queue.jobs = jobs;
+	queue.count = count;
+	queue.next = 0;
+	queue.ret = 0;
+	pthread_mutex_init(&queue.lock, NULL);
 	
-	for (i = 0; i < num; i++) {
-		free(list[i]);
+	nthreads = MIN(count, kMaxKCCopyThreads);
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, ReplaceKCFileWorker, &queue)) {
+			blesscontextprintf(context, kBLLogLevelVerbose, "Couldn't start KC copy thread\n");
+			break;
+		}
+	}
+	if (i == 0) {
+		// no threads at all; copy inline
+		ReplaceKCFileWorker(&queue);
+	}
+	nthreads = i;
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
 	}
-	free(list);
+	
+	pthread_mutex_destroy(&queue.lock);
+	if (queue.ret) return queue.ret;
+	
+	// The renames aren't durable until the directory is.  Every job
+	// targets the same directory.
+	return BLSyncParentDirectory(context, jobs[0].to);
 }
 
 
 
-static int StringCompare(const void *a, const void *b)
+static void *ReplaceKCFileWorker(void *arg)
 {
-	const char * const *s1 = a;
-	const char * const *s2 = b;
+	KCCopyQueue	*queue = arg;
+	char		*buffers[2] = { NULL, NULL };
+	KCCopyJob	*job;
+	bool		cloned;
+	int			ret;
 	
-	return strcmp(*s1, *s2);
+	// page aligned, so the copy can go straight to and from the page cache
+	if (posix_memalign((void **)&buffers[0], getpagesize(), kBLReplaceFileBufferSize) ||
+		posix_memalign((void **)&buffers[1], getpagesize(), kBLReplaceFileBufferSize)) {
+		pthread_mutex_lock(&queue->lock);
+		if (!queue->ret) queue->ret = ENOMEM;
+		pthread_mutex_unlock(&queue->lock);
+		goto exit;
+	}
+	
+	for (;;) {
+		pthread_mutex_lock(&queue->lock);
+		job = (queue->ret || queue->next == queue->count) ? NULL : &queue->jobs[queue->next++];
+		pthread_mutex_unlock(&queue->lock);
+		if (!job) break;
+		
+		ret = BLReplaceFileWithCopy(queue->context, job->from, job->to, buffers, &cloned);
+		if (ret) {
+			blesscontextprintf(queue->context, kBLLogLevelError, "Error %d copying KC file %s\n", ret, job->from);
+			pthread_mutex_lock(&queue->lock);
+			if (!queue->ret) queue->ret = ret;
+			pthread_mutex_unlock(&queue->lock);
+			break;
+		}
+	}
+	
+exit:
+	free(buffers[0]);
+	free(buffers[1]);
+	return NULL;
 }
 
 
 
-static int CopyKCFile(BLContextPtr context, const char *from, const char *to)
+// An interrupted run can leave temporary copies behind.  Their names start
+// with a dot, so the listings above never see them; remove them before
+// copying anything new.
+static void RemoveStaleKCTempFiles(BLContextPtr context, const char *prebootKCPath)
 {
-	int			ret = 0;
-	char		*buffer = NULL;
-	int			fdFrom = -1;
-	int			fdTo = -1;
-	off_t		fileSize;
-	int			bytes;
-	fstore_t	preall;
+	DirListing	stale;
+	char		path[MAXPATHLEN];
+	int			i;
 	
-	buffer = malloc(0x100000);	// 1 MiB
-	if (!buffer) {
-		ret = errno;
-		blesscontextprintf(context, kBLLogLevelError, "%s\n", strerror(ret));
-		goto exit;
-	}
-	fdFrom = open(from, O_RDONLY);
-	if (fdFrom < 0) {
-		ret = errno;
-		blesscontextprintf(context, kBLLogLevelError, "Couldn't open KC file %s: %s\n", from, strerror(ret));
-		goto exit;
-	}
-	fileSize = lseek(fdFrom, 0, SEEK_END);
-	if (fileSize < 0) {
-		ret = errno;
-		blesscontextprintf(context, kBLLogLevelError, "Couldn't get size of file %s: %s\n", from, strerror(ret));
-		goto exit;
+	if (ListDirectory(AT_FDCWD, prebootKCPath, "." kBL_NAME_BOOTKERNELEXTENSIONS, S_IFREG, 0, &stale)) return;
+	for (i = 0; i < stale.count; i++) {
+		if (!StringHasSuffix(DirListingName(&stale, i), kBLReplaceFileTempSuffix)) continue;
+		snprintf(path, sizeof path, "%s/%s", prebootKCPath, DirListingName(&stale, i));
+		if (unlink(path) < 0) {
+			blesscontextprintf(context, kBLLogLevelVerbose, "Couldn't remove stale file %s: %s\n", path, strerror(errno));
+		} else {
+			blesscontextprintf(context, kBLLogLevelVerbose, "Removed stale file %s\n", path);
+		}
 	}
-	fdTo = open(to, O_WRONLY|O_CREAT|O_TRUNC, 0644);
-	if (fdTo < 0) {
+	FreeDirListing(&stale);
+}
+
+
+
+// List the entries of directory (relative to dirfd) whose names start with
+// prefix, keeping only those of the given type unless it is 0.  d_type gives
+// the type where the filesystem fills it in; otherwise, or to see through a
+// symbolic link when statFlags allows, the entry is looked up with fstatat.
+static int ListDirectory(int dirfd, const char *directory, const char *prefix, mode_t type, int statFlags, DirListing *listing)
+{
+	int				ret = 0;
+	int				fd;
+	DIR				*dp = NULL;
+	struct dirent	*dirent;
+	struct stat		sb;
+	size_t			prefixLen = strlen(prefix);
+	size_t			nameLen;
+	mode_t			entryType;
+	
+	memset(listing, 0, sizeof *listing);
+	fd = openat(dirfd, directory, O_RDONLY|O_DIRECTORY);
+	if (fd < 0 || !(dp = fdopendir(fd))) {
 		ret = errno;
-		blesscontextprintf(context, kBLLogLevelError, "Couldn't create KC file %s: %s\n", to, strerror(ret));
+		if (fd >= 0) close(fd);
 		goto exit;
 	}
-	preall.fst_length = fileSize;
-	preall.fst_offset = 0;
-	preall.fst_flags = F_ALLOCATECONTIG;
-	preall.fst_posmode = F_PEOFPOSMODE;
-	if (fcntl(fdTo, F_PREALLOCATE, &preall) < 0) {
-		if (errno == ENOTSUP) {
-			blesscontextprintf(context, kBLLogLevelVerbose, "Preallocation not supported on this filesystem for %s\n", to);
-		} else {
-			ret = errno;
-			blesscontextprintf(context, kBLLogLevelError, "Preallocation of %s failed: %s\n", to, strerror(ret));
-			goto exit;
+	
+	while ((dirent = readdir(dp)) != NULL) {
+		if (!strcmp(dirent->d_name, ".") || !strcmp(dirent->d_name, "..")) continue;
+		if (strncmp(dirent->d_name, prefix, prefixLen) != 0) continue;
+		
+		switch (dirent->d_type) {
+			case DT_REG:	entryType = S_IFREG; break;
+			case DT_DIR:	entryType = S_IFDIR; break;
+			case DT_LNK:	entryType = (statFlags & AT_SYMLINK_NOFOLLOW) ? S_IFLNK : 0; break;
+			case DT_FIFO:	entryType = S_IFIFO; break;
+			case DT_CHR:	entryType = S_IFCHR; break;
+			case DT_BLK:	entryType = S_IFBLK; break;
+			case DT_SOCK:	entryType = S_IFSOCK; break;
+			default:		entryType = 0; break;
 		}
-	} else {
-		blesscontextprintf(context, kBLLogLevelVerbose, "0x%08X bytes preallocated for %s\n",
-						   (unsigned int)preall.fst_bytesalloc, to);
-	}
-	lseek(fdFrom, 0, SEEK_SET);
-	while (fileSize > 0) {
-		bytes = (int)MIN(fileSize, 0x100000);
-		if ((bytes = (int)read(fdFrom, buffer, bytes)) < 0) {
-			ret = errno;
-			blesscontextprintf(context, kBLLogLevelError, "Error reading from %s: %s\n", from, strerror(ret));
-			goto exit;
+		if (entryType == 0) {
+			if (fstatat(fd, dirent->d_name, &sb, statFlags) < 0) {
+				// gone since readdir, or a dangling link; either way it isn't
+				// there, and ENOENT would look like the directory is missing
+				if (errno == ENOENT) continue;
+				ret = errno;
+				goto exit;
+			}
+			entryType = sb.st_mode & S_IFMT;
 		}
-		if (write(fdTo, buffer, bytes) < 0) {
-			ret = errno;
-			blesscontextprintf(context, kBLLogLevelError, "Error writing to %s: %s\n", to, strerror(ret));
-			goto exit;
+		if (type && entryType != type) continue;
+		
+		nameLen = strlen(dirent->d_name) + 1;
+		if (listing->count == listing->capacity) {
+			int			newCapacity = listing->capacity ? listing->capacity * 2 : 64;
+			DirEntry	*entries = realloc(listing->entries, newCapacity * sizeof *entries);
+			
+			if (!entries) {
+				ret = ENOMEM;
+				goto exit;
+			}
+			listing->entries = entries;
+			listing->capacity = newCapacity;
 		}
-		fileSize -= bytes;
+		if (listing->namesLength + nameLen > listing->namesCapacity) {
+			size_t	newCapacity = listing->namesCapacity ? listing->namesCapacity * 2 : 4096;
+			char	*names;
+			
+			while (listing->namesLength + nameLen > newCapacity) newCapacity *= 2;
+			names = realloc(listing->names, newCapacity);
+			if (!names) {
+				ret = ENOMEM;
+				goto exit;
+			}
+			listing->names = names;
+			listing->namesCapacity = newCapacity;
+		}
+		listing->entries[listing->count].name = (uint32_t)listing->namesLength;
+		listing->entries[listing->count].type = entryType;
+		listing->count++;
+		memcpy(listing->names + listing->namesLength, dirent->d_name, nameLen);
+		listing->namesLength += nameLen;
 	}
 	
+	// names in a directory are unique, so this order doesn't depend on readdir's
+	if (listing->count > 1) qsort_r(listing->entries, listing->count, sizeof listing->entries[0], listing->names, CompareDirEntries);
+	
 exit:
-	if (buffer) free(buffer);
-	if (fdFrom >= 0) close(fdFrom);
-	if (fdTo >= 0) close(fdTo);
+	if (dp) closedir(dp);
+	if (ret) FreeDirListing(listing);
 	return ret;
 }
 
 
 
+static void FreeDirListing(DirListing *listing)
+{
+	free(listing->entries);
+	free(listing->names);
+	memset(listing, 0, sizeof *listing);
+}
+
+
+
+static int CompareDirEntries(void *names, const void *a, const void *b)
+{
+	const DirEntry	*e1 = a;
+	const DirEntry	*e2 = b;
+	
+	return strcmp((const char *)names + e1->name, (const char *)names + e2->name);
+}
+
+
+
 static bool StringHasSuffix(const char *str, const char *suffix)
 {
 	const char *cmp;
@@ -88,6 +88,10 @@ enum {
     ksnapshot,
     ksnapshotname,		/* 50 */
     knoapfsdriver,
+    kallbootoptions,
+    kplan,
+    kapplyplan,
+    kscanimages,
     klast
 };
 
@@ -87,6 +87,37 @@ int modeDevice(BLContextPtr context, struct clarg actargs[klast]) {
 		}
 	}
     
+    /* lay down an XCOFF loader as the HFS+ startup file */
+    if(actargs[kstartupfile].present) {
+        CFDataRef startupdata = NULL;
+
+        ret = BLLoadFile(context, actargs[kstartupfile].argument, 0, &startupdata);
+        if(ret) {
+            blesscontextprintf(context, kBLLogLevelError, "Can't load startup file '%s'\n",
+                               actargs[kstartupfile].argument);
+            if (labeldata) CFRelease(labeldata);
+            if (labeldata2) CFRelease(labeldata2);
+            return 2;
+        }
+
+        ret = BLWriteStartupFile(context, actargs[kdevice].argument, startupdata);
+        CFRelease(startupdata);
+        if(ret) {
+            blesscontextprintf(context, kBLLogLevelError, "Can't write startup file to %s\n",
+                               actargs[kdevice].argument);
+            if (labeldata) CFRelease(labeldata);
+            if (labeldata2) CFRelease(labeldata2);
+            return 6;
+        }
+
+        /* an image file has nothing in the I/O Registry or firmware to update */
+        if(strncmp(actargs[kdevice].argument, _PATH_DEV, strlen(_PATH_DEV)) != 0) {
+            if (labeldata) CFRelease(labeldata);
+            if (labeldata2) CFRelease(labeldata2);
+            return 0;
+        }
+    }
+
     devMediaObj = IOServiceGetMatchingService(kIOMasterPortDefault, IOBSDNameMatching(kIOMasterPortDefault, 0,
                                                                                       actargs[kdevice].argument + strlen(_PATH_DEV)));
     if (!devMediaObj) {
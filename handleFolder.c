@@ -93,7 +93,6 @@ int modeFolder(BLContextPtr context, struct clarg actargs[klast]) {
     int isHFS, isAPFS, shouldBless;
     bool isAPFSDataRolePreSSVToSSVThusDontWriteToVol;
 	
-    uint32_t folderXid = 0;                   // The directory ID specified by folderXpath
     
 	CFDataRef bootEFIdata = NULL;
 	CFDataRef labeldata = NULL;
@@ -329,7 +328,10 @@ int modeFolder(BLContextPtr context, struct clarg actargs[klast]) {
     if (shouldBless || (isAPFS && !isAPFSDataRolePreSSVToSSVThusDontWriteToVol)) {
         if (isHFS) {
             uint32_t oldwords[8];
+            uint64_t words[6];
             uint32_t bootfile = 0;
+            const char *bootfilePath = NULL;
+            int i, flags = kBLBlessIDsFolderInWord0;
             
             ret = BLGetVolumeFinderInfo(context, actargs[kmount].argument, oldwords);
             if(ret) {
@@ -342,35 +344,13 @@ int modeFolder(BLContextPtr context, struct clarg actargs[klast]) {
             
             /* bless! bless */
             
-            /* First get any directory IDs we need */
-            if(actargs[kfolder].present) {
-                ret = BLGetFileID(context, actargs[kfolder].argument, &folderXid);
-                if(ret) {
-                    blesscontextprintf(context, kBLLogLevelError,  "Error while getting directory ID of %s\n", actargs[kfolder].argument );
-                } else {
-                    blesscontextprintf(context, kBLLogLevelVerbose,  "Got directory ID of %u for %s\n",
-                                       folderXid, actargs[kfolder].argument );
-                }
-            }
-            
+            /*
+             * The directory and file IDs are looked up when the words are
+             * set, which for --plan is when the plan is applied: the files
+             * may not have been written yet, or may be replaced by then.
+             */
             if(actargs[kfile].present) {
-                ret = BLGetFileID(context, actargs[kfile].argument, &bootfile);
-                if(ret) {
-                    blesscontextprintf(context, kBLLogLevelError,  "Error while getting file ID of %s. Ignoring...\n", actargs[kfile].argument );
-                    bootfile = 0;
-                } else {
-                    struct stat checkForFile;
-                    
-                    ret = lstat(actargs[kfile].argument, &checkForFile);
-                    if(ret || !S_ISREG(checkForFile.st_mode)) {
-                        blesscontextprintf(context, kBLLogLevelError,  "%s cannot be accessed, or is not a regular file. Ignoring...\n", actargs[kfile].argument );
-                        bootfile = 0;
-                    } else {
-                        blesscontextprintf(context, kBLLogLevelVerbose,  "Got file ID of %u for %s\n",
-                                           bootfile, actargs[kfile].argument );
-                    }
-                }
-                
+                bootfilePath = actargs[kfile].argument;
             } else {
                 // no file given. we should try to verify the existing booter
                 if(bootfile) {
@@ -378,30 +358,20 @@ int modeFolder(BLContextPtr context, struct clarg actargs[klast]) {
                     if(ret) {
                         blesscontextprintf(context, kBLLogLevelVerbose,  "Invalid EFI blessed file ID %u. Zeroing...\n",
                                            bootfile );
-                        bootfile = 0;
                     } else {
-                        struct stat checkForFile;
-                        
-                        ret = lstat(actargs[kfile].argument, &checkForFile);
-                        if(ret || !S_ISREG(checkForFile.st_mode)) {
-                            blesscontextprintf(context, kBLLogLevelError,  "%s cannot be accessed, or is not a regular file. Ignoring...\n", actargs[kfile].argument );
-                            bootfile = 0;
-                        } else {
-                            blesscontextprintf(context, kBLLogLevelVerbose,
-                                               "Preserving EFI blessed file ID %u for %s\n",
-                                               bootfile, actargs[kfile].argument );
-                        }
+                        blesscontextprintf(context, kBLLogLevelVerbose,
+                                           "Preserving EFI blessed file %s\n", actargs[kfile].argument );
+                        bootfilePath = actargs[kfile].argument;
                     }
                 }
             }
             
-            /* If either directory was not specified, the dirID
-             * variables will be 0, so we can use that to initialize
-             * the FI fields */
+            /* If either path was not given, or can't be blessed, the
+             * corresponding words will be 0 */
             
             /* Set Finder info words 1 & 5*/
-            oldwords[1] = bootfile;
-            oldwords[5] = folderXid;
+            oldwords[1] = 0;
+            oldwords[5] = 0;
             
             // reserved1 returns the f_fssubtype attribute. Right now, 0 == HFS+,
             // 1 == HFS+J. Anything else is either HFS plain, or some form
@@ -422,23 +392,18 @@ int modeFolder(BLContextPtr context, struct clarg actargs[klast]) {
                ) {
                 blesscontextprintf(context, kBLLogLevelVerbose,  "%s is not HFS+ or Journaled HFS+. Not setting finderinfo[0]...\n", actargs[kmount].argument );
                 oldwords[0] = 0;
-            } else {
-                if(folderXid) {
-                    oldwords[0] = folderXid;
-                }
+                flags &= ~kBLBlessIDsFolderInWord0;
             }
             
-            blesscontextprintf(context, kBLLogLevelVerbose,  "finderinfo[0] = %d\n", oldwords[0] );
-            blesscontextprintf(context, kBLLogLevelVerbose,  "finderinfo[1] = %d\n", oldwords[1] );
-            blesscontextprintf(context, kBLLogLevelVerbose,  "finderinfo[5] = %d\n", oldwords[5] );
-            
-            
             if(geteuid() != 0 && geteuid() != sb.f_owner) {
                 blesscontextprintf(context, kBLLogLevelError,  "Authorization required\n" );
                 return 1;
             }
             
-            ret = BLSetVolumeFinderInfo(context,  actargs[kmount].argument, oldwords);
+            for(i = 0; i < 6; i++) words[i] = oldwords[i];
+            ret = BLSetBlessIDsFromPaths(context, kBLPlanActionSetVolumeFinderInfo, actargs[kmount].argument,
+                                         words, 6, bootfilePath,
+                                         actargs[kfolder].present ? actargs[kfolder].argument : NULL, flags);
             if(ret) {
                 blesscontextprintf(context, kBLLogLevelError,  "Can't set Finder info fields for volume mounted at %s: %s\n", actargs[kmount].argument , strerror(errno));
                 return 2;
@@ -446,8 +411,7 @@ int modeFolder(BLContextPtr context, struct clarg actargs[klast]) {
             
         } else if (isAPFS) {
             uint64_t oldWords[2] = { 0, 0 };
-            uint64_t folderInum = 0;
-            uint64_t fileInum = 0;
+            const char *bootfilePath = NULL;
             char     *bootEFISource;
             
             if (shouldBless) {
@@ -462,35 +426,9 @@ int modeFolder(BLContextPtr context, struct clarg actargs[klast]) {
                     
                     /* bless! bless */
                     
-                    /* First get any directory IDs we need */
-                    if (actargs[kfolder].present) {
-                        ret = BLGetAPFSInodeNum(context, actargs[kfolder].argument, &folderInum);
-                        if (ret) {
-                            blesscontextprintf(context, kBLLogLevelError,  "Error while getting inum of %s\n", actargs[kfolder].argument);
-                        } else {
-                            blesscontextprintf(context, kBLLogLevelVerbose,  "Got inum of %llu for %s\n",
-                                               folderInum, actargs[kfolder].argument );
-                        }
-                    }
-                    
+                    /* The inode numbers are looked up when the data is set */
                     if (actargs[kfile].present) {
-                        ret = BLGetAPFSInodeNum(context, actargs[kfile].argument, &fileInum);
-                        if (ret) {
-                            blesscontextprintf(context, kBLLogLevelError,  "Error while getting inum of %s. Ignoring...\n", actargs[kfile].argument );
-                            fileInum = 0;
-                        } else {
-                            struct stat checkForFile;
-                            
-                            ret = lstat(actargs[kfile].argument, &checkForFile);
-                            if (ret || !S_ISREG(checkForFile.st_mode)) {
-                                blesscontextprintf(context, kBLLogLevelError,  "%s cannot be accessed, or is not a regular file. Ignoring...\n", actargs[kfile].argument );
-                                fileInum = 0;
-                            } else {
-                                blesscontextprintf(context, kBLLogLevelVerbose,  "Got inum of %llu for %s\n",
-                                                   fileInum, actargs[kfile].argument);
-                            }
-                        }
-                        
+                        bootfilePath = actargs[kfile].argument;
                     } else {
                         // no file given. we should try to verify the existing booter
                         if (oldWords[0]) {
@@ -498,37 +436,27 @@ int modeFolder(BLContextPtr context, struct clarg actargs[klast]) {
                             if (ret) {
                                 blesscontextprintf(context, kBLLogLevelVerbose,  "Invalid EFI blessed file ID %llu. Zeroing...\n",
                                                    oldWords[0] );
-                                oldWords[0] = 0;
                             } else {
-                                struct stat checkForFile;
-                                
-                                ret = lstat(actargs[kfile].argument, &checkForFile);
-                                if(ret || !S_ISREG(checkForFile.st_mode)) {
-                                    blesscontextprintf(context, kBLLogLevelError,  "%s cannot be accessed, or is not a regular file. Ignoring...\n", actargs[kfile].argument );
-                                    oldWords[0] = 0;
-                                } else {
-                                    blesscontextprintf(context, kBLLogLevelVerbose,
-                                                       "Preserving EFI blessed file ID %llu for %s\n",
-                                                       oldWords[0], actargs[kfile].argument );
-									fileInum = oldWords[0];
-                                }
+                                blesscontextprintf(context, kBLLogLevelVerbose,
+                                                   "Preserving EFI blessed file ID %llu for %s\n",
+                                                   oldWords[0], actargs[kfile].argument );
+                                bootfilePath = actargs[kfile].argument;
                             }
                         }
                         
                     }
                     
-                    oldWords[0] = fileInum;
-                    oldWords[1] = folderInum;
-                    
-                    blesscontextprintf(context, kBLLogLevelVerbose,  "blessed file = %lld\n", oldWords[0]);
-                    blesscontextprintf(context, kBLLogLevelVerbose,  "blessed folder = %lld\n", oldWords[1]);
+                    oldWords[0] = 0;
+                    oldWords[1] = 0;
 					
 					if (geteuid() != 0 && geteuid() != sb.f_owner) {
 						blesscontextprintf(context, kBLLogLevelError,  "Authorization required\n" );
 						return 1;
 					}
 					
-					ret = BLSetAPFSBlessData(context,  actargs[kmount].argument, oldWords);
+					ret = BLSetBlessIDsFromPaths(context, kBLPlanActionSetAPFSBlessData, actargs[kmount].argument,
+												 oldWords, 2, bootfilePath,
+												 actargs[kfolder].present ? actargs[kfolder].argument : NULL, 0);
 					if (ret) {
 						blesscontextprintf(context, kBLLogLevelError,  "Can't set bless data for volume mounted at %s: %s\n", actargs[kmount].argument , strerror(errno));
 						return 2;
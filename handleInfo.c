@@ -72,6 +72,7 @@ static int findBootRootAggregate(BLContextPtr context, char *memberPartition, ch
 static int FixupPrebootMountPointInPaths(CFMutableDictionaryRef dict, const char *mountPoint);
 static int
 GetSystemBSDForVolumeGroupUUID(BLContextPtr context, CFStringRef uuid, char *currentDev, int len);
+static int printAllBootOptions(BLContextPtr context, struct clarg actargs[klast]);
 
 
 /* 8 words of "finder info" in volume
@@ -133,6 +134,10 @@ int modeInfo(BLContextPtr context, struct clarg actargs[klast]) {
     UInt16                  role;
     uuid_string_t           snap_uuid = {0};
 
+    if (actargs[kallbootoptions].present) {
+        return printAllBootOptions(context, actargs);
+    }
+
     if(!actargs[kinfo].hasArg || actargs[kgetboot].present) {
         char currentDev[1024]; // may contain URLs like bsdp://foo
         char currentPath[MAXPATHLEN];
@@ -970,7 +975,21 @@ GetSystemBSDForVolumeGroupUUID(BLContextPtr context, CFStringRef uuid, char *cur
     io_iterator_t              pb_iter = IO_OBJECT_NULL;
     io_service_t               volume = IO_OBJECT_NULL;
     char                       bsd_name[MAXPATHLEN];
-    
+    CFUUIDRef                  group_uuid;
+
+    // The volume index already knows every group's system volume
+    group_uuid = CFUUIDCreateFromString(kCFAllocatorDefault, uuid);
+    if (group_uuid) {
+        ret = BLVolumeIndexLookup(context, kBLVolumeIndexSystemGroupUUID, group_uuid,
+                                  bsd_name, sizeof bsd_name);
+        CFRelease(group_uuid);
+        if (ret == 0) {
+            snprintf(currentDev, len, "/dev/%s", bsd_name);
+            return 0;
+        }
+        ret = 0;
+    }
+
     // Create a matching dictionary for all system volumes
     match_dict = IOServiceMatching(APFS_VOLUME_OBJECT);
     if (!match_dict) {
@@ -1043,3 +1062,84 @@ fail:
     if (pb_iter != IO_OBJECT_NULL) IOObjectRelease(pb_iter);
     return ret;
 }
+
+static void printBootNumbers(BLContextPtr context, const char *label, CFTypeRef numbers)
+{
+    CFIndex     i, count = 1;
+    int32_t     number;
+
+    if (numbers == NULL) return;
+    if (CFGetTypeID(numbers) == CFArrayGetTypeID()) count = CFArrayGetCount(numbers);
+
+    blesscontextprintf(context, kBLLogLevelNormal, "%s: ", label);
+    for (i = 0; i < count; i++) {
+        CFNumberRef num = (CFGetTypeID(numbers) == CFArrayGetTypeID())
+                            ? CFArrayGetValueAtIndex(numbers, i) : numbers;
+        CFNumberGetValue(num, kCFNumberSInt32Type, &number);
+        blesscontextprintf(context, kBLLogLevelNormal, "%s%04X", i ? "," : "", number);
+    }
+    blesscontextprintf(context, kBLLogLevelNormal, "\n");
+}
+
+static int printAllBootOptions(BLContextPtr context, struct clarg actargs[klast])
+{
+    CFDictionaryRef bootOptions = NULL;
+    CFArrayRef      options;
+    CFIndex         i;
+    int             ret;
+
+    if (getPrebootType() != kBLPreBootEnvType_EFI) {
+        blesscontextprintf(context, kBLLogLevelError, "Boot options are only available on EFI systems\n");
+        return 1;
+    }
+
+    ret = BLCopyEFIBootOptions(context, &bootOptions);
+    if (ret) {
+        blesscontextprintf(context, kBLLogLevelError, "Can't read EFI boot options\n");
+        return 1;
+    }
+
+    if (actargs[kplist].present) {
+        CFDataRef   tempData = NULL;
+
+        tempData = CFPropertyListCreateData(kCFAllocatorDefault, bootOptions, kCFPropertyListXMLFormat_v1_0, 0, NULL);
+
+        write(fileno(stdout), CFDataGetBytePtr(tempData), CFDataGetLength(tempData));
+
+        CFRelease(tempData);
+        CFRelease(bootOptions);
+        return 0;
+    }
+
+    printBootNumbers(context, "BootOrder", CFDictionaryGetValue(bootOptions, CFSTR("BootOrder")));
+    printBootNumbers(context, "BootNext", CFDictionaryGetValue(bootOptions, CFSTR("BootNext")));
+
+    options = CFDictionaryGetValue(bootOptions, CFSTR("Options"));
+    for (i = 0; i < CFArrayGetCount(options); i++) {
+        CFDictionaryRef option = CFArrayGetValueAtIndex(options, i);
+        CFStringRef     error = CFDictionaryGetValue(option, CFSTR("Error"));
+        CFStringRef     desc = CFDictionaryGetValue(option, CFSTR("Description"));
+        CFStringRef     path = CFDictionaryGetValue(option, CFSTR("DevicePathText"));
+        CFDataRef       optionalData = CFDictionaryGetValue(option, CFSTR("OptionalData"));
+        CFBooleanRef    active = CFDictionaryGetValue(option, CFSTR("Active"));
+
+        blesscontextprintf(context, kBLLogLevelNormal, "%s%s %s\n",
+                           BLGetCStringDescription(CFDictionaryGetValue(option, CFSTR("Name"))),
+                           (active == kCFBooleanTrue) ? "*" : "",
+                           desc ? BLGetCStringDescription(desc) : "");
+        if (path) {
+            blesscontextprintf(context, kBLLogLevelNormal, "\t%s\n", BLGetCStringDescription(path));
+        }
+        if (optionalData) {
+            blesscontextprintf(context, kBLLogLevelNormal, "\t%ld bytes of optional data\n",
+                               (long)CFDataGetLength(optionalData));
+        }
+        if (error) {
+            blesscontextprintf(context, kBLLogLevelNormal, "\t<%s>\n", BLGetCStringDescription(error));
+        }
+    }
+
+    CFRelease(bootOptions);
+
+    return 0;
+}
@@ -59,6 +59,9 @@ int BLGetAPFSBlessData(BLContextPtr context, const char *mountpoint, uint64_t *w
 
 int BLSetAPFSBlessData(BLContextPtr context, const char *mountpoint, uint64_t *words)
 {
+    if (BLPlanIsRecording(context)) {
+        return BLPlanRecordVolumeWords(context, kBLPlanActionSetAPFSBlessData, mountpoint, words, 2);
+    }
     return fsctl(mountpoint, APFSIOC_SET_BOOTINFO, words, 0) < 0 ? errno : 0;
 }
 
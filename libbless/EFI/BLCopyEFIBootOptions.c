@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLCopyEFIBootOptions.c
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+#include "BLEFIDevicePath.h"
+
+#define kLoadOptionActive	0x00000001
+#define kLoadOptionHidden	0x00000008
+
+static CFArrayRef _copyBootOrder(BLContextPtr context, CFStringRef name, bool *isSet);
+static CFDictionaryRef _copyBootOption(BLContextPtr context, uint16_t number);
+static void _addDevicePath(CFMutableDictionaryRef dict, BLEFISpan devicePath);
+static CFDictionaryRef _copyNodeDescription(const BLEFIDevicePathNode *node, char *text, size_t textSize);
+static void _append(char *text, size_t textSize, size_t *used, const char *str);
+static void _setNumber(CFMutableDictionaryRef dict, CFStringRef key, int64_t value);
+static void _setCString(CFMutableDictionaryRef dict, CFStringRef key, const char *value);
+
+/*
+ * Read BootOrder, BootNext and every Boot#### either of them refers to,
+ * and decode each load option. Every variable is fetched exactly once,
+ * through the context's NVRAM session when it has one.
+ *
+ * The result has the following keys:
+ *	BootOrder	array of numbers (absent if the variable is not set)
+ *	BootNext	number (absent if not set)
+ *	Options		array of dictionaries, in BootOrder order followed by
+ *				BootNext if it isn't already listed, each with
+ *		Number, Name, Attributes, Active, Hidden, Description,
+ *		DevicePath (array of per-node dictionaries), DevicePathText and
+ *		OptionalData; or Error if the option is missing or malformed
+ */
+int BLCopyEFIBootOptions(BLContextPtr context, CFDictionaryRef *bootOptions)
+{
+	CFMutableDictionaryRef	dict;
+	CFMutableArrayRef		options;
+	CFArrayRef				order, next;
+	CFIndex					i, count;
+	bool					orderSet, nextSet;
+	int32_t					number;
+
+	*bootOptions = NULL;
+
+	order = _copyBootOrder(context, CFSTR(kBL_GLOBAL_NVRAM_GUID ":BootOrder"), &orderSet);
+	if (order == NULL) return 1;
+
+	next = _copyBootOrder(context, CFSTR(kBL_GLOBAL_NVRAM_GUID ":BootNext"), &nextSet);
+	if (next == NULL) {
+		CFRelease(order);
+		return 1;
+	}
+
+	dict = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+									 &kCFTypeDictionaryKeyCallBacks,
+									 &kCFTypeDictionaryValueCallBacks);
+	options = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+
+	if (orderSet) CFDictionarySetValue(dict, CFSTR("BootOrder"), order);
+	if (nextSet && CFArrayGetCount(next) > 0) {
+		CFDictionarySetValue(dict, CFSTR("BootNext"), CFArrayGetValueAtIndex(next, 0));
+	}
+
+	count = CFArrayGetCount(order);
+	for (i = 0; i < count + CFArrayGetCount(next); i++) {
+		CFNumberRef		num;
+		CFDictionaryRef	option;
+
+		if (i < count) {
+			num = CFArrayGetValueAtIndex(order, i);
+		} else {
+			num = CFArrayGetValueAtIndex(next, i - count);
+			if (CFArrayContainsValue(order, CFRangeMake(0, count), num)) continue;
+		}
+
+		CFNumberGetValue(num, kCFNumberSInt32Type, &number);
+
+		option = _copyBootOption(context, (uint16_t)number);
+		if (option) {
+			CFArrayAppendValue(options, option);
+			CFRelease(option);
+		}
+	}
+
+	CFDictionarySetValue(dict, CFSTR("Options"), options);
+
+	contextprintf(context, kBLLogLevelVerbose, "Decoded %ld boot options\n",
+				  (long)CFArrayGetCount(options));
+
+	CFRelease(options);
+	CFRelease(order);
+	CFRelease(next);
+
+	*bootOptions = dict;
+
+	return 0;
+}
+
+// an unset variable yields an empty array; NULL only on error
+static CFArrayRef _copyBootOrder(BLContextPtr context, CFStringRef name, bool *isSet)
+{
+	CFMutableArrayRef	array;
+	CFDataRef			dataRef;
+	const uint8_t		*bytes;
+	CFIndex				i, length;
+
+	*isSet = false;
+
+	if (BLNVRAMCopyValue(context, name, (CFTypeRef *)&dataRef)) {
+		contextprintf(context, kBLLogLevelError, "Could not access %s\n",
+					  BLGetCStringDescription(name));
+		return NULL;
+	}
+
+	array = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+	if (dataRef == NULL) return array;
+
+	if (CFGetTypeID(dataRef) != CFDataGetTypeID() || (CFDataGetLength(dataRef) % 2) != 0) {
+		contextprintf(context, kBLLogLevelError, "Invalid %s\n", BLGetCStringDescription(name));
+		CFRelease(dataRef);
+		return array;
+	}
+
+	*isSet = true;
+
+	bytes = CFDataGetBytePtr(dataRef);
+	length = CFDataGetLength(dataRef);
+	for (i = 0; i + 1 < length; i += 2) {
+		int32_t		number = bytes[i] | (bytes[i+1] << 8);
+		CFNumberRef	num;
+
+		num = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt32Type, &number);
+		CFArrayAppendValue(array, num);
+		CFRelease(num);
+	}
+
+	CFRelease(dataRef);
+
+	return array;
+}
+
+static CFDictionaryRef _copyBootOption(BLContextPtr context, uint16_t number)
+{
+	CFMutableDictionaryRef	dict;
+	CFStringRef				nvramName;
+	CFDataRef				dataRef = NULL;
+	BLEFILoadOption			option;
+	char					name[16];
+	char					description[256];
+	int						ret;
+
+	dict = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+									 &kCFTypeDictionaryKeyCallBacks,
+									 &kCFTypeDictionaryValueCallBacks);
+	if (dict == NULL) return NULL;
+
+	_setNumber(dict, CFSTR("Number"), number);
+	snprintf(name, sizeof(name), "Boot%04X", number);
+	_setCString(dict, CFSTR("Name"), name);
+
+	nvramName = CFStringCreateWithFormat(kCFAllocatorDefault, NULL,
+										 CFSTR("%s:Boot%04hx"), kBL_GLOBAL_NVRAM_GUID, number);
+	if (nvramName == NULL || BLNVRAMCopyValue(context, nvramName, (CFTypeRef *)&dataRef)) {
+		dataRef = NULL;
+	}
+	if (nvramName) CFRelease(nvramName);
+
+	if (dataRef == NULL) {
+		contextprintf(context, kBLLogLevelVerbose, "%s is referenced but not set\n", name);
+		_setCString(dict, CFSTR("Error"), "Not set");
+		return dict;
+	}
+
+	if (CFGetTypeID(dataRef) != CFDataGetTypeID()) {
+		_setCString(dict, CFSTR("Error"), "Not a data value");
+		CFRelease(dataRef);
+		return dict;
+	}
+
+	ret = BLEFIParseLoadOption(CFDataGetBytePtr(dataRef), CFDataGetLength(dataRef), &option);
+	if (ret) {
+		contextprintf(context, kBLLogLevelVerbose, "%s is malformed: %d\n", name, ret);
+		_setCString(dict, CFSTR("Error"), "Malformed load option");
+		CFRelease(dataRef);
+		return dict;
+	}
+
+	_setNumber(dict, CFSTR("Attributes"), option.attributes);
+	CFDictionarySetValue(dict, CFSTR("Active"),
+						 (option.attributes & kLoadOptionActive) ? kCFBooleanTrue : kCFBooleanFalse);
+	CFDictionarySetValue(dict, CFSTR("Hidden"),
+						 (option.attributes & kLoadOptionHidden) ? kCFBooleanTrue : kCFBooleanFalse);
+
+	BLEFIUTF16ToUTF8(option.description, option.descriptionChars, description, sizeof(description));
+	_setCString(dict, CFSTR("Description"), description);
+
+	_addDevicePath(dict, option.filePathList);
+
+	if (option.optionalData.length > 0) {
+		CFDataRef optionalData = CFDataCreate(kCFAllocatorDefault, option.optionalData.bytes,
+											  option.optionalData.length);
+		if (optionalData) {
+			CFDictionarySetValue(dict, CFSTR("OptionalData"), optionalData);
+			CFRelease(optionalData);
+		}
+	}
+
+	CFRelease(dataRef);
+
+	return dict;
+}
+
+// adds DevicePath and DevicePathText, in the UEFI text notation
+static void _addDevicePath(CFMutableDictionaryRef dict, BLEFISpan devicePath)
+{
+	CFMutableArrayRef	nodes;
+	BLEFIDevicePathNode	node;
+	char				text[4096];
+	char				nodeText[1024];
+	size_t				used = 0;
+	int					ret;
+
+	nodes = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+	if (nodes == NULL) return;
+
+	text[0] = '\0';
+
+	while ((ret = BLEFIDevicePathNextNode(&devicePath, &node)) > 0) {
+		CFDictionaryRef nodeDict;
+
+		nodeDict = _copyNodeDescription(&node, nodeText, sizeof(nodeText));
+		if (nodeDict) {
+			CFArrayAppendValue(nodes, nodeDict);
+			CFRelease(nodeDict);
+		}
+
+		if (node.type == kBLEFIDevicePathTypeEnd) {
+			// end of one instance; the next follows in the same list
+			_append(text, sizeof(text), &used, ",");
+		} else {
+			if (used > 0 && text[used-1] != ',') {
+				_append(text, sizeof(text), &used, "/");
+			}
+			_append(text, sizeof(text), &used, nodeText);
+		}
+	}
+
+	CFDictionarySetValue(dict, CFSTR("DevicePath"), nodes);
+	CFRelease(nodes);
+
+	if (ret < 0) {
+		CFDictionarySetValue(dict, CFSTR("Error"), CFSTR("Malformed device path"));
+	}
+
+	_setCString(dict, CFSTR("DevicePathText"), text);
+}
+
+// appends as much of str as fits, always leaving text terminated
+static void _append(char *text, size_t textSize, size_t *used, const char *str)
+{
+	*used += strlcpy(text + *used, str, textSize - *used);
+	if (*used >= textSize) *used = textSize - 1;
+}
+
+static void _formatGUID(const uint8_t guid[16], char *out, size_t outSize)
+{
+	// EFI_GUID: the first three fields are little-endian
+	snprintf(out, outSize, "%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+			 guid[3], guid[2], guid[1], guid[0], guid[5], guid[4], guid[7], guid[6],
+			 guid[8], guid[9], guid[10], guid[11], guid[12], guid[13], guid[14], guid[15]);
+}
+
+static CFDictionaryRef _copyNodeDescription(const BLEFIDevicePathNode *node, char *text, size_t textSize)
+{
+	CFMutableDictionaryRef	dict;
+	BLEFIHardDriveNode		hd;
+	BLEFIMACNode			mac;
+	BLEFIIPv4Node			ipv4;
+	char					buf[1024];
+
+	dict = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+									 &kCFTypeDictionaryKeyCallBacks,
+									 &kCFTypeDictionaryValueCallBacks);
+	if (dict == NULL) return NULL;
+
+	_setNumber(dict, CFSTR("Type"), node->type);
+	_setNumber(dict, CFSTR("SubType"), node->subType);
+
+	if (0 == BLEFIDecodeHardDriveNode(node, &hd)) {
+		_setCString(dict, CFSTR("Kind"), "HD");
+		_setNumber(dict, CFSTR("PartitionNumber"), hd.partitionNumber);
+		_setNumber(dict, CFSTR("PartitionStart"), hd.partitionStart);
+		_setNumber(dict, CFSTR("PartitionSize"), hd.partitionSize);
+
+		if (hd.signatureType == 2) {
+			_formatGUID(hd.signature, buf, sizeof(buf));
+			_setCString(dict, CFSTR("PartitionUUID"), buf);
+			snprintf(text, textSize, "HD(%u,GPT,%s,0x%llx,0x%llx)", hd.partitionNumber, buf,
+					 (unsigned long long)hd.partitionStart, (unsigned long long)hd.partitionSize);
+		} else {
+			uint32_t sig = hd.signature[0] | (hd.signature[1] << 8)
+							| (hd.signature[2] << 16) | ((uint32_t)hd.signature[3] << 24);
+			_setNumber(dict, CFSTR("MBRSignature"), sig);
+			snprintf(text, textSize, "HD(%u,MBR,0x%08X,0x%llx,0x%llx)", hd.partitionNumber, sig,
+					 (unsigned long long)hd.partitionStart, (unsigned long long)hd.partitionSize);
+		}
+	} else if (0 == BLEFIDecodeFilePathNode(node, buf, sizeof(buf))) {
+		_setCString(dict, CFSTR("Kind"), "File");
+		_setCString(dict, CFSTR("Path"), buf);
+		snprintf(text, textSize, "%s", buf);
+	} else if (0 == BLEFIDecodeMACNode(node, &mac)) {
+		// only Ethernet and its predecessor have a known address size
+		int addrLen = (mac.ifType <= 1) ? 6 : (int)sizeof(mac.address);
+		int i;
+
+		for (i = 0; i < addrLen; i++) {
+			snprintf(buf + 2*i, sizeof(buf) - 2*i, "%02x", mac.address[i]);
+		}
+		_setCString(dict, CFSTR("Kind"), "MAC");
+		_setCString(dict, CFSTR("Address"), buf);
+		_setNumber(dict, CFSTR("InterfaceType"), mac.ifType);
+		snprintf(text, textSize, "MAC(%s,0x%x)", buf, mac.ifType);
+	} else if (0 == BLEFIDecodeIPv4Node(node, &ipv4)) {
+		char local[16];
+
+		snprintf(buf, sizeof(buf), "%u.%u.%u.%u", ipv4.remoteAddress[0], ipv4.remoteAddress[1],
+				 ipv4.remoteAddress[2], ipv4.remoteAddress[3]);
+		snprintf(local, sizeof(local), "%u.%u.%u.%u", ipv4.localAddress[0], ipv4.localAddress[1],
+				 ipv4.localAddress[2], ipv4.localAddress[3]);
+		_setCString(dict, CFSTR("Kind"), "IPv4");
+		_setCString(dict, CFSTR("RemoteAddress"), buf);
+		_setCString(dict, CFSTR("LocalAddress"), local);
+		_setNumber(dict, CFSTR("Protocol"), ipv4.protocol);
+		CFDictionarySetValue(dict, CFSTR("Static"), ipv4.staticAddress ? kCFBooleanTrue : kCFBooleanFalse);
+		snprintf(text, textSize, "IPv4(%s,0x%x,%s,%s)", buf, ipv4.protocol,
+				 ipv4.staticAddress ? "Static" : "DHCP", local);
+	} else if (node->type == kBLEFIDevicePathTypeEnd) {
+		_setCString(dict, CFSTR("Kind"), "End");
+		text[0] = '\0';
+	} else {
+		CFDataRef	payload;
+		size_t		i, len = node->payload.length;
+
+		payload = CFDataCreate(kCFAllocatorDefault, node->payload.bytes, len);
+		if (payload) {
+			CFDictionarySetValue(dict, CFSTR("Data"), payload);
+			CFRelease(payload);
+		}
+
+		// hex-dump as much of the payload as fits
+		if (len > (sizeof(buf) - 1) / 2) len = (sizeof(buf) - 1) / 2;
+		for (i = 0; i < len; i++) {
+			snprintf(buf + 2*i, sizeof(buf) - 2*i, "%02X", node->payload.bytes[i]);
+		}
+		buf[2*len] = '\0';
+		snprintf(text, textSize, "Path(%u,%u,%s)", node->type, node->subType, buf);
+	}
+
+	return dict;
+}
+
+static void _setNumber(CFMutableDictionaryRef dict, CFStringRef key, int64_t value)
+{
+	CFNumberRef num = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt64Type, &value);
+
+	if (num) {
+		CFDictionarySetValue(dict, key, num);
+		CFRelease(num);
+	}
+}
+
+static void _setCString(CFMutableDictionaryRef dict, CFStringRef key, const char *value)
+{
+	CFStringRef str = CFStringCreateWithCString(kCFAllocatorDefault, value, kCFStringEncodingUTF8);
+
+	if (str) {
+		CFDictionarySetValue(dict, key, str);
+		CFRelease(str);
+	}
+}
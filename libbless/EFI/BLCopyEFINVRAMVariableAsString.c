@@ -40,23 +40,16 @@ int BLCopyEFINVRAMVariableAsString(BLContextPtr context,
                                    CFStringRef *value)
 {
     
-    io_registry_entry_t optionsNode = 0;
     char            cStr[1024];
     CFTypeRef       valRef;
     CFStringRef     stringRef;
     
     *value = NULL;
     
-    optionsNode = IORegistryEntryFromPath(kIOMasterPortDefault, kIODeviceTreePlane ":/options");
-    
-    if(IO_OBJECT_NULL == optionsNode) {
-        contextprintf(context, kBLLogLevelError,  "Could not find " kIODeviceTreePlane ":/options\n");
+    if(BLNVRAMCopyValue(context, name, &valRef)) {
         return 1;
     }
     
-    valRef = IORegistryEntryCreateCFProperty(optionsNode, name, kCFAllocatorDefault, 0);
-    IOObjectRelease(optionsNode);
-    
     if(valRef == NULL)
         return 0;
     
@@ -223,3 +223,21 @@ int BLCreateEFIXMLRepresentationForElToritoEntry(BLContextPtr   inContext,
     return retErr;
 }
 
+
+
+int BLCreateEFIXMLRepresentationForElToritoCatalog(BLContextPtr              inContext,
+                                                   const char *              inBSDName,
+                                                   const BLElToritoCatalog * inCatalog,
+                                                   CFStringRef *             outXMLString)
+{
+    BLElToritoUEFIRegion    region;
+    
+    if (0 != BLElToritoCatalogGetUEFIRegion (inCatalog, &region) || false == region.found)
+    {
+        contextprintf (inContext, kBLLogLevelError, "No bootable EFI entry in ElTorito boot catalog\n");
+        return 3;
+    }
+    
+    return BLCreateEFIXMLRepresentationForElToritoEntry (inContext, inBSDName, region.bootEntry,
+                                                         region.offset, region.size, outXMLString);
+}
@@ -30,7 +30,6 @@
  */
 
 #import <IOKit/IOKitLib.h>
-#import <IOKit/IOCFSerialize.h>
 #import <IOKit/IOBSD.h>
 #import <IOKit/IOKitKeys.h>
 #include <IOKit/network/IONetworkInterface.h>
@@ -54,18 +53,14 @@ int BLCreateEFIXMLRepresentationForNetworkPath(BLContextPtr context,
                                                CFStringRef *xmlString)
 {
     mach_port_t masterPort;
+    int ret;
     kern_return_t kret;
     io_service_t iface;
     
-    CFDataRef xmlData;
     CFMutableDictionaryRef dict, matchDict;
     CFMutableArrayRef array;
     CFDataRef macAddress;
     
-    const UInt8 *xmlBuffer;
-    UInt8 *outBuffer;
-    CFIndex count;
-    
     kret = IOMasterPort(MACH_PORT_NULL, &masterPort);
     if(kret) return 1;
         
@@ -171,25 +166,13 @@ int BLCreateEFIXMLRepresentationForNetworkPath(BLContextPtr context,
         CFRelease(optString);
     }
     
-    xmlData = IOCFSerialize(array, 0);
+    ret = BLEFIXMLCopySerializedString(context, array, xmlString);
     CFRelease(array);
     
-    if(xmlData == NULL) {
-        contextprintf(context, kBLLogLevelError, "Can't create XML representation\n");
+    if(ret) {
         return 2;
     }
     
-    count = CFDataGetLength(xmlData);
-    xmlBuffer = CFDataGetBytePtr(xmlData);
-    outBuffer = calloc(count+1, sizeof(char)); // terminate
-    
-    memcpy(outBuffer, xmlBuffer, count);
-    CFRelease(xmlData);
-    
-    *xmlString = CFStringCreateWithCString(kCFAllocatorDefault, (const char *)outBuffer, kCFStringEncodingUTF8);
-    
-    free(outBuffer);
-    
     return 0;
 }
 
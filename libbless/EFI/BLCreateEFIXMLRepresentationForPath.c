@@ -30,7 +30,6 @@
  */
 
 #import <IOKit/IOKitLib.h>
-#import <IOKit/IOCFSerialize.h>
 #import <IOKit/IOBSD.h>
 #import <IOKit/IOKitKeys.h>
 #import <IOKit/storage/IOMedia.h>
@@ -68,14 +67,9 @@ int BLCreateEFIXMLRepresentationForPath(BLContextPtr context,
     mach_port_t masterPort;
     kern_return_t kret;
     
-    CFDataRef xmlData;
     CFMutableDictionaryRef dict;
     CFMutableArrayRef array;
 
-    const UInt8 *xmlBuffer;
-    UInt8 *outBuffer;
-    CFIndex count;
-    
     CFStringRef pathString;
     
     kret = IOMasterPort(MACH_PORT_NULL, &masterPort);
@@ -166,25 +160,13 @@ int BLCreateEFIXMLRepresentationForPath(BLContextPtr context,
         CFRelease(optString);
     }
     
-    xmlData = IOCFSerialize(array, 0);
+    ret = BLEFIXMLCopySerializedString(context, array, xmlString);
     CFRelease(array);
     
-    if(xmlData == NULL) {
-        contextprintf(context, kBLLogLevelError, "Can't create XML representation\n");
+    if(ret) {
         return 2;
     }
     
-    count = CFDataGetLength(xmlData);
-    xmlBuffer = CFDataGetBytePtr(xmlData);
-    outBuffer = calloc(count+1, sizeof(char)); // terminate
-    
-    memcpy(outBuffer, xmlBuffer, count);
-    CFRelease(xmlData);
-    
-    *xmlString = CFStringCreateWithCString(kCFAllocatorDefault, (const char *)outBuffer, kCFStringEncodingUTF8);
-
-    free(outBuffer);
-    
     return 0;
 }
 
@@ -204,14 +186,9 @@ int BLCreateEFIXMLRepresentationForPartialPath(BLContextPtr context,
     size_t slen;
     char    newPath[MAXPATHLEN];
     
-    CFDataRef xmlData;
     CFMutableDictionaryRef dict;
     CFMutableArrayRef array;
     
-    const UInt8 *xmlBuffer;
-    UInt8 *outBuffer;
-    CFIndex count;
-    
     CFStringRef pathString;
     
     kret = IOMasterPort(MACH_PORT_NULL, &masterPort);
@@ -265,25 +242,13 @@ int BLCreateEFIXMLRepresentationForPartialPath(BLContextPtr context,
         CFRelease(optString);
     }
     
-    xmlData = IOCFSerialize(array, 0);
+    ret = BLEFIXMLCopySerializedString(context, array, xmlString);
     CFRelease(array);
     
-    if (xmlData == NULL) {
-        contextprintf(context, kBLLogLevelError, "Can't create XML representation\n");
+    if(ret) {
         return 2;
     }
     
-    count = CFDataGetLength(xmlData);
-    xmlBuffer = CFDataGetBytePtr(xmlData);
-    outBuffer = calloc(count+1, sizeof(char)); // terminate
-    
-    memcpy(outBuffer, xmlBuffer, count);
-    CFRelease(xmlData);
-    
-    *xmlString = CFStringCreateWithCString(kCFAllocatorDefault, (const char *)outBuffer, kCFStringEncodingUTF8);
-    
-    free(outBuffer);
-    
     return 0;
 }
 
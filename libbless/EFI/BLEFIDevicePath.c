@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLEFIDevicePath.c
+//
+
+#include <string.h>
+#include <sys/types.h>
+
+#include "BLEFIDevicePath.h"
+
+#define kHardDriveNodeLength	42
+#define kMACNodeLength			37
+#define kIPv4NodeLength			19
+#define kIPv4NodeLengthExtended	27
+
+static uint16_t _get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t _get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t _get64(const uint8_t *p)
+{
+	return (uint64_t)_get32(p) | ((uint64_t)_get32(p + 4) << 32);
+}
+
+size_t BLEFIUTF16ToUTF8(const uint8_t *utf16, size_t chars, char *out, size_t outSize)
+{
+	size_t		i, used = 0, need;
+	uint32_t	cp;
+	uint8_t		enc[4];
+
+	if (outSize == 0) return 0;
+
+	for (i = 0; i < chars; i++) {
+		cp = _get16(utf16 + 2*i);
+		if (cp >= 0xD800 && cp < 0xDC00 && i + 1 < chars) {
+			uint32_t lo = _get16(utf16 + 2*(i+1));
+			if (lo >= 0xDC00 && lo < 0xE000) {
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+				i++;
+			}
+		}
+
+		if (cp < 0x80) {
+			enc[0] = cp;
+			need = 1;
+		} else if (cp < 0x800) {
+			enc[0] = 0xC0 | (cp >> 6);
+			enc[1] = 0x80 | (cp & 0x3F);
+			need = 2;
+		} else if (cp < 0x10000) {
+			enc[0] = 0xE0 | (cp >> 12);
+			enc[1] = 0x80 | ((cp >> 6) & 0x3F);
+			enc[2] = 0x80 | (cp & 0x3F);
+			need = 3;
+		} else {
+			enc[0] = 0xF0 | (cp >> 18);
+			enc[1] = 0x80 | ((cp >> 12) & 0x3F);
+			enc[2] = 0x80 | ((cp >> 6) & 0x3F);
+			enc[3] = 0x80 | (cp & 0x3F);
+			need = 4;
+		}
+
+		if (used + need >= outSize) break;
+		memcpy(out + used, enc, need);
+		used += need;
+	}
+
+	out[used] = '\0';
+
+	return used;
+}
+
+int BLEFIParseLoadOption(const uint8_t *bytes, size_t length, BLEFILoadOption *option)
+{
+	size_t		offset, chars, pathLength;
+
+	// Attributes (4), FilePathListLength (2), then a NUL-terminated Description
+	if (bytes == NULL || length < 6) return 1;
+
+	option->attributes = _get32(bytes);
+	pathLength = _get16(bytes + 4);
+
+	offset = 6;
+	for (chars = 0; ; chars++) {
+		if (offset + 2*chars + 2 > length) return 2;
+		if (_get16(bytes + offset + 2*chars) == 0) break;
+	}
+
+	option->description = bytes + offset;
+	option->descriptionChars = chars;
+	offset += 2*chars + 2;
+
+	if (pathLength > length - offset) return 3;
+
+	option->filePathList.bytes = bytes + offset;
+	option->filePathList.length = pathLength;
+	offset += pathLength;
+
+	option->optionalData.bytes = bytes + offset;
+	option->optionalData.length = length - offset;
+
+	return 0;
+}
+
+int BLEFIDevicePathNextNode(BLEFISpan *cursor, BLEFIDevicePathNode *node)
+{
+	uint16_t	nodeLength;
+
+	if (cursor->length < kBLEFIDevicePathNodeHeaderSize) return -1;
+
+	nodeLength = _get16(cursor->bytes + 2);
+	if (nodeLength < kBLEFIDevicePathNodeHeaderSize || nodeLength > cursor->length) return -1;
+
+	node->type = cursor->bytes[0];
+	node->subType = cursor->bytes[1];
+	node->payload.bytes = cursor->bytes + kBLEFIDevicePathNodeHeaderSize;
+	node->payload.length = nodeLength - kBLEFIDevicePathNodeHeaderSize;
+
+	cursor->bytes += nodeLength;
+	cursor->length -= nodeLength;
+
+	if (node->type == kBLEFIDevicePathTypeEnd && node->subType == kBLEFIDevicePathSubTypeEndEntire) {
+		return 0;
+	}
+
+	return 1;
+}
+
+int BLEFIDecodeHardDriveNode(const BLEFIDevicePathNode *node, BLEFIHardDriveNode *hd)
+{
+	const uint8_t *p = node->payload.bytes;
+
+	if (node->type != kBLEFIDevicePathTypeMedia
+		|| node->subType != kBLEFIDevicePathSubTypeHardDrive
+		|| node->payload.length != kHardDriveNodeLength - kBLEFIDevicePathNodeHeaderSize) {
+		return 1;
+	}
+
+	hd->partitionNumber = _get32(p);
+	hd->partitionStart = _get64(p + 4);
+	hd->partitionSize = _get64(p + 12);
+	memcpy(hd->signature, p + 20, sizeof(hd->signature));
+	hd->mbrType = p[36];
+	hd->signatureType = p[37];
+
+	return 0;
+}
+
+int BLEFIDecodeMACNode(const BLEFIDevicePathNode *node, BLEFIMACNode *mac)
+{
+	if (node->type != kBLEFIDevicePathTypeMessaging
+		|| node->subType != kBLEFIDevicePathSubTypeMAC
+		|| node->payload.length != kMACNodeLength - kBLEFIDevicePathNodeHeaderSize) {
+		return 1;
+	}
+
+	memcpy(mac->address, node->payload.bytes, sizeof(mac->address));
+	mac->ifType = node->payload.bytes[32];
+
+	return 0;
+}
+
+int BLEFIDecodeIPv4Node(const BLEFIDevicePathNode *node, BLEFIIPv4Node *ipv4)
+{
+	const uint8_t	*p = node->payload.bytes;
+	size_t			len = node->payload.length + kBLEFIDevicePathNodeHeaderSize;
+
+	if (node->type != kBLEFIDevicePathTypeMessaging
+		|| node->subType != kBLEFIDevicePathSubTypeIPv4
+		|| (len != kIPv4NodeLength && len != kIPv4NodeLengthExtended)) {
+		return 1;
+	}
+
+	memcpy(ipv4->localAddress, p, 4);
+	memcpy(ipv4->remoteAddress, p + 4, 4);
+	ipv4->localPort = _get16(p + 8);
+	ipv4->remotePort = _get16(p + 10);
+	ipv4->protocol = _get16(p + 12);
+	ipv4->staticAddress = p[14];
+
+	ipv4->hasGatewayAndSubnet = (len == kIPv4NodeLengthExtended);
+	if (ipv4->hasGatewayAndSubnet) {
+		memcpy(ipv4->gatewayAddress, p + 15, 4);
+		memcpy(ipv4->subnetMask, p + 19, 4);
+	} else {
+		memset(ipv4->gatewayAddress, 0, 4);
+		memset(ipv4->subnetMask, 0, 4);
+	}
+
+	return 0;
+}
+
+int BLEFIDecodeFilePathNode(const BLEFIDevicePathNode *node, char *path, size_t pathSize)
+{
+	size_t	chars, i;
+
+	if (node->type != kBLEFIDevicePathTypeMedia
+		|| node->subType != kBLEFIDevicePathSubTypeFilePath
+		|| (node->payload.length % 2) != 0) {
+		return 1;
+	}
+
+	// PathName is NUL-terminated within the node; tolerate a missing NUL
+	chars = node->payload.length / 2;
+	for (i = 0; i < chars; i++) {
+		if (_get16(node->payload.bytes + 2*i) == 0) break;
+	}
+
+	BLEFIUTF16ToUTF8(node->payload.bytes, i, path, pathSize);
+
+	for (i = 0; path[i]; i++) {
+		if (path[i] == '\\') path[i] = '/';
+	}
+
+	return 0;
+}
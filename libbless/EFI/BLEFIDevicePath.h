@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLEFIDevicePath.h
+//
+//  Binary EFI_LOAD_OPTION and device path decoder. It works on borrowed
+//  byte spans (typically a CFData fetched from NVRAM) and never copies;
+//  every read is bounds-checked against the span.
+//
+
+#ifndef _BLEFIDEVICEPATH_H_
+#define _BLEFIDEVICEPATH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// device path node types and subtypes (UEFI 2.x, section 10.3)
+#define kBLEFIDevicePathTypeMessaging		0x03
+#define kBLEFIDevicePathTypeMedia			0x04
+#define kBLEFIDevicePathTypeEnd				0x7F
+
+#define kBLEFIDevicePathSubTypeMAC			0x0B
+#define kBLEFIDevicePathSubTypeIPv4			0x0C
+#define kBLEFIDevicePathSubTypeHardDrive	0x01
+#define kBLEFIDevicePathSubTypeFilePath		0x04
+#define kBLEFIDevicePathSubTypeEndInstance	0x01
+#define kBLEFIDevicePathSubTypeEndEntire	0xFF
+
+#define kBLEFIDevicePathNodeHeaderSize		4
+
+typedef struct {
+	const uint8_t	*bytes;
+	size_t			length;
+} BLEFISpan;
+
+typedef struct {
+	uint32_t		attributes;
+	const uint8_t	*description;		// UTF-16LE, without the terminating NUL
+	size_t			descriptionChars;
+	BLEFISpan		filePathList;
+	BLEFISpan		optionalData;
+} BLEFILoadOption;
+
+typedef struct {
+	uint8_t			type;
+	uint8_t			subType;
+	BLEFISpan		payload;			// node contents after the 4-byte header
+} BLEFIDevicePathNode;
+
+typedef struct {
+	uint32_t		partitionNumber;
+	uint64_t		partitionStart;		// in LBAs
+	uint64_t		partitionSize;		// in LBAs
+	uint8_t			signature[16];
+	uint8_t			mbrType;
+	uint8_t			signatureType;
+} BLEFIHardDriveNode;
+
+typedef struct {
+	uint8_t			address[32];
+	uint8_t			ifType;
+} BLEFIMACNode;
+
+typedef struct {
+	uint8_t			localAddress[4];
+	uint8_t			remoteAddress[4];
+	uint16_t		localPort;
+	uint16_t		remotePort;
+	uint16_t		protocol;
+	uint8_t			staticAddress;
+	bool			hasGatewayAndSubnet;	// 27-byte form
+	uint8_t			gatewayAddress[4];
+	uint8_t			subnetMask[4];
+} BLEFIIPv4Node;
+
+/*
+ * Decoding. All return 0 on success, non-zero if the bytes are
+ * malformed or truncated.
+ */
+int BLEFIParseLoadOption(const uint8_t *bytes, size_t length, BLEFILoadOption *option);
+
+// returns 1 and advances cursor if a node was read, 0 at the end node, -1 if malformed
+int BLEFIDevicePathNextNode(BLEFISpan *cursor, BLEFIDevicePathNode *node);
+
+int BLEFIDecodeHardDriveNode(const BLEFIDevicePathNode *node, BLEFIHardDriveNode *hd);
+int BLEFIDecodeMACNode(const BLEFIDevicePathNode *node, BLEFIMACNode *mac);
+int BLEFIDecodeIPv4Node(const BLEFIDevicePathNode *node, BLEFIIPv4Node *ipv4);
+
+// file path is converted to UTF-8 with '\' separators turned into '/'
+int BLEFIDecodeFilePathNode(const BLEFIDevicePathNode *node, char *path, size_t pathSize);
+
+// UTF-16LE to NUL-terminated UTF-8; output is truncated at a character boundary
+size_t BLEFIUTF16ToUTF8(const uint8_t *utf16, size_t chars, char *out, size_t outSize);
+
+#endif // _BLEFIDEVICEPATH_H_
@@ -0,0 +1,737 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLEFIXMLScanner.c
+//
+//  The strings bless writes to efi-boot-device look like
+//
+//    <array><dict><key>IOMatch</key><dict>...</dict>
+//    <key>BLLastBSDName</key><string>disk0s2</string></dict>...</array>
+//
+//  with ID="n" attributes on values and <tag IDREF="n"/> standing in for
+//  a value already seen. The scanner walks that text once, remembering
+//  the extent of every ID'd value so references can be resolved, and
+//  decodes only the keys it was asked about into an arena.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <IOKit/IOCFUnserialize.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+#define kBLEFIXMLMaxDepth	64
+#define kBLArenaBlockSize	4096
+
+enum {
+	kKindString = 1,
+	kKindData,
+	kKindInteger,
+	kKindBoolean,
+	kKindArray,
+	kKindDict
+};
+
+typedef struct _BLArenaBlock {
+	struct _BLArenaBlock	*next;
+	size_t					used;
+	size_t					size;
+	char					bytes[];
+} BLArenaBlock;
+
+typedef struct {
+	uint8_t			kind;
+	const char		*start;		// '<' of the opening tag
+	const char		*end;		// just past the closing tag
+} BLEFIXMLSpan;
+
+struct BLEFIXMLScan {
+	CFStringRef			xmlString;
+	char				*ownedSource;
+	const char			*source;
+
+	BLEFIXMLElement		*elements;
+	CFIndex				count;
+	CFIndex				capacity;
+
+	BLEFIXMLSpan		*ids;
+	size_t				idCapacity;
+
+	BLArenaBlock		*arena;
+};
+
+typedef struct {
+	const char		*start;
+	const char		*name;
+	size_t			nameLength;
+	bool			closing;
+	bool			empty;
+	long			id;
+	long			idref;
+} BLEFIXMLTag;
+
+typedef struct {
+	BLEFIXMLScanRef	scan;
+	const char		*p;
+	const char		*end;
+} BLEFIXMLParser;
+
+static const char *kKeyNames[kBLEFIXMLKeyCount] = {
+	"IOMatch",
+	"BLVolumeUUID",
+	"BLLastBSDName",
+	"IOEFIDevicePathType",
+	"Path",
+	"IOEFIBootOption",
+};
+
+static const char *_copyUTF8(CFStringRef string, char **owned);
+static int _parseValue(BLEFIXMLParser *ps, const BLEFIXMLTag *tag, int depth,
+					   BLEFIXMLElement *element, BLEFIXMLSpan *span);
+
+
+static void *_arenaAlloc(BLEFIXMLScanRef scan, size_t size)
+{
+	BLArenaBlock	*block = scan->arena;
+	void			*ptr;
+
+	if (block == NULL || block->size - block->used < size) {
+		size_t blockSize = size > kBLArenaBlockSize ? size : kBLArenaBlockSize;
+
+		block = malloc(sizeof(*block) + blockSize);
+		if (block == NULL) return NULL;
+		block->next = scan->arena;
+		block->used = 0;
+		block->size = blockSize;
+		scan->arena = block;
+	}
+
+	ptr = block->bytes + block->used;
+	block->used += size;
+
+	return ptr;
+}
+
+static bool _tagIs(const BLEFIXMLTag *tag, const char *name)
+{
+	size_t len = strlen(name);
+
+	return tag->nameLength == len && 0 == memcmp(tag->name, name, len);
+}
+
+static int _tagKind(const BLEFIXMLTag *tag)
+{
+	if (_tagIs(tag, "string")) return kKindString;
+	if (_tagIs(tag, "data")) return kKindData;
+	if (_tagIs(tag, "integer")) return kKindInteger;
+	if (_tagIs(tag, "true") || _tagIs(tag, "false")) return kKindBoolean;
+	if (_tagIs(tag, "array") || _tagIs(tag, "set")) return kKindArray;
+	if (_tagIs(tag, "dict")) return kKindDict;
+	return 0;
+}
+
+static void _skipSpace(BLEFIXMLParser *ps)
+{
+	while (ps->p < ps->end && (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n' || *ps->p == '\r')) {
+		ps->p++;
+	}
+}
+
+static long _parseNumber(const char *p, const char *end)
+{
+	long val = 0;
+
+	if (p == end) return -1;
+	for (; p < end; p++) {
+		if (*p < '0' || *p > '9' || val > 0x7FFFFFF) return -1;
+		val = val * 10 + (*p - '0');
+	}
+
+	return val;
+}
+
+static int _readTag(BLEFIXMLParser *ps, BLEFIXMLTag *tag)
+{
+	_skipSpace(ps);
+
+	memset(tag, 0, sizeof(*tag));
+	tag->id = tag->idref = -1;
+	tag->start = ps->p;
+
+	if (ps->p >= ps->end || *ps->p != '<') return -1;
+	ps->p++;
+
+	if (ps->p < ps->end && *ps->p == '/') {
+		tag->closing = true;
+		ps->p++;
+	}
+
+	tag->name = ps->p;
+	while (ps->p < ps->end && ((*ps->p >= 'a' && *ps->p <= 'z') || (*ps->p >= 'A' && *ps->p <= 'Z'))) {
+		ps->p++;
+	}
+	tag->nameLength = ps->p - tag->name;
+	if (tag->nameLength == 0) return -1;
+
+	for (;;) {
+		const char	*attr, *value;
+		size_t		attrLength;
+
+		_skipSpace(ps);
+		if (ps->p >= ps->end) return -1;
+
+		if (*ps->p == '>') {
+			ps->p++;
+			return 0;
+		}
+
+		if (*ps->p == '/') {
+			if (ps->p + 1 >= ps->end || ps->p[1] != '>' || tag->closing) return -1;
+			tag->empty = true;
+			ps->p += 2;
+			return 0;
+		}
+
+		attr = ps->p;
+		while (ps->p < ps->end && *ps->p != '=' && *ps->p != '>' && *ps->p != ' ') ps->p++;
+		attrLength = ps->p - attr;
+		if (ps->p + 1 >= ps->end || ps->p[0] != '=' || ps->p[1] != '"') return -1;
+		ps->p += 2;
+
+		value = ps->p;
+		while (ps->p < ps->end && *ps->p != '"') ps->p++;
+		if (ps->p >= ps->end) return -1;
+
+		if (attrLength == 2 && 0 == memcmp(attr, "ID", 2)) {
+			tag->id = _parseNumber(value, ps->p);
+			if (tag->id < 0) return -1;
+		} else if (attrLength == 5 && 0 == memcmp(attr, "IDREF", 5)) {
+			tag->idref = _parseNumber(value, ps->p);
+			if (tag->idref < 0) return -1;
+		}
+		// other attributes (integer size) are not needed
+
+		ps->p++;
+	}
+}
+
+static int _expectClose(BLEFIXMLParser *ps, const BLEFIXMLTag *open)
+{
+	BLEFIXMLTag close;
+
+	if (_readTag(ps, &close)) return -1;
+	if (!close.closing || close.nameLength != open->nameLength
+		|| 0 != memcmp(close.name, open->name, open->nameLength)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _recordID(BLEFIXMLParser *ps, long id, const BLEFIXMLSpan *span)
+{
+	BLEFIXMLScanRef scan = ps->scan;
+
+	// IDs are handed out sequentially, so can't outnumber the tags
+	if ((size_t)id > (size_t)(ps->end - scan->source)) return -1;
+
+	if ((size_t)id >= scan->idCapacity) {
+		size_t			newCapacity = scan->idCapacity ? scan->idCapacity : 32;
+		BLEFIXMLSpan	*ids;
+
+		while (newCapacity <= (size_t)id) newCapacity *= 2;
+		ids = realloc(scan->ids, newCapacity * sizeof(*ids));
+		if (ids == NULL) return -1;
+		memset(ids + scan->idCapacity, 0, (newCapacity - scan->idCapacity) * sizeof(*ids));
+		scan->ids = ids;
+		scan->idCapacity = newCapacity;
+	}
+
+	scan->ids[id] = *span;
+
+	return 0;
+}
+
+// text between the opening and closing tag of a scalar span
+static void _spanContent(const BLEFIXMLSpan *span, const char **content, size_t *length)
+{
+	const char *gt, *lt;
+
+	gt = memchr(span->start, '>', span->end - span->start);
+	if (gt == NULL || gt[-1] == '/') {
+		*content = "";
+		*length = 0;
+		return;
+	}
+
+	for (lt = span->end - 1; lt > gt && *lt != '<'; lt--)
+		;
+
+	*content = gt + 1;
+	*length = lt - (gt + 1);
+}
+
+static size_t _decodeEntities(const char *in, size_t length, char *out)
+{
+	size_t	i = 0, used = 0;
+
+	while (i < length) {
+		const char	*semi;
+		size_t		entityLength;
+
+		if (in[i] != '&' || (semi = memchr(in + i, ';', length - i)) == NULL) {
+			out[used++] = in[i++];
+			continue;
+		}
+
+		entityLength = semi - (in + i) + 1;
+		if (entityLength == 4 && 0 == memcmp(in + i, "&lt;", 4)) {
+			out[used++] = '<';
+		} else if (entityLength == 4 && 0 == memcmp(in + i, "&gt;", 4)) {
+			out[used++] = '>';
+		} else if (entityLength == 5 && 0 == memcmp(in + i, "&amp;", 5)) {
+			out[used++] = '&';
+		} else if (entityLength == 6 && 0 == memcmp(in + i, "&quot;", 6)) {
+			out[used++] = '"';
+		} else if (entityLength == 6 && 0 == memcmp(in + i, "&apos;", 6)) {
+			out[used++] = '\'';
+		} else if (entityLength > 3 && in[i+1] == '#' && entityLength <= 8) {
+			// numeric references are only ever emitted for ASCII
+			unsigned long	c;
+			char			num[8];
+
+			memcpy(num, in + i + 2, entityLength - 3);
+			num[entityLength - 3] = '\0';
+			c = (num[0] == 'x') ? strtoul(num + 1, NULL, 16) : strtoul(num, NULL, 10);
+			out[used++] = (c > 0 && c < 0x80) ? (char)c : '?';
+		} else {
+			memcpy(out + used, in + i, entityLength);
+			used += entityLength;
+		}
+
+		i += entityLength;
+	}
+
+	return used;
+}
+
+static int _base64Value(char c)
+{
+	if (c >= 'A' && c <= 'Z') return c - 'A';
+	if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+	if (c >= '0' && c <= '9') return c - '0' + 52;
+	if (c == '+') return 62;
+	if (c == '/') return 63;
+	return -1;
+}
+
+static size_t _decodeBase64(const char *in, size_t length, char *out)
+{
+	uint32_t	acc = 0;
+	int			bits = 0;
+	size_t		i, used = 0;
+
+	for (i = 0; i < length; i++) {
+		int v = _base64Value(in[i]);
+
+		if (v < 0) continue;	// whitespace and padding
+		acc = (acc << 6) | v;
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			out[used++] = (char)((acc >> bits) & 0xFF);
+		}
+	}
+
+	return used;
+}
+
+static int _capture(BLEFIXMLParser *ps, int key, const BLEFIXMLSpan *span, BLEFIXMLValue *value)
+{
+	const char	*content;
+	size_t		length;
+	char		*out;
+
+	if (key == kBLEFIXMLKeyIOMatch) {
+		if (span->kind != kKindDict) return 0;
+
+		length = span->end - span->start;
+		out = _arenaAlloc(ps->scan, length + 1);
+		if (out == NULL) return -1;
+		memcpy(out, span->start, length);
+		out[length] = '\0';
+
+		value->type = kBLEFIXMLValueDict;
+		value->bytes = out;
+		value->length = length;
+		return 0;
+	}
+
+	if (span->kind != kKindString && !(span->kind == kKindData && key == kBLEFIXMLKeyBootOption)) {
+		return 0;
+	}
+
+	_spanContent(span, &content, &length);
+
+	// decoding never lengthens the text
+	out = _arenaAlloc(ps->scan, length + 1);
+	if (out == NULL) return -1;
+
+	if (span->kind == kKindString) {
+		value->type = kBLEFIXMLValueString;
+		value->length = _decodeEntities(content, length, out);
+	} else {
+		value->type = kBLEFIXMLValueData;
+		value->length = _decodeBase64(content, length, out);
+	}
+	out[value->length] = '\0';
+	value->bytes = out;
+
+	return 0;
+}
+
+static int _parseDict(BLEFIXMLParser *ps, int depth, BLEFIXMLElement *element)
+{
+	BLEFIXMLTag		tag;
+	BLEFIXMLSpan	span;
+	const char		*key;
+	size_t			keyLength;
+	int				i;
+
+	for (;;) {
+		if (_readTag(ps, &tag)) return -1;
+
+		if (tag.closing) {
+			return _tagIs(&tag, "dict") ? 0 : -1;
+		}
+
+		if (!_tagIs(&tag, "key") || tag.empty) return -1;
+
+		key = ps->p;
+		while (ps->p < ps->end && *ps->p != '<') ps->p++;
+		keyLength = ps->p - key;
+		if (_expectClose(ps, &tag)) return -1;
+
+		if (_readTag(ps, &tag)) return -1;
+		if (_parseValue(ps, &tag, depth + 1, NULL, &span)) return -1;
+
+		if (element == NULL) continue;
+
+		for (i = 0; i < kBLEFIXMLKeyCount; i++) {
+			if (strlen(kKeyNames[i]) == keyLength && 0 == memcmp(kKeyNames[i], key, keyLength)) {
+				if (_capture(ps, i, &span, &element->values[i])) return -1;
+				break;
+			}
+		}
+	}
+}
+
+static int _parseValue(BLEFIXMLParser *ps, const BLEFIXMLTag *tag, int depth,
+					   BLEFIXMLElement *element, BLEFIXMLSpan *span)
+{
+	BLEFIXMLTag	child;
+	int			kind;
+
+	if (tag->closing || depth > kBLEFIXMLMaxDepth) return -1;
+
+	kind = _tagKind(tag);
+	if (kind == 0) return -1;
+
+	if (tag->idref >= 0) {
+		BLEFIXMLScanRef scan = ps->scan;
+
+		if (!tag->empty || (size_t)tag->idref >= scan->idCapacity || scan->ids[tag->idref].kind == 0) {
+			return -1;
+		}
+		*span = scan->ids[tag->idref];
+		return 0;
+	}
+
+	span->kind = kind;
+	span->start = tag->start;
+
+	if (!tag->empty) {
+		switch (kind) {
+			case kKindDict:
+				if (_parseDict(ps, depth, element)) return -1;
+				break;
+			case kKindArray:
+				for (;;) {
+					BLEFIXMLSpan childSpan;
+
+					if (_readTag(ps, &child)) return -1;
+					if (child.closing) {
+						if (child.nameLength != tag->nameLength
+							|| 0 != memcmp(child.name, tag->name, tag->nameLength)) {
+							return -1;
+						}
+						break;
+					}
+					if (_parseValue(ps, &child, depth + 1, NULL, &childSpan)) return -1;
+				}
+				break;
+			default:
+				while (ps->p < ps->end && *ps->p != '<') ps->p++;
+				if (_expectClose(ps, tag)) return -1;
+				break;
+		}
+	}
+
+	span->end = ps->p;
+
+	if (tag->id >= 0 && _recordID(ps, tag->id, span)) return -1;
+
+	return 0;
+}
+
+static BLEFIXMLElement *_newElement(BLEFIXMLScanRef scan)
+{
+	if (scan->count == scan->capacity) {
+		CFIndex			newCapacity = scan->capacity ? 2 * scan->capacity : 8;
+		BLEFIXMLElement	*elements;
+
+		elements = realloc(scan->elements, newCapacity * sizeof(*elements));
+		if (elements == NULL) return NULL;
+		scan->elements = elements;
+		scan->capacity = newCapacity;
+	}
+
+	memset(&scan->elements[scan->count], 0, sizeof(BLEFIXMLElement));
+
+	return &scan->elements[scan->count++];
+}
+
+// 0 on success, -1 if malformed, 2 if well formed but not an array of dictionaries
+static int _parseTopLevel(BLEFIXMLParser *ps)
+{
+	BLEFIXMLTag		tag, child;
+	BLEFIXMLSpan	span;
+
+	if (_readTag(ps, &tag)) return -1;
+	if (_tagKind(&tag) != kKindArray || tag.idref >= 0) return 2;
+
+	span.kind = kKindArray;
+	span.start = tag.start;
+
+	if (!tag.empty) {
+		for (;;) {
+			BLEFIXMLElement	*element;
+			BLEFIXMLSpan	childSpan;
+
+			if (_readTag(ps, &child)) return -1;
+			if (child.closing) {
+				if (!_tagIs(&child, "array") && !_tagIs(&child, "set")) return -1;
+				break;
+			}
+
+			if (_tagKind(&child) != kKindDict || child.idref >= 0) return 2;
+
+			element = _newElement(ps->scan);
+			if (element == NULL) return -1;
+
+			if (_parseValue(ps, &child, 1, element, &childSpan)) return -1;
+		}
+	}
+
+	span.end = ps->p;
+	if (tag.id >= 0 && _recordID(ps, tag.id, &span)) return -1;
+
+	return 0;
+}
+
+int BLEFIXMLScanCreate(BLContextPtr context, CFStringRef xmlString, BLEFIXMLScanRef *scan)
+{
+	BLEFIXMLScanRef	newScan;
+	BLEFIXMLParser	ps;
+	int				ret;
+
+	*scan = NULL;
+
+	newScan = calloc(1, sizeof(*newScan));
+	if (newScan == NULL) return 1;
+
+	newScan->xmlString = CFRetain(xmlString);
+	newScan->source = _copyUTF8(xmlString, &newScan->ownedSource);
+	if (newScan->source == NULL) {
+		BLEFIXMLScanRelease(newScan);
+		return 1;
+	}
+
+	ps.scan = newScan;
+	ps.p = newScan->source;
+	ps.end = newScan->source + strlen(newScan->source);
+
+	ret = _parseTopLevel(&ps);
+	if (ret) {
+		if (ret == 2) {
+			contextprintf(context, kBLLogLevelError, "Bad type in XML string\n");
+		} else {
+			contextprintf(context, kBLLogLevelError, "Could not unserialize string\n");
+		}
+		BLEFIXMLScanRelease(newScan);
+		return 2;
+	}
+
+	*scan = newScan;
+
+	return 0;
+}
+
+void BLEFIXMLScanRelease(BLEFIXMLScanRef scan)
+{
+	BLArenaBlock *block, *next;
+
+	if (scan == NULL) return;
+
+	for (block = scan->arena; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+
+	free(scan->ids);
+	free(scan->elements);
+	free(scan->ownedSource);
+	if (scan->xmlString) CFRelease(scan->xmlString);
+	free(scan);
+}
+
+CFIndex BLEFIXMLScanGetCount(BLEFIXMLScanRef scan)
+{
+	return scan->count;
+}
+
+const BLEFIXMLElement *BLEFIXMLScanGetElement(BLEFIXMLScanRef scan, CFIndex index)
+{
+	if (index < 0 || index >= scan->count) return NULL;
+
+	return &scan->elements[index];
+}
+
+const char *BLEFIXMLElementGetString(const BLEFIXMLElement *element, int key)
+{
+	if (key < 0 || key >= kBLEFIXMLKeyCount
+		|| element->values[key].type != kBLEFIXMLValueString) {
+		return NULL;
+	}
+
+	return element->values[key].bytes;
+}
+
+CFDictionaryRef BLEFIXMLScanCopyMatchDictionary(BLContextPtr context, BLEFIXMLScanRef scan, CFIndex index)
+{
+	const BLEFIXMLElement	*element = BLEFIXMLScanGetElement(scan, index);
+	CFTypeRef				obj;
+	CFArrayRef				array;
+	CFDictionaryRef			dict;
+
+	if (element == NULL || element->values[kBLEFIXMLKeyIOMatch].type != kBLEFIXMLValueDict) {
+		return NULL;
+	}
+
+	obj = IOCFUnserialize(element->values[kBLEFIXMLKeyIOMatch].bytes, kCFAllocatorDefault, 0, NULL);
+	if (obj && CFGetTypeID(obj) == CFDictionaryGetTypeID()) {
+		return obj;
+	}
+	if (obj) CFRelease(obj);
+
+	// the fragment refers to objects serialized outside it, so
+	// it only makes sense in the context of the whole string
+	contextprintf(context, kBLLogLevelVerbose, "Unserializing whole string for IOMatch\n");
+
+	array = IOCFUnserialize(scan->source, kCFAllocatorDefault, 0, NULL);
+	if (array == NULL) return NULL;
+
+	dict = NULL;
+	if (CFGetTypeID(array) == CFArrayGetTypeID() && index < CFArrayGetCount(array)) {
+		CFDictionaryRef elementDict = CFArrayGetValueAtIndex(array, index);
+
+		if (CFGetTypeID(elementDict) == CFDictionaryGetTypeID()) {
+			dict = CFDictionaryGetValue(elementDict, CFSTR("IOMatch"));
+			if (dict && CFGetTypeID(dict) == CFDictionaryGetTypeID()) {
+				CFRetain(dict);
+			} else {
+				dict = NULL;
+			}
+		}
+	}
+
+	CFRelease(array);
+
+	return dict;
+}
+
+int BLEFIXMLCopyArray(BLContextPtr context, CFStringRef xmlString, CFArrayRef *array)
+{
+	const char	*source;
+	char		*owned = NULL;
+	CFTypeRef	obj;
+
+	*array = NULL;
+
+	source = _copyUTF8(xmlString, &owned);
+	if (source == NULL) return 1;
+
+	obj = IOCFUnserialize(source, kCFAllocatorDefault, 0, NULL);
+	free(owned);
+
+	if (obj == NULL) {
+		contextprintf(context, kBLLogLevelError, "Could not unserialize string\n");
+		return 2;
+	}
+
+	if (CFGetTypeID(obj) != CFArrayGetTypeID()) {
+		CFRelease(obj);
+		contextprintf(context, kBLLogLevelError, "Bad type in XML string\n");
+		return 2;
+	}
+
+	*array = obj;
+
+	return 0;
+}
+
+// borrow the string's own UTF-8 storage if it has one, else convert
+static const char *_copyUTF8(CFStringRef string, char **owned)
+{
+	const char	*ptr;
+	CFIndex		maxSize;
+
+	*owned = NULL;
+
+	ptr = CFStringGetCStringPtr(string, kCFStringEncodingUTF8);
+	if (ptr) return ptr;
+
+	maxSize = CFStringGetMaximumSizeForEncoding(CFStringGetLength(string), kCFStringEncodingUTF8) + 1;
+	*owned = malloc(maxSize);
+	if (*owned == NULL) return NULL;
+
+	if (!CFStringGetCString(string, *owned, maxSize, kCFStringEncodingUTF8)) {
+		free(*owned);
+		*owned = NULL;
+		return NULL;
+	}
+
+	return *owned;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLEFIXMLSerialize.c
+//
+
+#include <string.h>
+
+#include <IOKit/IOCFSerialize.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+/*
+ * IOCFSerialize a boot device array and make a CFString of it straight
+ * from the serialized bytes. Like the NUL-terminated copy this replaces,
+ * the string stops at the first NUL (IOCFSerialize terminates its data).
+ */
+int BLEFIXMLCopySerializedString(BLContextPtr context, CFTypeRef object, CFStringRef *xmlString)
+{
+	CFDataRef	xmlData;
+	const char	*bytes;
+	size_t		length;
+
+	*xmlString = NULL;
+
+	xmlData = IOCFSerialize(object, 0);
+	if (xmlData == NULL) {
+		contextprintf(context, kBLLogLevelError, "Can't create XML representation\n");
+		return 2;
+	}
+
+	bytes = (const char *)CFDataGetBytePtr(xmlData);
+	length = strnlen(bytes, CFDataGetLength(xmlData));
+
+	*xmlString = CFStringCreateWithBytes(kCFAllocatorDefault, (const UInt8 *)bytes, length,
+										 kCFStringEncodingUTF8, false);
+	CFRelease(xmlData);
+
+	if (*xmlString == NULL) {
+		contextprintf(context, kBLLogLevelError, "Can't create XML representation\n");
+		return 2;
+	}
+
+	return 0;
+}
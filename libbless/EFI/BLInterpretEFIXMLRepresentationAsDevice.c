@@ -30,7 +30,6 @@
  */
 
 #include <IOKit/IOKitLib.h>
-#include <IOKit/IOCFUnserialize.h>
 #include <IOKit/storage/IOMedia.h>
 #include <IOKit/IOBSD.h>
 
@@ -41,62 +40,48 @@
 #include <DiskArbitration/DiskArbitration.h>
 #endif
 
-static int checkForMatch(BLContextPtr context, CFDictionaryRef dict,
+static int checkForMatch(BLContextPtr context, BLEFIXMLScanRef scan, CFIndex index,
 						 char *bsdName, int bsdNameLen);
 
-static int checkForPath(BLContextPtr context, CFDictionaryRef dict,
+static int checkForPath(BLContextPtr context, const BLEFIXMLElement *element,
                          char *path, int pathLen);
 
+static int lookupMatchInIndex(BLContextPtr context, CFDictionaryRef iomatch,
+							  char *bsdName, int bsdNameLen);
+
+static int IOMatchService(BLContextPtr context, CFDictionaryRef iomatch,
+						  char *bsdName, int bsdNameLen);
+
+static int volumeMatchesUUID(BLContextPtr context, const char *bsdName, CFUUIDRef uuid);
+
 static CFUUIDRef    copyVolUUIDFromDiskArb(BLContextPtr context,
-                                          CFStringRef bsdName);
+                                          const char *bsdName);
 
 int BLInterpretEFIXMLRepresentationAsDevice(BLContextPtr context,
                                             CFStringRef xmlString,
                                             char *bsdName,
                                             int bsdNameLen)
 {
-	CFArrayRef  efiArray = NULL;
+	BLEFIXMLScanRef scan = NULL;
     CFIndex     count, i;
-    char        buffer[1024];
 	int			foundDevice = 0;
+	int			ret;
 	
-    if(!CFStringGetCString(xmlString, buffer, sizeof(buffer), kCFStringEncodingUTF8)) {
-        return 1;
-    }
-    
-    efiArray = IOCFUnserialize(buffer,
-                               kCFAllocatorDefault,
-                               0,
-                               NULL);
-    if(efiArray == NULL) {
-        contextprintf(context, kBLLogLevelError, "Could not unserialize string\n");
-        return 2;
-    }
-    
-    if(CFGetTypeID(efiArray) != CFArrayGetTypeID()) {
-        CFRelease(efiArray);
-        contextprintf(context, kBLLogLevelError, "Bad type in XML string\n");
-        return 2;        
-    }
+	ret = BLEFIXMLScanCreate(context, xmlString, &scan);
+	if(ret) {
+		return ret;
+	}
     
     // for each entry, see if there's a volume UUID, or if IOMatch works
-    count = CFArrayGetCount(efiArray);
+    count = BLEFIXMLScanGetCount(scan);
     for(i=0; i < count; i++) {
-        CFDictionaryRef dict = CFArrayGetValueAtIndex(efiArray, i);
-        
-        if(CFGetTypeID(dict) != CFDictionaryGetTypeID()) {
-            CFRelease(efiArray);
-            contextprintf(context, kBLLogLevelError, "Bad type in XML string\n");
-            return 2;                    
-        }
-
-        if(checkForMatch(context, dict, bsdName, bsdNameLen)) {
+        if(checkForMatch(context, scan, i, bsdName, bsdNameLen)) {
 			foundDevice = 1;
 			break;
 		}        
     }
 	
-    CFRelease(efiArray);
+    BLEFIXMLScanRelease(scan);
     
 	if(!foundDevice) {
 		contextprintf(context, kBLLogLevelVerbose, "Could not find disk device for string\n");
@@ -114,48 +99,26 @@ int BLInterpretEFIXMLRepresentationAsDeviceWithPath(BLContextPtr context,
                                                     char *path,
                                                     int pathLen)
 {
-    CFArrayRef  efiArray = NULL;
+    BLEFIXMLScanRef scan = NULL;
     CFIndex     count, i;
-    char        buffer[1024];
     int			foundDevice = 0;
     int         foundPath = 0;
+    int         ret;
     
-    if(!CFStringGetCString(xmlString, buffer, sizeof(buffer), kCFStringEncodingUTF8)) {
-        return 1;
-    }
-    
-    efiArray = IOCFUnserialize(buffer,
-                               kCFAllocatorDefault,
-                               0,
-                               NULL);
-    if(efiArray == NULL) {
-        contextprintf(context, kBLLogLevelError, "Could not unserialize string\n");
-        return 2;
-    }
-    
-    if(CFGetTypeID(efiArray) != CFArrayGetTypeID()) {
-        CFRelease(efiArray);
-        contextprintf(context, kBLLogLevelError, "Bad type in XML string\n");
-        return 2;
+    ret = BLEFIXMLScanCreate(context, xmlString, &scan);
+    if(ret) {
+        return ret;
     }
     
     // for each entry, see if there's a volume UUID, or if IOMatch works
-    count = CFArrayGetCount(efiArray);
+    count = BLEFIXMLScanGetCount(scan);
     for (i=0; i < count; i++) {
-        CFDictionaryRef dict = CFArrayGetValueAtIndex(efiArray, i);
-        
-        if(CFGetTypeID(dict) != CFDictionaryGetTypeID()) {
-            CFRelease(efiArray);
-            contextprintf(context, kBLLogLevelError, "Bad type in XML string\n");
-            return 2;
-        }
-        
-        if (checkForMatch(context, dict, bsdName, bsdNameLen)) {
+        if (checkForMatch(context, scan, i, bsdName, bsdNameLen)) {
             foundDevice = 1;
         }
         if (path) {
             // Caller wants us to look for a path within the device
-            if (checkForPath(context, dict, path, pathLen)) {
+            if (checkForPath(context, BLEFIXMLScanGetElement(scan, i), path, pathLen)) {
                 foundPath = 1;
             }
         }
@@ -164,7 +127,7 @@ int BLInterpretEFIXMLRepresentationAsDeviceWithPath(BLContextPtr context,
     
     }
     
-    CFRelease(efiArray);
+    BLEFIXMLScanRelease(scan);
     
     if(!foundDevice) {
         contextprintf(context, kBLLogLevelVerbose, "Could not find disk device for string\n");
@@ -175,19 +138,24 @@ int BLInterpretEFIXMLRepresentationAsDeviceWithPath(BLContextPtr context,
 }
 
 
-static int checkForMatch(BLContextPtr context, CFDictionaryRef dict,
+static int checkForMatch(BLContextPtr context, BLEFIXMLScanRef scan, CFIndex index,
 						 char *bsdName, int bsdNameLen)
 {
-	CFStringRef		fsuuid;
+	const BLEFIXMLElement *element = BLEFIXMLScanGetElement(scan, index);
+	const char		*fsuuid;
 	CFUUIDRef		uuid = NULL;
-	io_service_t	service;
 	int				foundDevice = 0;
 	
 	// first check for volume UUID. if it's present at all, it's preferred
 	
-	fsuuid = CFDictionaryGetValue(dict, CFSTR("BLVolumeUUID"));
-	if(fsuuid && CFGetTypeID(fsuuid) == CFStringGetTypeID()) {
-		uuid = CFUUIDCreateFromString(kCFAllocatorDefault, fsuuid);
+	fsuuid = BLEFIXMLElementGetString(element, kBLEFIXMLKeyVolumeUUID);
+	if(fsuuid) {
+		CFStringRef	uuidString = CFStringCreateWithCString(kCFAllocatorDefault, fsuuid, kCFStringEncodingUTF8);
+		
+		if(uuidString) {
+			uuid = CFUUIDCreateFromString(kCFAllocatorDefault, uuidString);
+			CFRelease(uuidString);
+		}
 	
 		if(uuid == NULL) {
 			contextprintf(context, kBLLogLevelVerbose, "Bad Volume UUID\n");
@@ -195,75 +163,46 @@ static int checkForMatch(BLContextPtr context, CFDictionaryRef dict,
 	}
 	
 	if(uuid) {
-		CFStringRef	lastBSDName = CFDictionaryGetValue(dict, CFSTR("BLLastBSDName"));
+		const char	*lastBSDName = BLEFIXMLElementGetString(element, kBLEFIXMLKeyLastBSDName);
 		
-		// use this as a cache. eventually we may want to scan DiskArb's list of volumes
-		if(lastBSDName && CFGetTypeID(lastBSDName) == CFStringGetTypeID()) {
-			CFUUIDRef       dauuid = NULL;
-
-            dauuid = copyVolUUIDFromDiskArb(context, lastBSDName);
-            
-			if(dauuid && CFEqual(uuid, dauuid)) {
+		if(0 == BLVolumeIndexLookup(context, kBLVolumeIndexVolumeUUID, uuid, bsdName, bsdNameLen)) {
+			contextprintf(context, kBLLogLevelVerbose, "Found device: %s\n", bsdName);
+			foundDevice = 1;
+		} else if(lastBSDName) {
+			// no index, or the volume isn't in it. use this as a cache
+			if(volumeMatchesUUID(context, lastBSDName, uuid)) {
 				// found it!
-                CFStringGetCString(lastBSDName, bsdName, 
-                                   bsdNameLen, kCFStringEncodingUTF8);
+                strlcpy(bsdName, lastBSDName, bsdNameLen);
                 
 				contextprintf(context, kBLLogLevelVerbose, "Found device: %s\n", bsdName);
 				foundDevice = 1;		
-				
-				CFRelease(dauuid);
 			}
 		}
     }
     
     if (!foundDevice) {
 		// not present, let's hope the matching dictionary was unique enough
-		CFDictionaryRef iomatch = CFDictionaryGetValue(dict, CFSTR("IOMatch"));
-		if(iomatch && CFGetTypeID(iomatch) == CFDictionaryGetTypeID()) {
+		CFDictionaryRef iomatch = BLEFIXMLScanCopyMatchDictionary(context, scan, index);
+		if(iomatch) {
+			char	nameCString[MNAMELEN];
 			
-			CFRetain(iomatch); // IOServiceGetMatchingService releases 1 ref
-			service = IOServiceGetMatchingService(kIOMasterPortDefault,iomatch);
-			if(service != IO_OBJECT_NULL) {
-				
-				CFStringRef name = NULL;
+			// IOMatchService consumes our reference to iomatch
+			if(0 == lookupMatchInIndex(context, iomatch, nameCString, sizeof(nameCString))
+			   || 0 == IOMatchService(context, iomatch, nameCString, sizeof(nameCString))) {
 				
-				if(!IOObjectConformsTo(service,kIOMediaClass)) {
-					contextprintf(context, kBLLogLevelVerbose, "found service but it is not a media object\n");                            
+				// if we had a volume uuid, validate it!
+				if(uuid) {
+					// we had a UUID, but this disk didn't, or was incorrect
+					foundDevice = volumeMatchesUUID(context, nameCString, uuid);
 				} else {
-                    
-					name = IORegistryEntryCreateCFProperty(service,
-														   CFSTR(kIOBSDNameKey),
-														   kCFAllocatorDefault,
-														   0);
-					if(name && CFGetTypeID(name) == CFStringGetTypeID()) {
-                        // if we had a volume uuid, validate it!
-                        if(uuid) {
-                            CFUUIDRef       dauuid = NULL;
-                            
-                            dauuid = copyVolUUIDFromDiskArb(context, name);
-                            
-                            if(dauuid && CFEqual(uuid, dauuid)) {
-                                foundDevice = 1;		                                
-                                CFRelease(dauuid);
-                            } else {
-                                // we had a UUID, but this disk didn't, or was incorrect
-                                foundDevice = 0;		                                                                
-                            }
-                        } else {
-                            // we don't have a volume UUID, so assume this is enough
-                            foundDevice = 1;
-                        }
-						
-                        if(foundDevice) {
-                            CFStringGetCString(name, bsdName, bsdNameLen, kCFStringEncodingUTF8);
-                            contextprintf(context, kBLLogLevelVerbose, "Found device: %s\n", bsdName);
-                        }
-                    }
-					
-					if(name) CFRelease(name);
+					// we don't have a volume UUID, so assume this is enough
+					foundDevice = 1;
 				}
 				
-				IOObjectRelease(service);
+				if(foundDevice) {
+					strlcpy(bsdName, nameCString, bsdNameLen);
+					contextprintf(context, kBLLogLevelVerbose, "Found device: %s\n", bsdName);
+				}
 			}
 		}
 	}
@@ -279,54 +218,135 @@ static int checkForMatch(BLContextPtr context, CFDictionaryRef dict,
 	}
 }
 
+// the matching dictionaries bless writes for partitions are just
+// { IOProviderClass = IOMedia; IOPropertyMatch = { UUID = ... } },
+// which the volume index can answer without a registry search.
+// iomatch is released if the lookup succeeds
+static int lookupMatchInIndex(BLContextPtr context, CFDictionaryRef iomatch,
+							  char *bsdName, int bsdNameLen)
+{
+	CFTypeRef		providerClass;
+	CFDictionaryRef	propMatch;
+	CFStringRef		uuidString;
+	CFUUIDRef		uuid;
+	int				ret;
+	
+	if(CFDictionaryGetCount(iomatch) != 2)
+		return 1;
+	
+	providerClass = CFDictionaryGetValue(iomatch, CFSTR(kIOProviderClassKey));
+	if(providerClass == NULL || !CFEqual(providerClass, CFSTR(kIOMediaClass)))
+		return 1;
+	
+	propMatch = CFDictionaryGetValue(iomatch, CFSTR(kIOPropertyMatchKey));
+	if(propMatch == NULL || CFGetTypeID(propMatch) != CFDictionaryGetTypeID()
+	   || CFDictionaryGetCount(propMatch) != 1)
+		return 1;
+	
+	uuidString = CFDictionaryGetValue(propMatch, CFSTR(kIOMediaUUIDKey));
+	if(uuidString == NULL || CFGetTypeID(uuidString) != CFStringGetTypeID())
+		return 1;
+	
+	uuid = CFUUIDCreateFromString(kCFAllocatorDefault, uuidString);
+	if(uuid == NULL)
+		return 1;
+	
+	ret = BLVolumeIndexLookup(context, kBLVolumeIndexPartitionUUID, uuid, bsdName, bsdNameLen);
+	CFRelease(uuid);
+	
+	if(ret == 0)
+		CFRelease(iomatch);
+	
+	return ret;
+}
+
+// consumes iomatch
+static int IOMatchService(BLContextPtr context, CFDictionaryRef iomatch,
+						  char *bsdName, int bsdNameLen)
+{
+	io_service_t	service;
+	CFStringRef		name = NULL;
+	int				ret = 1;
+	
+	service = IOServiceGetMatchingService(kIOMasterPortDefault,iomatch);
+	if(service == IO_OBJECT_NULL)
+		return 1;
+	
+	if(!IOObjectConformsTo(service,kIOMediaClass)) {
+		contextprintf(context, kBLLogLevelVerbose, "found service but it is not a media object\n");                            
+	} else {
+		name = IORegistryEntryCreateCFProperty(service,
+											   CFSTR(kIOBSDNameKey),
+											   kCFAllocatorDefault,
+											   0);
+		if(name && CFGetTypeID(name) == CFStringGetTypeID()
+		   && CFStringGetCString(name, bsdName, bsdNameLen, kCFStringEncodingUTF8)) {
+			ret = 0;
+		}
+		
+		if(name) CFRelease(name);
+	}
+	
+	IOObjectRelease(service);
+	
+	return ret;
+}
+
+static int volumeMatchesUUID(BLContextPtr context, const char *bsdName, CFUUIDRef uuid)
+{
+	CFUUIDRef	known;
+	int			matches;
+	
+	known = BLVolumeIndexGetVolumeUUID(context, bsdName);
+	if(known) {
+		return CFEqual(uuid, known);
+	}
+	
+	known = copyVolUUIDFromDiskArb(context, bsdName);
+	matches = known && CFEqual(uuid, known);
+	if(known) CFRelease(known);
+	
+	return matches;
+}
+
 
 
-static int checkForPath(BLContextPtr context, CFDictionaryRef dict,
+static int checkForPath(BLContextPtr context, const BLEFIXMLElement *element,
                         char *path, int pathLen)
 {
-    int         ret = 0;
-    CFStringRef type;
-    CFStringRef pathStr;
+    const char  *type;
+    const char  *pathStr;
     
-    type = CFDictionaryGetValue(dict, CFSTR("IOEFIDevicePathType"));
-    if (type && CFEqual(type, CFSTR("MediaFilePath"))) {
-        pathStr = CFDictionaryGetValue(dict, CFSTR("Path"));
-        if (pathStr && CFGetTypeID(pathStr) == CFStringGetTypeID()) {
-            if (CFStringGetCString(pathStr, path, pathLen, kCFStringEncodingUTF8)) {
-                ret = 1;
-            }
-        }
+    type = BLEFIXMLElementGetString(element, kBLEFIXMLKeyDevicePathType);
+    if (type == NULL || strcmp(type, "MediaFilePath") != 0) {
+        return 0;
     }
-    if (ret) {
-        // Change path separators from EFI to fs representation
-        // Note: we know there's a '\0' before the end of the
-        // buffer (pathLen) because it was successfully converted
-        // by CFStringGetCString, above.
-        for (; *path; path++) {
-            if (*path == '\\') *path = '/';
-        }
+    
+    pathStr = BLEFIXMLElementGetString(element, kBLEFIXMLKeyPath);
+    if (pathStr == NULL || strlcpy(path, pathStr, pathLen) >= pathLen) {
+        return 0;
     }
-    return ret;
+    
+    // Change path separators from EFI to fs representation
+    for (; *path; path++) {
+        if (*path == '\\') *path = '/';
+    }
+    return 1;
 }
 
 
 
 static CFUUIDRef    copyVolUUIDFromDiskArb(BLContextPtr context,
-                                           CFStringRef bsdName)
+                                           const char *bsdName)
 {
     CFUUIDRef       dauuid = NULL;
 #if USE_DISKARBITRATION
     DASessionRef    session = NULL;
     DADiskRef       dadisk = NULL;
-    char			lastBSDNameCString[MNAMELEN];
-    
-    CFStringGetCString(bsdName, lastBSDNameCString, 
-                       sizeof(lastBSDNameCString),kCFStringEncodingUTF8);
-    
     session = DASessionCreate(kCFAllocatorDefault);
     if(session) {
         dadisk = DADiskCreateFromBSDName(kCFAllocatorDefault, session, 
-                                         lastBSDNameCString);
+                                         bsdName);
         if(dadisk) {
             CFDictionaryRef descrip = DADiskCopyDescription(dadisk);
             if(descrip) {
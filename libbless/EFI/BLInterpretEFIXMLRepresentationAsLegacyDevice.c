@@ -30,7 +30,6 @@
  */
 
 #include <IOKit/IOKitLib.h>
-#include <IOKit/IOCFUnserialize.h>
 #include <IOKit/storage/IOMedia.h>
 #include <IOKit/IOBSD.h>
 
@@ -51,7 +50,6 @@ int BLInterpretEFIXMLRepresentationAsLegacyDevice(BLContextPtr context,
 	CFArrayRef  efiArray = NULL;
     CFIndex     count, i;
 	int			ret;
-    char        buffer[1024];
 	int			foundLegacyPath = 0;
 	CFStringRef	legacyType = NULL;
 	
@@ -60,23 +58,9 @@ int BLInterpretEFIXMLRepresentationAsLegacyDevice(BLContextPtr context,
 		return 1;
 	}
 	
-    if(!CFStringGetCString(xmlString, buffer, sizeof(buffer), kCFStringEncodingUTF8)) {
-        return 1;
-    }
-    
-    efiArray = IOCFUnserialize(buffer,
-                               kCFAllocatorDefault,
-                               0,
-                               NULL);
-    if(efiArray == NULL) {
-        contextprintf(context, kBLLogLevelError, "Could not unserialize string\n");
-        return 2;
-    }
-    
-    if(CFGetTypeID(efiArray) != CFArrayGetTypeID()) {
-        CFRelease(efiArray);
-        contextprintf(context, kBLLogLevelError, "Bad type in XML string\n");
-        return 2;        
+    ret = BLEFIXMLCopyArray(context, xmlString, &efiArray);
+    if(ret) {
+        return ret;
     }
     
     // for each entry, see if there's a volume UUID, or if IOMatch works
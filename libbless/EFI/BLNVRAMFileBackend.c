@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLNVRAMFileBackend.c
+//
+//  NVRAM backend over a recorded variable store: a property list
+//  dictionary of variable name to value, in the format written by
+//  "nvram -xp". Writes go straight back to the file, so the store
+//  stays consistent even if the caller exits without closing it.
+//  Like the rest of the EFI path it needs CoreFoundation, so it runs
+//  against a recorded store on macOS, not off a Mac.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+typedef struct {
+	char					path[MAXPATHLEN];
+	CFMutableDictionaryRef	vars;
+} BLNVRAMFileState;
+
+static int _fileWrite(BLContextPtr context, BLNVRAMFileState *fstate);
+
+static int _fileOpen(BLContextPtr context, const char *location, void **state)
+{
+	BLNVRAMFileState	*fstate;
+	CFMutableDataRef	data = NULL;
+	CFPropertyListRef	plist = NULL;
+	struct stat			sb;
+	ssize_t				bytesRead;
+	int					fd;
+
+	if (location == NULL) {
+		contextprintf(context, kBLLogLevelError, "No NVRAM store file given\n");
+		return 1;
+	}
+
+	fstate = calloc(1, sizeof(*fstate));
+	if (fstate == NULL) return 2;
+
+	if (strlcpy(fstate->path, location, sizeof fstate->path) >= sizeof fstate->path) {
+		contextprintf(context, kBLLogLevelError, "NVRAM store path too long\n");
+		free(fstate);
+		return 1;
+	}
+
+	fd = open(location, O_RDONLY);
+	if (fd < 0 && errno == ENOENT) {
+		// start with an empty store, created on first write
+		contextprintf(context, kBLLogLevelVerbose, "NVRAM store %s does not exist, starting empty\n", location);
+		fstate->vars = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+												 &kCFTypeDictionaryKeyCallBacks,
+												 &kCFTypeDictionaryValueCallBacks);
+		if (fstate->vars == NULL) {
+			free(fstate);
+			return 2;
+		}
+		*state = fstate;
+		return 0;
+	}
+
+	if (fd < 0 || fstat(fd, &sb) < 0) {
+		contextprintf(context, kBLLogLevelError, "Can't open NVRAM store %s: %s\n", location, strerror(errno));
+		if (fd >= 0) close(fd);
+		free(fstate);
+		return 1;
+	}
+
+	data = CFDataCreateMutable(kCFAllocatorDefault, sb.st_size);
+	if (data == NULL) {
+		close(fd);
+		free(fstate);
+		return 2;
+	}
+	CFDataSetLength(data, sb.st_size);
+
+	bytesRead = pread(fd, CFDataGetMutableBytePtr(data), sb.st_size, 0);
+	close(fd);
+	if (bytesRead != sb.st_size) {
+		contextprintf(context, kBLLogLevelError, "Can't read NVRAM store %s\n", location);
+		CFRelease(data);
+		free(fstate);
+		return 1;
+	}
+
+	plist = CFPropertyListCreateWithData(kCFAllocatorDefault, data, kCFPropertyListImmutable, NULL, NULL);
+	CFRelease(data);
+	if (plist == NULL || CFGetTypeID(plist) != CFDictionaryGetTypeID()) {
+		contextprintf(context, kBLLogLevelError, "NVRAM store %s is not a property list dictionary\n", location);
+		if (plist) CFRelease(plist);
+		free(fstate);
+		return 3;
+	}
+
+	fstate->vars = CFDictionaryCreateMutableCopy(kCFAllocatorDefault, 0, plist);
+	CFRelease(plist);
+	if (fstate->vars == NULL) {
+		free(fstate);
+		return 2;
+	}
+
+	contextprintf(context, kBLLogLevelVerbose, "Loaded %ld variables from NVRAM store %s\n",
+				  (long)CFDictionaryGetCount(fstate->vars), location);
+
+	*state = fstate;
+
+	return 0;
+}
+
+static void _fileClose(BLContextPtr context, void *state)
+{
+	BLNVRAMFileState *fstate = state;
+
+	CFRelease(fstate->vars);
+	free(fstate);
+}
+
+static int _fileCopyValue(BLContextPtr context, void *state, CFStringRef name, CFTypeRef *value)
+{
+	BLNVRAMFileState	*fstate = state;
+	CFTypeRef			val;
+
+	val = CFDictionaryGetValue(fstate->vars, name);
+	*value = val ? CFRetain(val) : NULL;
+
+	return 0;
+}
+
+static int _fileSetValue(BLContextPtr context, void *state, CFStringRef name, CFTypeRef value)
+{
+	BLNVRAMFileState *fstate = state;
+
+	CFDictionarySetValue(fstate->vars, name, value);
+
+	return _fileWrite(context, fstate);
+}
+
+static int _fileDeleteValue(BLContextPtr context, void *state, CFStringRef name)
+{
+	BLNVRAMFileState *fstate = state;
+
+	if (!CFDictionaryContainsKey(fstate->vars, name)) return 0;
+
+	CFDictionaryRemoveValue(fstate->vars, name);
+
+	return _fileWrite(context, fstate);
+}
+
+// replace the store atomically and durably, so neither a reader nor a
+// crash ever leaves a partial file
+static int _fileWrite(BLContextPtr context, BLNVRAMFileState *fstate)
+{
+	CFDataRef		data;
+	char			tmpPath[MAXPATHLEN];
+	int				fd;
+	const UInt8		*bytes;
+	CFIndex			remaining;
+	ssize_t			written = 0;
+
+	data = CFPropertyListCreateData(kCFAllocatorDefault, fstate->vars,
+									kCFPropertyListXMLFormat_v1_0, 0, NULL);
+	if (data == NULL) {
+		contextprintf(context, kBLLogLevelError, "Can't serialize NVRAM store\n");
+		return 2;
+	}
+
+	snprintf(tmpPath, sizeof tmpPath, "%s.XXXXXX", fstate->path);
+	fd = mkstemp(tmpPath);
+	if (fd < 0) {
+		contextprintf(context, kBLLogLevelError, "Can't create %s: %s\n", tmpPath, strerror(errno));
+		CFRelease(data);
+		return 3;
+	}
+
+	bytes = CFDataGetBytePtr(data);
+	for (remaining = CFDataGetLength(data); remaining > 0; remaining -= written, bytes += written) {
+		written = write(fd, bytes, remaining);
+		if (written < 0 && errno == EINTR) {
+			written = 0;
+			continue;
+		}
+		if (written <= 0) {
+			if (written == 0) errno = EIO;
+			break;
+		}
+	}
+	if (remaining > 0) {
+		contextprintf(context, kBLLogLevelError, "Can't write NVRAM store %s: %s\n", fstate->path, strerror(errno));
+		close(fd);
+		unlink(tmpPath);
+		CFRelease(data);
+		return 3;
+	}
+	CFRelease(data);
+
+	// the new store has to be on the disk before it replaces the old one,
+	// or a crash could leave an empty file behind
+	if (BLFullSync(context, fd, tmpPath)) {
+		close(fd);
+		unlink(tmpPath);
+		return 3;
+	}
+	close(fd);
+
+	if (rename(tmpPath, fstate->path) < 0) {
+		contextprintf(context, kBLLogLevelError, "Can't write NVRAM store %s: %s\n", fstate->path, strerror(errno));
+		unlink(tmpPath);
+		return 3;
+	}
+
+	// and the rename has to survive a crash too
+	return BLSyncParentDirectory(context, fstate->path) ? 3 : 0;
+}
+const BLNVRAMBackend kBLNVRAMBackendFile = {
+	.version		= 0,
+	.name			= "file",
+	.open			= _fileOpen,
+	.close			= _fileClose,
+	.copyValue		= _fileCopyValue,
+	.setValue		= _fileSetValue,
+	.deleteValue	= _fileDeleteValue,
+};
@@ -0,0 +1,558 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLNVRAMSession.c
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <IOKit/IOKitLib.h>
+#include <IOKit/IOKitKeys.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+struct BLNVRAMSession {
+	const BLNVRAMBackend	*backend;
+	char					*location;
+	void					*state;
+	bool					isOpen;
+
+	// name -> value; kCFNull records a variable known to be unset
+	CFMutableDictionaryRef	cache;
+
+	// open write set: name -> value, kCFNull for a delete, applied in
+	// the order the names were first staged
+	int						writeSetDepth;
+	bool					writeSetDiscarded;	// until the outermost level ends
+	CFMutableDictionaryRef	staged;
+	CFMutableArrayRef		stagedOrder;
+
+	uint32_t				lookups;
+	uint32_t				backendReads;
+	uint32_t				writes;
+	uint32_t				deletes;
+	uint32_t				unchanged;
+	uint32_t				commits;
+};
+
+static BLNVRAMSessionRef _contextSession(BLContextPtr context);
+static int _openSession(BLContextPtr context, BLNVRAMSessionRef session);
+static int _beginAccess(BLContextPtr context, BLNVRAMSessionRef *session, bool *transient);
+static void _endAccess(BLContextPtr context, BLNVRAMSessionRef session, bool transient);
+static bool _isStaging(BLContextPtr context, BLNVRAMSessionRef *session);
+static int _stage(BLContextPtr context, BLNVRAMSessionRef session, CFStringRef name, CFTypeRef value);
+static int _flush(BLContextPtr context, BLNVRAMSessionRef session);
+
+int BLNVRAMSessionCreate(BLContextPtr context, const BLNVRAMBackend *backend,
+						 const char *location, BLNVRAMSessionRef *session)
+{
+	BLNVRAMSessionRef	newSession;
+
+	*session = NULL;
+
+	if (backend == NULL || backend->version != 0) {
+		contextprintf(context, kBLLogLevelError, "Unsupported NVRAM backend\n");
+		return 1;
+	}
+
+	newSession = calloc(1, sizeof(*newSession));
+	if (newSession == NULL) {
+		return 2;
+	}
+
+	newSession->backend = backend;
+	if (location) {
+		newSession->location = strdup(location);
+		if (newSession->location == NULL) {
+			free(newSession);
+			return 2;
+		}
+	}
+
+	newSession->cache = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+												  &kCFTypeDictionaryKeyCallBacks,
+												  &kCFTypeDictionaryValueCallBacks);
+	newSession->staged = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+												   &kCFTypeDictionaryKeyCallBacks,
+												   &kCFTypeDictionaryValueCallBacks);
+	newSession->stagedOrder = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+	if (newSession->cache == NULL || newSession->staged == NULL || newSession->stagedOrder == NULL) {
+		if (newSession->cache) CFRelease(newSession->cache);
+		if (newSession->staged) CFRelease(newSession->staged);
+		if (newSession->stagedOrder) CFRelease(newSession->stagedOrder);
+		free(newSession->location);
+		free(newSession);
+		return 2;
+	}
+
+	// the store itself is opened on first access, so that a session
+	// costs nothing for invocations which never touch NVRAM
+	*session = newSession;
+
+	return 0;
+}
+
+void BLNVRAMSessionRelease(BLContextPtr context, BLNVRAMSessionRef session)
+{
+	if (session == NULL) return;
+
+	if (CFArrayGetCount(session->stagedOrder) > 0) {
+		contextprintf(context, kBLLogLevelVerbose, "Discarding %ld uncommitted NVRAM changes\n",
+					  (long)CFArrayGetCount(session->stagedOrder));
+	}
+
+	if (session->isOpen) {
+		contextprintf(context, kBLLogLevelVerbose,
+					  "NVRAM session (%s): %u lookups, %u backend reads, %u writes, %u deletes, "
+					  "%u unchanged, %u commits\n",
+					  session->backend->name, session->lookups, session->backendReads,
+					  session->writes, session->deletes, session->unchanged, session->commits);
+		session->backend->close(context, session->state);
+	}
+
+	CFRelease(session->cache);
+	CFRelease(session->staged);
+	CFRelease(session->stagedOrder);
+	free(session->location);
+	free(session);
+}
+
+int BLNVRAMCopyValue(BLContextPtr context, CFStringRef name, CFTypeRef *value)
+{
+	BLNVRAMSessionRef	session;
+	bool				transient;
+	CFTypeRef			cached;
+	int					ret;
+
+	*value = NULL;
+
+	// reads see the write set
+	if (_isStaging(context, &session)) {
+		cached = CFDictionaryGetValue(session->staged, name);
+		if (cached) {
+			if (cached != kCFNull) {
+				*value = CFRetain(cached);
+			}
+			return 0;
+		}
+	}
+
+	ret = _beginAccess(context, &session, &transient);
+	if (ret) return ret;
+
+	session->lookups++;
+
+	cached = CFDictionaryGetValue(session->cache, name);
+	if (cached) {
+		if (cached != kCFNull) {
+			*value = CFRetain(cached);
+		}
+		_endAccess(context, session, transient);
+		return 0;
+	}
+
+	session->backendReads++;
+	ret = session->backend->copyValue(context, session->state, name, value);
+	if (ret == 0) {
+		CFDictionarySetValue(session->cache, name, *value ? *value : kCFNull);
+	}
+
+	_endAccess(context, session, transient);
+
+	return ret;
+}
+
+int BLNVRAMSetValue(BLContextPtr context, CFStringRef name, CFTypeRef value)
+{
+	BLNVRAMSessionRef	session;
+	bool				transient;
+	int					ret;
+
+	if (_isStaging(context, &session)) {
+		return _stage(context, session, name, value);
+	}
+
+	if (BLPlanIsRecording(context)) {
+		// later reads in this run see the planned value
+		if (session) CFDictionarySetValue(session->cache, name, value);
+		return BLPlanRecordNVRAM(context, name, value);
+	}
+
+	ret = _beginAccess(context, &session, &transient);
+	if (ret) return ret;
+
+	session->writes++;
+	ret = session->backend->setValue(context, session->state, name, value);
+
+	// the firmware store may derive other variables from this one
+	// (efi-boot-device-data, Boot####), so nothing cached can be trusted
+	CFDictionaryRemoveAllValues(session->cache);
+
+	_endAccess(context, session, transient);
+
+	return ret;
+}
+
+int BLNVRAMDeleteValue(BLContextPtr context, CFStringRef name)
+{
+	BLNVRAMSessionRef	session;
+	bool				transient;
+	int					ret;
+
+	if (_isStaging(context, &session)) {
+		return _stage(context, session, name, kCFNull);
+	}
+
+	if (BLPlanIsRecording(context)) {
+		if (session) CFDictionarySetValue(session->cache, name, kCFNull);
+		return BLPlanRecordNVRAM(context, name, NULL);
+	}
+
+	ret = _beginAccess(context, &session, &transient);
+	if (ret) return ret;
+
+	session->deletes++;
+	ret = session->backend->deleteValue(context, session->state, name);
+	CFDictionaryRemoveAllValues(session->cache);
+
+	_endAccess(context, session, transient);
+
+	return ret;
+}
+
+int BLNVRAMWriteSetBegin(BLContextPtr context)
+{
+	BLNVRAMSessionRef session = _contextSession(context);
+
+	// without a session every write goes straight through
+	if (session) session->writeSetDepth++;
+
+	return 0;
+}
+
+int BLNVRAMWriteSetFlush(BLContextPtr context)
+{
+	BLNVRAMSessionRef session = _contextSession(context);
+
+	if (session == NULL) return 0;
+	if (session->writeSetDiscarded) return 1;
+
+	return _flush(context, session);
+}
+
+int BLNVRAMWriteSetCommit(BLContextPtr context)
+{
+	BLNVRAMSessionRef	session = _contextSession(context);
+	uint32_t			writes, deletes, unchanged;
+	int					ret;
+
+	if (session == NULL || session->writeSetDepth == 0) return 0;
+
+	// a discarded set fails at every level, and writes nothing
+	if (session->writeSetDiscarded) {
+		if (--session->writeSetDepth == 0) session->writeSetDiscarded = false;
+		return 1;
+	}
+
+	// nested sets are committed by the outermost one
+	if (--session->writeSetDepth > 0) return 0;
+
+	writes = session->writes;
+	deletes = session->deletes;
+	unchanged = session->unchanged;
+
+	ret = _flush(context, session);
+	session->commits++;
+
+	contextprintf(context, kBLLogLevelVerbose,
+				  "NVRAM commit: %u writes, %u deletes, %u unchanged\n",
+				  session->writes - writes, session->deletes - deletes,
+				  session->unchanged - unchanged);
+
+	return ret;
+}
+
+void BLNVRAMWriteSetDiscard(BLContextPtr context)
+{
+	BLNVRAMSessionRef session = _contextSession(context);
+
+	if (session == NULL || session->writeSetDepth == 0) return;
+
+	// a failure anywhere abandons the whole set, outer levels included:
+	// they stay open, but refuse further writes and fail to commit
+	session->writeSetDepth--;
+	session->writeSetDiscarded = (session->writeSetDepth > 0);
+	CFDictionaryRemoveAllValues(session->staged);
+	CFArrayRemoveAllValues(session->stagedOrder);
+}
+
+static bool _isStaging(BLContextPtr context, BLNVRAMSessionRef *session)
+{
+	*session = _contextSession(context);
+
+	return *session && (*session)->writeSetDepth > 0;
+}
+
+static int _stage(BLContextPtr context, BLNVRAMSessionRef session, CFStringRef name, CFTypeRef value)
+{
+	if (session->writeSetDiscarded) {
+		contextprintf(context, kBLLogLevelError, "NVRAM write set was discarded; not writing %s\n",
+					  BLGetCStringDescription(name));
+		return 1;
+	}
+	if (!CFDictionaryContainsKey(session->staged, name)) {
+		CFArrayAppendValue(session->stagedOrder, name);
+	}
+	CFDictionarySetValue(session->staged, name, value);
+
+	return 0;
+}
+
+// string variables may come back from the store as data
+static bool _valuesEqual(CFTypeRef current, CFTypeRef value)
+{
+	CFStringRef	string;
+	CFDataRef	data;
+	CFDataRef	stringBytes;
+	CFIndex		length;
+	bool		equal;
+
+	if (CFEqual(current, value)) return true;
+
+	if (CFGetTypeID(current) == CFStringGetTypeID() && CFGetTypeID(value) == CFDataGetTypeID()) {
+		string = current;
+		data = value;
+	} else if (CFGetTypeID(current) == CFDataGetTypeID() && CFGetTypeID(value) == CFStringGetTypeID()) {
+		string = value;
+		data = current;
+	} else {
+		return false;
+	}
+
+	stringBytes = CFStringCreateExternalRepresentation(kCFAllocatorDefault, string, kCFStringEncodingUTF8, 0);
+	if (stringBytes == NULL) return false;
+
+	length = CFDataGetLength(data);
+	if (length > 0 && CFDataGetBytePtr(data)[length-1] == '\0') length--;
+
+	equal = (length == CFDataGetLength(stringBytes)
+			 && 0 == memcmp(CFDataGetBytePtr(data), CFDataGetBytePtr(stringBytes), length));
+	CFRelease(stringBytes);
+
+	return equal;
+}
+
+/*
+ * The firmware deletes BootNext once it has booted from it, but leaves
+ * efi-boot-next alone, so an unchanged efi-boot-next only means the
+ * one-shot boot is still pending while BootNext is there too.
+ */
+static bool _bootNextPending(BLContextPtr context)
+{
+	CFTypeRef	bootNext = NULL;
+
+	if (BLNVRAMCopyValue(context, CFSTR(kBL_GLOBAL_NVRAM_GUID ":BootNext"), &bootNext) || bootNext == NULL) {
+		return false;
+	}
+	CFRelease(bootNext);
+
+	return true;
+}
+
+static int _flush(BLContextPtr context, BLNVRAMSessionRef session)
+{
+	CFMutableArrayRef	order;
+	CFIndex				i, count;
+	int					ret = 0;
+
+	count = CFArrayGetCount(session->stagedOrder);
+	if (count == 0) return 0;
+
+	// take the set, so the reads and writes below go to the store
+	order = session->stagedOrder;
+	session->stagedOrder = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+	session->writeSetDepth = -session->writeSetDepth;
+
+	for (i = 0; i < count && ret == 0; i++) {
+		CFStringRef	name = CFArrayGetValueAtIndex(order, i);
+		CFTypeRef	value = CFDictionaryGetValue(session->staged, name);
+		CFTypeRef	current = NULL;
+		bool		unchanged;
+
+		ret = BLNVRAMCopyValue(context, name, &current);
+		if (ret) break;
+
+		unchanged = value == kCFNull ? current == NULL : (current && _valuesEqual(current, value));
+		if (unchanged && value != kCFNull && CFEqual(name, CFSTR("efi-boot-next"))) {
+			unchanged = _bootNextPending(context);
+		}
+
+		if (unchanged) {
+			contextprintf(context, kBLLogLevelVerbose, "NVRAM variable '%s' unchanged, skipping\n",
+						  BLGetCStringDescription(name));
+			session->unchanged++;
+		} else if (value == kCFNull) {
+			ret = BLNVRAMDeleteValue(context, name);
+		} else {
+			ret = BLNVRAMSetValue(context, name, value);
+		}
+
+		if (current) CFRelease(current);
+	}
+
+	session->writeSetDepth = -session->writeSetDepth;
+	CFDictionaryRemoveAllValues(session->staged);
+	CFRelease(order);
+
+	return ret;
+}
+
+static BLNVRAMSessionRef _contextSession(BLContextPtr context)
+{
+	if (context && context->version >= kBLContextVersionNVRAMSession) {
+		return context->nvram;
+	}
+
+	return NULL;
+}
+
+static int _openSession(BLContextPtr context, BLNVRAMSessionRef session)
+{
+	int ret;
+
+	if (session->isOpen) return 0;
+
+	ret = session->backend->open(context, session->location, &session->state);
+	if (ret) return ret;
+
+	session->isOpen = true;
+
+	return 0;
+}
+
+static int _beginAccess(BLContextPtr context, BLNVRAMSessionRef *session, bool *transient)
+{
+	int ret;
+
+	*session = _contextSession(context);
+	*transient = false;
+
+	if (*session == NULL) {
+		// legacy behavior: open IODeviceTree:/options for this access only
+		ret = BLNVRAMSessionCreate(context, &kBLNVRAMBackendIOKit, NULL, session);
+		if (ret) return ret;
+		*transient = true;
+	}
+
+	ret = _openSession(context, *session);
+	if (ret) {
+		if (*transient) {
+			BLNVRAMSessionRelease(context, *session);
+		}
+		*session = NULL;
+		return ret;
+	}
+
+	return 0;
+}
+
+static void _endAccess(BLContextPtr context, BLNVRAMSessionRef session, bool transient)
+{
+	if (transient) {
+		session->backend->close(context, session->state);
+		session->isOpen = false;
+		BLNVRAMSessionRelease(context, session);
+	}
+}
+
+
+// IOKit backend: IODeviceTree:/options
+
+static int _iokitOpen(BLContextPtr context, const char *location, void **state)
+{
+	io_registry_entry_t optionsNode;
+
+	optionsNode = IORegistryEntryFromPath(kIOMasterPortDefault, kIODeviceTreePlane ":/options");
+
+	if (IO_OBJECT_NULL == optionsNode) {
+		contextprintf(context, kBLLogLevelError,  "Could not find " kIODeviceTreePlane ":/options\n");
+		return 1;
+	}
+
+	*state = (void *)(uintptr_t)optionsNode;
+
+	return 0;
+}
+
+static void _iokitClose(BLContextPtr context, void *state)
+{
+	IOObjectRelease((io_registry_entry_t)(uintptr_t)state);
+}
+
+static int _iokitCopyValue(BLContextPtr context, void *state, CFStringRef name, CFTypeRef *value)
+{
+	*value = IORegistryEntryCreateCFProperty((io_registry_entry_t)(uintptr_t)state,
+											 name, kCFAllocatorDefault, 0);
+	return 0;
+}
+
+static int _iokitSetValue(BLContextPtr context, void *state, CFStringRef name, CFTypeRef value)
+{
+	kern_return_t kret;
+
+	kret = IORegistryEntrySetCFProperty((io_registry_entry_t)(uintptr_t)state, name, value);
+	if (kret) {
+		contextprintf(context, kBLLogLevelError,  "Could not set NVRAM variable '%s': %#x\n",
+					  BLGetCStringDescription(name), kret);
+		return 2;
+	}
+
+	return 0;
+}
+
+static int _iokitDeleteValue(BLContextPtr context, void *state, CFStringRef name)
+{
+	kern_return_t kret;
+
+	kret = IORegistryEntrySetCFProperty((io_registry_entry_t)(uintptr_t)state,
+										CFSTR(kIONVRAMDeletePropertyKey), name);
+	if (kret) {
+		contextprintf(context, kBLLogLevelError,  "Could not delete NVRAM variable '%s': %#x\n",
+					  BLGetCStringDescription(name), kret);
+		return 2;
+	}
+
+	return 0;
+}
+
+const BLNVRAMBackend kBLNVRAMBackendIOKit = {
+	.version		= 0,
+	.name			= "IOKit",
+	.open			= _iokitOpen,
+	.close			= _iokitClose,
+	.copyValue		= _iokitCopyValue,
+	.setValue		= _iokitSetValue,
+	.deleteValue	= _iokitDeleteValue,
+};
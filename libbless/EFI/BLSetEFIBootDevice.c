@@ -73,11 +73,47 @@ BLSetEFIBootFileOnce(BLContextPtr context, char *path)
  * private entry points (bless_private.h)
  */
 
-// one static helper (defined at the bottom of this file)
+// static helpers (defined below)
 static int setefibootargs(BLContextPtr context, mach_port_t masterPort);
-
+static int _setefidevice(BLContextPtr context, const char * bsdname, int bootNext,
+						 int bootLegacy, const char *legacyHint, const char *optionalData, bool shortForm);
+static int _setefifilepath(BLContextPtr context, const char *path, int bootNext,
+						   const char *optionalData, bool shortForm);
+static int _setefinetworkpath(BLContextPtr context, CFStringRef booterXML,
+							  CFStringRef kernelXML, CFStringRef mkextXML,
+							  CFStringRef kernelcacheXML, int bootNext);
+static int _endWriteSet(BLContextPtr context, int ret);
+
+// Each of these stages its NVRAM changes and commits them together,
+// so re-blessing the current target writes nothing, unless it asks for
+// a one-shot boot the firmware has already used.
 int setefidevice(BLContextPtr context, const char * bsdname, int bootNext,
 				 int bootLegacy, const char *legacyHint, const char *optionalData, bool shortForm)
+{
+	BLNVRAMWriteSetBegin(context);
+	return _endWriteSet(context, _setefidevice(context, bsdname, bootNext, bootLegacy,
+											   legacyHint, optionalData, shortForm));
+}
+
+int setefifilepath(BLContextPtr context, const char *path, int bootNext,
+				   const char *optionalData, bool shortForm)
+{
+	BLNVRAMWriteSetBegin(context);
+	return _endWriteSet(context, _setefifilepath(context, path, bootNext, optionalData, shortForm));
+}
+
+// no BLSet...() wrapper yet
+int setefinetworkpath(BLContextPtr context, CFStringRef booterXML,
+					  CFStringRef kernelXML, CFStringRef mkextXML,
+					  CFStringRef kernelcacheXML, int bootNext)
+{
+	BLNVRAMWriteSetBegin(context);
+	return _endWriteSet(context, _setefinetworkpath(context, booterXML, kernelXML, mkextXML,
+													kernelcacheXML, bootNext));
+}
+
+static int _setefidevice(BLContextPtr context, const char * bsdname, int bootNext,
+						 int bootLegacy, const char *legacyHint, const char *optionalData, bool shortForm)
 {
     int ret;
     
@@ -103,6 +139,10 @@ int setefidevice(BLContextPtr context, const char * bsdname, int bootNext,
             ret = setit(context, kIOMasterPortDefault, "efi-legacy-drive-hint", xmlString);    
             if(ret) return ret;
 
+            // the -data variable only appears once the hint is really written
+            ret = BLNVRAMWriteSetFlush(context);
+            if(ret) return ret;
+
             ret = _forwardNVRAM(context, CFSTR("efi-legacy-drive-hint-data"), CFSTR("BootCampHD"));
             if(ret) return ret;     
             
@@ -122,9 +162,7 @@ int setefidevice(BLContextPtr context, const char * bsdname, int bootNext,
         
         CFStringRef firstBooter = NULL;
         CFStringRef firstData = NULL;
-        int         uefiDiscBootEntry = 0;
-        int         uefiDiscPartitionStart = 0;
-        int         uefiDiscPartitionSize = 0;
+        BLElToritoCatalog *uefiDiscCatalog = NULL;
 		CFStringRef firstVolume = NULL;
 		char        prebootBSD[64];
 		char		prebootPath[MAXPATHLEN];
@@ -138,8 +176,8 @@ int setefidevice(BLContextPtr context, const char * bsdname, int bootNext,
         
         // first check to see if we are dealing with a disk that has the following properties:
         // is optical AND is DVD AND has an El Torito Boot Catalog AND has an UEFI-bootable entry.
-        // get yes/no on that, and if yes, also get some facts about where on disc it is.
-        bool isUEFIDisc = isDVDWithElToritoWithUEFIBootableOS(context, newBSDName, &uefiDiscBootEntry, &uefiDiscPartitionStart, &uefiDiscPartitionSize);
+        // get yes/no on that, and if yes, also get its decoded boot catalog.
+        bool isUEFIDisc = isDVDWithElToritoWithUEFIBootableOS(context, newBSDName, &uefiDiscCatalog);
         
         if (isUEFIDisc) {
             contextprintf(context, kBLLogLevelVerbose, "Disk is DVD disc with BootCatalog with UEFIBootableOS\n");
@@ -308,12 +346,10 @@ int setefidevice(BLContextPtr context, const char * bsdname, int bootNext,
 															 &xmlString,
 															 shortForm);
 		} else if (isUEFIDisc) {
-			ret = BLCreateEFIXMLRepresentationForElToritoEntry(context,
-															   newBSDName,
-															   uefiDiscBootEntry,
-															   uefiDiscPartitionStart,
-															   uefiDiscPartitionSize,
-															   &xmlString);
+			ret = BLCreateEFIXMLRepresentationForElToritoCatalog(context,
+																 newBSDName,
+																 uefiDiscCatalog,
+																 &xmlString);
         } else {
 			ret = BLCreateEFIXMLRepresentationForDevice(context,
 														newBSDName,
@@ -324,6 +360,8 @@ int setefidevice(BLContextPtr context, const char * bsdname, int bootNext,
         
         if (dict)
             CFRelease(dict);
+        if (uefiDiscCatalog)
+            BLElToritoCatalogRelease(uefiDiscCatalog);
 	}
     
     if(ret) {
@@ -347,8 +385,8 @@ int setefidevice(BLContextPtr context, const char * bsdname, int bootNext,
     return ret;
 }
 
-int setefifilepath(BLContextPtr context, const char *path, int bootNext,
-				   const char *optionalData, bool shortForm)
+static int _setefifilepath(BLContextPtr context, const char *path, int bootNext,
+						   const char *optionalData, bool shortForm)
 {
     CFStringRef xmlString = NULL;
     const char *bootString = NULL;
@@ -377,9 +415,7 @@ int setefifilepath(BLContextPtr context, const char *path, int bootNext,
     CFStringRef firstVolume = NULL;
 	char        prebootBSD[64];
 	char        *partialPath;
-    int         uefiDiscBootEntry = 0;
-    int         uefiDiscPartitionStart = 0;
-    int         uefiDiscPartitionSize = 0;
+    BLElToritoCatalog *uefiDiscCatalog = NULL;
 	char		prebootPath[MAXPATHLEN];
 	char		prebootMountPoint[MAXPATHLEN];
 	bool        mustUnmount = false;
@@ -390,8 +426,8 @@ int setefifilepath(BLContextPtr context, const char *path, int bootNext,
     
     // first check to see if we are dealing with a disk that has the following properties:
     // is optical AND is DVD AND has an El Torito Boot Catalog AND has an UEFI-bootable entry.
-    // get yes/no on that, and if yes, also get some facts about where on disc it is.
-    bool isUEFIDisc = isDVDWithElToritoWithUEFIBootableOS(context, newBSDName, &uefiDiscBootEntry, &uefiDiscPartitionStart, &uefiDiscPartitionSize);
+    // get yes/no on that, and if yes, also get its decoded boot catalog.
+    bool isUEFIDisc = isDVDWithElToritoWithUEFIBootableOS(context, newBSDName, &uefiDiscCatalog);
     
     if (isUEFIDisc) {
         contextprintf(context, kBLLogLevelVerbose, "Disk is DVD disc with BootCatalog with UEFIBootableOS\n");
@@ -565,12 +601,10 @@ int setefifilepath(BLContextPtr context, const char *path, int bootNext,
                                                     &xmlString,
                                                     shortForm);
     } else if (isUEFIDisc) {
-        ret = BLCreateEFIXMLRepresentationForElToritoEntry(context,
-                                                           newBSDName,
-                                                           uefiDiscBootEntry,
-                                                           uefiDiscPartitionStart,
-                                                           uefiDiscPartitionSize,
-                                                           &xmlString);
+        ret = BLCreateEFIXMLRepresentationForElToritoCatalog(context,
+                                                             newBSDName,
+                                                             uefiDiscCatalog,
+                                                             &xmlString);
     } else if (firstVolume) {
         ret = BLCreateEFIXMLRepresentationForPartialPath(context,
                                                          prebootBSD,
@@ -588,6 +622,8 @@ int setefifilepath(BLContextPtr context, const char *path, int bootNext,
     
     if (dict)
         CFRelease (dict);
+    if (uefiDiscCatalog)
+        BLElToritoCatalogRelease(uefiDiscCatalog);
     
     if(ret) {
         return 1;
@@ -611,10 +647,9 @@ int setefifilepath(BLContextPtr context, const char *path, int bootNext,
     return 0;
 }
 
-// no BLSet...() wrapper yet
-int setefinetworkpath(BLContextPtr context, CFStringRef booterXML,
-					  CFStringRef kernelXML, CFStringRef mkextXML,
-					  CFStringRef kernelcacheXML, int bootNext)
+static int _setefinetworkpath(BLContextPtr context, CFStringRef booterXML,
+							  CFStringRef kernelXML, CFStringRef mkextXML,
+							  CFStringRef kernelcacheXML, int bootNext)
 {
     const char *bootString = NULL;
     int ret;
@@ -656,6 +691,7 @@ int setefinetworkpath(BLContextPtr context, CFStringRef booterXML,
     return 0;
 }
 
+// inside a write set, deletes of variables that are already unset are dropped
 int efinvramcleanup(BLContextPtr context)
 {
 	int ret;
@@ -681,19 +717,19 @@ int efinvramcleanup(BLContextPtr context)
 int _forwardNVRAM(BLContextPtr context, CFStringRef from, CFStringRef to)
 {
     
-    io_registry_entry_t optionsNode = 0;
     CFTypeRef       valRef;
-    kern_return_t   kret;
+    int             ret;
     
-    optionsNode = IORegistryEntryFromPath(kIOMasterPortDefault, kIODeviceTreePlane ":/options");
+    // the store hasn't derived the source variable yet
+    if(BLPlanIsRecording(context)) {
+        return BLPlanRecordNVRAMForward(context, from, to);
+    }
     
-    if(IO_OBJECT_NULL == optionsNode) {
-        contextprintf(context, kBLLogLevelError,  "Could not find " kIODeviceTreePlane ":/options\n");
+    ret = BLNVRAMCopyValue(context, from, &valRef);
+    if(ret) {
         return 1;
     }
     
-    valRef = IORegistryEntryCreateCFProperty(optionsNode, from, kCFAllocatorDefault, 0);
-    
     if(valRef == NULL) {
         contextprintf(context, kBLLogLevelError,  "Could not find variable '%s'\n",
                                                     BLGetCStringDescription(from));
@@ -703,58 +739,54 @@ int _forwardNVRAM(BLContextPtr context, CFStringRef from, CFStringRef to)
     contextprintf(context, kBLLogLevelVerbose,  "Setting EFI NVRAM:\n" );
     contextprintf(context, kBLLogLevelVerbose,  "\t%s='...'\n", BLGetCStringDescription(to) );
 
-    kret = IORegistryEntrySetCFProperty(optionsNode, to, valRef);
-    if(kret) {
-        CFRelease(valRef);
-        IOObjectRelease(optionsNode);
-        contextprintf(context, kBLLogLevelError,  "Could not set boot property '%s': %#x\n",
-                                                        BLGetCStringDescription(to),
-                                                        kret);
+    ret = BLNVRAMSetValue(context, to, valRef);
+    CFRelease(valRef);    
+    if(ret) {
+        contextprintf(context, kBLLogLevelError,  "Could not set boot property '%s'\n",
+                                                        BLGetCStringDescription(to));
         return 3;        
     }
 
-    CFRelease(valRef);    
-    IOObjectRelease(optionsNode);
-
     return 0;
 }
 
+// masterPort is unused; NVRAM is reached through the context's session
 int setit(BLContextPtr context, mach_port_t masterPort, const char *bootvar, CFStringRef xmlstring)
 {
     
-    io_registry_entry_t optionsNode = 0;
     CFStringRef bootName = NULL;
-    kern_return_t kret;
+    int     ret;
     char    cStr[1024];
 
-    optionsNode = IORegistryEntryFromPath(masterPort, kIODeviceTreePlane ":/options");
-    
-    if(IO_OBJECT_NULL == optionsNode) {
-        contextprintf(context, kBLLogLevelError,  "Could not find " kIODeviceTreePlane ":/options\n");
-        return 1;
+    CFStringGetCString(xmlstring, cStr, sizeof(cStr), kCFStringEncodingUTF8);
+
+    // kIONVRAMDeletePropertyKey names the variable to delete
+    if(0 == strcmp(bootvar, kIONVRAMDeletePropertyKey)) {
+        contextprintf(context, kBLLogLevelVerbose,  "Deleting EFI NVRAM:\n" );
+        contextprintf(context, kBLLogLevelVerbose,  "\t%s\n", cStr );
+
+        ret = BLNVRAMDeleteValue(context, xmlstring);
+        if(ret) {
+            contextprintf(context, kBLLogLevelError,  "Could not delete boot device property\n");
+            return 2;
+        }
+        return 0;
     }
     
     bootName = CFStringCreateWithCString(kCFAllocatorDefault, bootvar, kCFStringEncodingUTF8);
     if(bootName == NULL) {
-        IOObjectRelease(optionsNode);
         return 2;
     }
     
-    CFStringGetCString(xmlstring, cStr, sizeof(cStr), kCFStringEncodingUTF8);
-    
     contextprintf(context, kBLLogLevelVerbose,  "Setting EFI NVRAM:\n" );
     contextprintf(context, kBLLogLevelVerbose,  "\t%s='%s'\n", bootvar, cStr );
 
-    kret = IORegistryEntrySetCFProperty(optionsNode, bootName, xmlstring);
-    if(kret) {
-        CFRelease(bootName);
-        IOObjectRelease(optionsNode);
-        contextprintf(context, kBLLogLevelError,  "Could not set boot device property: %#x\n", kret);
+    ret = BLNVRAMSetValue(context, bootName, xmlstring);
+    CFRelease(bootName);
+    if(ret) {
+        contextprintf(context, kBLLogLevelError,  "Could not set boot device property\n");
         return 2;        
     }
-    
-    CFRelease(bootName);
-    IOObjectRelease(optionsNode);
         
     return 0;
 }
@@ -763,50 +795,65 @@ int setit(BLContextPtr context, mach_port_t masterPort, const char *bootvar, CFS
 // fetch old args. If set, filter them and reset
 static int setefibootargs(BLContextPtr context, mach_port_t masterPort)
 {
-    
+
     int             ret;
-    char        cStr[1024], newArgs[1024];
-    bool            didChange = false;
+    char            *cStr = NULL, *newArgs = NULL;
+    CFIndex         maxLength;
     CFStringRef     newString;
-    
+    BLBootArgsRef   args;
+    BLBootArgsChanges changes;
+
     ret = BLCopyEFINVRAMVariableAsString(context,
                                    CFSTR("boot-args"),
                                    &newString);
-    
+
     if(ret) {
-        contextprintf(context, kBLLogLevelError,  "Error getting NVRAM variable \"boot-args\"\n");        
+        contextprintf(context, kBLLogLevelError,  "Error getting NVRAM variable \"boot-args\"\n");
         return 1;
     }
-    
+
     if(newString == NULL) {
         // nothing set. that's OK
-        contextprintf(context, kBLLogLevelVerbose,  "NVRAM variable \"boot-args\" not set.\n");        
-        return 0;        
+        contextprintf(context, kBLLogLevelVerbose,  "NVRAM variable \"boot-args\" not set.\n");
+        return 0;
     }
-        
-    if(!CFStringGetCString(newString, cStr, sizeof(cStr), kCFStringEncodingUTF8)) {
+
+    maxLength = CFStringGetMaximumSizeForEncoding(CFStringGetLength(newString), kCFStringEncodingUTF8) + 1;
+    cStr = malloc(maxLength);
+    if(cStr == NULL || !CFStringGetCString(newString, cStr, maxLength, kCFStringEncodingUTF8)) {
         contextprintf(context, kBLLogLevelError,  "Could not interpret boot-args as string. Ignoring...\n");
-        cStr[0] = '\0';
-        // since we truncate boot-args, act like everything was filtered
-        newArgs[0] = '\0';
-        didChange = true;
-        ret = 0;
-    } else {
-        // apply boot-args filtering to the result, track changed status
-        ret = BLPreserveBootArgsIfChanged(context, cStr, newArgs, sizeof newArgs, &didChange);
+        // act like everything was filtered
+        free(cStr);
+        cStr = NULL;
     }
-    
+
     CFRelease(newString);
-    
+
+    ret = BLBootArgsCreate(context, cStr ? cStr : "", &args);
     if(ret) {
+        free(cStr);
         return ret;
     }
-    if(!didChange) {
+
+    BLBootArgsFilter(context, args);
+    BLBootArgsGetChanges(args, &changes);
+
+    if(cStr && changes.removed == 0) {
         contextprintf(context, kBLLogLevelVerbose, "New boot-args unchanged, skipping update.\n");
+        BLBootArgsRelease(args);
+        free(cStr);
         return 0; // nothing changed, return success
     }
-        
+
+    ret = BLBootArgsCopyString(context, args, &newArgs);
+    BLBootArgsRelease(args);
+    free(cStr);
+    if(ret) {
+        return ret;
+    }
+
     newString = CFStringCreateWithCString(kCFAllocatorDefault, newArgs, kCFStringEncodingUTF8);
+    free(newArgs);
     if(newString == NULL) {
         return 2;
     }
@@ -815,7 +862,16 @@ static int setefibootargs(BLContextPtr context, mach_port_t masterPort)
     CFRelease(newString);
     if(ret)
         return ret;
-    
+
     return 0;
 }
 
+static int _endWriteSet(BLContextPtr context, int ret)
+{
+	if (ret) {
+		BLNVRAMWriteSetDiscard(context);
+		return ret;
+	}
+
+	return BLNVRAMWriteSetCommit(context);
+}
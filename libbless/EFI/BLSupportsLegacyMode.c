@@ -66,19 +66,12 @@ static bool _getFeatureFlags(BLContextPtr context, uint32_t *featureMask,
                         uint32_t *featureFlags)
 {
     
-    io_registry_entry_t optionsNode = IO_OBJECT_NULL;
     CFDataRef		dataRef;
     
-    optionsNode = IORegistryEntryFromPath(kIOMasterPortDefault, kIODeviceTreePlane ":/options");
-    
-    if(IO_OBJECT_NULL == optionsNode) {
-        contextprintf(context, kBLLogLevelVerbose,  "Could not find " kIODeviceTreePlane ":/options\n");
+    if(BLNVRAMCopyValue(context, CFSTR(kBL_APPLE_VENDOR_NVRAM_GUID ":FirmwareFeaturesMask"),
+                        (CFTypeRef *)&dataRef)) {
         return false;
     }
-    
-    dataRef = IORegistryEntryCreateCFProperty(optionsNode,
-											 CFSTR(kBL_APPLE_VENDOR_NVRAM_GUID ":FirmwareFeaturesMask"),
-											 kCFAllocatorDefault, 0);
 
 	if(dataRef != NULL
 	   && CFGetTypeID(dataRef) == CFDataGetTypeID()
@@ -92,9 +85,10 @@ static bool _getFeatureFlags(BLContextPtr context, uint32_t *featureMask,
     
 	if(dataRef) CFRelease(dataRef);
 	
-    dataRef = IORegistryEntryCreateCFProperty(optionsNode,
-											  CFSTR(kBL_APPLE_VENDOR_NVRAM_GUID ":FirmwareFeatures"),
-											  kCFAllocatorDefault, 0);
+    if(BLNVRAMCopyValue(context, CFSTR(kBL_APPLE_VENDOR_NVRAM_GUID ":FirmwareFeatures"),
+                        (CFTypeRef *)&dataRef)) {
+        return false;
+    }
 	
 	if(dataRef != NULL
 	   && CFGetTypeID(dataRef) == CFDataGetTypeID()
@@ -107,8 +101,6 @@ static bool _getFeatureFlags(BLContextPtr context, uint32_t *featureMask,
 	}
     
 	if(dataRef) CFRelease(dataRef);
-		
-	IOObjectRelease(optionsNode);
     
 	contextprintf(context, kBLLogLevelVerbose,  "Firmware feature mask: 0x%08X\n", *featureMask);
 	contextprintf(context, kBLLogLevelVerbose,  "Firmware features: 0x%08X\n", *featureFlags);
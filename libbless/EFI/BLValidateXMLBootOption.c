@@ -29,80 +29,58 @@
  *
  */
 
-#include <IOKit/IOCFUnserialize.h>
-
 #include "bless.h"
 #include "bless_private.h"
 
-#define kBL_GLOBAL_NVRAM_GUID "8BE4DF61-93CA-11D2-AA0D-00E098032B8C"
-
-typedef uint8_t		EFI_UINT8;
-typedef uint16_t	EFI_UINT16;
-typedef uint16_t	EFI_CHAR16;
-typedef uint32_t	EFI_UINT32;
-typedef EFI_UINT8	EFI_DEVICE_PATH_PROTOCOL;
-
-typedef struct _BLESS_EFI_LOAD_OPTION {
-    EFI_UINT32                          Attributes; 
-    EFI_UINT16                          FilePathListLength; 
-    EFI_CHAR16                          Description[0]; 
-    EFI_DEVICE_PATH_PROTOCOL            FilePathList[0]; 
-    EFI_UINT8                           OptionalData[0]; 
-} BLESS_EFI_LOAD_OPTION;
+#include "BLEFIDevicePath.h"
 
-static int _getBootOptionNumber(BLContextPtr context, io_registry_entry_t options, uint16_t *bootOptionNumber);
-static BLESS_EFI_LOAD_OPTION * _getBootOptionData(BLContextPtr context, io_registry_entry_t options, uint16_t bootOptionNumber, size_t *bootOptionSize);
-static EFI_DEVICE_PATH_PROTOCOL * _getBootDevicePath(BLContextPtr context, io_registry_entry_t options, CFStringRef name, size_t *devicePathSize);
-static CFArrayRef _getBootDeviceXML(BLContextPtr context, io_registry_entry_t options, CFStringRef name);
+static int _getBootOptionNumber(BLContextPtr context, uint16_t *bootOptionNumber);
+static CFDataRef _copyBootOptionData(BLContextPtr context, uint16_t bootOptionNumber);
+static CFDataRef _copyBootDevicePath(BLContextPtr context, CFStringRef name);
+static BLEFIXMLScanRef _getBootDeviceXML(BLContextPtr context, CFStringRef name);
 
-static int _validate(BLContextPtr context, BLESS_EFI_LOAD_OPTION *bootOption, 
-					 size_t bootOptionSize, EFI_DEVICE_PATH_PROTOCOL *devicePath,
-					 size_t devicePathSize, CFArrayRef xmlPath);
+static void _logDevicePath(BLContextPtr context, BLEFISpan devicePath);
+static int _validate(BLContextPtr context, CFDataRef bootOption,
+					 CFDataRef devicePath, BLEFIXMLScanRef xmlPath);
 
 int BLValidateXMLBootOption(BLContextPtr context,
 							CFStringRef	 xmlName,
 							CFStringRef	 binaryName)
 {
 	
-	io_registry_entry_t optionsNode = 0;
 	uint16_t		bootOptionNumber = 0;
 	int				ret;
 
-    BLESS_EFI_LOAD_OPTION *bootOption = NULL;
-	EFI_DEVICE_PATH_PROTOCOL *devicePath = NULL;
-	size_t				bootOptionSize, devicePathSize;
-	CFArrayRef			xmlPath = NULL;
+	CFDataRef		bootOption = NULL;
+	CFDataRef		devicePath = NULL;
+	BLEFIXMLScanRef	xmlPath = NULL;
 	
-    optionsNode = IORegistryEntryFromPath(kIOMasterPortDefault, kIODeviceTreePlane ":/options");
-    
-    if(IO_OBJECT_NULL == optionsNode) {
-        contextprintf(context, kBLLogLevelError,  "Could not find " kIODeviceTreePlane ":/options\n");
-        return 1;
-    }
-    
-	ret = _getBootOptionNumber(context, optionsNode, &bootOptionNumber);
+	ret = _getBootOptionNumber(context, &bootOptionNumber);
 	if(ret)
 		return 2;
 
-	bootOption = _getBootOptionData(context, optionsNode, bootOptionNumber, &bootOptionSize);
+	bootOption = _copyBootOptionData(context, bootOptionNumber);
 	if(bootOption == NULL)
 		return 3;
 
-	devicePath = _getBootDevicePath(context, optionsNode, binaryName, &devicePathSize);
-	if(devicePath == NULL)
+	devicePath = _copyBootDevicePath(context, binaryName);
+	if(devicePath == NULL) {
+		CFRelease(bootOption);
 		return 4;
+	}
 	
-	xmlPath = _getBootDeviceXML(context, optionsNode, xmlName);
-	if(xmlPath == NULL)
+	xmlPath = _getBootDeviceXML(context, xmlName);
+	if(xmlPath == NULL) {
+		CFRelease(bootOption);
+		CFRelease(devicePath);
 		return 5;
+	}
 	
-	ret = _validate(context, bootOption, bootOptionSize, devicePath, devicePathSize, xmlPath);
+	ret = _validate(context, bootOption, devicePath, xmlPath);
 	
-	free(bootOption);
-	free(devicePath);
-	CFRelease(xmlPath);
-    
-	IOObjectRelease(optionsNode);
+	CFRelease(bootOption);
+	CFRelease(devicePath);
+	BLEFIXMLScanRelease(xmlPath);
 
 	if(ret) {
 		contextprintf(context, kBLLogLevelError,  "Boot option does not match XML representation\n");
@@ -113,14 +91,15 @@ int BLValidateXMLBootOption(BLContextPtr context,
 	}
 }
 
-static int _getBootOptionNumber(BLContextPtr context, io_registry_entry_t options, uint16_t *bootOptionNumber)
+static int _getBootOptionNumber(BLContextPtr context, uint16_t *bootOptionNumber)
 {
 	CFDataRef       dataRef;
-	const uint16_t	*orderBuffer;
+	const uint8_t	*orderBuffer;
 	
-	dataRef = IORegistryEntryCreateCFProperty(options, 
-											 CFSTR(kBL_GLOBAL_NVRAM_GUID ":BootOrder"),
-											 kCFAllocatorDefault, 0);
+	if(BLNVRAMCopyValue(context, CFSTR(kBL_GLOBAL_NVRAM_GUID ":BootOrder"),
+						(CFTypeRef *)&dataRef)) {
+		return 1;
+	}
     
     if(dataRef == NULL) {
         contextprintf(context, kBLLogLevelError,  "Could not access BootOrder\n");
@@ -133,20 +112,20 @@ static int _getBootOptionNumber(BLContextPtr context, io_registry_entry_t option
 		return 2;
 	}
     
-	orderBuffer = (const uint16_t *)CFDataGetBytePtr(dataRef);
-	*bootOptionNumber = CFSwapInt16LittleToHost(*orderBuffer);
+	orderBuffer = CFDataGetBytePtr(dataRef);
+	*bootOptionNumber = (uint16_t)(orderBuffer[0] | (orderBuffer[1] << 8));
 	
 	CFRelease(dataRef);
 	
 	return 0;
 }
 
-static BLESS_EFI_LOAD_OPTION * _getBootOptionData(BLContextPtr context, io_registry_entry_t options, uint16_t bootOptionNumber, size_t *bootOptionSize)
+// the returned data is borrowed by the parser, not copied
+static CFDataRef _copyBootOptionData(BLContextPtr context, uint16_t bootOptionNumber)
 {
     char            bootName[1024];
 	CFStringRef		nvramName;
 	CFDataRef		dataRef;
-	BLESS_EFI_LOAD_OPTION *buffer = NULL;
 	
 	snprintf(bootName, sizeof(bootName), "%s:Boot%04hx", kBL_GLOBAL_NVRAM_GUID, bootOptionNumber);
 	contextprintf(context, kBLLogLevelVerbose,  "Boot option is %s\n", bootName);
@@ -156,44 +135,34 @@ static BLESS_EFI_LOAD_OPTION * _getBootOptionData(BLContextPtr context, io_regis
 		return NULL;
 	}
 	
-	dataRef = IORegistryEntryCreateCFProperty(options, 
-											  nvramName,
-											  kCFAllocatorDefault, 0);
+	if(BLNVRAMCopyValue(context, nvramName, (CFTypeRef *)&dataRef)) {
+		CFRelease(nvramName);
+		return NULL;
+	}
     
+	CFRelease(nvramName);
+
     if(dataRef == NULL) {
-		CFRelease(nvramName);
         contextprintf(context, kBLLogLevelError,  "Could not access Boot%04hx\n", bootOptionNumber);
         return NULL;
 	}
 
-	CFRelease(nvramName);
-
 	if(CFGetTypeID(dataRef) != CFDataGetTypeID()) {
-		if(dataRef) CFRelease(dataRef);
+		CFRelease(dataRef);
         contextprintf(context, kBLLogLevelError,  "Invalid Boot%04hx\n", bootOptionNumber);
 		return NULL;
 	}
 	
-	*bootOptionSize = CFDataGetLength(dataRef);
-	buffer = (BLESS_EFI_LOAD_OPTION *)calloc(*bootOptionSize, sizeof(char));
-	if(buffer == NULL)
-		return NULL;
-	
-	memcpy(buffer, CFDataGetBytePtr(dataRef), *bootOptionSize);
-	
-	CFRelease(dataRef);
-
-	return buffer;
+	return dataRef;
 }
 
-static EFI_DEVICE_PATH_PROTOCOL * _getBootDevicePath(BLContextPtr context, io_registry_entry_t options, CFStringRef name, size_t *devicePathSize)
+static CFDataRef _copyBootDevicePath(BLContextPtr context, CFStringRef name)
 {
 	CFDataRef		dataRef;
-	EFI_DEVICE_PATH_PROTOCOL *buffer = NULL;
 	
-	dataRef = IORegistryEntryCreateCFProperty(options, 
-											  name,
-											  kCFAllocatorDefault, 0);
+	if(BLNVRAMCopyValue(context, name, (CFTypeRef *)&dataRef)) {
+		return NULL;
+	}
     
     if(dataRef == NULL) {
         contextprintf(context, kBLLogLevelError,  "Could not access boot device\n");
@@ -201,142 +170,153 @@ static EFI_DEVICE_PATH_PROTOCOL * _getBootDevicePath(BLContextPtr context, io_re
 	}
 	
 	if(CFGetTypeID(dataRef) != CFDataGetTypeID()) {
-		if(dataRef) CFRelease(dataRef);
+		CFRelease(dataRef);
         contextprintf(context, kBLLogLevelError,  "Invalid boot device\n");
 		return NULL;
 	}
 	
-	*devicePathSize = CFDataGetLength(dataRef);
-	buffer = (EFI_DEVICE_PATH_PROTOCOL *)calloc(*devicePathSize, sizeof(char));
-	if(buffer == NULL)
-		return NULL;
-	
-	memcpy(buffer, CFDataGetBytePtr(dataRef), *devicePathSize);
-
-	CFRelease(dataRef);
-	
-	return buffer;
+	return dataRef;
 }
 
-static CFArrayRef _getBootDeviceXML(BLContextPtr context, io_registry_entry_t options, CFStringRef name)
+static BLEFIXMLScanRef _getBootDeviceXML(BLContextPtr context, CFStringRef name)
 {
 	int ret;
 	CFStringRef stringVal = NULL;
-	char        buffer[1024];
-	CFArrayRef	arrayRef;
+	BLEFIXMLScanRef	scan = NULL;
 	
 	ret = BLCopyEFINVRAMVariableAsString(context, name, &stringVal);
 	if(ret || stringVal == NULL) {
 		return NULL;
 	}
 
-    if(!CFStringGetCString(stringVal, buffer, sizeof(buffer), kCFStringEncodingUTF8)) {
-		CFRelease(stringVal);
-        return NULL;
-    }
-    
+	ret = BLEFIXMLScanCreate(context, stringVal, &scan);
 	CFRelease(stringVal);
-
-    arrayRef = IOCFUnserialize(buffer,
-                               kCFAllocatorDefault,
-                               0,
-                               NULL);
-    if(arrayRef == NULL) {
-        contextprintf(context, kBLLogLevelError, "Could not unserialize string\n");
-        return NULL;
-    }
-    
-    if(CFGetTypeID(arrayRef) != CFArrayGetTypeID()) {
-        CFRelease(arrayRef);
-        contextprintf(context, kBLLogLevelError, "Bad type in XML string\n");
-        return NULL;        
-    }
-	
+	if(ret) {
+		return NULL;
+	}
 	
-	return arrayRef;
+	return scan;
 }
 
-static int _validate(BLContextPtr context, BLESS_EFI_LOAD_OPTION *bootOption, 
-					 size_t bootOptionSize, EFI_DEVICE_PATH_PROTOCOL *devicePath,
-					 size_t devicePathSize, CFArrayRef xmlPath)
+static void _logDevicePath(BLContextPtr context, BLEFISpan devicePath)
 {
-	EFI_CHAR16		*description;
-	int				i;
-	char			debugDesc[100];
-	EFI_DEVICE_PATH_PROTOCOL	*bootDev;
-	EFI_UINT8		*OptionalData;
-	size_t			OptionalDataSize;
+	BLEFIDevicePathNode	node;
+	BLEFIHardDriveNode	hd;
+	BLEFIMACNode		mac;
+	BLEFIIPv4Node		ipv4;
+	char				path[1024];
+	int					ret;
+
+	while((ret = BLEFIDevicePathNextNode(&devicePath, &node)) > 0) {
+		if(0 == BLEFIDecodeHardDriveNode(&node, &hd)) {
+			contextprintf(context, kBLLogLevelVerbose, "  HD(%u, %llu, %llu)\n",
+						  hd.partitionNumber, (unsigned long long)hd.partitionStart,
+						  (unsigned long long)hd.partitionSize);
+		} else if(0 == BLEFIDecodeFilePathNode(&node, path, sizeof(path))) {
+			contextprintf(context, kBLLogLevelVerbose, "  File(%s)\n", path);
+		} else if(0 == BLEFIDecodeMACNode(&node, &mac)) {
+			contextprintf(context, kBLLogLevelVerbose, "  MAC(%02x:%02x:%02x:%02x:%02x:%02x)\n",
+						  mac.address[0], mac.address[1], mac.address[2],
+						  mac.address[3], mac.address[4], mac.address[5]);
+		} else if(0 == BLEFIDecodeIPv4Node(&node, &ipv4)) {
+			contextprintf(context, kBLLogLevelVerbose, "  IPv4(%u.%u.%u.%u)\n",
+						  ipv4.remoteAddress[0], ipv4.remoteAddress[1],
+						  ipv4.remoteAddress[2], ipv4.remoteAddress[3]);
+		} else {
+			contextprintf(context, kBLLogLevelVerbose, "  Node(%#x, %#x, %zu bytes)\n",
+						  node.type, node.subType, node.payload.length);
+		}
+	}
+
+	if(ret < 0) {
+		contextprintf(context, kBLLogLevelVerbose, "  Malformed device path\n");
+	}
+}
+
+static int _validate(BLContextPtr context, CFDataRef bootOption,
+					 CFDataRef devicePath, BLEFIXMLScanRef xmlPath)
+{
+	BLEFILoadOption	option;
+	char			debugDesc[256];
 	CFIndex			j, count;
-	size_t			bufferSize = 0;
-	EFI_UINT8		*buffer = NULL;
+	CFDataRef		expected = NULL;
+	size_t			expectedSize = 0;
+	bool			expectedIsString = false;
+	int				ret;
 
-	
-	description = bootOption->Description;
-	
-	for(i=0; description[i]; i++) {
-		debugDesc[i] = (char)CFSwapInt16LittleToHost(description[i]);
+	ret = BLEFIParseLoadOption(CFDataGetBytePtr(bootOption), CFDataGetLength(bootOption), &option);
+	if(ret) {
+		contextprintf(context, kBLLogLevelVerbose, "Boot option is malformed\n");
+		return 1;
 	}
-	debugDesc[i] = '\0';
 	
-	// i is the size of the description string
+	BLEFIUTF16ToUTF8(option.description, option.descriptionChars, debugDesc, sizeof(debugDesc));
 	contextprintf(context, kBLLogLevelVerbose, "Processing boot option '%s'\n", debugDesc);
 
-	bootDev = (EFI_DEVICE_PATH_PROTOCOL	*)&bootOption->Description[i+1];
-	bootOption->FilePathListLength = CFSwapInt16LittleToHost(bootOption->FilePathListLength);
-	
-	if((bootOption->FilePathListLength != devicePathSize)
-	   || (0 != memcmp(bootDev, devicePath, devicePathSize))) {
+	_logDevicePath(context, option.filePathList);
+
+	if((option.filePathList.length != CFDataGetLength(devicePath))
+	   || (0 != memcmp(option.filePathList.bytes, CFDataGetBytePtr(devicePath), option.filePathList.length))) {
 		contextprintf(context, kBLLogLevelVerbose, "Boot device path incorrect\n");	
 		return 1;
 	}
 	
-	OptionalData = ((EFI_UINT8 *)bootDev) + bootOption->FilePathListLength;
-	OptionalDataSize = bootOptionSize - ((intptr_t)OptionalData - (intptr_t)bootOption);
-	
-	count = CFArrayGetCount(xmlPath);
+	count = BLEFIXMLScanGetCount(xmlPath);
 	for(j=0; j < count; j++) {
-		CFDictionaryRef element = CFArrayGetValueAtIndex(xmlPath, j);
-		CFTypeRef	val;
+		const BLEFIXMLValue *val = &BLEFIXMLScanGetElement(xmlPath, j)->values[kBLEFIXMLKeyBootOption];
 		
-		if(CFGetTypeID(element) != CFDictionaryGetTypeID())
-			continue;
-		
-		val = CFDictionaryGetValue(element, CFSTR("IOEFIBootOption"));
-		if(val == NULL)
-			continue;
-		
-		if(CFGetTypeID(val) == CFStringGetTypeID()) {
-			bufferSize = (CFStringGetLength(val)+1)*2;
-			buffer = (EFI_UINT8 *)calloc(bufferSize, sizeof(char));
-			
-			if(!CFStringGetCString(val, (char *)buffer, bufferSize, kCFStringEncodingUTF16LE)) {
-				free(buffer);
-				buffer = NULL;
-				bufferSize = 0;
+		if(val->type == kBLEFIXMLValueString) {
+			CFStringRef	string;
+			CFDataRef	encoded;
+
+			// NUL-terminated UTF-16LE, as firmware stores it
+			string = CFStringCreateWithCString(kCFAllocatorDefault, val->bytes, kCFStringEncodingUTF8);
+			if(string == NULL)
+				continue;
+			encoded = CFStringCreateExternalRepresentation(kCFAllocatorDefault, string,
+														   kCFStringEncodingUTF16LE, 0);
+			CFRelease(string);
+			if(encoded == NULL)
 				continue;
-			}
-				
-		} else if(CFGetTypeID(val) == CFDataGetTypeID()) {
-			bufferSize = CFDataGetLength(val);
-			buffer = (EFI_UINT8 *)calloc(bufferSize, sizeof(char));
 
-			memcpy(buffer, CFDataGetBytePtr(val), bufferSize);
+			if(expected) CFRelease(expected);
+			expected = encoded;
+			expectedSize = CFDataGetLength(expected) + 2;
+			expectedIsString = true;
+		} else if(val->type == kBLEFIXMLValueData) {
+			CFDataRef	data;
+
+			data = CFDataCreate(kCFAllocatorDefault, (const UInt8 *)val->bytes, val->length);
+			if(data == NULL)
+				continue;
+
+			if(expected) CFRelease(expected);
+			expected = data;
+			expectedSize = val->length;
+			expectedIsString = false;
 		}
-		
 	}
-	
+
 	// if either the boot option or the XML has this, we need to validate
-	if(OptionalDataSize || bufferSize) {
-		if((OptionalDataSize != bufferSize)
-		   || (0 != memcmp(OptionalData, buffer, bufferSize))) {
+	if(option.optionalData.length || expectedSize) {
+		const uint8_t	*data = option.optionalData.bytes;
+		size_t			compareSize = expectedIsString ? expectedSize - 2 : expectedSize;
+		bool			match;
+
+		// a string is stored with its UTF-16 NUL terminator
+		match = (option.optionalData.length == expectedSize)
+			&& (compareSize == 0 || 0 == memcmp(data, CFDataGetBytePtr(expected), compareSize))
+			&& (!expectedIsString || (data[compareSize] == 0 && data[compareSize + 1] == 0));
+
+		if(!match) {
 			contextprintf(context, kBLLogLevelVerbose, "Optional data incorrect\n");	
-			free(buffer);
+			if(expected) CFRelease(expected);
 			return 2;
 		}
 	}
 		
-	if(buffer)
-		free(buffer);
+	if(expected)
+		CFRelease(expected);
 	
 	return 0;
 }
@@ -46,7 +46,7 @@
 /*
  * 1. getattrlist on the mountpoint to get the volume id
  * 2. read in the finder words
- * 3. for the directories we're interested in, get the entries in /.vol
+ * 3. for the directories we're interested in, look them up in the catalog
  */
 int BLCreateVolumeInformationDictionary(BLContextPtr context, const char * mountpoint,
 					CFDictionaryRef *outDict) {
@@ -57,13 +57,26 @@ int BLCreateVolumeInformationDictionary(BLContextPtr context, const char * mount
     CFMutableDictionaryRef dict = NULL;
     CFMutableArrayRef infarray = NULL;
 
-    char blesspath[MAXPATHLEN];
+    char blesspaths[8-2][MAXPATHLEN];
+    char *outpaths[8-2];
+    char *blesspath;
 
     err = BLGetVolumeFinderInfo(context, mountpoint, finderinfo);
     if(err) {
         return 1;
     }
 
+    /* resolve all the directories at once */
+    memset(blesspaths, 0, sizeof(blesspaths));
+    for(i = 0; i < 8-2; i++) {
+      outpaths[i] = blesspaths[i];
+    }
+    err = BLLookupFileIDsOnMount(context, mountpoint, finderinfo, 8-2, outpaths);
+    if(err) {
+        contextprintf(context, kBLLogLevelError, "Could not look up blessed directories on %s: %d\n", mountpoint, err);
+        return 2;
+    }
+
     infarray = CFArrayCreateMutable(kCFAllocatorDefault,
 				    8,
 				    &kCFTypeArrayCallBacks);
@@ -76,9 +89,7 @@ int BLCreateVolumeInformationDictionary(BLContextPtr context, const char * mount
       CFTypeRef val;
       
       dirID = finderinfo[i];
-      blesspath[0] = '\0';
-      
-      err = BLLookupFileIDOnMount(context, mountpoint, dirID, blesspath);
+      blesspath = blesspaths[i];
       
       val = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt32Type, &dirID);
       CFDictionaryAddValue(word, CFSTR("Directory ID"), val);
@@ -57,6 +57,10 @@ int BLSetFinderFlag(BLContextPtr context, const char * path, uint16_t flag, int
     struct TwoUInt16 *twoUint = (struct TwoUInt16 *)&finfo.finderinfo[2];
     int err;
 	
+    if (BLPlanIsRecording(context)) {
+        return BLPlanRecordFinderFlag(context, path, flag, setval);
+    }
+
     alist.bitmapcount = 5;
     alist.reserved = 0;
     alist.commonattr = ATTR_CMN_FNDRINFO;
@@ -53,6 +53,13 @@ int BLSetVolumeFinderInfo(BLContextPtr context, const char *mountpoint, uint32_t
     struct volinfobuf vinfo;
     int err, i;
 
+    if (BLPlanIsRecording(context)) {
+        uint64_t planned[6];
+
+        for (i=0; i<6; i++) planned[i] = words[i];
+        return BLPlanRecordVolumeWords(context, kBLPlanActionSetVolumeFinderInfo, mountpoint, planned, 6);
+    }
+
     alist.bitmapcount = 5;
     alist.reserved = 0;
     alist.commonattr = ATTR_CMN_FNDRINFO;
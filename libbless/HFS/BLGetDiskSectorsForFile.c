@@ -39,6 +39,7 @@
 #include <sys/stat.h>
 #include <sys/mount.h>
 #include <hfs/hfs_format.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
@@ -48,33 +49,31 @@
 
 struct extinfo {
     uint32_t length;
+    uint64_t fileID;
+    off_t allocSize;
     HFSPlusExtentRecord extents;
-};
-
-struct allocinfo {
-    uint32_t length;
-    off_t allocationSize;
-};
+} __attribute__((aligned(4), packed));
 
 /*
- * First determine the device and the extents on the mounted volume
- * Then parse the device to see if an offset needs to be added
+ * First determine the device and the first extents on the mounted volume,
+ * then read the rest from the extents overflow file on the device
  */
 
-int BLGetDiskSectorsForFile(BLContextPtr context, const char * path, off_t extents[8][2],
+int BLGetDiskExtentsForFile(BLContextPtr context, const char * path,
+                            BLDiskExtent ** extents, uint32_t * extentCount,
                             char * device, int deviceLen) {
 
     struct statfs sb;
     struct extinfo info;
-    struct allocinfo ainfo;
-    struct attrlist alist, blist;
-    char buffer[512];
-    HFSMasterDirectoryBlock *mdb = (HFSMasterDirectoryBlock  *) buffer;
-    off_t sectorsPerBlock, offset;
+    struct attrlist alist;
+    BLHFSForkData fork;
+    BLHFSVolumeRef volume;
     char rawdev[MNAMELEN];
-    int i,  fd;
     int ret;
-    
+
+    *extents = NULL;
+    *extentCount = 0;
+
     ret = statfs(path, &sb);
     if(ret) {
         contextprintf(context, kBLLogLevelError,  "Can't get information for %s\n", path );
@@ -85,71 +84,62 @@ int BLGetDiskSectorsForFile(BLContextPtr context, const char * path, off_t exten
 
     alist.bitmapcount = 5;
     alist.reserved = 0;
-    alist.commonattr = 0;
+    alist.commonattr = ATTR_CMN_FILEID;
     alist.volattr =  0;
     alist.dirattr = 0;
-    alist.fileattr = ATTR_FILE_DATAEXTENTS;
+    alist.fileattr = ATTR_FILE_DATAALLOCSIZE | ATTR_FILE_DATAEXTENTS;
     alist.forkattr = 0;
-    
+
     ret = getattrlist(path, &alist, &info, sizeof(info), 1);
     if(ret) {
         contextprintf(context, kBLLogLevelError,  "Could not get extents for %s: %d\n", path, errno);
         return 1;
     }
 
-    blist.bitmapcount = 5;
-    blist.reserved = 0;
-    blist.commonattr = 0;
-    blist.volattr =  ATTR_VOL_MINALLOCATION|ATTR_VOL_INFO;
-    blist.dirattr = 0;
-    blist.fileattr = 0;
-    blist.forkattr = 0;
-    
-    ret = getattrlist(sb.f_mntonname, &blist, &ainfo, sizeof(ainfo), 1);
+    snprintf(rawdev, sizeof(rawdev), "/dev/r%s", sb.f_mntfromname+5);
+
+    ret = BLHFSVolumeCreate(rawdev, false, &volume);
     if(ret) {
-        contextprintf(context, kBLLogLevelError, "Could not get allocation block size for %s: %d\n", sb.f_mntonname, errno);
-        return 1;
+        contextprintf(context, kBLLogLevelError,  "Could not read HFS volume header from %s: %d\n", rawdev, ret);
+        return 3;
     }
-    
-    sectorsPerBlock = ainfo.allocationSize / 512;
 
-    snprintf(rawdev, sizeof(rawdev), "/dev/r%s", device+5);
+    memset(&fork, 0, sizeof(fork));
+    fork.totalBlocks = (uint32_t)(info.allocSize / BLHFSVolumeGetBlockSize(volume));
+    memcpy(fork.extents, info.extents, sizeof(fork.extents));
 
-    fd = open(rawdev, O_RDONLY, 0);
-    if(fd == -1) {
-            contextprintf(context, kBLLogLevelError,  "Could not open device to read Master Directory Block: %d\n", errno);
-            return 3;
-    }
-    
-    lseek(fd, 1024, SEEK_SET);
-    
-    if(512 != read(fd, buffer, 512)) {
-            contextprintf(context, kBLLogLevelError,  "Failed to read Master Directory Block\n");
-            return 3;    
+    ret = BLHFSVolumeCopyForkExtents(volume, (uint32_t)info.fileID, kBLHFSDataForkType,
+                                     &fork, extents, extentCount);
+    BLHFSVolumeRelease(volume);
+    if(ret) {
+        contextprintf(context, kBLLogLevelError,  "Could not map extents for %s\n", path);
+        return 4;
     }
-   
-   
-    offset = 0;
-    if(CFSwapInt16BigToHost(mdb->drSigWord) == kHFSPlusSigWord) {
-        // pure HFS+
-        offset = 0;
-    } else if ((CFSwapInt16BigToHost(mdb->drSigWord) == kHFSSigWord)
-            && (CFSwapInt16BigToHost(mdb->drEmbedSigWord) == kHFSPlusSigWord)) {
-        // HFS+ embedded
-        offset = CFSwapInt16BigToHost(mdb->drAlBlSt)
-            + CFSwapInt16BigToHost(mdb->drEmbedExtent.startBlock)*
-	               (CFSwapInt32BigToHost(mdb->drAlBlkSiz) >> 9);
-    } else {
-        // pure HFS
-        offset = CFSwapInt16BigToHost(mdb->drAlBlSt);
+
+    return 0;
+}
+
+int BLGetDiskSectorsForFile(BLContextPtr context, const char * path, off_t extents[8][2],
+                            char * device, int deviceLen) {
+
+    BLDiskExtent *list;
+    uint32_t count, i;
+    int ret;
+
+    ret = BLGetDiskExtentsForFile(context, path, &list, &count, device, deviceLen);
+    if(ret) return ret;
+
+    if(count > 8) {
+        contextprintf(context, kBLLogLevelError,  "%s is in %u pieces, too many to describe in 8 extents\n", path, count);
+        free(list);
+        return 5;
     }
-   
-    close(fd);
 
     for(i=0; i<8; i++) {
-        extents[i][0] = info.extents[i].startBlock*sectorsPerBlock+offset;
-        extents[i][1] = info.extents[i].blockCount*sectorsPerBlock;
+        extents[i][0] = i < count ? list[i].start : 0;
+        extents[i][1] = i < count ? list[i].length : 0;
     }
+    free(list);
 
     return 0;
 }
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLHFSCatalog.c
+//
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <hfs/hfs_format.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+// leaf nodes are read this much at a time, as they are mostly in order
+#define kBLHFSCatalogReadAhead	(1024 * 1024)
+
+typedef struct {
+	BLHFSVolumeRef	volume;
+	BLDiskExtent	*extents;
+	uint32_t		extentCount;
+	off_t			fileLength;
+	uint16_t		nodeSize;
+	uint8_t			*window;
+	off_t			windowStart;
+	size_t			windowLength;
+} BLHFSCatalogReader;
+
+static int _readNode(BLContextPtr context, BLHFSCatalogReader *reader, uint32_t node, const uint8_t **buf);
+static uint16_t _get16(const uint8_t *p);
+static uint32_t _get32(const uint8_t *p);
+
+int BLHFSCatalogIterate(BLContextPtr context, BLHFSVolumeRef volume,
+						BLHFSCatalogRecordFunction function, void *refcon)
+{
+	BLHFSCatalogReader		reader;
+	uint8_t					header[512];	// raw devices only read whole sectors
+	BTHeaderRec				*headerRec = (BTHeaderRec *)(header + sizeof(BTNodeDescriptor));
+	uint32_t				node, totalNodes, visited = 0, i;
+	int						ret;
+
+	memset(&reader, 0, sizeof(reader));
+	reader.volume = volume;
+
+	// plain HFS catalog records are laid out differently
+	if (!BLHFSVolumeIsHFSPlus(volume)) {
+		contextprintf(context, kBLLogLevelError, "Catalog is not HFS+\n");
+		return 2;
+	}
+
+	ret = BLHFSVolumeCopyForkExtents(volume, kBLHFSCatalogFileID, kBLHFSDataForkType,
+									 BLHFSVolumeGetCatalogFork(volume), &reader.extents, &reader.extentCount);
+	if (ret) {
+		contextprintf(context, kBLLogLevelError, "Can't map the catalog file: %d\n", ret);
+		return ret;
+	}
+
+	for (i = 0; i < reader.extentCount; i++) {
+		reader.fileLength += reader.extents[i].length * 512;
+	}
+
+	ret = BLHFSVolumeReadExtents(volume, reader.extents, reader.extentCount, 0, header, sizeof header);
+	if (ret) {
+		contextprintf(context, kBLLogLevelError, "Can't read catalog header\n");
+		goto exit;
+	}
+
+	reader.nodeSize = CFSwapInt16BigToHost(headerRec->nodeSize);
+	totalNodes = CFSwapInt32BigToHost(headerRec->totalNodes);
+	if (reader.nodeSize < 512 || (reader.nodeSize & (reader.nodeSize - 1)) != 0
+		|| reader.nodeSize > kBLHFSCatalogReadAhead) {
+		contextprintf(context, kBLLogLevelError, "Bad catalog node size %u\n", reader.nodeSize);
+		ret = 4;
+		goto exit;
+	}
+
+	reader.window = malloc(kBLHFSCatalogReadAhead);
+	if (reader.window == NULL) {
+		ret = 1;
+		goto exit;
+	}
+
+	for (node = CFSwapInt32BigToHost(headerRec->firstLeafNode); node != 0;) {
+		const uint8_t			*buf;
+		const BTNodeDescriptor	*desc;
+		uint16_t				numRecords, r;
+		size_t					tableStart;
+
+		if (++visited > totalNodes) {
+			contextprintf(context, kBLLogLevelError, "Catalog leaf chain loops\n");
+			ret = 4;
+			goto exit;
+		}
+
+		ret = _readNode(context, &reader, node, &buf);
+		if (ret) goto exit;
+
+		desc = (const BTNodeDescriptor *)buf;
+		numRecords = CFSwapInt16BigToHost(desc->numRecords);
+		if (desc->kind != kBTLeafNode
+			|| sizeof(BTNodeDescriptor) + ((size_t)numRecords + 1) * sizeof(uint16_t) > reader.nodeSize) {
+			contextprintf(context, kBLLogLevelError, "Catalog node %u is damaged\n", node);
+			ret = 4;
+			goto exit;
+		}
+		tableStart = reader.nodeSize - ((size_t)numRecords + 1) * sizeof(uint16_t);
+
+		for (r = 0; r < numRecords; r++) {
+			BLHFSCatalogRecord	record;
+			size_t				offset = _get16(buf + reader.nodeSize - (r + 1) * sizeof(uint16_t));
+			size_t				end = _get16(buf + reader.nodeSize - (r + 2) * sizeof(uint16_t));
+			size_t				keyLength;
+
+			// key: length, parent ID, name length, name
+			if (offset < sizeof(BTNodeDescriptor) || end > tableStart || offset + 8 > end) continue;
+
+			keyLength = _get16(buf + offset);
+			record.parentID = _get32(buf + offset + 2);
+			record.nameLength = _get16(buf + offset + 6);
+			record.name = buf + offset + 8;
+			if (keyLength < 6 + (size_t)record.nameLength * 2 || offset + 2 + keyLength > end) continue;
+
+			record.data = buf + offset + 2 + keyLength;
+			record.dataLength = end - (offset + 2 + keyLength);
+			record.position = (off_t)node * reader.nodeSize + offset + 2 + keyLength;
+
+			ret = function(context, &record, refcon);
+			if (ret) goto exit;
+		}
+
+		node = CFSwapInt32BigToHost(desc->fLink);
+	}
+
+	contextprintf(context, kBLLogLevelVerbose, "Read %u catalog leaf nodes\n", visited);
+
+exit:
+	free(reader.extents);
+	free(reader.window);
+
+	return ret;
+}
+
+size_t BLHFSCatalogNameToUTF8(const uint8_t *name, uint16_t length, char *out)
+{
+	char		*p = out;
+	uint16_t	i;
+
+	for (i = 0; i < length; i++) {
+		uint32_t	c = _get16(name + 2*i);
+
+		if (c >= 0xD800 && c < 0xDC00 && i + 1 < length) {
+			uint32_t	low = _get16(name + 2*i + 2);
+
+			if (low >= 0xDC00 && low < 0xE000) {
+				c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				i++;
+			}
+		}
+
+		if (c == '/') c = ':';
+
+		if (c < 0x80) {
+			*p++ = (char)c;
+		} else if (c < 0x800) {
+			*p++ = (char)(0xC0 | (c >> 6));
+			*p++ = (char)(0x80 | (c & 0x3F));
+		} else if (c < 0x10000) {
+			*p++ = (char)(0xE0 | (c >> 12));
+			*p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+			*p++ = (char)(0x80 | (c & 0x3F));
+		} else {
+			*p++ = (char)(0xF0 | (c >> 18));
+			*p++ = (char)(0x80 | ((c >> 12) & 0x3F));
+			*p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+			*p++ = (char)(0x80 | (c & 0x3F));
+		}
+	}
+	*p = '\0';
+
+	return p - out;
+}
+
+static int _readNode(BLContextPtr context, BLHFSCatalogReader *reader, uint32_t node, const uint8_t **buf)
+{
+	off_t	position = (off_t)node * reader->nodeSize;
+	size_t	length;
+
+	if (position < reader->windowStart || position + reader->nodeSize > reader->windowStart + (off_t)reader->windowLength) {
+		if (position + reader->nodeSize > reader->fileLength) {
+			contextprintf(context, kBLLogLevelError, "Catalog node %u is past the end of the catalog\n", node);
+			return 4;
+		}
+
+		length = (size_t)MIN((off_t)kBLHFSCatalogReadAhead, reader->fileLength - position);
+		if (BLHFSVolumeReadExtents(reader->volume, reader->extents, reader->extentCount,
+								   position, reader->window, length)) {
+			contextprintf(context, kBLLogLevelError, "Can't read catalog node %u\n", node);
+			reader->windowLength = 0;
+			return 3;
+		}
+		reader->windowStart = position;
+		reader->windowLength = length;
+	}
+
+	*buf = reader->window + (position - reader->windowStart);
+	return 0;
+}
+
+// catalog records are only 2-byte aligned
+static uint16_t _get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t _get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLHFSCatalogIndex.c
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <hfs/hfs_format.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+// Where each catalog node lives: the ID's parent and its own name
+typedef struct {
+	uint32_t	cnid;
+	uint32_t	parentID;
+	uint32_t	name;			// offset into the name arena
+	char		*path;			// memoized path, once resolved
+} BLHFSCatalogEntry;
+
+struct BLHFSCatalogIndex {
+	BLHFSCatalogEntry	*entries;		// sorted by cnid
+	uint32_t			count;
+	uint32_t			capacity;
+	char				*names;			// NUL-terminated UTF-8 names
+	size_t				namesLength;
+	size_t				namesCapacity;
+};
+
+static int _addRecord(BLContextPtr context, const BLHFSCatalogRecord *record, void *refcon);
+static int _compareEntries(const void *a, const void *b);
+static BLHFSCatalogEntry *_findEntry(BLHFSCatalogIndexRef index, uint32_t cnid);
+static uint16_t _get16(const uint8_t *p);
+static uint32_t _get32(const uint8_t *p);
+
+int BLHFSCatalogIndexCreate(BLContextPtr context, BLHFSVolumeRef volume, BLHFSCatalogIndexRef *index)
+{
+	BLHFSCatalogIndexRef	newIndex;
+	uint32_t				i;
+	int						ret;
+
+	*index = NULL;
+
+	newIndex = calloc(1, sizeof(*newIndex));
+	if (newIndex == NULL) return 1;
+
+	ret = BLHFSCatalogIterate(context, volume, _addRecord, newIndex);
+	if (ret) {
+		BLHFSCatalogIndexRelease(newIndex);
+		return ret;
+	}
+
+	// thread records are keyed by their own ID, so they should already be in order
+	for (i = 1; i < newIndex->count; i++) {
+		if (newIndex->entries[i].cnid <= newIndex->entries[i - 1].cnid) {
+			qsort(newIndex->entries, newIndex->count, sizeof(BLHFSCatalogEntry), _compareEntries);
+			break;
+		}
+	}
+
+	contextprintf(context, kBLLogLevelVerbose, "Indexed %u catalog IDs\n", newIndex->count);
+
+	*index = newIndex;
+	return 0;
+}
+
+void BLHFSCatalogIndexRelease(BLHFSCatalogIndexRef index)
+{
+	uint32_t	i;
+
+	if (index == NULL) return;
+
+	for (i = 0; i < index->count; i++) {
+		free(index->entries[i].path);
+	}
+	free(index->entries);
+	free(index->names);
+	free(index);
+}
+
+const char *BLHFSCatalogIndexGetPath(BLContextPtr context, BLHFSCatalogIndexRef index, uint32_t fileID)
+{
+	BLHFSCatalogEntry	*chain[MAXPATHLEN / 2];
+	BLHFSCatalogEntry	*entry;
+	const char			*prefix = "";
+	int					depth = 0;
+
+	if (fileID == kHFSRootFolderID) return "";
+
+	// walk up until the root or a directory already resolved
+	for (entry = _findEntry(index, fileID); entry && entry->path == NULL; entry = _findEntry(index, entry->parentID)) {
+		if (depth == sizeof(chain) / sizeof(chain[0])) {
+			contextprintf(context, kBLLogLevelError, "File ID %u is nested too deeply\n", fileID);
+			return NULL;
+		}
+		chain[depth++] = entry;
+		if (entry->parentID == kHFSRootFolderID) break;
+	}
+
+	if (depth == 0) return entry ? entry->path : NULL;
+	if (entry == NULL) {
+		contextprintf(context, kBLLogLevelVerbose, "File ID %u has no path to the root\n", fileID);
+		return NULL;
+	}
+	if (entry->path) prefix = entry->path;
+
+	// then come back down, memoizing each level
+	while (depth > 0) {
+		size_t	prefixLength = strlen(prefix);
+		char	*name;
+
+		entry = chain[--depth];
+		name = index->names + entry->name;
+
+		entry->path = malloc(prefixLength + 1 + strlen(name) + 1);
+		if (entry->path == NULL) return NULL;
+
+		if (prefixLength) {
+			memcpy(entry->path, prefix, prefixLength);
+			entry->path[prefixLength] = '/';
+			strcpy(entry->path + prefixLength + 1, name);
+		} else {
+			strcpy(entry->path, name);
+		}
+		prefix = entry->path;
+	}
+
+	return prefix;
+}
+
+uint32_t BLHFSCatalogIndexGetPaths(BLContextPtr context, BLHFSCatalogIndexRef index,
+								   const uint32_t *fileIDs, uint32_t count, const char **paths)
+{
+	uint32_t	i, found = 0;
+
+	for (i = 0; i < count; i++) {
+		paths[i] = BLHFSCatalogIndexGetPath(context, index, fileIDs[i]);
+		if (paths[i]) found++;
+	}
+
+	return found;
+}
+
+// Thread records carry each ID's parent and name
+static int _addRecord(BLContextPtr context, const BLHFSCatalogRecord *record, void *refcon)
+{
+	BLHFSCatalogIndexRef	index = refcon;
+	int16_t					recordType;
+	uint16_t				nameLength;
+
+	if (record->dataLength < 10) return 0;
+
+	recordType = (int16_t)_get16(record->data);
+	if (recordType != kHFSPlusFolderThreadRecord && recordType != kHFSPlusFileThreadRecord) return 0;
+
+	nameLength = _get16(record->data + 8);
+	if (nameLength > 255 || 10 + (size_t)nameLength * 2 > record->dataLength) return 0;
+
+	if (index->count == index->capacity) {
+		uint32_t			newCapacity = index->capacity ? index->capacity * 2 : 1024;
+		BLHFSCatalogEntry	*entries = realloc(index->entries, newCapacity * sizeof(BLHFSCatalogEntry));
+
+		if (entries == NULL) goto nomem;
+		index->entries = entries;
+		index->capacity = newCapacity;
+	}
+
+	if (index->namesLength + (size_t)nameLength * 3 + 1 > index->namesCapacity) {
+		size_t	newCapacity = index->namesCapacity ? index->namesCapacity * 2 : 64 * 1024;
+		char	*names = realloc(index->names, newCapacity);
+
+		if (names == NULL) goto nomem;
+		index->names = names;
+		index->namesCapacity = newCapacity;
+	}
+
+	// a thread's key has the ID it describes as its parent
+	index->entries[index->count].cnid = record->parentID;
+	index->entries[index->count].parentID = _get32(record->data + 4);
+	index->entries[index->count].name = (uint32_t)index->namesLength;
+	index->entries[index->count].path = NULL;
+	index->count++;
+	index->namesLength += BLHFSCatalogNameToUTF8(record->data + 10, nameLength,
+												 index->names + index->namesLength) + 1;
+
+	return 0;
+
+nomem:
+	contextprintf(context, kBLLogLevelError, "Can't allocate catalog index\n");
+	return 1;
+}
+
+// catalog records are only 2-byte aligned
+static uint16_t _get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t _get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static int _compareEntries(const void *a, const void *b)
+{
+	uint32_t	x = ((const BLHFSCatalogEntry *)a)->cnid;
+	uint32_t	y = ((const BLHFSCatalogEntry *)b)->cnid;
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static BLHFSCatalogEntry *_findEntry(BLHFSCatalogIndexRef index, uint32_t cnid)
+{
+	uint32_t	low = 0, high = index->count;
+
+	while (low < high) {
+		uint32_t	mid = low + (high - low) / 2;
+
+		if (index->entries[mid].cnid == cnid) return &index->entries[mid];
+		if (index->entries[mid].cnid < cnid) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return NULL;
+}
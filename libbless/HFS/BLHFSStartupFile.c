@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLHFSStartupFile.c
+//
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/param.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "BLHFSStartupFile.h"
+#include "BLHFSVolume.h"
+#include "BLBlockChecksum.h"
+
+// no secondary loader has come close to this
+#define kBLStartupMaxLength		(32 * 1024 * 1024)
+
+// XFileHeader, XOptHeader and XSection of BLWriteStartupFile.h, as byte offsets
+#define kXFileMagic				0x01DF
+#define kXFileHeaderSize		20
+#define kXFileNSections			2
+#define kXFileOptHeaderSize		16
+#define kXOptMagic				0x010B
+#define kXOptHeaderSize			72
+#define kXOptEntryPoint			16
+#define kXOptSNText				34
+#define kXOptSNData				36
+#define kXOptSNBSS				42
+#define kXSectionSize			40
+#define kXSectionVAddr			12
+#define kXSectionSizeField		16
+#define kXSectionFileOffset		20
+
+typedef struct {
+	uint32_t	vAddr;
+	uint32_t	size;
+} BLStartupSegment;
+
+static const uint8_t	gZeros[512];
+
+static int _readSection(const uint8_t *xcoff, size_t length, size_t tableOffset, uint16_t nSections,
+						uint16_t sn, const char *name, bool loaded, BLStartupSegment *segment,
+						const char **problem);
+
+static inline uint16_t _be16(const uint8_t *p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t _be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int BLHFSStartupFileCheckXCOFF(const void *xcoff, size_t length, uint32_t *entryPoint, const char **problem)
+{
+	const uint8_t		*bytes = xcoff;
+	const uint8_t		*opt = bytes + kXFileHeaderSize;
+	BLStartupSegment	segments[3], segment;
+	uint16_t			nSections, optHeaderSize;
+	uint32_t			imageEnd;
+	size_t				tableOffset;
+	int					count = 0, i, j, ret;
+
+	*entryPoint = 0;
+	*problem = NULL;
+
+	if (length < kXFileHeaderSize + kXOptHeaderSize) {
+		*problem = "too short to be XCOFF";
+		return 4;
+	}
+	if (length > kBLStartupMaxLength) {
+		*problem = "larger than any secondary loader";
+		return 4;
+	}
+
+	nSections = _be16(bytes + kXFileNSections);
+	optHeaderSize = _be16(bytes + kXFileOptHeaderSize);
+	if (_be16(bytes) != kXFileMagic || optHeaderSize < kXOptHeaderSize) {
+		*problem = "not a 32-bit XCOFF executable";
+		return 4;
+	}
+	if (_be16(opt) != kXOptMagic) {
+		*problem = "no XCOFF auxiliary header";
+		return 4;
+	}
+
+	tableOffset = kXFileHeaderSize + optHeaderSize;
+	if (nSections == 0 || tableOffset + (size_t)nSections * kXSectionSize > length) {
+		*problem = "section table out of bounds";
+		return 4;
+	}
+
+	ret = _readSection(bytes, length, tableOffset, nSections, _be16(opt + kXOptSNText), ".text", true,
+					   &segment, problem);
+	if (ret) return ret;
+	if (segment.size == 0) {
+		*problem = "no .text section";
+		return 4;
+	}
+	segments[count++] = segment;
+
+	ret = _readSection(bytes, length, tableOffset, nSections, _be16(opt + kXOptSNData), ".data", true,
+					   &segment, problem);
+	if (ret) return ret;
+	if (segment.size) segments[count++] = segment;
+
+	ret = _readSection(bytes, length, tableOffset, nSections, _be16(opt + kXOptSNBSS), ".bss", false,
+					   &segment, problem);
+	if (ret) return ret;
+	if (segment.size) segments[count++] = segment;
+
+	// insertion sort of at most three
+	for (i = 1; i < count; i++) {
+		segment = segments[i];
+		for (j = i; j > 0 && segments[j - 1].vAddr > segment.vAddr; j--) {
+			segments[j] = segments[j - 1];
+		}
+		segments[j] = segment;
+	}
+
+	for (i = 1; i < count; i++) {
+		if (segments[i - 1].vAddr + segments[i - 1].size > segments[i].vAddr) {
+			*problem = "sections overlap";
+			return 4;
+		}
+	}
+
+	imageEnd = segments[count - 1].vAddr + segments[count - 1].size;
+	if (imageEnd - segments[0].vAddr > kBLStartupMaxLength) {
+		*problem = "loaded image larger than any secondary loader";
+		return 4;
+	}
+
+	// XCOFF entry points are function descriptors, which live in the image
+	*entryPoint = _be32(opt + kXOptEntryPoint);
+	if (*entryPoint < segments[0].vAddr || *entryPoint >= imageEnd) {
+		*problem = "entry point outside the loaded image";
+		return 4;
+	}
+
+	return 0;
+}
+
+/*
+ * Open Firmware loads the startup file as an XCOFF, so it is written
+ * as it is, straight from xcoff and padded to whole sectors with zeros
+ */
+int BLHFSStartupFileWrite(const char *device, const void *xcoff, size_t length, BLHFSStartupFileInfo *info)
+{
+	BLHFSVolumeRef	volume = NULL;
+	BLHFSForkData	fork;
+	BLDiskExtent	*extents = NULL;
+	uint32_t		extentCount = 0;
+	struct iovec	iov[2];
+	uint8_t			*readback = NULL;
+	const void		*bufs[2];
+	size_t			lengths[2];
+	uint32_t		sums[2];
+	uint32_t		blockSize, blocksNeeded, startBlock;
+	size_t			fileLength = roundup(length, 512);
+	int				ret;
+
+	memset(info, 0, sizeof(*info));
+
+	ret = BLHFSStartupFileCheckXCOFF(xcoff, length, &info->entryPoint, &info->problem);
+	if (ret) return ret;
+
+	ret = BLHFSVolumeCreate(device, true, &volume);
+	if (ret == 1) goto nomem;
+	if (ret) {
+		info->problem = "can't read an HFS volume header";
+		return 2;
+	}
+
+	// plain HFS has no startup file
+	if (!BLHFSVolumeIsHFSPlus(volume)) {
+		info->problem = "not HFS+";
+		ret = 2;
+		goto exit;
+	}
+
+	// a mounted volume has this cleared until it is unmounted
+	if (!(BLHFSVolumeGetAttributes(volume) & kBLHFSVolumeUnmountedMask)) {
+		info->problem = "mounted, or not cleanly unmounted";
+		ret = 3;
+		goto exit;
+	}
+
+	blockSize = BLHFSVolumeGetBlockSize(volume);
+	blocksNeeded = (uint32_t)((fileLength + blockSize - 1) / blockSize);
+	fork = *BLHFSVolumeGetStartupFork(volume);
+
+	if (fork.totalBlocks == 0) {
+		ret = BLHFSVolumeAllocateBlocks(volume, blocksNeeded, &startBlock);
+		if (ret == 1) goto nomem;
+		if (ret == 6) {
+			info->problem = "no run of free blocks large enough";
+			ret = 5;
+			goto exit;
+		}
+		if (ret) goto ioerror;
+
+		memset(&fork, 0, sizeof(fork));
+		fork.clumpSize = blocksNeeded * blockSize;
+		fork.totalBlocks = blocksNeeded;
+		fork.extents[0].startBlock = startBlock;
+		fork.extents[0].blockCount = blocksNeeded;
+
+		// recorded straight away, so the blocks aren't lost if the write fails
+		ret = BLHFSVolumeSetStartupFork(volume, &fork);
+		if (ret) goto ioerror;
+	} else if (fork.totalBlocks < blocksNeeded) {
+		info->problem = "existing startup file too small";
+		ret = 5;
+		goto exit;
+	}
+
+	ret = BLHFSVolumeCopyForkExtents(volume, kBLHFSStartupFileID, kBLHFSDataForkType,
+									 &fork, &extents, &extentCount);
+	if (ret == 1) goto nomem;
+	if (ret) goto ioerror;
+	info->extentCount = extentCount;
+
+	iov[0].iov_base = (void *)xcoff;
+	iov[0].iov_len = length;
+	iov[1].iov_base = (void *)gZeros;
+	iov[1].iov_len = fileLength - length;
+	ret = BLHFSVolumeWriteExtentsVector(volume, extents, extentCount, 0, iov, iov[1].iov_len ? 2 : 1);
+	if (ret) goto ioerror;
+
+	readback = malloc(fileLength);
+	if (readback == NULL) goto nomem;
+
+	ret = BLHFSVolumeReadExtents(volume, extents, extentCount, 0, readback, fileLength);
+	if (ret) goto ioerror;
+
+	// both at once; the checksum leaves out a partial last word, so that is compared as it is
+	bufs[0] = readback;
+	bufs[1] = xcoff;
+	lengths[0] = lengths[1] = length;
+	BLBlockChecksumMulti(bufs, lengths, sums, 2);
+	info->checksum = sums[0];
+	if (sums[0] != sums[1] || memcmp(readback + (length & ~(size_t)3),
+									  (const uint8_t *)xcoff + (length & ~(size_t)3), length & 3) != 0) {
+		info->problem = "checksum of the startup file read back is wrong";
+		ret = 6;
+		goto exit;
+	}
+
+	fork.logicalSize = length;
+	ret = BLHFSVolumeSetStartupFork(volume, &fork);
+	if (ret) goto ioerror;
+
+exit:
+	free(readback);
+	free(extents);
+	BLHFSVolumeRelease(volume);
+
+	return ret;
+
+nomem:
+	info->problem = "out of memory";
+	ret = 1;
+	goto exit;
+
+ioerror:
+	info->problem = "I/O error";
+	ret = 7;
+	goto exit;
+}
+
+// A section by its 1-based number; 0 means the loader has none
+static int _readSection(const uint8_t *xcoff, size_t length, size_t tableOffset, uint16_t nSections,
+						uint16_t sn, const char *name, bool loaded, BLStartupSegment *segment,
+						const char **problem)
+{
+	const uint8_t	*section;
+
+	memset(segment, 0, sizeof(*segment));
+	if (sn == 0) return 0;
+
+	if (sn > nSections) {
+		*problem = "section number past the section table";
+		return 4;
+	}
+
+	section = xcoff + tableOffset + (size_t)(sn - 1) * kXSectionSize;
+	if (strncmp((const char *)section, name, 8) != 0) {
+		*problem = "section numbers don't match section names";
+		return 4;
+	}
+
+	segment->vAddr = _be32(section + kXSectionVAddr);
+	segment->size = _be32(section + kXSectionSizeField);
+	if ((uint64_t)segment->vAddr + segment->size > UINT32_MAX) {
+		*problem = "section wraps the address space";
+		return 4;
+	}
+
+	if (loaded && (uint64_t)_be32(section + kXSectionFileOffset) + segment->size > length) {
+		*problem = "section past the end of the file";
+		return 4;
+	}
+
+	return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLHFSStartupFile.h
+//
+//  Writes an XCOFF secondary loader, as Open Firmware loads it, into the
+//  startup file of an unmounted HFS+ volume on a device node or an image
+//  file. Only the C library is used, so test images can be made anywhere.
+//
+
+#ifndef _BLHFSSTARTUPFILE_H_
+#define _BLHFSSTARTUPFILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+	uint32_t	entryPoint;		// of the XCOFF
+	uint32_t	extentCount;	// of the startup file
+	uint32_t	checksum;		// BLBlockChecksum of what was read back
+	const char	*problem;		// why it failed, for the caller to log
+} BLHFSStartupFileInfo;
+
+/*
+ * Check that xcoff is a 32-bit XCOFF executable whose .text, .data and
+ * .bss sections lie inside it, don't overlap, and contain its entry
+ * point. Returns 4, with *problem set, if not
+ */
+int BLHFSStartupFileCheckXCOFF(const void *xcoff, size_t length, uint32_t *entryPoint, const char **problem);
+
+/*
+ * Write xcoff as the startup file of device, allocating one if the
+ * volume has none, and check it by reading it back. Returns 1 if out of
+ * memory, 2 if device isn't an HFS+ volume, 3 if it is mounted or wasn't
+ * cleanly unmounted, 4 if xcoff isn't valid, 5 if there's no room for
+ * it, 6 if it doesn't read back the same, 7 on an I/O error
+ */
+int BLHFSStartupFileWrite(const char *device, const void *xcoff, size_t length, BLHFSStartupFileInfo *info);
+
+#endif // _BLHFSSTARTUPFILE_H_
@@ -0,0 +1,891 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLHFSVolume.c
+//
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/param.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "BLHFSVolume.h"
+
+#define kBLHFSGeometryCacheSize	8
+#define kBLHFSMaxTreeDepth		16
+#define kBLHFSBitmapWindow		(1024 * 1024)
+#define kBLHFSHeaderOffset		1024
+
+#ifndef IOV_MAX
+#define IOV_MAX					1024
+#endif
+
+// HFS Master Directory Block fields, as byte offsets
+#define kMDBSigWord				0
+#define kMDBAtrb				10
+#define kMDBNmAlBlks			18
+#define kMDBAlBlkSiz			20
+#define kMDBAlBlSt				28
+#define kMDBEmbedSigWord		124
+#define kMDBEmbedExtent			126
+#define kMDBXTFlSize			130
+#define kMDBXTExtRec			134
+#define kMDBCTFlSize			146
+#define kMDBCTExtRec			150
+
+// HFS+ volume header fields
+#define kVHSignature			0
+#define kVHAttributes			4
+#define kVHModifyDate			20
+#define kVHBlockSize			40
+#define kVHTotalBlocks			44
+#define kVHFreeBlocks			48
+#define kVHNextAllocation		52
+#define kVHWriteCount			68
+#define kVHAllocationFile		112
+#define kVHExtentsFile			192
+#define kVHCatalogFile			272
+#define kVHStartupFile			432
+#define kForkDataSize			80
+
+// HFS+ dates are seconds since 1904, UTC
+#define kHFSEpochOffset			2082844800U
+
+// B-tree node descriptor and header record
+#define kNodeDescriptorSize		14
+#define kNodeKind				8
+#define kNodeNumRecords			10
+#define kHeaderRootNode			(kNodeDescriptorSize + 2)
+#define kHeaderNodeSize			(kNodeDescriptorSize + 18)
+#define kNodeKindIndex			0x00
+#define kNodeKindLeaf			0xFF
+
+#define kHFSExtentDensity		3
+#define kHFSExtentKeyLength		8		// with the length byte
+#define kHFSPlusExtentKeyLength	12		// with the length word
+
+// What the volume header says; cached per device
+typedef struct {
+	dev_t			dev;
+	ino_t			ino;
+	time_t			mtime;
+	time_t			ctime;
+	off_t			size;
+	bool			isHFSPlus;
+	off_t			offset;			// bytes from the start of the device to the volume
+	uint32_t		attributes;
+	uint32_t		blockSize;
+	uint32_t		totalBlocks;
+	BLHFSForkData	allocationFile;	// HFS+ only
+	BLHFSForkData	extentsFile;
+	BLHFSForkData	catalogFile;
+	BLHFSForkData	startupFile;	// HFS+ only
+} BLHFSGeometry;
+
+struct BLHFSVolume {
+	int				fd;
+	BLHFSGeometry	geometry;
+	uint16_t		nodeSize;		// of the extents overflow file
+	uint32_t		rootNode;		// 0 if that tree is empty
+	uint8_t			*node;			// one node's worth of buffer
+};
+
+static pthread_mutex_t	gGeometryLock = PTHREAD_MUTEX_INITIALIZER;
+static BLHFSGeometry	gGeometryCache[kBLHFSGeometryCacheSize];
+static int				gGeometryCount;
+static int				gGeometryNext;
+
+static int _readGeometry(int fd, BLHFSGeometry *geometry);
+static void _readHFSGeometry(const uint8_t *mdb, BLHFSGeometry *geometry);
+static int _readHFSPlusGeometry(const uint8_t *vh, BLHFSGeometry *geometry);
+static bool _sameNode(const BLHFSGeometry *geometry, const struct stat *sb);
+static void _forgetGeometry(BLHFSVolumeRef volume);
+static int _updateHeaders(BLHFSVolumeRef volume, uint32_t startBlock, uint32_t allocated,
+						  const BLHFSForkData *startupFile);
+static void _getForkData(const uint8_t *p, BLHFSForkData *fork);
+static void _putForkData(uint8_t *p, const BLHFSForkData *fork);
+static void _getHFSForkData(const uint8_t *size, const uint8_t *extents, uint32_t blockSize, BLHFSForkData *fork);
+static int _readFork(BLHFSVolumeRef volume, const BLHFSForkData *fork, off_t position, void *buf, size_t length);
+static int _transferExtents(BLHFSVolumeRef volume, const BLDiskExtent *extents, uint32_t extentCount,
+							off_t position, void *buf, size_t length, bool write);
+static int _readNode(BLHFSVolumeRef volume, uint32_t node);
+static int _compareKeys(BLHFSVolumeRef volume, const uint8_t *key, uint32_t fileID, uint8_t forkType,
+						uint32_t startBlock);
+static int _findExtentRecord(BLHFSVolumeRef volume, uint32_t fileID, uint8_t forkType, uint32_t startBlock,
+							 BLHFSExtentDescriptor record[kBLHFSExtentDensity], bool *found);
+static int _appendExtent(BLHFSVolumeRef volume, const BLHFSExtentDescriptor *extent,
+						 BLDiskExtent **extents, uint32_t *count, uint32_t *capacity);
+
+static inline uint16_t _be16(const uint8_t *p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t _be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint64_t _be64(const uint8_t *p)
+{
+	return ((uint64_t)_be32(p) << 32) | _be32(p + 4);
+}
+
+static inline void _put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static inline void _put64(uint8_t *p, uint64_t v)
+{
+	_put32(p, (uint32_t)(v >> 32));
+	_put32(p + 4, (uint32_t)v);
+}
+
+int BLHFSVolumeCreate(const char *path, bool writable, BLHFSVolumeRef *volume)
+{
+	BLHFSVolumeRef	newVolume;
+	struct stat		sb;
+	uint8_t			buffer[512];	// raw devices only read whole sectors
+	int				i, ret;
+
+	*volume = NULL;
+
+	newVolume = calloc(1, sizeof(*newVolume));
+	if (newVolume == NULL) return 1;
+
+	newVolume->fd = open(path, writable ? O_RDWR : O_RDONLY, 0);
+	if (newVolume->fd < 0 || fstat(newVolume->fd, &sb) < 0) {
+		ret = 3;
+		goto error;
+	}
+
+	pthread_mutex_lock(&gGeometryLock);
+	for (i = 0; i < gGeometryCount; i++) {
+		if (_sameNode(&gGeometryCache[i], &sb)) {
+			newVolume->geometry = gGeometryCache[i];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&gGeometryLock);
+
+	if (i == gGeometryCount) {
+		ret = _readGeometry(newVolume->fd, &newVolume->geometry);
+		if (ret) goto error;
+
+		newVolume->geometry.dev = sb.st_dev;
+		newVolume->geometry.ino = sb.st_ino;
+		newVolume->geometry.mtime = sb.st_mtime;
+		newVolume->geometry.ctime = sb.st_ctime;
+		newVolume->geometry.size = sb.st_size;
+
+		pthread_mutex_lock(&gGeometryLock);
+		gGeometryCache[gGeometryNext] = newVolume->geometry;
+		gGeometryNext = (gGeometryNext + 1) % kBLHFSGeometryCacheSize;
+		if (gGeometryCount < kBLHFSGeometryCacheSize) gGeometryCount++;
+		pthread_mutex_unlock(&gGeometryLock);
+	}
+
+	// the tree itself changes as files are written, so its header isn't cached
+	ret = _readFork(newVolume, &newVolume->geometry.extentsFile, 0, buffer, sizeof buffer);
+	if (ret) goto error;
+
+	newVolume->nodeSize = _be16(buffer + kHeaderNodeSize);
+	newVolume->rootNode = _be32(buffer + kHeaderRootNode);
+	if (newVolume->nodeSize < 512 || (newVolume->nodeSize & (newVolume->nodeSize - 1)) != 0) {
+		ret = 4;
+		goto error;
+	}
+
+	newVolume->node = malloc(newVolume->nodeSize);
+	if (newVolume->node == NULL) {
+		ret = 1;
+		goto error;
+	}
+
+	*volume = newVolume;
+	return 0;
+
+error:
+	i = errno;
+	BLHFSVolumeRelease(newVolume);
+	errno = i;
+	return ret;
+}
+
+void BLHFSVolumeRelease(BLHFSVolumeRef volume)
+{
+	if (volume == NULL) return;
+
+	if (volume->fd >= 0) close(volume->fd);
+	free(volume->node);
+	free(volume);
+}
+
+bool BLHFSVolumeIsHFSPlus(BLHFSVolumeRef volume)
+{
+	return volume->geometry.isHFSPlus;
+}
+
+uint32_t BLHFSVolumeGetBlockSize(BLHFSVolumeRef volume)
+{
+	return volume->geometry.blockSize;
+}
+
+uint32_t BLHFSVolumeGetAttributes(BLHFSVolumeRef volume)
+{
+	return volume->geometry.attributes;
+}
+
+off_t BLHFSVolumeGetOffset(BLHFSVolumeRef volume)
+{
+	return volume->geometry.offset;
+}
+
+const BLHFSForkData *BLHFSVolumeGetCatalogFork(BLHFSVolumeRef volume)
+{
+	return &volume->geometry.catalogFile;
+}
+
+const BLHFSForkData *BLHFSVolumeGetStartupFork(BLHFSVolumeRef volume)
+{
+	return &volume->geometry.startupFile;
+}
+
+int BLHFSVolumeSetStartupFork(BLHFSVolumeRef volume, const BLHFSForkData *fork)
+{
+	int	ret;
+
+	if (!volume->geometry.isHFSPlus) return 2;
+
+	ret = _updateHeaders(volume, 0, 0, fork);
+	if (ret) return ret;
+
+	volume->geometry.startupFile = *fork;
+	return 0;
+}
+
+int BLHFSVolumeAllocateBlocks(BLHFSVolumeRef volume, uint32_t count, uint32_t *startBlock)
+{
+	BLDiskExtent	*extents = NULL;
+	uint32_t		extentCount;
+	uint32_t		totalBlocks = volume->geometry.totalBlocks;
+	uint32_t		block = 0, runStart = 0, runLength = 0, i;
+	off_t			bitmapLength = ((off_t)totalBlocks + 7) / 8;
+	off_t			first, last;
+	uint8_t			*buffer = NULL;
+	int				ret;
+
+	*startBlock = 0;
+	if (!volume->geometry.isHFSPlus) return 2;
+	if (count == 0 || count > totalBlocks) return 6;
+
+	ret = BLHFSVolumeCopyForkExtents(volume, kBLHFSAllocationFileID, kBLHFSDataForkType,
+									 &volume->geometry.allocationFile, &extents, &extentCount);
+	if (ret) return ret;
+
+	buffer = malloc(kBLHFSBitmapWindow);
+	if (buffer == NULL) {
+		ret = 1;
+		goto exit;
+	}
+
+	// first fit, a window of the bitmap at a time. Bit 7 of byte 0 is block 0
+	while (block < totalBlocks && runLength < count) {
+		off_t	position = block / 8;
+		size_t	length = (size_t)MIN((off_t)kBLHFSBitmapWindow, bitmapLength - position);
+
+		// the bitmap fork is whole allocation blocks, so rounding up stays inside it
+		length = roundup(length, 512);
+		if (BLHFSVolumeReadExtents(volume, extents, extentCount, position, buffer, length)) {
+			ret = 3;
+			goto exit;
+		}
+
+		for (i = 0; i < length * 8 && block < totalBlocks; i++, block++) {
+			if ((i & 7) == 0 && buffer[i / 8] == 0xFF && block + 8 <= totalBlocks) {
+				runLength = 0;
+				i += 7;
+				block += 7;
+				continue;
+			}
+			if (buffer[i / 8] & (0x80 >> (i & 7))) {
+				runLength = 0;
+				continue;
+			}
+			if (runLength++ == 0) runStart = block;
+			if (runLength == count) break;
+		}
+	}
+
+	if (runLength < count) {
+		ret = 6;
+		goto exit;
+	}
+
+	// now mark the run, rewriting only the sectors it touches
+	first = ((off_t)runStart / 8) & ~(off_t)511;
+	last = roundup(((off_t)runStart + count - 1) / 8 + 1, 512);
+	free(buffer);
+	buffer = malloc((size_t)(last - first));
+	if (buffer == NULL) {
+		ret = 1;
+		goto exit;
+	}
+
+	if (BLHFSVolumeReadExtents(volume, extents, extentCount, first, buffer, (size_t)(last - first))) {
+		ret = 3;
+		goto exit;
+	}
+	for (block = runStart; block < runStart + count; block++) {
+		buffer[block / 8 - first] |= 0x80 >> (block & 7);
+	}
+	if (BLHFSVolumeWriteExtents(volume, extents, extentCount, first, buffer, (size_t)(last - first))) {
+		ret = 3;
+		goto exit;
+	}
+
+	ret = _updateHeaders(volume, runStart, count, NULL);
+	if (ret) goto exit;
+
+	*startBlock = runStart;
+
+exit:
+	free(extents);
+	free(buffer);
+
+	return ret;
+}
+
+int BLHFSVolumeReadExtents(BLHFSVolumeRef volume, const BLDiskExtent *extents, uint32_t extentCount,
+						   off_t position, void *buf, size_t length)
+{
+	return _transferExtents(volume, extents, extentCount, position, buf, length, false);
+}
+
+int BLHFSVolumeWriteExtents(BLHFSVolumeRef volume, const BLDiskExtent *extents, uint32_t extentCount,
+							off_t position, const void *buf, size_t length)
+{
+	return _transferExtents(volume, extents, extentCount, position, (void *)buf, length, true);
+}
+
+int BLHFSVolumeWriteExtentsVector(BLHFSVolumeRef volume, const BLDiskExtent *extents, uint32_t extentCount,
+								  off_t position, const struct iovec *iov, int iovcnt)
+{
+	struct iovec	batch[MIN(IOV_MAX, 1024)];
+	off_t			extentStart = 0, extentLength;
+	size_t			skip = 0;		// bytes of iov[v] already written
+	uint32_t		i;
+	int				v = 0;
+
+	for (i = 0; i < extentCount; i++, extentStart += extentLength) {
+		off_t	device, room;
+
+		while (v < iovcnt && iov[v].iov_len == skip) {
+			v++;
+			skip = 0;
+		}
+		if (v == iovcnt) break;
+
+		extentLength = extents[i].length * 512;
+		if (position >= extentStart + extentLength) continue;
+
+		device = extents[i].start * 512 + (position - extentStart);
+		room = extentStart + extentLength - position;
+
+		// each write covers as much of the vector as fits in this extent
+		while (room > 0 && v < iovcnt) {
+			size_t	total = 0;
+			int		n = 0;
+
+			while (n < (int)(sizeof(batch) / sizeof(batch[0])) && v < iovcnt && (off_t)total < room) {
+				size_t	length = (size_t)MIN((off_t)(iov[v].iov_len - skip), room - (off_t)total);
+
+				batch[n].iov_base = (uint8_t *)iov[v].iov_base + skip;
+				batch[n].iov_len = length;
+				n++;
+				total += length;
+				skip += length;
+				while (v < iovcnt && iov[v].iov_len == skip) {
+					v++;
+					skip = 0;
+				}
+			}
+
+			if (pwritev(volume->fd, batch, n, device) != (ssize_t)total) return 3;
+
+			device += total;
+			position += total;
+			room -= total;
+		}
+	}
+
+	return v < iovcnt ? 4 : 0;
+}
+
+int BLHFSVolumeCopyForkExtents(BLHFSVolumeRef volume, uint32_t fileID, uint8_t forkType,
+							   const BLHFSForkData *fork, BLDiskExtent **extents, uint32_t *extentCount)
+{
+	BLHFSExtentDescriptor	record[kBLHFSExtentDensity];
+	BLDiskExtent			*list = NULL;
+	uint32_t				count = 0, capacity = 0;
+	uint32_t				covered = 0;
+	bool					found;
+	int						i, ret;
+
+	*extents = NULL;
+	*extentCount = 0;
+
+	for (i = 0; i < kBLHFSExtentDensity && fork->extents[i].blockCount; i++) {
+		if (_appendExtent(volume, &fork->extents[i], &list, &count, &capacity)) goto nomem;
+		covered += fork->extents[i].blockCount;
+	}
+
+	while (covered < fork->totalBlocks) {
+		ret = _findExtentRecord(volume, fileID, forkType, covered, record, &found);
+		if (ret) goto error;
+		if (!found || record[0].blockCount == 0) {
+			ret = 5;
+			goto error;
+		}
+
+		for (i = 0; i < kBLHFSExtentDensity && record[i].blockCount; i++) {
+			if (_appendExtent(volume, &record[i], &list, &count, &capacity)) goto nomem;
+			covered += record[i].blockCount;
+		}
+	}
+
+	*extents = list;
+	*extentCount = count;
+	return 0;
+
+nomem:
+	ret = 1;
+error:
+	free(list);
+	return ret;
+}
+
+static int _readGeometry(int fd, BLHFSGeometry *geometry)
+{
+	uint8_t		buffer[512];
+	uint16_t	signature;
+
+	memset(geometry, 0, sizeof(*geometry));
+
+	if (pread(fd, buffer, sizeof buffer, kBLHFSHeaderOffset) != sizeof buffer) {
+		if (errno == 0) errno = EIO;
+		return 3;
+	}
+
+	signature = _be16(buffer + kMDBSigWord);
+	if (signature == kBLHFSSigWord) {
+		uint32_t	blockSize = _be32(buffer + kMDBAlBlkSiz);
+
+		if (blockSize < 512 || (blockSize % 512) != 0) return 4;
+
+		if (_be16(buffer + kMDBEmbedSigWord) != kBLHFSPlusSigWord) {
+			// pure HFS
+			_readHFSGeometry(buffer, geometry);
+			return 0;
+		}
+
+		// HFS+ embedded in an HFS wrapper
+		geometry->offset = ((off_t)_be16(buffer + kMDBAlBlSt)
+							+ (off_t)_be16(buffer + kMDBEmbedExtent) * (blockSize >> 9)) * 512;
+
+		if (pread(fd, buffer, sizeof buffer, geometry->offset + kBLHFSHeaderOffset) != sizeof buffer) {
+			if (errno == 0) errno = EIO;
+			return 3;
+		}
+		signature = _be16(buffer + kVHSignature);
+	}
+
+	if (signature != kBLHFSPlusSigWord && signature != kBLHFSXSigWord) return 2;
+
+	return _readHFSPlusGeometry(buffer, geometry);
+}
+
+static void _readHFSGeometry(const uint8_t *mdb, BLHFSGeometry *geometry)
+{
+	// allocation blocks start drAlBlSt sectors in, rather than at 0
+	geometry->isHFSPlus = false;
+	geometry->offset = (off_t)_be16(mdb + kMDBAlBlSt) * 512;
+	geometry->attributes = _be16(mdb + kMDBAtrb);
+	geometry->blockSize = _be32(mdb + kMDBAlBlkSiz);
+	geometry->totalBlocks = _be16(mdb + kMDBNmAlBlks);
+
+	_getHFSForkData(mdb + kMDBXTFlSize, mdb + kMDBXTExtRec, geometry->blockSize, &geometry->extentsFile);
+	_getHFSForkData(mdb + kMDBCTFlSize, mdb + kMDBCTExtRec, geometry->blockSize, &geometry->catalogFile);
+}
+
+static int _readHFSPlusGeometry(const uint8_t *vh, BLHFSGeometry *geometry)
+{
+	geometry->isHFSPlus = true;
+	geometry->attributes = _be32(vh + kVHAttributes);
+	geometry->blockSize = _be32(vh + kVHBlockSize);
+	geometry->totalBlocks = _be32(vh + kVHTotalBlocks);
+	if (geometry->blockSize < 512 || (geometry->blockSize & (geometry->blockSize - 1)) != 0) return 4;
+
+	_getForkData(vh + kVHAllocationFile, &geometry->allocationFile);
+	_getForkData(vh + kVHExtentsFile, &geometry->extentsFile);
+	_getForkData(vh + kVHCatalogFile, &geometry->catalogFile);
+	_getForkData(vh + kVHStartupFile, &geometry->startupFile);
+
+	return 0;
+}
+
+// Modification and status change times only have whole seconds
+// everywhere, so the size is compared too
+static bool _sameNode(const BLHFSGeometry *geometry, const struct stat *sb)
+{
+	return geometry->dev == sb->st_dev && geometry->ino == sb->st_ino
+		   && geometry->mtime == sb->st_mtime && geometry->ctime == sb->st_ctime
+		   && geometry->size == sb->st_size;
+}
+
+// A device node's times may not change as it is written, so drop
+// anything cached for it once its header has been rewritten
+static void _forgetGeometry(BLHFSVolumeRef volume)
+{
+	int	i;
+
+	pthread_mutex_lock(&gGeometryLock);
+	for (i = 0; i < gGeometryCount; i++) {
+		if (gGeometryCache[i].dev == volume->geometry.dev && gGeometryCache[i].ino == volume->geometry.ino) {
+			gGeometryCache[i].size = -1;	// never matches a stat
+		}
+	}
+	pthread_mutex_unlock(&gGeometryLock);
+}
+
+/*
+ * Rewrite the primary and alternate volume headers with allocated
+ * blocks from startBlock taken from the free count and, if given, a new
+ * startup file fork. Either way the volume is modified now, and written
+ * once more, as fsck and the mounting kernel expect
+ */
+static int _updateHeaders(BLHFSVolumeRef volume, uint32_t startBlock, uint32_t allocated,
+						  const BLHFSForkData *startupFile)
+{
+	uint8_t		buffer[512];
+	off_t		locations[2];
+	uint16_t	signature;
+	uint32_t	freeBlocks, nextAllocation;
+	uint32_t	now = (uint32_t)time(NULL) + kHFSEpochOffset;
+	int			i;
+
+	locations[0] = volume->geometry.offset + kBLHFSHeaderOffset;
+	locations[1] = volume->geometry.offset + (off_t)volume->geometry.totalBlocks * volume->geometry.blockSize - 1024;
+
+	for (i = 0; i < 2; i++) {
+		if (pread(volume->fd, buffer, sizeof buffer, locations[i]) != sizeof buffer) return 3;
+
+		signature = _be16(buffer + kVHSignature);
+		if (signature != kBLHFSPlusSigWord && signature != kBLHFSXSigWord) {
+			if (i == 0) return 4;
+			break;		// no alternate volume header
+		}
+
+		freeBlocks = _be32(buffer + kVHFreeBlocks);
+		_put32(buffer + kVHFreeBlocks, freeBlocks > allocated ? freeBlocks - allocated : 0);
+		if (allocated) {
+			nextAllocation = startBlock + allocated;
+			_put32(buffer + kVHNextAllocation, nextAllocation < volume->geometry.totalBlocks ? nextAllocation : 0);
+		}
+		if (startupFile) _putForkData(buffer + kVHStartupFile, startupFile);
+		_put32(buffer + kVHModifyDate, now);
+		_put32(buffer + kVHWriteCount, _be32(buffer + kVHWriteCount) + 1);
+
+		if (pwrite(volume->fd, buffer, sizeof buffer, locations[i]) != sizeof buffer) return 3;
+	}
+
+	_forgetGeometry(volume);
+	return 0;
+}
+
+static void _getForkData(const uint8_t *p, BLHFSForkData *fork)
+{
+	int	i;
+
+	fork->logicalSize = _be64(p);
+	fork->clumpSize = _be32(p + 8);
+	fork->totalBlocks = _be32(p + 12);
+	for (i = 0; i < kBLHFSExtentDensity; i++) {
+		fork->extents[i].startBlock = _be32(p + 16 + 8 * i);
+		fork->extents[i].blockCount = _be32(p + 20 + 8 * i);
+	}
+}
+
+static void _putForkData(uint8_t *p, const BLHFSForkData *fork)
+{
+	int	i;
+
+	_put64(p, fork->logicalSize);
+	_put32(p + 8, fork->clumpSize);
+	_put32(p + 12, fork->totalBlocks);
+	for (i = 0; i < kBLHFSExtentDensity; i++) {
+		_put32(p + 16 + 8 * i, fork->extents[i].startBlock);
+		_put32(p + 20 + 8 * i, fork->extents[i].blockCount);
+	}
+}
+
+// An HFS fork is a 32-bit size and three 16-bit extents
+static void _getHFSForkData(const uint8_t *size, const uint8_t *extents, uint32_t blockSize, BLHFSForkData *fork)
+{
+	int	i;
+
+	memset(fork, 0, sizeof(*fork));
+	fork->logicalSize = _be32(size);
+	fork->totalBlocks = (uint32_t)((fork->logicalSize + blockSize - 1) / blockSize);
+	for (i = 0; i < kHFSExtentDensity; i++) {
+		fork->extents[i].startBlock = _be16(extents + 4 * i);
+		fork->extents[i].blockCount = _be16(extents + 4 * i + 2);
+	}
+}
+
+// Read from a fork described entirely by its own extents, as the
+// B-tree files are. A read may span extents
+static int _readFork(BLHFSVolumeRef volume, const BLHFSForkData *fork, off_t position, void *buf, size_t length)
+{
+	uint8_t		*p = buf;
+	off_t		extentStart = 0, extentLength;
+	uint32_t	blockSize = volume->geometry.blockSize;
+	int			i;
+
+	for (i = 0; i < kBLHFSExtentDensity && length > 0; i++) {
+		off_t	device;
+		size_t	chunk;
+
+		extentLength = (off_t)fork->extents[i].blockCount * blockSize;
+		if (extentLength == 0) break;
+
+		if (position < extentStart + extentLength) {
+			device = volume->geometry.offset + (off_t)fork->extents[i].startBlock * blockSize
+					 + (position - extentStart);
+			chunk = (size_t)MIN((off_t)length, extentStart + extentLength - position);
+
+			if (pread(volume->fd, p, chunk, device) != (ssize_t)chunk) return 3;
+
+			p += chunk;
+			position += chunk;
+			length -= chunk;
+		}
+		extentStart += extentLength;
+	}
+
+	return length > 0 ? 4 : 0;
+}
+
+static int _transferExtents(BLHFSVolumeRef volume, const BLDiskExtent *extents, uint32_t extentCount,
+							off_t position, void *buf, size_t length, bool write)
+{
+	uint8_t		*p = buf;
+	off_t		extentStart = 0, extentLength;
+	uint32_t	i;
+
+	for (i = 0; i < extentCount && length > 0; i++) {
+		off_t	device;
+		size_t	chunk;
+		ssize_t	done;
+
+		extentLength = extents[i].length * 512;
+		if (position < extentStart + extentLength) {
+			chunk = (size_t)MIN((off_t)length, extentStart + extentLength - position);
+			device = extents[i].start * 512 + (position - extentStart);
+
+			done = write ? pwrite(volume->fd, p, chunk, device) : pread(volume->fd, p, chunk, device);
+			if (done != (ssize_t)chunk) return 3;
+
+			p += chunk;
+			position += chunk;
+			length -= chunk;
+		}
+		extentStart += extentLength;
+	}
+
+	return length > 0 ? 4 : 0;
+}
+
+static int _readNode(BLHFSVolumeRef volume, uint32_t node)
+{
+	uint8_t		kind;
+	uint16_t	numRecords;
+
+	if (_readFork(volume, &volume->geometry.extentsFile, (off_t)node * volume->nodeSize,
+				  volume->node, volume->nodeSize)) {
+		return 3;
+	}
+
+	kind = volume->node[kNodeKind];
+	numRecords = _be16(volume->node + kNodeNumRecords);
+	if ((kind != kNodeKindIndex && kind != kNodeKindLeaf)
+		|| kNodeDescriptorSize + (size_t)numRecords * sizeof(uint16_t) > volume->nodeSize) {
+		return 4;
+	}
+
+	return 0;
+}
+
+// Extent keys order by file, then fork, then first block. HFS keys are
+// a length byte, fork type, file ID and a 16-bit block; HFS+ keys a
+// length word, fork type, a pad byte, file ID and a 32-bit block
+static int _compareKeys(BLHFSVolumeRef volume, const uint8_t *key, uint32_t fileID, uint8_t forkType,
+						uint32_t startBlock)
+{
+	uint8_t		keyForkType;
+	uint32_t	keyFileID, keyStartBlock;
+
+	if (volume->geometry.isHFSPlus) {
+		keyForkType = key[2];
+		keyFileID = _be32(key + 4);
+		keyStartBlock = _be32(key + 8);
+	} else {
+		keyForkType = key[1];
+		keyFileID = _be32(key + 2);
+		keyStartBlock = _be16(key + 6);
+	}
+
+	if (keyFileID != fileID) return keyFileID < fileID ? -1 : 1;
+	if (keyForkType != forkType) return keyForkType < forkType ? -1 : 1;
+	if (keyStartBlock != startBlock) return keyStartBlock < startBlock ? -1 : 1;
+
+	return 0;
+}
+
+static int _findExtentRecord(BLHFSVolumeRef volume, uint32_t fileID, uint8_t forkType, uint32_t startBlock,
+							 BLHFSExtentDescriptor record[kBLHFSExtentDensity], bool *found)
+{
+	bool		isHFSPlus = volume->geometry.isHFSPlus;
+	size_t		keySize = isHFSPlus ? kHFSPlusExtentKeyLength : kHFSExtentKeyLength;
+	size_t		recordSize = isHFSPlus ? kBLHFSExtentDensity * 8 : kHFSExtentDensity * 4;
+	uint32_t	node = volume->rootNode;
+	int			depth, ret;
+
+	*found = false;
+
+	for (depth = 0; node != 0 && depth < kBLHFSMaxTreeDepth; depth++) {
+		uint8_t		kind;
+		uint16_t	numRecords, i;
+		size_t		tableStart;
+		uint32_t	child = 0;
+
+		ret = _readNode(volume, node);
+		if (ret) return ret;
+
+		kind = volume->node[kNodeKind];
+		numRecords = _be16(volume->node + kNodeNumRecords);
+		tableStart = volume->nodeSize - (size_t)numRecords * sizeof(uint16_t);
+		node = 0;
+
+		for (i = 0; i < numRecords; i++) {
+			uint16_t		offset = _be16(volume->node + volume->nodeSize - (i + 1) * sizeof(uint16_t));
+			const uint8_t	*key = volume->node + offset;
+			size_t			dataOffset;
+			int				cmp, j;
+
+			if (offset < kNodeDescriptorSize || offset + keySize > tableStart) return 4;
+
+			// HFS keys are padded to an even length
+			if (isHFSPlus) {
+				dataOffset = offset + sizeof(uint16_t) + _be16(key);
+			} else {
+				dataOffset = (offset + 1 + key[0] + 1) & ~(size_t)1;
+			}
+
+			cmp = _compareKeys(volume, key, fileID, forkType, startBlock);
+			if (cmp > 0) break;
+
+			if (kind == kNodeKindIndex) {
+				if (dataOffset + sizeof(uint32_t) > tableStart) return 4;
+				child = _be32(volume->node + dataOffset);
+			} else if (cmp == 0) {
+				const uint8_t	*data = volume->node + dataOffset;
+
+				if (dataOffset + recordSize > tableStart) return 4;
+
+				memset(record, 0, kBLHFSExtentDensity * sizeof(record[0]));
+				for (j = 0; j < (isHFSPlus ? kBLHFSExtentDensity : kHFSExtentDensity); j++) {
+					if (isHFSPlus) {
+						record[j].startBlock = _be32(data + 8 * j);
+						record[j].blockCount = _be32(data + 8 * j + 4);
+					} else {
+						record[j].startBlock = _be16(data + 4 * j);
+						record[j].blockCount = _be16(data + 4 * j + 2);
+					}
+				}
+				*found = true;
+				return 0;
+			}
+		}
+
+		// in an index node, descend into the last child not after the key
+		if (kind == kNodeKindIndex) node = child;
+	}
+
+	// deeper than any real tree, so probably a loop
+	if (node != 0) return 4;
+
+	return 0;
+}
+
+static int _appendExtent(BLHFSVolumeRef volume, const BLHFSExtentDescriptor *extent,
+						 BLDiskExtent **extents, uint32_t *count, uint32_t *capacity)
+{
+	off_t	sectorsPerBlock = volume->geometry.blockSize / 512;
+	off_t	start = volume->geometry.offset / 512 + (off_t)extent->startBlock * sectorsPerBlock;
+	off_t	length = (off_t)extent->blockCount * sectorsPerBlock;
+
+	// physically contiguous neighbours are reported as one extent
+	if (*count > 0 && (*extents)[*count - 1].start + (*extents)[*count - 1].length == start) {
+		(*extents)[*count - 1].length += length;
+		return 0;
+	}
+
+	if (*count == *capacity) {
+		uint32_t		newCapacity = *capacity ? *capacity * 2 : 16;
+		BLDiskExtent	*list = realloc(*extents, newCapacity * sizeof(BLDiskExtent));
+
+		if (list == NULL) return 1;
+		*extents = list;
+		*capacity = newCapacity;
+	}
+
+	(*extents)[*count].start = start;
+	(*extents)[*count].length = length;
+	(*count)++;
+
+	return 0;
+}
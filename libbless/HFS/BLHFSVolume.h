@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLHFSVolume.h
+//
+//  HFS and HFS+ volumes read (or written) directly on a device node or
+//  an image file, so no mount is needed. Only the C library is used,
+//  and on-disk fields are decoded byte by byte, so image files can be
+//  checked anywhere. I/O on raw devices must be in whole sectors.
+//
+//  The volume header is read once per device and its geometry kept for
+//  as long as the node is unchanged. Extents are in 512-byte sectors
+//  from the start of the device or image. Plain HFS volumes can be read
+//  (fork extents, including the extents overflow file); only HFS+ can be
+//  written.
+//
+
+#ifndef _BLHFSVOLUME_H_
+#define _BLHFSVOLUME_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifndef _BLDISKEXTENT_DEFINED
+#define _BLDISKEXTENT_DEFINED
+typedef struct {
+    off_t   start;
+    off_t   length;
+} BLDiskExtent;
+#endif
+
+#define kBLHFSSigWord				0x4244	// 'BD'
+#define kBLHFSPlusSigWord			0x482B	// 'H+'
+#define kBLHFSXSigWord				0x4858	// 'HX'
+
+// volume attributes
+#define kBLHFSVolumeUnmountedMask	0x00000100
+
+#define kBLHFSExtentDensity			8		// HFS+ extents per record; HFS has 3
+#define kBLHFSDataForkType			0x00
+#define kBLHFSResourceForkType		0xFF
+#define kBLHFSExtentsFileID			3
+#define kBLHFSCatalogFileID			4
+#define kBLHFSAllocationFileID		6
+#define kBLHFSStartupFileID			7
+
+// in allocation blocks
+typedef struct {
+	uint32_t	startBlock;
+	uint32_t	blockCount;
+} BLHFSExtentDescriptor;
+
+// HFSPlusForkData, in host byte order. Plain HFS forks fill the first three extents
+typedef struct {
+	uint64_t				logicalSize;
+	uint32_t				clumpSize;
+	uint32_t				totalBlocks;
+	BLHFSExtentDescriptor	extents[kBLHFSExtentDensity];
+} BLHFSForkData;
+
+struct iovec;
+typedef struct BLHFSVolume *BLHFSVolumeRef;
+
+/*
+ * Returns 3 if path can't be opened or read (errno is set), 2 if it
+ * isn't HFS or HFS+, 4 if the volume or extents overflow header is damaged.
+ */
+int BLHFSVolumeCreate(const char *path, bool writable, BLHFSVolumeRef *volume);
+void BLHFSVolumeRelease(BLHFSVolumeRef volume);
+
+// false for plain HFS
+bool BLHFSVolumeIsHFSPlus(BLHFSVolumeRef volume);
+uint32_t BLHFSVolumeGetBlockSize(BLHFSVolumeRef volume);
+uint32_t BLHFSVolumeGetAttributes(BLHFSVolumeRef volume);
+
+// bytes from the start of the device to the volume: an HFS+ volume in an
+// HFS wrapper, or the first allocation block of plain HFS
+off_t BLHFSVolumeGetOffset(BLHFSVolumeRef volume);
+
+/*
+ * Every extent of a fork: those in fork, then those in the extents
+ * overflow file, up to fork->totalBlocks. Returns 1 if out of memory,
+ * 3 or 4 if the overflow file can't be read or is damaged, 5 if it
+ * doesn't cover the whole fork. Caller frees *extents
+ */
+int BLHFSVolumeCopyForkExtents(BLHFSVolumeRef volume, uint32_t fileID, uint8_t forkType,
+							   const BLHFSForkData *fork, BLDiskExtent **extents, uint32_t *extentCount);
+
+// the catalog and startup files' forks. Plain HFS has no startup file
+const BLHFSForkData *BLHFSVolumeGetCatalogFork(BLHFSVolumeRef volume);
+const BLHFSForkData *BLHFSVolumeGetStartupFork(BLHFSVolumeRef volume);
+
+/*
+ * Both of these rewrite the primary and alternate volume headers,
+ * setting their modify date and counting one more write.
+ */
+
+// store a new startup file fork in both volume headers; 2 on plain HFS
+int BLHFSVolumeSetStartupFork(BLHFSVolumeRef volume, const BLHFSForkData *fork);
+
+// mark the first run of count free allocation blocks as used, and start
+// the next allocation after it; 6 if there is none, 2 on plain HFS
+int BLHFSVolumeAllocateBlocks(BLHFSVolumeRef volume, uint32_t count, uint32_t *startBlock);
+
+// read from, or write to, a file laid out as extents; 4 if it ends before length bytes
+int BLHFSVolumeReadExtents(BLHFSVolumeRef volume, const BLDiskExtent *extents, uint32_t extentCount,
+						   off_t position, void *buf, size_t length);
+int BLHFSVolumeWriteExtents(BLHFSVolumeRef volume, const BLDiskExtent *extents, uint32_t extentCount,
+							off_t position, const void *buf, size_t length);
+
+// gather-write a vector, one pwritev per extent it spans
+int BLHFSVolumeWriteExtentsVector(BLHFSVolumeRef volume, const BLDiskExtent *extents, uint32_t extentCount,
+								  off_t position, const struct iovec *iov, int iovcnt);
+
+#endif // _BLHFSVOLUME_H_
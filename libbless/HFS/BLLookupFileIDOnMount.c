@@ -56,8 +56,16 @@ struct cataloginforeturn {
   struct cataloginfo c;
 };
 
+struct objidreturn {
+  uint32_t length;
+  fsobj_id_t objectid;
+} __attribute__((aligned(4), packed));
+
 
 static int lookupIDOnVolID(uint32_t volid, uint32_t fileID, char *out);
+static int lookupIDsInCatalog(BLContextPtr context, const char *mount, const uint32_t *fileIDs,
+                              uint32_t count, char **out, bool *resolved);
+static bool pathHasFileID(const char *path, uint32_t fileID);
 
 int BLLookupFileIDOnMount(BLContextPtr context, const char *mount, uint32_t fileID, char *out) {
     struct attrlist alist;
@@ -105,6 +113,36 @@ int BLLookupFileIDOnMount(BLContextPtr context, const char *mount, uint32_t file
 
 
 
+/*
+ * Read the catalog once for all of fileIDs, and only fall back
+ * to volfs for those it doesn't know (or if it can't be read)
+ */
+int BLLookupFileIDsOnMount(BLContextPtr context, const char *mount, const uint32_t *fileIDs,
+                           uint32_t count, char **out) {
+    bool *resolved;
+    uint32_t i;
+    int err = 0;
+
+    resolved = calloc(count ? count : 1, sizeof(bool));
+    if (resolved == NULL) {
+        return ENOMEM;
+    }
+
+    lookupIDsInCatalog(context, mount, fileIDs, count, out, resolved);
+
+    for (i = 0; i < count; i++) {
+        if (resolved[i]) continue;
+
+        err = BLLookupFileIDOnMount(context, mount, fileIDs[i], out[i]);
+        if (err && fileIDs[i] >= kHFSRootFolderID) {
+            contextprintf(context, kBLLogLevelVerbose, "Could not look up file ID %u: %d\n", fileIDs[i], err);
+        }
+    }
+
+    free(resolved);
+    return 0;
+}
+
 int BLLookupFileIDOnMount64(BLContextPtr context, const char *mountpoint, uint64_t fileID, char *out, int bufsize)
 {
     int err;
@@ -199,3 +237,90 @@ static int lookupIDOnVolID(uint32_t volid, uint32_t fileID, char *out) {
     memmove(out, bp, strlen(bp)+1);
     return 0;
 }
+
+static int lookupIDsInCatalog(BLContextPtr context, const char *mount, const uint32_t *fileIDs,
+                              uint32_t count, char **out, bool *resolved) {
+    struct statfs sfs;
+    char rawdev[MNAMELEN];
+    BLHFSVolumeRef volume;
+    BLHFSCatalogIndexRef index;
+    const char **paths;
+    uint32_t i, wanted = 0;
+    int err;
+
+    for (i = 0; i < count; i++) {
+        if (fileIDs[i] >= kHFSRootFolderID) wanted++;
+    }
+    if (wanted < 2) {
+        return 0; // not worth reading the catalog
+    }
+
+    if (statfs(mount, &sfs) < 0) {
+        return errno;
+    }
+    if (strcmp(sfs.f_fstypename, "hfs") != 0 || strncmp(sfs.f_mntfromname, "/dev/", 5) != 0) {
+        return ENOTSUP;
+    }
+
+    snprintf(rawdev, sizeof(rawdev), "/dev/r%s", sfs.f_mntfromname + 5);
+
+    err = BLHFSVolumeCreate(rawdev, false, &volume);
+    if (err) {
+        contextprintf(context, kBLLogLevelVerbose, "Can't read HFS volume header from %s: %d\n", rawdev, err);
+        return err;
+    }
+
+    err = BLHFSCatalogIndexCreate(context, volume, &index);
+    BLHFSVolumeRelease(volume);
+    if (err) {
+        return err;
+    }
+
+    paths = calloc(count, sizeof(*paths));
+    if (paths == NULL) {
+        BLHFSCatalogIndexRelease(index);
+        return ENOMEM;
+    }
+
+    BLHFSCatalogIndexGetPaths(context, index, fileIDs, count, paths);
+
+    for (i = 0; i < count; i++) {
+        // the on-disk catalog may lag the mounted volume; those go to volfs
+        if (fileIDs[i] < kHFSRootFolderID || paths[i] == NULL) continue;
+
+        if (strcmp(mount, "/")) {
+            snprintf(out[i], MAXPATHLEN, "%s/%s", mount, paths[i]);
+        } else {
+            snprintf(out[i], MAXPATHLEN, "/%s", paths[i]);
+        }
+
+        // and so may the names in it, if something was renamed since
+        if (!pathHasFileID(out[i], fileIDs[i])) {
+            contextprintf(context, kBLLogLevelVerbose, "Catalog path %s is no longer file ID %u\n",
+                          out[i], fileIDs[i]);
+            out[i][0] = '\0';
+            continue;
+        }
+        resolved[i] = true;
+    }
+
+    free(paths);
+    BLHFSCatalogIndexRelease(index);
+
+    return 0;
+}
+
+static bool pathHasFileID(const char *path, uint32_t fileID) {
+    struct attrlist alist;
+    struct objidreturn objid;
+
+    memset(&alist, 0, sizeof(alist));
+    alist.bitmapcount = ATTR_BIT_MAP_COUNT;
+    alist.commonattr = ATTR_CMN_OBJID;
+
+    if (getattrlist(path, &alist, &objid, sizeof(objid), FSOPT_NOFOLLOW) < 0) {
+        return false;
+    }
+
+    return objid.objectid.fid_objno == fileID;
+}
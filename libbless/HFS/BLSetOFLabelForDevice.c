@@ -54,6 +54,10 @@ int BLSetDiskLabelForDevice(BLContextPtr context,
 	uint32_t        blessedID;
 	BLUpdateBooterFileSpec	spec;
     
+	if (BLPlanIsRecording(context)) {
+		return BLPlanRecordDiskLabel(context, device, label, scale);
+	}
+	
 	status = GetBlessedFolder(context, device, &blessedID);
 	if (status) {
 		return 1;
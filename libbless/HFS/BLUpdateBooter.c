@@ -32,18 +32,311 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <unistd.h>
+#include <string.h>
 #include <sys/param.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <hfs/hfs_format.h>
 
 #include <CoreFoundation/CoreFoundation.h>
 
 #include "bless.h"
 #include "bless_private.h"
 
+// offsets within an HFSPlusCatalogFile record
+#define kFileRecordFileID		8
+#define kFileRecordType			48
+#define kFileRecordCreator		52
+#define kFileRecordDataFork		88
+#define kFileRecordLength		248
+
+typedef struct {
+	bool			found;
+	uint32_t		fileID;
+	off_t			position;		// of the file record, within the catalog file
+	BLHFSForkData	dataFork;
+} BLUpdateBooterMatch;
+
+typedef struct {
+	BLUpdateBooterFileSpec	*specs;
+	BLUpdateBooterMatch		*matches;
+	int32_t					specCount;
+	int32_t					remaining;
+} BLUpdateBooterScan;
+
+static int matchRecord(BLContextPtr context, const BLHFSCatalogRecord *record, void *refcon);
+static int updateFile(BLContextPtr context, BLHFSVolumeRef volume, const BLDiskExtent *catalog,
+					  uint32_t catalogCount, BLUpdateBooterFileSpec *spec, BLUpdateBooterMatch *match);
+static bool isMounted(const char *device);
+static uint32_t get32(const uint8_t *p);
+static void put32(uint8_t *p, uint32_t value);
+
+/*
+ * Find the files described by specs in one pass over the catalog of
+ * device (or an image file), and overwrite their data fork in place
+ * with each spec's payload if it fits in the space already allocated.
+ * The volume must not be mounted.
+ */
 int BLUpdateBooter(BLContextPtr context, const char * device,
 				   BLUpdateBooterFileSpec *specs,
 				   int32_t specCount)
 {
-	return 1;	
+	BLUpdateBooterScan	scan;
+	BLHFSVolumeRef		volume = NULL;
+	BLDiskExtent		*catalog = NULL;
+	uint32_t			catalogCount = 0;
+	char				rawdev[MAXPATHLEN];
+	int32_t				i;
+	int					ret;
+
+	for (i = 0; i < specCount; i++) {
+		specs[i].foundFile = 0;
+		specs[i].updatedFile = 0;
+	}
+
+	if (isMounted(device)) {
+		contextprintf(context, kBLLogLevelError, "%s is mounted, and can't be updated in place\n", device);
+		return 1;
+	}
+
+	if (strncmp(device, "/dev/", 5) == 0) {
+		snprintf(rawdev, sizeof(rawdev), "/dev/r%s", device + 5);
+	} else {
+		strlcpy(rawdev, device, sizeof(rawdev));
+	}
+
+	ret = BLHFSVolumeCreate(rawdev, true, &volume);
+	if (ret) {
+		contextprintf(context, kBLLogLevelError, "Could not read HFS volume header from %s: %d\n", rawdev, ret);
+		return 2;
+	}
+
+	if (!BLHFSVolumeIsHFSPlus(volume)) {
+		contextprintf(context, kBLLogLevelError, "%s is not HFS+\n", device);
+		BLHFSVolumeRelease(volume);
+		return 2;
+	}
+
+	if (!(BLHFSVolumeGetAttributes(volume) & kHFSVolumeUnmountedMask)) {
+		contextprintf(context, kBLLogLevelError, "%s was not cleanly unmounted\n", device);
+		BLHFSVolumeRelease(volume);
+		return 3;
+	}
+
+	scan.specs = specs;
+	scan.specCount = specCount;
+	scan.remaining = specCount;
+	scan.matches = calloc(specCount ? specCount : 1, sizeof(BLUpdateBooterMatch));
+	if (scan.matches == NULL) {
+		BLHFSVolumeRelease(volume);
+		return 1;
+	}
+
+	ret = BLHFSCatalogIterate(context, volume, matchRecord, &scan);
+	if (ret < 0) ret = 0;	// every spec was matched before the end
+	if (ret) {
+		contextprintf(context, kBLLogLevelError, "Could not scan catalog of %s\n", device);
+		ret = 4;
+		goto exit;
+	}
+
+	if (scan.remaining < specCount) {
+		ret = BLHFSVolumeCopyForkExtents(volume, kBLHFSCatalogFileID, kBLHFSDataForkType,
+										 BLHFSVolumeGetCatalogFork(volume), &catalog, &catalogCount);
+		if (ret) {
+			contextprintf(context, kBLLogLevelError, "Can't map the catalog file of %s: %d\n", device, ret);
+			ret = 4;
+			goto exit;
+		}
+	}
+
+	for (i = 0; i < specCount; i++) {
+		if (!scan.matches[i].found) {
+			contextprintf(context, kBLLogLevelVerbose, "No file found for spec %d\n", i);
+			continue;
+		}
+
+		specs[i].foundFile = 1;
+		if (updateFile(context, volume, catalog, catalogCount, &specs[i], &scan.matches[i]) == 0) {
+			specs[i].updatedFile = 1;
+		}
+	}
+
+exit:
+	free(catalog);
+	free(scan.matches);
+	BLHFSVolumeRelease(volume);
+
+	return ret;
 }
 
+static int matchRecord(BLContextPtr context, const BLHFSCatalogRecord *record, void *refcon)
+{
+	BLUpdateBooterScan	*scan = refcon;
+	char				name[3 * 255 + 1];
+	bool				haveName = false;
+	uint32_t			type, creator;
+	int32_t				i;
+	int					j;
+
+	if (record->dataLength < kFileRecordLength
+		|| (int16_t)((record->data[0] << 8) | record->data[1]) != kHFSPlusFileRecord) {
+		return 0;
+	}
+
+	type = get32(record->data + kFileRecordType);
+	creator = get32(record->data + kFileRecordCreator);
+
+	for (i = 0; i < scan->specCount; i++) {
+		BLUpdateBooterFileSpec	*spec = &scan->specs[i];
+		BLUpdateBooterMatch		*match = &scan->matches[i];
+		const uint8_t			*fork;
+
+		if (spec->reqType && spec->reqType != type) continue;
+		if (spec->reqCreator && spec->reqCreator != creator) continue;
+		if (spec->reqParentDir && spec->reqParentDir != record->parentID) continue;
+		if (spec->reqFilename) {
+			if (!haveName) {
+				if (record->nameLength > 255) continue;
+				BLHFSCatalogNameToUTF8(record->name, record->nameLength, name);
+				haveName = true;
+			}
+			if (strcmp(name, spec->reqFilename) != 0) continue;
+		}
+
+		if (match->found) {
+			contextprintf(context, kBLLogLevelVerbose, "Spec %d also matches file %u; keeping file %u\n",
+						  i, get32(record->data + kFileRecordFileID), match->fileID);
+			continue;
+		}
+
+		match->found = true;
+		match->fileID = get32(record->data + kFileRecordFileID);
+		match->position = record->position;
+
+		fork = record->data + kFileRecordDataFork;
+		match->dataFork.logicalSize = (uint64_t)get32(fork) << 32 | get32(fork + 4);
+		match->dataFork.clumpSize = get32(fork + 8);
+		match->dataFork.totalBlocks = get32(fork + 12);
+		for (j = 0; j < kHFSPlusExtentDensity; j++) {
+			match->dataFork.extents[j].startBlock = get32(fork + 16 + 8*j);
+			match->dataFork.extents[j].blockCount = get32(fork + 20 + 8*j);
+		}
+
+		contextprintf(context, kBLLogLevelVerbose, "Spec %d matches file %u\n", i, match->fileID);
+		scan->remaining--;
+	}
+
+	// nothing left to look for
+	return scan->remaining == 0 ? -1 : 0;
+}
+
+static int updateFile(BLContextPtr context, BLHFSVolumeRef volume, const BLDiskExtent *catalog,
+					  uint32_t catalogCount, BLUpdateBooterFileSpec *spec, BLUpdateBooterMatch *match)
+{
+	BLDiskExtent	*extents = NULL;
+	uint32_t		extentCount = 0;
+	uint8_t			*buffer = NULL;
+	uint8_t			sectors[2 * 512];
+	off_t			start;
+	size_t			length, sectorLength;
+	uint8_t			*record;
+	int				ret;
+
+	length = (size_t)CFDataGetLength(spec->payloadData);
+	if ((off_t)length > (off_t)match->dataFork.totalBlocks * BLHFSVolumeGetBlockSize(volume)) {
+		contextprintf(context, kBLLogLevelError, "%lu bytes will not fit in the %u blocks of file %u\n",
+					  (unsigned long)length, match->dataFork.totalBlocks, match->fileID);
+		return 1;
+	}
+
+	ret = BLHFSVolumeCopyForkExtents(volume, match->fileID, kBLHFSDataForkType,
+									 &match->dataFork, &extents, &extentCount);
+	if (ret) {
+		contextprintf(context, kBLLogLevelError, "Can't map the extents of file %u: %d\n", match->fileID, ret);
+		return 2;
+	}
+
+	// whole sectors, zero-filled past the payload
+	buffer = calloc(1, roundup(length, 512) ? roundup(length, 512) : 512);
+	if (buffer == NULL) {
+		ret = 1;
+		goto exit;
+	}
+	CFDataGetBytes(spec->payloadData, CFRangeMake(0, length), buffer);
+
+	ret = BLHFSVolumeWriteExtents(volume, extents, extentCount, 0, buffer, roundup(length, 512));
+	if (ret) {
+		contextprintf(context, kBLLogLevelError, "Could not write data of file %u\n", match->fileID);
+		goto exit;
+	}
+
+	// then the catalog record: new length, and type and creator if asked
+	start = match->position & ~(off_t)511;
+	sectorLength = (size_t)(roundup(match->position + kFileRecordLength, 512) - start);
+	ret = BLHFSVolumeReadExtents(volume, catalog, catalogCount, start, sectors, sectorLength);
+	if (ret) {
+		contextprintf(context, kBLLogLevelError, "Could not read catalog record of file %u\n", match->fileID);
+		goto exit;
+	}
+
+	record = sectors + (match->position - start);
+	put32(record + kFileRecordDataFork, (uint32_t)((uint64_t)length >> 32));
+	put32(record + kFileRecordDataFork + 4, (uint32_t)length);
+	if (spec->postType) put32(record + kFileRecordType, spec->postType);
+	if (spec->postCreator) put32(record + kFileRecordCreator, spec->postCreator);
+
+	ret = BLHFSVolumeWriteExtents(volume, catalog, catalogCount, start, sectors, sectorLength);
+	if (ret) {
+		contextprintf(context, kBLLogLevelError, "Could not write catalog record of file %u\n", match->fileID);
+		goto exit;
+	}
+
+	contextprintf(context, kBLLogLevelVerbose, "Wrote %lu bytes to file %u\n", (unsigned long)length, match->fileID);
+
+exit:
+	free(buffer);
+	free(extents);
+
+	return ret;
+}
+
+// The mount table names block devices, but device may be the raw node
+// (/dev/rdiskN) or another name for it, so nodes are also compared by
+// st_rdev, which a disk's block and raw nodes share
+static bool isMounted(const char *device)
+{
+	struct statfs	*mnts;
+	struct stat		sb, mntsb;
+	bool			isNode;
+	int				i, count;
+
+	isNode = stat(device, &sb) == 0 && (S_ISBLK(sb.st_mode) || S_ISCHR(sb.st_mode));
+
+	count = getmntinfo(&mnts, MNT_NOWAIT);
+	for (i = 0; i < count; i++) {
+		if (strcmp(mnts[i].f_mntfromname, device) == 0) return true;
+		if (isNode && stat(mnts[i].f_mntfromname, &mntsb) == 0
+			&& (S_ISBLK(mntsb.st_mode) || S_ISCHR(mntsb.st_mode)) && mntsb.st_rdev == sb.st_rdev) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// catalog records are only 2-byte aligned
+static uint32_t get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put32(uint8_t *p, uint32_t value)
+{
+	p[0] = (uint8_t)(value >> 24);
+	p[1] = (uint8_t)(value >> 16);
+	p[2] = (uint8_t)(value >> 8);
+	p[3] = (uint8_t)value;
+}
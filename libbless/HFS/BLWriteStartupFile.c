@@ -31,3 +31,38 @@
  *
  */
 
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bless.h"
+#include "bless_private.h"
+#include "HFS/BLHFSStartupFile.h"
+
+/*
+ * Write an XCOFF secondary loader as the startup file of an unmounted
+ * HFS+ volume (a block device or an image file). An empty startup file
+ * is allocated first; one already allocated is reused if it is large
+ * enough. The result is read back and checked with BLBlockChecksum.
+ */
+int BLWriteStartupFile(BLContextPtr context, const char *device, CFDataRef xcoff)
+{
+	BLHFSStartupFileInfo	info;
+	int						ret;
+
+	ret = BLHFSStartupFileWrite(device, CFDataGetBytePtr(xcoff), (size_t)CFDataGetLength(xcoff), &info);
+	if (ret == 4) {
+		contextprintf(context, kBLLogLevelError, "Loader is not usable as a startup file: %s\n", info.problem);
+		return ret;
+	}
+	if (ret) {
+		contextprintf(context, kBLLogLevelError, "Can't write startup file on %s: %s\n", device, info.problem);
+		return ret;
+	}
+
+	contextprintf(context, kBLLogLevelVerbose, "Wrote %ld byte startup file in %u extents, entry 0x%08X, checksum 0x%08X\n",
+				  (long)CFDataGetLength(xcoff), info.extentCount, info.entryPoint, info.checksum);
+
+	return 0;
+}
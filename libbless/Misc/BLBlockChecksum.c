@@ -32,8 +32,11 @@
  */
 
 #include <sys/types.h>
+#include <string.h>
 
-#include "bless_private.h"
+#include "BLBlockChecksum.h"
+
+#define ROTATE(sum)   (((sum) >> 31) | ((sum) << 1))
 
 /*
  * Taken from MediaKit. Used to checksum secondary loader
@@ -42,14 +45,122 @@
 
 uint32_t BLBlockChecksum(const void *buf,uint32_t length)
 {
-  uint32_t          sum = 0;
-  uint32_t          *s = (uint32_t *) buf;
-  uint32_t          *t = s + length/4;
+  BLBlockChecksumContext    context;
+
+  BLBlockChecksumInit(&context);
+  BLBlockChecksumUpdate(&context, buf, length);
+  return BLBlockChecksumFinal(&context);
+}
+
+void BLBlockChecksumInit(BLBlockChecksumContext *context)
+{
+  context->sum = 0;
+  context->pendingLength = 0;
+}
+
+/*
+ * Chunks may split words anywhere; a partial word is held
+ * until the next chunk completes it
+ */
+void BLBlockChecksumUpdate(BLBlockChecksumContext *context, const void *buf, size_t length)
+{
+  const uint8_t     *p = buf;
+  uint32_t          sum = context->sum;
+  uint32_t          w[4];
+
+  while (context->pendingLength > 0 && length > 0) {
+    context->pending[context->pendingLength++] = *p++;
+    length--;
+    if (context->pendingLength == 4) {
+      memcpy(&w[0], context->pending, 4);
+      sum = ROTATE(sum) + w[0];
+      context->pendingLength = 0;
+    }
+  }
+  if (context->pendingLength > 0) {
+    context->sum = sum;
+    return;
+  }
+
+  // buffers from a streaming read or mmap need not be aligned
+  while (length >= sizeof(w)) {
+    memcpy(w, p, sizeof(w));
+    sum = ROTATE(sum) + w[0];
+    sum = ROTATE(sum) + w[1];
+    sum = ROTATE(sum) + w[2];
+    sum = ROTATE(sum) + w[3];
+    p += sizeof(w);
+    length -= sizeof(w);
+  }
 
-  while (s < t) {
-    //      rotate 1 bit left and add bytes
-    sum = ((sum >> 31) | (sum << 1)) + *s++;
+  while (length >= 4) {
+    memcpy(&w[0], p, 4);
+    sum = ROTATE(sum) + w[0];
+    p += 4;
+    length -= 4;
   }
-  return sum;
+
+  memcpy(context->pending, p, length);
+  context->pendingLength = (uint32_t)length;
+  context->sum = sum;
 }
 
+// As with MediaKit's checksum, a trailing partial word is not summed
+uint32_t BLBlockChecksumFinal(BLBlockChecksumContext *context)
+{
+  context->pendingLength = 0;
+
+  return context->sum;
+}
+
+/*
+ * Each sum depends on the one before it, so a single buffer goes no
+ * faster than one rotate and add at a time. Four buffers are stepped
+ * together so their chains overlap, then each finishes on its own. A
+ * last group of fewer than four fills its spare lanes with its first
+ * buffer, and drops their sums
+ */
+void BLBlockChecksumMulti(const void * const *bufs, const size_t *lengths, uint32_t *sums, uint32_t count)
+{
+  uint32_t          i, j;
+
+  for (i = 0; i < count; i += 4) {
+    const uint8_t           *p[4];
+    size_t                  length[4];
+    uint32_t                s[4] = { 0, 0, 0, 0 };
+    uint32_t                lanes = count - i < 4 ? count - i : 4;
+    size_t                  common, offset;
+    BLBlockChecksumContext  context;
+
+    for (j = 0; j < 4; j++) {
+      p[j] = bufs[i + (j < lanes ? j : 0)];
+      length[j] = lengths[i + (j < lanes ? j : 0)];
+    }
+
+    common = length[0];
+    for (j = 1; j < 4; j++) {
+      if (length[j] < common) common = length[j];
+    }
+    common &= ~(size_t)3;
+
+    for (offset = 0; offset < common; offset += 4) {
+      uint32_t      w[4];
+
+      memcpy(&w[0], p[0] + offset, 4);
+      memcpy(&w[1], p[1] + offset, 4);
+      memcpy(&w[2], p[2] + offset, 4);
+      memcpy(&w[3], p[3] + offset, 4);
+      s[0] = ROTATE(s[0]) + w[0];
+      s[1] = ROTATE(s[1]) + w[1];
+      s[2] = ROTATE(s[2]) + w[2];
+      s[3] = ROTATE(s[3]) + w[3];
+    }
+
+    for (j = 0; j < lanes; j++) {
+      context.sum = s[j];
+      context.pendingLength = 0;
+      BLBlockChecksumUpdate(&context, p[j] + common, length[j] - common);
+      sums[i + j] = BLBlockChecksumFinal(&context);
+    }
+  }
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLBlockChecksum.h
+//
+//  The MediaKit block checksum used for secondary loaders. Only the C
+//  library is used, so it builds anywhere.
+//
+
+#ifndef _BLBLOCKCHECKSUM_H_
+#define _BLBLOCKCHECKSUM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Calculate a shift-1-left & add checksum of all
+ * 32-bit words, in host byte order. A trailing partial
+ * word is ignored
+ */
+uint32_t BLBlockChecksum(const void *buf , uint32_t length);
+
+/*
+ * The same checksum over data that arrives in pieces,
+ * split anywhere. Only a partial word at the very end
+ * is ignored
+ */
+typedef struct {
+    uint32_t    sum;
+    uint8_t     pending[4];
+    uint32_t    pendingLength;
+} BLBlockChecksumContext;
+
+void BLBlockChecksumInit(BLBlockChecksumContext *context);
+void BLBlockChecksumUpdate(BLBlockChecksumContext *context, const void *buf, size_t length);
+uint32_t BLBlockChecksumFinal(BLBlockChecksumContext *context);
+
+// sums[i] for each of count buffers, up to four at a time
+void BLBlockChecksumMulti(const void * const *bufs, const size_t *lengths, uint32_t *sums, uint32_t count);
+
+#endif // _BLBLOCKCHECKSUM_H_
@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLBootArgs.c
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+typedef struct {
+	const char	*key;
+	size_t		keyLength;
+	uint32_t	keyHash;
+	const char	*value;			// NULL for a bare flag such as -v
+	size_t		valueLength;
+	char		*owned;			// storage of tokens added after parsing
+	bool		removed;
+} BLBootArg;
+
+struct BLBootArgs {
+	char				*text;		// parsed copy; original tokens point into it
+	BLBootArg			*tokens;
+	uint32_t			count;
+	uint32_t			capacity;
+	BLBootArgsChanges	changes;
+};
+
+// boot-args bless knows about. Slots are assigned by _knownKeySlot, which
+// is collision-free for exactly these names; recheck it when adding one.
+#define kKnownKeyFiltered	0x1		// rooting arguments, stale after a bless
+
+static const struct {
+	const char	*name;
+	uint32_t	flags;
+} kKnownKeys[8] = {
+	[0] = { "rp",			kKnownKeyFiltered },	/* rp=nfs:1.2.3.4:/foo:bar.dmg, netboot */
+	[3] = { "boot-uuid",	kKnownKeyFiltered },	/* UUID of filesystem/partition for rooting */
+	[4] = { "rd",			kKnownKeyFiltered },	/* rd=(enet|disk0|md0) */
+};
+
+static uint32_t _knownKeyFlags(const char *key, size_t keyLength);
+static uint32_t _hashKey(const char *key, size_t keyLength);
+static bool _validKey(const char *key);
+static BLBootArg *_append(BLBootArgsRef args);
+static BLBootArg *_find(BLBootArgsRef args, const char *key, size_t keyLength, uint32_t keyHash,
+						BLBootArg *after);
+static void _remove(BLContextPtr context, BLBootArgsRef args, BLBootArg *token);
+
+int BLBootArgsCreate(BLContextPtr context, const char *bootArgs, BLBootArgsRef *args)
+{
+	BLBootArgsRef	newArgs;
+	char			*p;
+
+	*args = NULL;
+
+	newArgs = calloc(1, sizeof(*newArgs));
+	if (newArgs == NULL) return 1;
+
+	newArgs->text = strdup(bootArgs ? bootArgs : "");
+	if (newArgs->text == NULL) {
+		free(newArgs);
+		return 1;
+	}
+
+	for (p = newArgs->text; *p; ) {
+		BLBootArg	*token;
+		char		*start, *equals = NULL;
+
+		if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+			p++;
+			continue;
+		}
+
+		for (start = p; *p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r'; p++) {
+			if (*p == '=' && equals == NULL) equals = p;
+		}
+
+		token = _append(newArgs);
+		if (token == NULL) {
+			BLBootArgsRelease(newArgs);
+			return 1;
+		}
+
+		token->key = start;
+		if (equals) {
+			token->keyLength = equals - start;
+			token->value = equals + 1;
+			token->valueLength = p - (equals + 1);
+		} else {
+			token->keyLength = p - start;
+		}
+		token->keyHash = _hashKey(token->key, token->keyLength);
+	}
+
+	contextprintf(context, kBLLogLevelVerbose, "Parsed %u boot-args\n", newArgs->count);
+
+	*args = newArgs;
+	return 0;
+}
+
+void BLBootArgsRelease(BLBootArgsRef args)
+{
+	uint32_t	i;
+
+	if (args == NULL) return;
+
+	for (i = 0; i < args->count; i++) {
+		free(args->tokens[i].owned);
+	}
+	free(args->tokens);
+	free(args->text);
+	free(args);
+}
+
+bool BLBootArgsGetValue(BLBootArgsRef args, const char *key, const char **value, size_t *valueLength)
+{
+	size_t		keyLength = strlen(key);
+	BLBootArg	*token;
+
+	token = _find(args, key, keyLength, _hashKey(key, keyLength), NULL);
+
+	if (value) *value = token ? token->value : NULL;
+	if (valueLength) *valueLength = token ? token->valueLength : 0;
+
+	return token != NULL;
+}
+
+int BLBootArgsSet(BLContextPtr context, BLBootArgsRef args, const char *key, const char *value)
+{
+	size_t		keyLength, valueLength;
+	uint32_t	keyHash;
+	BLBootArg	*token, *duplicate;
+	char		*owned;
+
+	if (!_validKey(key) || (value && strpbrk(value, " \t\r\n"))) {
+		contextprintf(context, kBLLogLevelError, "Invalid boot-arg %s%s%s\n",
+					  key, value ? "=" : "", value ? value : "");
+		return 1;
+	}
+
+	keyLength = strlen(key);
+	valueLength = value ? strlen(value) : 0;
+	keyHash = _hashKey(key, keyLength);
+
+	token = _find(args, key, keyLength, keyHash, NULL);
+
+	// anything after the first occurrence would shadow the new value
+	while (token && (duplicate = _find(args, key, keyLength, keyHash, token)) != NULL) {
+		_remove(context, args, duplicate);
+	}
+
+	if (token && (token->value == NULL) == (value == NULL)
+		&& token->valueLength == valueLength
+		&& (value == NULL || 0 == memcmp(token->value, value, valueLength))) {
+		return 0;
+	}
+
+	owned = malloc(keyLength + 1 + valueLength + 1);
+	if (owned == NULL) return 1;
+
+	memcpy(owned, key, keyLength);
+	owned[keyLength] = '=';
+	if (value) memcpy(owned + keyLength + 1, value, valueLength);
+	owned[keyLength + 1 + valueLength] = '\0';
+
+	if (token) {
+		contextprintf(context, kBLLogLevelVerbose, "\tReplacing boot-arg: %.*s%s%.*s\n",
+					  (int)token->keyLength, token->key, token->value ? "=" : "",
+					  (int)token->valueLength, token->value ? token->value : "");
+		free(token->owned);
+		args->changes.replaced++;
+	} else {
+		token = _append(args);
+		if (token == NULL) {
+			free(owned);
+			return 1;
+		}
+		args->changes.added++;
+	}
+
+	token->owned = owned;
+	token->key = owned;
+	token->keyLength = keyLength;
+	token->keyHash = keyHash;
+	token->value = value ? owned + keyLength + 1 : NULL;
+	token->valueLength = valueLength;
+
+	contextprintf(context, kBLLogLevelVerbose, "\tSetting boot-arg: %s%s%s\n",
+				  key, value ? "=" : "", value ? value : "");
+
+	return 0;
+}
+
+int BLBootArgsRemove(BLContextPtr context, BLBootArgsRef args, const char *key)
+{
+	size_t		keyLength = strlen(key);
+	uint32_t	keyHash = _hashKey(key, keyLength);
+	BLBootArg	*token;
+
+	while ((token = _find(args, key, keyLength, keyHash, NULL)) != NULL) {
+		_remove(context, args, token);
+	}
+
+	return 0;
+}
+
+int BLBootArgsFilter(BLContextPtr context, BLBootArgsRef args)
+{
+	uint32_t	i;
+
+	for (i = 0; i < args->count; i++) {
+		BLBootArg *token = &args->tokens[i];
+
+		if (!token->removed
+			&& token->value
+			&& (_knownKeyFlags(token->key, token->keyLength) & kKnownKeyFiltered)) {
+			_remove(context, args, token);
+		}
+	}
+
+	return 0;
+}
+
+void BLBootArgsGetChanges(BLBootArgsRef args, BLBootArgsChanges *changes)
+{
+	*changes = args->changes;
+}
+
+int BLBootArgsCopyString(BLContextPtr context, BLBootArgsRef args, char **bootArgs)
+{
+	size_t		length = 0;
+	uint32_t	i;
+	char		*p;
+
+	*bootArgs = NULL;
+
+	for (i = 0; i < args->count; i++) {
+		BLBootArg *token = &args->tokens[i];
+
+		if (token->removed) continue;
+		length += token->keyLength + (token->value ? 1 + token->valueLength : 0) + 1;
+	}
+
+	*bootArgs = p = malloc(length + 1);
+	if (p == NULL) {
+		contextprintf(context, kBLLogLevelError, "Could not allocate %zu bytes for boot-args\n", length + 1);
+		return 1;
+	}
+
+	for (i = 0; i < args->count; i++) {
+		BLBootArg *token = &args->tokens[i];
+
+		if (token->removed) continue;
+
+		if (p != *bootArgs) *p++ = ' ';
+		memcpy(p, token->key, token->keyLength);
+		p += token->keyLength;
+		if (token->value) {
+			*p++ = '=';
+			memcpy(p, token->value, token->valueLength);
+			p += token->valueLength;
+		}
+	}
+	*p = '\0';
+
+	return 0;
+}
+
+static uint32_t _knownKeySlot(const char *key, size_t keyLength)
+{
+	return (uint32_t)(keyLength + (unsigned char)key[0] * 3 + (unsigned char)key[keyLength-1]) & 7;
+}
+
+static uint32_t _knownKeyFlags(const char *key, size_t keyLength)
+{
+	const char	*name;
+
+	if (keyLength == 0) return 0;
+
+	name = kKnownKeys[_knownKeySlot(key, keyLength)].name;
+	if (name == NULL || strlen(name) != keyLength || 0 != memcmp(name, key, keyLength)) {
+		return 0;
+	}
+
+	return kKnownKeys[_knownKeySlot(key, keyLength)].flags;
+}
+
+// FNV-1a; lets _find reject most tokens without comparing bytes
+static uint32_t _hashKey(const char *key, size_t keyLength)
+{
+	uint32_t	hash = 2166136261U;
+	size_t		i;
+
+	for (i = 0; i < keyLength; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static bool _validKey(const char *key)
+{
+	return key[0] != '\0' && strpbrk(key, "= \t\r\n") == NULL;
+}
+
+static BLBootArg *_append(BLBootArgsRef args)
+{
+	BLBootArg	*tokens;
+	uint32_t	capacity;
+
+	if (args->count == args->capacity) {
+		capacity = args->capacity ? args->capacity * 2 : 16;
+		tokens = realloc(args->tokens, capacity * sizeof(*tokens));
+		if (tokens == NULL) return NULL;
+
+		args->tokens = tokens;
+		args->capacity = capacity;
+	}
+
+	memset(&args->tokens[args->count], 0, sizeof(BLBootArg));
+	return &args->tokens[args->count++];
+}
+
+static BLBootArg *_find(BLBootArgsRef args, const char *key, size_t keyLength, uint32_t keyHash,
+						BLBootArg *after)
+{
+	uint32_t	i = after ? (uint32_t)(after - args->tokens) + 1 : 0;
+
+	for (; i < args->count; i++) {
+		BLBootArg *token = &args->tokens[i];
+
+		if (!token->removed
+			&& token->keyHash == keyHash
+			&& token->keyLength == keyLength
+			&& 0 == memcmp(token->key, key, keyLength)) {
+			return token;
+		}
+	}
+
+	return NULL;
+}
+
+static void _remove(BLContextPtr context, BLBootArgsRef args, BLBootArg *token)
+{
+	contextprintf(context, kBLLogLevelVerbose, "\tRemoving boot-arg: %.*s%s%.*s\n",
+				  (int)token->keyLength, token->key, token->value ? "=" : "",
+				  (int)token->valueLength, token->value ? token->value : "");
+
+	token->removed = true;
+	args->changes.removed++;
+}
@@ -48,7 +48,7 @@ int contextprintf(BLContextPtr context, int loglevel, char const *fmt, ...) {
 
     
     
-    if(context->version == 0 && context->logstring) {
+    if(context->version <= kBLContextVersionPlan && context->logstring) {
 
         va_start(ap, fmt);
 #if NO_VASPRINTF
@@ -37,16 +37,33 @@
 #include <sys/stat.h>
 #include <sys/fcntl.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/param.h>
 
 #include "bless.h"
 #include "bless_private.h"
 
+// big enough writes bypass the buffer cache
+#define kBLWriteChunkSize           (8 * 1024 * 1024)
+#define kBLUncachedWriteThreshold   (16 * 1024 * 1024)
+
 int BLCopyFileFromCFData(BLContextPtr context, const CFDataRef data,
 						 const char * dest, int shouldPreallocate) {
+    return BLCopyFileFromCFDataWithDurability(context, data, dest, shouldPreallocate, kBLDurabilityNone);
+}
+
+int BLCopyFileFromCFDataWithDurability(BLContextPtr context, const CFDataRef data,
+						 const char * dest, int shouldPreallocate, int durability) {
 	
     int fdw;
     CFDataRef theData = data;
+    const UInt8 *bytes = CFDataGetBytePtr(theData);
+    off_t length = CFDataGetLength(theData);
+    off_t offset;
     ssize_t byteswritten;
+    size_t chunk;
+    struct timespec start, end;
+    double seconds;
 	
     fstore_t preall;
     int err = 0;
@@ -60,7 +77,7 @@ int BLCopyFileFromCFData(BLContextPtr context, const CFDataRef data,
     }
 	
     if (shouldPreallocate > kNoPreallocate) {
-		preall.fst_length = CFDataGetLength(theData);
+		preall.fst_length = length;
 		preall.fst_offset = 0;
 		preall.fst_flags = F_ALLOCATECONTIG;
 		preall.fst_posmode = F_PEOFPOSMODE;
@@ -81,17 +98,60 @@ int BLCopyFileFromCFData(BLContextPtr context, const CFDataRef data,
 		contextprintf(context, kBLLogLevelVerbose,  "No preallocation attempted for %s\n", dest );
     }
 	
-    byteswritten = write(fdw, (char *)CFDataGetBytePtr(theData), CFDataGetLength(theData));
-    if(byteswritten != CFDataGetLength(theData)) {
-		contextprintf(context, kBLLogLevelError,  "Error while writing to %s: %s\n", dest, strerror(errno) );
-		contextprintf(context, kBLLogLevelError,  "%ld bytes written\n", byteswritten );
-		close(fdw);
-		return 2;
+    if (length >= kBLUncachedWriteThreshold && fcntl(fdw, F_NOCACHE, 1) == 0) {
+        contextprintf(context, kBLLogLevelVerbose,  "Writing %s without caching\n", dest );
     }
-    contextprintf(context, kBLLogLevelVerbose,  "\n" );
 	
-    close(fdw);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	
+    // Each write ends on a chunk boundary, even after a short one
+    for (offset = 0; offset < length; offset += byteswritten) {
+        chunk = (size_t)MIN(length - offset, kBLWriteChunkSize - offset % kBLWriteChunkSize);
+        byteswritten = write(fdw, bytes + offset, chunk);
+        if (byteswritten < 0 && errno == EINTR) {
+            byteswritten = 0;
+            continue;
+        }
+        if (byteswritten <= 0) {
+            contextprintf(context, kBLLogLevelError,  "Error while writing to %s: %s\n", dest,
+                          byteswritten < 0 ? strerror(errno) : "no progress" );
+            contextprintf(context, kBLLogLevelError,  "%lld bytes written\n", (long long)offset );
+            close(fdw);
+            return 2;
+        }
+    }
+	
+    switch (durability) {
+        case kBLDurabilitySync:
+            err = fsync(fdw);
+            break;
+        case kBLDurabilityBarrier:
+            // not every filesystem can flush the drive's cache
+            err = fcntl(fdw, F_FULLFSYNC);
+            if (err == -1 && (errno == ENOTSUP || errno == ENOTTY || errno == EINVAL)) {
+                contextprintf(context, kBLLogLevelVerbose,  "F_FULLFSYNC not supported for %s\n", dest );
+                err = fsync(fdw);
+            }
+            break;
+        default:
+            err = 0;
+            break;
+    }
+    if (err) {
+        contextprintf(context, kBLLogLevelError,  "Error while syncing %s: %s\n", dest, strerror(errno) );
+        close(fdw);
+        return 2;
+    }
+	
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    contextprintf(context, kBLLogLevelVerbose,  "Wrote %lld bytes to %s in %.3f s (%.1f MB/s)\n",
+                  (long long)length, dest, seconds, seconds > 0 ? (double)length / seconds / 1e6 : 0.0 );
+	
+    if (close(fdw) < 0) {
+        contextprintf(context, kBLLogLevelError,  "Error while closing %s: %s\n", dest, strerror(errno) );
+        return 2;
+    }
 	
     return 0;
 }
-
@@ -34,6 +34,7 @@
 #include <CoreFoundation/CoreFoundation.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <sys/param.h>
@@ -47,14 +48,45 @@
 #include "bless_private.h"
 
 
+static int contentsMatch(int fd, const CFDataRef data, off_t size, bool *match);
+
+/*
+ * If file already holds exactly data, it is left in place and only its
+ * flags and type/creator are brought up to date. Otherwise data is written
+ * to a temporary file next to it, named the way BLReplaceFileWithCopy names
+ * its copies, which is then renamed over it, so file is always either the
+ * old contents or the new.
+ */
 int BLCreateFileWithOptions(BLContextPtr context, const CFDataRef data,
                             const char * file, int setImmutable,
                             uint32_t type, uint32_t creator, int shouldPreallocate)
 {
 	int err = 0;
-	int mainfd = 0;
+	int mainfd = -1;
+	int tempfd = -1;
 	struct stat sb;
 	const char *rsrcpath = file;
+	char temppath[MAXPATHLEN];
+	bool havetemp = false;
+	const char *name;
+	bool match = false;
+
+	if (BLPlanIsRecording(context)) {
+		return BLPlanRecordCreateFile(context, file, data, setImmutable, type, creator, shouldPreallocate);
+	}
+
+	// The new contents are written under a fixed name next to the file, so
+	// a copy left behind by an interrupted run is found and removed here
+	name = strrchr(rsrcpath, '/');
+	name = name ? name + 1 : rsrcpath;
+	if(snprintf(temppath, sizeof(temppath), "%.*s.%s" kBLReplaceFileTempSuffix,
+				(int)(name - rsrcpath), rsrcpath, name) >= (int)sizeof(temppath)) {
+		contextprintf(context, kBLLogLevelError, "Path %s is too long\n", rsrcpath);
+		return ENAMETOOLONG;
+	}
+	if(unlink(temppath) == 0) {
+		contextprintf(context, kBLLogLevelVerbose, "Removed %s, left by an interrupted run\n", temppath);
+	}
 
 	// Create file descriptor and don't close till IMMUTABLE FLAG will be cleared to avoid vulnerability
 	// Following scenario can cause to code vulnerability
@@ -88,7 +120,14 @@ int BLCreateFileWithOptions(BLContextPtr context, const CFDataRef data,
 		goto exit;
 	}
 
-	if(sb.st_flags & UF_IMMUTABLE) {
+	err = contentsMatch(mainfd, data, sb.st_size, &match);
+	if(err) {
+		contextprintf(context, kBLLogLevelError, "Can't read %s: %s\n", rsrcpath, strerror(err));
+		goto exit;
+	}
+
+	// type/creator can't change while the file is immutable
+	if((sb.st_flags & UF_IMMUTABLE) && (!match || !setImmutable || type || creator)) {
 		uint32_t newflags = sb.st_flags & ~UF_IMMUTABLE;
 
 		contextprintf(context, kBLLogLevelVerbose, "Removing UF_IMMUTABLE from %s\n", rsrcpath);
@@ -100,35 +139,57 @@ int BLCreateFileWithOptions(BLContextPtr context, const CFDataRef data,
 						  strerror(err));
 			goto exit;
 		}
+		sb.st_flags = newflags;
 	}
-	close(mainfd);
 
-	contextprintf(context, kBLLogLevelVerbose, "Deleting old %s\n", rsrcpath);
-	err = unlink(rsrcpath);
-	if(err) {
-		err = errno;
-		contextprintf(context, kBLLogLevelError,
-					  "Can't delete %s: %s\n", rsrcpath,
-					  strerror(err));
-		return err;
+	if(match) {
+		contextprintf(context, kBLLogLevelVerbose, "%s already matches; skipped writing %lld bytes\n",
+					  rsrcpath, (long long)sb.st_size);
+		goto file_attributes;
 	}
+	close(mainfd);
+	mainfd = -1;
 
 file_create:
-	// Create new file that will replace the previous one or create from the scratch
-	mainfd = open(rsrcpath, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
-	if(mainfd < 0) {
+	// Write a new file that will replace the previous one or create from the scratch
+	tempfd = open(temppath, O_RDWR|O_CREAT|O_EXCL|O_NOFOLLOW, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if(tempfd < 0) {
 		err = errno;
-		contextprintf(context, kBLLogLevelError,  "Could not touch %s %s\n", rsrcpath, strerror(err));
+		contextprintf(context, kBLLogLevelError,  "Could not touch %s %s\n", temppath, strerror(err));
 		return err;
 	}
+	havetemp = true;
+	fchmod(tempfd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
 
 	if(data != NULL) {
-		err = BLCopyFileFromCFData(context, data, rsrcpath, shouldPreallocate);
+		// on disk before the rename makes it the file
+		err = BLCopyFileFromCFDataWithDurability(context, data, temppath, shouldPreallocate, kBLDurabilityBarrier);
 		if(err) {
 			goto exit;
 		}
 	}
 
+	contextprintf(context, kBLLogLevelVerbose, "Replacing %s\n", rsrcpath);
+	if(rename(temppath, rsrcpath) < 0) {
+		err = errno;
+		contextprintf(context, kBLLogLevelError,
+					  "Can't replace %s: %s\n", rsrcpath,
+					  strerror(err));
+		goto exit;
+	}
+	havetemp = false;
+
+	// the rename is only durable once the directory is
+	err = BLSyncParentDirectory(context, rsrcpath);
+	if(err) {
+		goto exit;
+	}
+
+	// the rest goes through the new file's descriptor
+	mainfd = tempfd;
+	tempfd = -1;
+
+file_attributes:
 	if (type || creator) {
 		err = BLSetTypeAndCreator(context, rsrcpath, type, creator);
 		if(err) {
@@ -144,28 +205,75 @@ file_create:
 	}
 
 	if(setImmutable) {
-		contextprintf(context, kBLLogLevelVerbose, "Setting UF_IMMUTABLE on %s\n", rsrcpath);
 		err = fstat(mainfd, &sb);
 		if(err) {
 			err = errno;
 			contextprintf(context, kBLLogLevelError, "Can't stat %s: %s\n", rsrcpath, strerror(errno));
 			goto exit;
 		}
-		err = fchflags(mainfd, sb.st_flags | UF_IMMUTABLE);
-		if(err && errno != ENOTSUP) {
-			err = errno;
-			contextprintf(context, kBLLogLevelError,
-						  "Can't set UF_IMMUTABLE on %s: %s\n", rsrcpath,
-						  strerror(err));
+		if(!(sb.st_flags & UF_IMMUTABLE)) {
+			contextprintf(context, kBLLogLevelVerbose, "Setting UF_IMMUTABLE on %s\n", rsrcpath);
+			err = fchflags(mainfd, sb.st_flags | UF_IMMUTABLE);
+			if(err && errno != ENOTSUP) {
+				err = errno;
+				contextprintf(context, kBLLogLevelError,
+							  "Can't set UF_IMMUTABLE on %s: %s\n", rsrcpath,
+							  strerror(err));
+			} else {
+				err = 0;
+			}
 		}
 	}
 
 exit:
-	close(mainfd);
+	if(mainfd >= 0) close(mainfd);
+	if(tempfd >= 0) close(tempfd);
+	if(havetemp) unlink(temppath);
 
 	return err;
 }
 
+// Compare the file with data a chunk at a time; a size mismatch needs no reads
+static int contentsMatch(int fd, const CFDataRef data, off_t size, bool *match)
+{
+	const UInt8	*bytes = data ? CFDataGetBytePtr(data) : NULL;
+	off_t		length = data ? CFDataGetLength(data) : 0;
+	off_t		offset;
+	ssize_t		chunk;
+	char		*buffer;
+	int			err = 0;
+
+	*match = false;
+	if(size != length) return 0;
+	if(length == 0) {
+		*match = true;
+		return 0;
+	}
+
+	buffer = malloc(MIN(length, 0x100000));
+	if(buffer == NULL) return ENOMEM;
+
+	for(offset = 0; offset < length; offset += chunk) {
+		ssize_t bytesread;
+
+		chunk = (ssize_t)MIN(length - offset, 0x100000);
+		bytesread = pread(fd, buffer, chunk, offset);
+		if(bytesread < 0) {
+			err = errno;
+			break;
+		}
+		// shorter than it was a moment ago; just rewrite it
+		if(bytesread != chunk || memcmp(buffer, bytes + offset, chunk) != 0) break;
+	}
+	if(!err && offset >= length) *match = true;
+
+	free(buffer);
+	return err;
+}
+
+
+
+
 
 
 int BLCreateFile(BLContextPtr context, const CFDataRef data,
@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLElToritoCatalog.c
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "BLElToritoCatalog.h"
+
+// Multi-byte fields are little-endian byte arrays, read with _le16 and
+// _le32, so the layouts need no packing and decode the same on any host.
+
+// ISO 9660 CD "Primary Volume Descriptor" found at 2048-Sector #16:
+//
+typedef struct
+{
+	uint8_t	volume_descriptor_type;                 //  type
+	char	ident[5];                               //	characters 'CD001'
+	uint8_t	volume_descriptor_version;
+	uint8_t	unused1;
+	char	system_id [32];
+	char	volume_id [32];
+	uint8_t	unused2 [8];
+	uint8_t	volume_space_size_LE[4];                //	provided in both endians
+	uint8_t	volume_space_size_BE[4];
+	uint8_t	other [1960];                           //	2048 bytes total
+
+} ISO9660_PRIMARY_VOLUME_DESCRIPTOR;
+
+// "El Torito" optical disc identification standard "Boot Record Volume Descriptor" found at 2048-Sector #17:
+//
+typedef struct
+{
+	uint8_t	type;
+	char    ident [5];
+	uint8_t	version;
+	char    system_id [32];
+	char    unused1 [32];
+	uint8_t	bootcat_ptr[4];
+} EL_TORITO_BOOT_VOLUME_DESCRIPTOR;
+
+typedef struct                                      //	32 Byte El Torito Validation Entry
+{
+	uint8_t	id;                                     //	Header ID				= 1
+	uint8_t	arch;                                   //	Platform Architecture	= x86, ppc
+	uint8_t	reserved[2];                            //	Reserved				= 0
+	char	creator_id [24];                        //	Creator Identity
+	uint8_t	checksum[2];                            //	Word sum				= 0
+	uint8_t	key55;                                  //	Key, must be 0x55
+	uint8_t	keyAA;                                  //	Key, must be 0xaa
+} EL_TORITO_VALIDATION_ENTRY;
+
+typedef struct                                      //	32 Byte Section + Initial/Default Entry
+{
+	uint8_t	boot_indicator;                         //	Boot Indicator 			= 0x00 | 0x88
+	uint8_t	boot_media;                             //	Boot Emulation mode
+	uint8_t	load_segment[2];                        //	Load address			= 0x0000
+	uint8_t	system_type;                            //	MBR/PBR System Type		= E.G. 0xAF for Darwin_HFS
+	uint8_t	reserved1;                              //	Reserved				= 0x00
+	uint8_t	blockcount[2];                          //	Load size
+	uint8_t	lba[4];                                 //	Virtual Disk Address
+	uint8_t	reserved2[20];                          //	Reserved				= 0x00
+} EL_TORITO_INITIAL_DEFAULT_ENTRY;
+
+typedef struct
+{
+	uint8_t	header_indicator;                       //	Header Indicator = 0x90 (more headers follow), 0x91 (this is last)
+	uint8_t	platform_id;                            //	Platform ID	0=80x86; 1=PowerPC; 2=Mac; 0xEF=EFI
+	uint8_t	sections_count[2];                      //	Number of sections following this section header
+	char	section_id [28];                        //	ID string; should be checkd by bios and boot software.
+} EL_TORITO_SECTION_HEADER_ENTRY;
+
+typedef struct
+{
+	uint8_t	boot_indicator;                         //	0x88=bootable; 0x00=not bootable
+	uint8_t	boot_media;                             //	b0:b3=0..f,4=hard drive; b4=0; b5=continuation entry follows; b6=ATAPI driver incl; b7=SCSI drvr
+	uint8_t	load_segment[2];                        //	Load segment for the initial boot image
+	uint8_t	system_type;                            //	Must be a copy of byte 5 from the Partition Table found in the boot image
+	uint8_t	unused1;                                //	Must be 0
+	uint8_t	sector_count[2];                        //	Number of emulated sectors the system wil store at Load Segment during boot
+	uint8_t	load_rba[4];                            //	Start address of the virtual disk
+	uint8_t	selection_criteria_type;                //	What info follows in next field: 0=none, 1=Language&Version, 2..255=reserved
+	uint8_t	selection_criteria [19];                //	Vendor unique selection criteria
+} EL_TORITO_SECTION_SECTION_ENTRY;
+
+typedef struct
+{
+	uint8_t	extension_indicator;                    //	Must be 0x44
+	uint8_t	bits;                                   //	b5=ExtensionRecordFollows; other bits unused
+	uint8_t	other[30];                              //	Vendor uqniue extra bytes
+} EL_TORITO_SECTION_EXTENSION_ENTRY;
+
+#define kElToritoEntrySize			32
+#define kElToritoPlatformEFI		0xEF
+#define kElToritoBootable			0x88
+#define kElToritoMoreHeaders		0x90
+#define kElToritoFinalHeader		0x91
+#define kElToritoExtension			0x44
+#define kElToritoContinuation		0x20
+
+static int _parseDescriptors(const uint8_t *descriptors, size_t length,
+							 uint32_t *volumeSpaceSize, uint32_t *bootCatalogSector);
+static void _addPlatform(BLElToritoUEFIRegion *region, uint8_t platform);
+
+static inline uint16_t _le16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t _le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int BLElToritoCatalogCreate(uint32_t volumeSpaceSize, uint32_t bootCatalogSector,
+							const uint8_t *bytes, size_t length, BLElToritoCatalog **catalog)
+{
+	const EL_TORITO_VALIDATION_ENTRY		*ve;
+	const EL_TORITO_INITIAL_DEFAULT_ENTRY	*de;
+	BLElToritoCatalog	*newCatalog;
+	BLElToritoEntry		*entry;
+	size_t		recordCount = length / kElToritoEntrySize;
+	size_t		recordNum;
+	uint16_t	sum = 0;
+	uint16_t	bootEntry = 0;
+	size_t		i;
+
+	*catalog = NULL;
+
+	if (recordCount > kBLElToritoMaxCatalogSectors * kBLElToritoSectorSize / kElToritoEntrySize) {
+		recordCount = kBLElToritoMaxCatalogSectors * kBLElToritoSectorSize / kElToritoEntrySize;
+	}
+
+	// Validation Entry, then the Initial/Default Entry, then one or more of:
+	// a Section Header Entry followed by its Section Entries, each optionally
+	// followed by a chain of Section Extension Entries
+	if (recordCount < 2) return 2;
+
+	ve = (const EL_TORITO_VALIDATION_ENTRY *)bytes;
+	if (1 != ve->id || 0x55 != ve->key55 || 0xaa != ve->keyAA) return 2;
+
+	newCatalog = calloc(1, sizeof(*newCatalog) + recordCount * sizeof(BLElToritoEntry));
+	if (newCatalog == NULL) return 1;
+
+	newCatalog->volumeSpaceSize = volumeSpaceSize;
+	newCatalog->bootCatalogSector = bootCatalogSector;
+
+	// Only the keys are required; creator and checksum vary between vendors
+	for (i = 0; i < kElToritoEntrySize; i += 2) {
+		sum += _le16(bytes + i);
+	}
+	newCatalog->checksumValid = (sum == 0);
+
+	entry = &newCatalog->entries[newCatalog->entryCount++];
+	entry->type = kBLElToritoEntryValidation;
+	entry->platformID = ve->arch;
+
+	// the Initial/Default Entry is for the validation entry's platform
+	de = (const EL_TORITO_INITIAL_DEFAULT_ENTRY *)(bytes + kElToritoEntrySize);
+	entry = &newCatalog->entries[newCatalog->entryCount++];
+	entry->type = kBLElToritoEntryDefault;
+	entry->platformID = ve->arch;
+	entry->indicator = de->boot_indicator;
+	entry->media = de->boot_media;
+	entry->systemType = de->system_type;
+	entry->count = _le16(de->blockcount);
+	entry->loadSegment = _le16(de->load_segment);
+	entry->loadRBA = _le32(de->lba);
+	entry->bootEntry = bootEntry++;
+
+	// Decoding stops at the first damaged record; what came before it is kept
+	for (recordNum = 2; recordNum < recordCount; ) {
+		const EL_TORITO_SECTION_HEADER_ENTRY	*he;
+		uint16_t	sectionCount, section;
+		uint16_t	header;
+		bool		isFinalHeader;
+
+		he = (const EL_TORITO_SECTION_HEADER_ENTRY *)(bytes + recordNum * kElToritoEntrySize);
+		if (he->header_indicator != kElToritoMoreHeaders && he->header_indicator != kElToritoFinalHeader) {
+			goto incomplete;
+		}
+
+		isFinalHeader = (he->header_indicator == kElToritoFinalHeader);
+		sectionCount = _le16(he->sections_count);
+		recordNum++;
+
+		header = (uint16_t)newCatalog->entryCount;
+		entry = &newCatalog->entries[newCatalog->entryCount++];
+		entry->type = kBLElToritoEntryHeader;
+		entry->platformID = he->platform_id;
+		entry->indicator = he->header_indicator;
+		entry->count = sectionCount;
+		entry->header = header;
+
+		for (section = 0; section < sectionCount; section++) {
+			const EL_TORITO_SECTION_SECTION_ENTRY	*se;
+			bool		hasExtensions;
+
+			if (recordNum >= recordCount) goto incomplete;
+
+			se = (const EL_TORITO_SECTION_SECTION_ENTRY *)(bytes + recordNum * kElToritoEntrySize);
+			hasExtensions = (0 != (se->boot_media & kElToritoContinuation));
+			recordNum++;
+
+			entry = &newCatalog->entries[newCatalog->entryCount++];
+			entry->type = kBLElToritoEntrySection;
+			entry->platformID = he->platform_id;
+			entry->indicator = se->boot_indicator;
+			entry->media = se->boot_media;
+			entry->systemType = se->system_type;
+			entry->count = _le16(se->sector_count);
+			entry->loadSegment = _le16(se->load_segment);
+			entry->loadRBA = _le32(se->load_rba);
+			entry->header = header;
+			entry->bootEntry = bootEntry++;
+
+			while (hasExtensions) {
+				const EL_TORITO_SECTION_EXTENSION_ENTRY	*see;
+
+				if (recordNum >= recordCount) goto incomplete;
+
+				see = (const EL_TORITO_SECTION_EXTENSION_ENTRY *)(bytes + recordNum * kElToritoEntrySize);
+				if (see->extension_indicator != kElToritoExtension) goto incomplete;
+				hasExtensions = (0 != (see->bits & kElToritoContinuation));
+				recordNum++;
+
+				entry = &newCatalog->entries[newCatalog->entryCount++];
+				entry->type = kBLElToritoEntryExtension;
+				entry->platformID = he->platform_id;
+				entry->indicator = see->extension_indicator;
+				entry->media = see->bits;
+				entry->header = header;
+			}
+		}
+
+		if (isFinalHeader) {
+			newCatalog->complete = true;
+			break;
+		}
+	}
+
+incomplete:
+	*catalog = newCatalog;
+	return 0;
+}
+
+int BLElToritoCatalogCreateWithImage(const uint8_t *image, size_t length, BLElToritoCatalog **catalog)
+{
+	uint32_t	volumeSpaceSize, bootCatalogSector;
+	size_t		catalogOffset;
+	int			ret;
+
+	*catalog = NULL;
+
+	if (length < 18 * kBLElToritoSectorSize) return 1;
+
+	ret = _parseDescriptors(image + 16 * kBLElToritoSectorSize, 2 * kBLElToritoSectorSize,
+							&volumeSpaceSize, &bootCatalogSector);
+	if (ret) return ret;
+
+	catalogOffset = (size_t)bootCatalogSector * kBLElToritoSectorSize;
+	if (catalogOffset >= length) return 2;
+
+	return BLElToritoCatalogCreate(volumeSpaceSize, bootCatalogSector,
+								   image + catalogOffset, length - catalogOffset, catalog);
+}
+
+int BLElToritoCatalogCreateWithFile(const char *path, BLElToritoCatalog **catalog)
+{
+	struct stat	sb;
+	uint8_t		*buf;
+	uint32_t	volumeSpaceSize, bootCatalogSector;
+	ssize_t		got;
+	int			fd;
+	int			ret;
+
+	*catalog = NULL;
+
+	// shared lock, so the image isn't rewritten while it is decoded
+	fd = open(path, O_RDONLY);
+	if (fd < 0) return 3;
+	if (flock(fd, LOCK_SH) < 0 || fstat(fd, &sb) < 0) {
+		ret = errno;
+		close(fd);
+		errno = ret;
+		return 3;
+	}
+
+	// Image files are mapped and parsed in place; device nodes can't be
+	// mapped, so read the two descriptors at once and then the catalog
+	if (S_ISREG(sb.st_mode)) {
+		void	*image = NULL;
+
+		if (sb.st_size > 0) {
+			image = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		ret = errno;
+		close(fd);
+		if (image == MAP_FAILED) {
+			errno = ret;
+			return 3;
+		}
+
+		ret = BLElToritoCatalogCreateWithImage(image, image ? (size_t)sb.st_size : 0, catalog);
+		if (image) munmap(image, (size_t)sb.st_size);
+		return ret;
+	}
+
+	buf = malloc(kBLElToritoMaxCatalogSectors * kBLElToritoSectorSize);
+	if (buf == NULL) {
+		close(fd);
+		return 3;
+	}
+
+	got = pread(fd, buf, 2 * kBLElToritoSectorSize, 16 * kBLElToritoSectorSize);
+	if (got < 0) {
+		ret = 3;
+		goto exit;
+	}
+
+	ret = _parseDescriptors(buf, (size_t)got, &volumeSpaceSize, &bootCatalogSector);
+	if (ret) goto exit;
+
+	got = pread(fd, buf, kBLElToritoMaxCatalogSectors * kBLElToritoSectorSize,
+				(off_t)bootCatalogSector * kBLElToritoSectorSize);
+	if (got < 0) {
+		ret = 3;
+		goto exit;
+	}
+
+	ret = BLElToritoCatalogCreate(volumeSpaceSize, bootCatalogSector, buf, (size_t)got, catalog);
+
+exit:
+	free(buf);
+	close(fd);
+
+	return ret;
+}
+
+void BLElToritoCatalogRelease(BLElToritoCatalog *catalog)
+{
+	free(catalog);
+}
+
+int BLElToritoCatalogGetUEFIRegion(const BLElToritoCatalog *catalog, BLElToritoUEFIRegion *region)
+{
+	uint32_t	i;
+
+	memset(region, 0, sizeof(*region));
+	region->volumeSpaceSize = catalog->volumeSpaceSize;
+	region->bootCatalogSector = catalog->bootCatalogSector;
+	region->checksumValid = catalog->checksumValid;
+
+	for (i = 0; i < catalog->entryCount; i++) {
+		const BLElToritoEntry *entry = &catalog->entries[i];
+
+		if (entry->type == kBLElToritoEntryValidation || entry->type == kBLElToritoEntryHeader) {
+			_addPlatform(region, entry->platformID);
+		}
+
+		if (region->found
+			|| entry->type != kBLElToritoEntrySection
+			|| entry->platformID != kElToritoPlatformEFI
+			|| entry->indicator != kElToritoBootable) {
+			continue;
+		}
+
+		if (entry->loadRBA >= catalog->volumeSpaceSize) return 2;
+
+		// in device blocks: VolumeSpaceSize - SectionEntry.LoadRBA
+		region->bootEntry = entry->bootEntry;
+		region->offset = entry->loadRBA;
+		region->size = catalog->volumeSpaceSize - entry->loadRBA;
+		region->found = true;
+	}
+
+	if (region->found) return 0;
+
+	return catalog->complete ? 0 : 2;
+}
+
+int BLElToritoFindUEFIInFile(const char *path, BLElToritoUEFIRegion *region)
+{
+	BLElToritoCatalog	*catalog;
+	int					ret;
+
+	memset(region, 0, sizeof(*region));
+
+	ret = BLElToritoCatalogCreateWithFile(path, &catalog);
+	if (ret) return ret;
+
+	ret = BLElToritoCatalogGetUEFIRegion(catalog, region);
+	BLElToritoCatalogRelease(catalog);
+
+	return ret;
+}
+
+static int _parseDescriptors(const uint8_t *descriptors, size_t length,
+							 uint32_t *volumeSpaceSize, uint32_t *bootCatalogSector)
+{
+	const ISO9660_PRIMARY_VOLUME_DESCRIPTOR	*vd;
+	const EL_TORITO_BOOT_VOLUME_DESCRIPTOR	*bvd;
+
+	if (length < 2 * kBLElToritoSectorSize) return 1;
+
+	vd = (const ISO9660_PRIMARY_VOLUME_DESCRIPTOR *)descriptors;
+	if (0 != memcmp(vd->ident, "CD001", sizeof(vd->ident)) || 1 != vd->volume_descriptor_type) {
+		return 1;
+	}
+	*volumeSpaceSize = _le32(vd->volume_space_size_LE);
+
+	bvd = (const EL_TORITO_BOOT_VOLUME_DESCRIPTOR *)(descriptors + kBLElToritoSectorSize);
+	if (0 != memcmp(bvd->ident, "CD001", sizeof(bvd->ident)) || 0 != bvd->type
+		|| 0 == _le32(bvd->bootcat_ptr)) {
+		return 1;
+	}
+	*bootCatalogSector = _le32(bvd->bootcat_ptr);
+
+	return 0;
+}
+
+static void _addPlatform(BLElToritoUEFIRegion *region, uint8_t platform)
+{
+	uint32_t	i;
+
+	for (i = 0; i < region->platformCount; i++) {
+		if (region->platformIDs[i] == platform) return;
+	}
+	if (region->platformCount < kBLElToritoMaxPlatforms) {
+		region->platformIDs[region->platformCount++] = platform;
+	}
+}
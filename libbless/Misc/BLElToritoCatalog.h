@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLElToritoCatalog.h
+//
+//  El Torito boot catalog decoder. Catalogs are decoded from bytes
+//  already in memory, so image files can be checked without attaching
+//  them; only the C library is used, so it builds anywhere. Sectors
+//  are 2048 bytes.
+//
+
+#ifndef _BLELTORITOCATALOG_H_
+#define _BLELTORITOCATALOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define kBLElToritoSectorSize			2048
+#define kBLElToritoMaxCatalogSectors	8
+#define kBLElToritoMaxPlatforms			8
+
+enum {
+	kBLElToritoEntryValidation = 0,
+	kBLElToritoEntryDefault,
+	kBLElToritoEntryHeader,
+	kBLElToritoEntrySection,
+	kBLElToritoEntryExtension
+};
+
+// One decoded 32-byte catalog record
+typedef struct {
+	uint8_t		type;			// kBLElToritoEntry*
+	uint8_t		platformID;		// of the validation entry, or of the owning section header
+	uint8_t		indicator;		// header (0x90/0x91), boot (0x88 bootable) or extension (0x44) indicator
+	uint8_t		media;			// boot media type; the flags byte of extensions
+	uint8_t		systemType;
+	uint8_t		reserved;
+	uint16_t	count;			// headers: section entries; default and sections: emulated sectors
+	uint16_t	loadSegment;
+	uint16_t	header;			// index of the owning section header entry
+	uint32_t	loadRBA;
+	uint16_t	bootEntry;		// boot entry number of default and section entries; default is 0
+} BLElToritoEntry;
+
+typedef struct {
+	uint32_t		volumeSpaceSize;	// sectors, from the primary volume descriptor
+	uint32_t		bootCatalogSector;
+	bool			checksumValid;		// validation entry's words sum to 0
+	bool			complete;			// false if decoding stopped at a damaged record
+	uint32_t		entryCount;
+	BLElToritoEntry	entries[];			// in catalog order
+} BLElToritoCatalog;
+
+typedef struct {
+	uint32_t	volumeSpaceSize;
+	uint32_t	bootCatalogSector;
+	bool		checksumValid;
+	bool		found;					// a bootable EFI section entry was found
+	uint32_t	bootEntry;				// its boot entry number
+	uint32_t	offset;					// its first sector
+	uint32_t	size;					// sectors from there to the end of the volume
+	uint8_t		platformIDs[kBLElToritoMaxPlatforms];	// each distinct platform in the catalog
+	uint32_t	platformCount;
+} BLElToritoUEFIRegion;
+
+/*
+ * Decode every record of a boot catalog, never reading past length.
+ * Returns 2 if there is no validation entry; damage after it just
+ * leaves the catalog incomplete.
+ */
+int BLElToritoCatalogCreate(uint32_t volumeSpaceSize, uint32_t bootCatalogSector,
+							const uint8_t *bytes, size_t length, BLElToritoCatalog **catalog);
+
+/*
+ * Decode the catalog of a whole image in memory. Returns 1 if this isn't
+ * El Torito media, 2 if the catalog is missing or past the end.
+ */
+int BLElToritoCatalogCreateWithImage(const uint8_t *image, size_t length, BLElToritoCatalog **catalog);
+
+/*
+ * Map an image file, or read a device node, and decode its catalog.
+ * Returns 3 on I/O errors, with errno set.
+ */
+int BLElToritoCatalogCreateWithFile(const char *path, BLElToritoCatalog **catalog);
+
+void BLElToritoCatalogRelease(BLElToritoCatalog *catalog);
+
+/*
+ * The first bootable EFI entry. Returns 0 with region->found false if there is
+ * none, 2 if the catalog is damaged before one or its image starts past the
+ * end of the volume.
+ */
+int BLElToritoCatalogGetUEFIRegion(const BLElToritoCatalog *catalog, BLElToritoUEFIRegion *region);
+
+/*
+ * BLElToritoCatalogCreateWithFile and BLElToritoCatalogGetUEFIRegion together
+ */
+int BLElToritoFindUEFIInFile(const char *path, BLElToritoUEFIRegion *region);
+
+#endif // _BLELTORITOCATALOG_H_
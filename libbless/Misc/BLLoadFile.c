@@ -33,14 +33,26 @@
 
 #include <CoreFoundation/CoreFoundation.h>
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include <sys/paths.h>
 #include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
 
 #include "bless.h"
 #include "bless_private.h"
 #include "sharedUtilities.h"
 
+// smaller files aren't worth a mapping
+#define kBLMapThreshold (64 * 1024)
+
+static int createMappedData(BLContextPtr context, const char *path, CFDataRef *data);
+static void unmapBytes(void *ptr, void *info);
+static void releaseMapping(const void *info);
 
 int BLLoadFile(BLContextPtr context, const char * src, int useRsrcFork,
     CFDataRef* data) {
@@ -68,6 +80,12 @@ int BLLoadFile(BLContextPtr context, const char * src, int useRsrcFork,
 
     rsrcpath[MAXPATHLEN-1] = '\0';
 
+    // large files on read-only local volumes come back as a mapping, so
+    // nothing is copied until the bytes are written out
+    if(createMappedData(context, rsrcpath, data) == 0) {
+        return 0;
+    }
+
     loadSrc = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
 													  (UInt8 *)rsrcpath,
 													  strlen(rsrcpath), 0);
@@ -89,3 +107,85 @@ int BLLoadFile(BLContextPtr context, const char * src, int useRsrcFork,
     
     return 0;
 }
+
+/*
+ * The CFData's bytes are a private mapping of the file, unmapped when the
+ * CFData is freed. Non-zero if the file should be read the usual way instead.
+ *
+ * Only data forks on read-only local volumes are mapped. Anywhere else the
+ * file can be truncated or the server can go away while the CFData is
+ * still alive, and touching the mapping would then raise SIGBUS; resource
+ * forks can't be mapped at all.
+ */
+static int createMappedData(BLContextPtr context, const char *path, CFDataRef *data) {
+
+    int fd;
+    struct stat sb;
+    struct statfs sfs;
+    void *bytes;
+    size_t *length;
+    CFAllocatorRef deallocator;
+    CFAllocatorContext allocatorContext;
+
+    if(strstr(path, _PATH_RSRCFORKSPEC) != NULL) return 1;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0) return 1;
+
+    if(fstat(fd, &sb) < 0 || !S_ISREG(sb.st_mode) || sb.st_size < kBLMapThreshold
+       || (uint64_t)sb.st_size > SIZE_MAX) {
+        close(fd);
+        return 1;
+    }
+
+    if(fstatfs(fd, &sfs) < 0 || (sfs.f_flags & (MNT_RDONLY | MNT_LOCAL)) != (MNT_RDONLY | MNT_LOCAL)) {
+        close(fd);
+        return 1;
+    }
+
+    bytes = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(bytes == MAP_FAILED) {
+        contextprintf(context, kBLLogLevelVerbose,  "Can't map %s, reading it instead\n", path );
+        return 1;
+    }
+    madvise(bytes, (size_t)sb.st_size, MADV_SEQUENTIAL);
+
+    // the deallocator is only told the address, so it carries the length
+    length = malloc(sizeof(*length));
+    if(length == NULL) {
+        munmap(bytes, (size_t)sb.st_size);
+        return 1;
+    }
+    *length = (size_t)sb.st_size;
+
+    memset(&allocatorContext, 0, sizeof(allocatorContext));
+    allocatorContext.info = length;
+    allocatorContext.release = releaseMapping;
+    allocatorContext.deallocate = unmapBytes;
+
+    deallocator = CFAllocatorCreate(kCFAllocatorDefault, &allocatorContext);
+    if(deallocator == NULL) {
+        munmap(bytes, *length);
+        free(length);
+        return 1;
+    }
+
+    *data = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, bytes, (CFIndex)*length, deallocator);
+    CFRelease(deallocator);		// the CFData holds it now, or it freed length
+    if(*data == NULL) {
+        munmap(bytes, (size_t)sb.st_size);
+        return 1;
+    }
+
+    contextprintf(context, kBLLogLevelVerbose,  "Mapped %lld bytes of %s\n", (long long)sb.st_size, path );
+    return 0;
+}
+
+static void unmapBytes(void *ptr, void *info) {
+    munmap(ptr, *(size_t *)info);
+}
+
+static void releaseMapping(const void *info) {
+    free((void *)info);
+}
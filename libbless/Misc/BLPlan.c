@@ -0,0 +1,838 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLPlan.c
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <paths.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <sys/param.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+struct BLPlan {
+	// one dictionary per action, in the order they were recorded
+	CFMutableArrayRef	actions;
+};
+
+// volumes BLPlanApply had to mount itself
+typedef struct {
+	char		mountPoints[8][MAXPATHLEN];
+	int			count;
+} BLPlanMounts;
+
+static int _record(BLContextPtr context, CFMutableDictionaryRef action);
+static CFMutableDictionaryRef _createAction(CFStringRef kind);
+static CFMutableDictionaryRef _createWordsAction(BLContextPtr context, CFStringRef kind, const char *mountpoint,
+												 const uint64_t *words, int count);
+static void _setCString(CFMutableDictionaryRef dict, CFStringRef key, const char *value);
+static void _setNumber(CFMutableDictionaryRef dict, CFStringRef key, int64_t value);
+static int _setLocation(BLContextPtr context, CFMutableDictionaryRef dict, CFStringRef prefix, const char *path);
+static int _resolveLocation(BLContextPtr context, CFDictionaryRef dict, CFStringRef prefix,
+							BLPlanMounts *mounts, char *path, size_t pathLen);
+static bool _validAction(BLContextPtr context, CFDictionaryRef action);
+static bool _isNVRAMAction(CFDictionaryRef action);
+static int _applyAction(BLContextPtr context, CFDictionaryRef action, BLPlanMounts *mounts);
+static bool _getCString(CFDictionaryRef dict, CFStringRef key, char *buf, size_t bufLen);
+static int64_t _getNumber(CFDictionaryRef dict, CFStringRef key);
+static int _deleteFile(const char *path);
+
+int BLPlanCreate(BLContextPtr context, BLPlanRef *plan)
+{
+	BLPlanRef	newPlan;
+
+	*plan = NULL;
+
+	newPlan = calloc(1, sizeof(*newPlan));
+	if (newPlan == NULL) return 1;
+
+	newPlan->actions = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+	if (newPlan->actions == NULL) {
+		free(newPlan);
+		return 2;
+	}
+
+	*plan = newPlan;
+	return 0;
+}
+
+int BLPlanCreateWithPropertyList(BLContextPtr context, CFDataRef data, BLPlanRef *plan)
+{
+	CFPropertyListRef	plist;
+	CFErrorRef			error = NULL;
+	CFIndex				i, count;
+	int					ret;
+
+	*plan = NULL;
+
+	plist = CFPropertyListCreateWithData(kCFAllocatorDefault, data, kCFPropertyListImmutable, NULL, &error);
+	if (plist == NULL) {
+		contextprintf(context, kBLLogLevelError, "Could not parse plan\n");
+		if (error) CFRelease(error);
+		return 1;
+	}
+
+	if (CFGetTypeID(plist) != CFArrayGetTypeID()) {
+		contextprintf(context, kBLLogLevelError, "Plan is not an array of actions\n");
+		CFRelease(plist);
+		return 2;
+	}
+
+	// everything applying or printing the plan reads is checked here
+	count = CFArrayGetCount(plist);
+	for (i = 0; i < count; i++) {
+		if (!_validAction(context, CFArrayGetValueAtIndex(plist, i))) {
+			contextprintf(context, kBLLogLevelError, "Plan action %ld is malformed\n", (long)i);
+			CFRelease(plist);
+			return 3;
+		}
+	}
+
+	ret = BLPlanCreate(context, plan);
+	if (ret == 0) {
+		CFArrayAppendArray((*plan)->actions, plist, CFRangeMake(0, count));
+	}
+	CFRelease(plist);
+
+	return ret;
+}
+
+void BLPlanRelease(BLPlanRef plan)
+{
+	if (plan == NULL) return;
+
+	CFRelease(plan->actions);
+	free(plan);
+}
+
+CFArrayRef BLPlanGetActions(BLPlanRef plan)
+{
+	return plan->actions;
+}
+
+int BLPlanCopyPropertyList(BLContextPtr context, BLPlanRef plan, CFDataRef *data)
+{
+	*data = CFPropertyListCreateData(kCFAllocatorDefault, plan->actions,
+									 kCFPropertyListXMLFormat_v1_0, 0, NULL);
+	if (*data == NULL) {
+		contextprintf(context, kBLLogLevelError, "Could not serialize plan\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+int BLPlanApply(BLContextPtr context, BLPlanRef plan)
+{
+	BLPlanMounts	mounts;
+	CFIndex			i, count;
+	int				pass;
+	int				ret = 0;
+
+	if (BLPlanIsRecording(context)) {
+		contextprintf(context, kBLLogLevelError, "Can't apply a plan while recording one\n");
+		return 1;
+	}
+
+	mounts.count = 0;
+	count = CFArrayGetCount(plan->actions);
+
+	BLNVRAMWriteSetBegin(context);
+
+	// Files and volumes first.  A forward has to flush the writes staged
+	// before it, so NVRAM actions are only replayed, in order, once
+	// nothing else can fail.
+	for (pass = 0; pass < 2 && ret == 0; pass++) {
+		for (i = 0; i < count && ret == 0; i++) {
+			CFDictionaryRef	action = CFArrayGetValueAtIndex(plan->actions, i);
+
+			if (_isNVRAMAction(action) != (pass == 1)) continue;
+			ret = _applyAction(context, action, &mounts);
+			if (ret) {
+				contextprintf(context, kBLLogLevelError, "Plan action %ld failed\n", (long)i);
+			}
+		}
+	}
+
+	if (ret) {
+		BLNVRAMWriteSetDiscard(context);
+	} else {
+		ret = BLNVRAMWriteSetCommit(context);
+	}
+
+	while (mounts.count > 0) {
+		BLUnmountContainerVolume(context, mounts.mountPoints[--mounts.count]);
+	}
+
+	return ret;
+}
+
+bool BLPlanIsRecording(BLContextPtr context)
+{
+	return context && context->version >= kBLContextVersionPlan && context->plan != NULL;
+}
+
+int BLPlanRecordNVRAM(BLContextPtr context, CFStringRef name, CFTypeRef value)
+{
+	CFMutableDictionaryRef	action;
+
+	action = _createAction(value ? kBLPlanActionNVRAMSet : kBLPlanActionNVRAMDelete);
+	if (action == NULL) return 1;
+
+	CFDictionarySetValue(action, CFSTR("Name"), name);
+	if (value) CFDictionarySetValue(action, CFSTR("Value"), value);
+
+	return _record(context, action);
+}
+
+int BLPlanRecordNVRAMForward(BLContextPtr context, CFStringRef from, CFStringRef to)
+{
+	CFMutableDictionaryRef	action;
+
+	action = _createAction(kBLPlanActionNVRAMForward);
+	if (action == NULL) return 1;
+
+	CFDictionarySetValue(action, CFSTR("From"), from);
+	CFDictionarySetValue(action, CFSTR("To"), to);
+
+	return _record(context, action);
+}
+
+int BLPlanRecordCreateFile(BLContextPtr context, const char *path, CFDataRef data,
+						   int setImmutable, uint32_t type, uint32_t creator, int shouldPreallocate)
+{
+	CFMutableDictionaryRef	action;
+
+	action = _createAction(kBLPlanActionCreateFile);
+	if (action == NULL) return 1;
+
+	if (_setLocation(context, action, CFSTR(""), path)) {
+		CFRelease(action);
+		return 2;
+	}
+	if (data) CFDictionarySetValue(action, CFSTR("Data"), data);
+	_setNumber(action, CFSTR("Immutable"), setImmutable);
+	_setNumber(action, CFSTR("Type"), type);
+	_setNumber(action, CFSTR("Creator"), creator);
+	_setNumber(action, CFSTR("Preallocate"), shouldPreallocate);
+
+	return _record(context, action);
+}
+
+int BLPlanRecordCopyFile(BLContextPtr context, const char *from, const char *to)
+{
+	CFMutableDictionaryRef	action;
+
+	action = _createAction(kBLPlanActionCopyFile);
+	if (action == NULL) return 1;
+
+	if (_setLocation(context, action, CFSTR("Source"), from)
+		|| _setLocation(context, action, CFSTR(""), to)) {
+		CFRelease(action);
+		return 2;
+	}
+
+	return _record(context, action);
+}
+
+int BLPlanRecordDeleteFile(BLContextPtr context, const char *path)
+{
+	CFMutableDictionaryRef	action;
+
+	action = _createAction(kBLPlanActionDeleteFile);
+	if (action == NULL) return 1;
+
+	if (_setLocation(context, action, CFSTR(""), path)) {
+		CFRelease(action);
+		return 2;
+	}
+
+	return _record(context, action);
+}
+
+int BLPlanRecordFinderFlag(BLContextPtr context, const char *path, uint16_t flag, int setval)
+{
+	CFMutableDictionaryRef	action;
+
+	action = _createAction(kBLPlanActionSetFinderFlag);
+	if (action == NULL) return 1;
+
+	if (_setLocation(context, action, CFSTR(""), path)) {
+		CFRelease(action);
+		return 2;
+	}
+	_setNumber(action, CFSTR("Flag"), flag);
+	_setNumber(action, CFSTR("Value"), setval);
+
+	return _record(context, action);
+}
+
+int BLPlanRecordVolumeWords(BLContextPtr context, CFStringRef kind, const char *mountpoint,
+							const uint64_t *words, int count)
+{
+	CFMutableDictionaryRef	action;
+
+	action = _createWordsAction(context, kind, mountpoint, words, count);
+	if (action == NULL) return 1;
+
+	return _record(context, action);
+}
+
+int BLPlanRecordDiskLabel(BLContextPtr context, const char *device, CFDataRef label, int scale)
+{
+	CFMutableDictionaryRef	action;
+
+	action = _createAction(kBLPlanActionSetDiskLabel);
+	if (action == NULL) return 1;
+
+	_setCString(action, CFSTR("Device"), device);
+	CFDictionarySetValue(action, CFSTR("Data"), label);
+	_setNumber(action, CFSTR("Scale"), scale);
+
+	return _record(context, action);
+}
+
+int BLPlanRecordBlessIDsFromPaths(BLContextPtr context, CFStringRef kind, const char *mountpoint,
+								  const uint64_t *words, int count, const char *file, const char *folder, int flags)
+{
+	CFMutableDictionaryRef	action;
+
+	action = _createWordsAction(context, kBLPlanActionSetBlessIDsFromPaths, mountpoint, words, count);
+	if (action == NULL) return 1;
+
+	// the words as they are, then what to fill in when applying
+	CFDictionarySetValue(action, CFSTR("Target"), kind);
+	_setNumber(action, CFSTR("Flags"), flags);
+	if ((file && _setLocation(context, action, CFSTR("File"), file))
+		|| (folder && _setLocation(context, action, CFSTR("Folder"), folder))) {
+		CFRelease(action);
+		return 2;
+	}
+
+	return _record(context, action);
+}
+
+static int _record(BLContextPtr context, CFMutableDictionaryRef action)
+{
+	contextprintf(context, kBLLogLevelVerbose, "Planned %s\n",
+				  BLGetCStringDescription(CFDictionaryGetValue(action, kBLPlanActionKey)));
+
+	CFArrayAppendValue(context->plan->actions, action);
+	CFRelease(action);
+
+	return 0;
+}
+
+static CFMutableDictionaryRef _createAction(CFStringRef kind)
+{
+	CFMutableDictionaryRef	action;
+
+	action = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+									   &kCFTypeDictionaryKeyCallBacks,
+									   &kCFTypeDictionaryValueCallBacks);
+	if (action) CFDictionarySetValue(action, kBLPlanActionKey, kind);
+
+	return action;
+}
+
+static CFMutableDictionaryRef _createWordsAction(BLContextPtr context, CFStringRef kind, const char *mountpoint,
+												 const uint64_t *words, int count)
+{
+	CFMutableDictionaryRef	action;
+	CFMutableArrayRef		array;
+	int						i;
+
+	action = _createAction(kind);
+	if (action == NULL) return NULL;
+
+	array = CFArrayCreateMutable(kCFAllocatorDefault, count, &kCFTypeArrayCallBacks);
+	if (array == NULL || _setLocation(context, action, CFSTR(""), mountpoint)) {
+		if (array) CFRelease(array);
+		CFRelease(action);
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++) {
+		int64_t		value = (int64_t)words[i];
+		CFNumberRef	number = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt64Type, &value);
+
+		CFArrayAppendValue(array, number);
+		CFRelease(number);
+	}
+	CFDictionarySetValue(action, CFSTR("Words"), array);
+	CFRelease(array);
+
+	return action;
+}
+
+static void _setCString(CFMutableDictionaryRef dict, CFStringRef key, const char *value)
+{
+	CFStringRef	string = CFStringCreateWithCString(kCFAllocatorDefault, value, kCFStringEncodingUTF8);
+
+	if (string) {
+		CFDictionarySetValue(dict, key, string);
+		CFRelease(string);
+	}
+}
+
+static void _setNumber(CFMutableDictionaryRef dict, CFStringRef key, int64_t value)
+{
+	CFNumberRef	number = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt64Type, &value);
+
+	if (number) {
+		CFDictionarySetValue(dict, key, number);
+		CFRelease(number);
+	}
+}
+
+// Volumes bless mounts for itself are gone by the time the plan is applied,
+// so paths are recorded relative to the volume they are on, along with the
+// volume's device (<prefix>Device, <prefix>Path). <prefix>FullPath is the
+// absolute path at recording time, for volumes that aren't device-backed.
+static int _setLocation(BLContextPtr context, CFMutableDictionaryRef dict, CFStringRef prefix, const char *path)
+{
+	char			dir[MAXPATHLEN];
+	struct statfs	sfs;
+	const char		*relative;
+	size_t			mountLen;
+	CFStringRef		key;
+
+	if (strlcpy(dir, path, sizeof dir) >= sizeof dir) return 1;
+
+	// the file itself may not exist yet
+	while (blsustatfs(dir, &sfs) < 0) {
+		char *slash = strrchr(dir, '/');
+
+		if (slash == NULL || slash == dir) {
+			contextprintf(context, kBLLogLevelError, "Can't find the volume containing %s\n", path);
+			return 2;
+		}
+		*slash = '\0';
+	}
+
+	mountLen = strlen(sfs.f_mntonname);
+	if (strcmp(sfs.f_mntonname, "/") == 0) {
+		relative = path;
+	} else if (strncmp(path, sfs.f_mntonname, mountLen) == 0) {
+		relative = path + mountLen;
+		if (*relative == '\0') relative = "/";
+	} else {
+		relative = NULL;
+	}
+
+	key = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("%@FullPath"), prefix);
+	_setCString(dict, key, path);
+	CFRelease(key);
+
+	if (relative) {
+		key = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("%@Device"), prefix);
+		_setCString(dict, key, sfs.f_mntfromname);
+		CFRelease(key);
+		key = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("%@Path"), prefix);
+		_setCString(dict, key, relative);
+		CFRelease(key);
+	}
+
+	return 0;
+}
+
+static int _resolveLocation(BLContextPtr context, CFDictionaryRef dict, CFStringRef prefix,
+							BLPlanMounts *mounts, char *path, size_t pathLen)
+{
+	char		device[MAXPATHLEN];
+	char		relative[MAXPATHLEN];
+	char		mountPoint[MAXPATHLEN];
+	CFStringRef	deviceKey, pathKey, fullPathKey;
+	bool		haveDevice;
+	int			ret = 0;
+
+	deviceKey = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("%@Device"), prefix);
+	pathKey = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("%@Path"), prefix);
+	fullPathKey = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("%@FullPath"), prefix);
+
+	haveDevice = _getCString(dict, deviceKey, device, sizeof device)
+				 && _getCString(dict, pathKey, relative, sizeof relative)
+				 && strncmp(device, _PATH_DEV, strlen(_PATH_DEV)) == 0;
+
+	if (!haveDevice) {
+		if (!_getCString(dict, fullPathKey, path, pathLen)) ret = 1;
+		goto exit;
+	}
+
+	ret = GetMountForBSD(context, device + strlen(_PATH_DEV), mountPoint, sizeof mountPoint);
+	if (ret) goto exit;
+
+	if (!mountPoint[0]) {
+		if (mounts->count == sizeof(mounts->mountPoints) / sizeof(mounts->mountPoints[0])) {
+			contextprintf(context, kBLLogLevelError, "Plan touches too many unmounted volumes\n");
+			ret = 2;
+			goto exit;
+		}
+		ret = BLMountContainerVolume(context, device + strlen(_PATH_DEV), mountPoint, sizeof mountPoint, false);
+		if (ret) {
+			contextprintf(context, kBLLogLevelError, "Couldn't mount %s\n", device);
+			goto exit;
+		}
+		strlcpy(mounts->mountPoints[mounts->count++], mountPoint, sizeof mounts->mountPoints[0]);
+	}
+
+	if (strcmp(mountPoint, "/") == 0) {
+		strlcpy(path, relative, pathLen);
+	} else if (strcmp(relative, "/") == 0) {
+		strlcpy(path, mountPoint, pathLen);
+	} else {
+		snprintf(path, pathLen, "%s%s", mountPoint, relative);
+	}
+
+exit:
+	CFRelease(deviceKey);
+	CFRelease(pathKey);
+	CFRelease(fullPathKey);
+
+	return ret;
+}
+
+/*
+ * What each action must (or may) contain. A location is the <key>FullPath,
+ * <key>Device and <key>Path strings written by _setLocation; an NVRAM
+ * value is any type BLNVRAMSetValue takes; words are an array of at most
+ * eight numbers.
+ */
+enum {
+	kKeyString = 1,
+	kKeyNumber,
+	kKeyData,
+	kKeyLocation,
+	kKeyNVRAMValue,
+	kKeyWords,
+	kKeyTarget
+};
+
+typedef struct {
+	const char	*name;
+	int			type;
+	bool		optional;
+} BLPlanKey;
+
+typedef struct {
+	const char	*kind;
+	BLPlanKey	keys[7];
+} BLPlanSchema;
+
+static const BLPlanSchema kPlanSchemas[] = {
+	{ "NVRAMSet",				{ { "Name", kKeyString }, { "Value", kKeyNVRAMValue } } },
+	{ "NVRAMDelete",			{ { "Name", kKeyString } } },
+	{ "NVRAMForward",			{ { "From", kKeyString }, { "To", kKeyString } } },
+	{ "CreateFile",				{ { "", kKeyLocation }, { "Data", kKeyData, true }, { "Immutable", kKeyNumber },
+								  { "Type", kKeyNumber }, { "Creator", kKeyNumber }, { "Preallocate", kKeyNumber } } },
+	{ "CopyFile",				{ { "Source", kKeyLocation }, { "", kKeyLocation } } },
+	{ "DeleteFile",				{ { "", kKeyLocation } } },
+	{ "SetFinderFlag",			{ { "", kKeyLocation }, { "Flag", kKeyNumber }, { "Value", kKeyNumber } } },
+	{ "SetVolumeFinderInfo",	{ { "", kKeyLocation }, { "Words", kKeyWords } } },
+	{ "SetAPFSBlessData",		{ { "", kKeyLocation }, { "Words", kKeyWords } } },
+	{ "SetDiskLabel",			{ { "Device", kKeyString }, { "Data", kKeyData }, { "Scale", kKeyNumber } } },
+	{ "SetBlessIDsFromPaths",	{ { "", kKeyLocation }, { "Words", kKeyWords }, { "Target", kKeyTarget },
+								  { "Flags", kKeyNumber }, { "File", kKeyLocation, true },
+								  { "Folder", kKeyLocation, true } } },
+};
+
+static CFTypeRef _getValue(CFDictionaryRef dict, const char *prefix, const char *suffix)
+{
+	char		name[64];
+	CFStringRef	key;
+	CFTypeRef	value;
+
+	snprintf(name, sizeof name, "%s%s", prefix, suffix);
+	key = CFStringCreateWithCString(kCFAllocatorDefault, name, kCFStringEncodingUTF8);
+	if (key == NULL) return NULL;
+	value = CFDictionaryGetValue(dict, key);
+	CFRelease(key);
+
+	return value;
+}
+
+static bool _validKey(CFDictionaryRef action, const BLPlanKey *key)
+{
+	CFTypeRef	value, device, relative;
+	CFIndex		i, count;
+
+	if (key->type == kKeyLocation) {
+		value = _getValue(action, key->name, "FullPath");
+		device = _getValue(action, key->name, "Device");
+		relative = _getValue(action, key->name, "Path");
+
+		if (value == NULL) return key->optional && device == NULL && relative == NULL;
+
+		// the device and relative path come as a pair, if at all
+		return CFGetTypeID(value) == CFStringGetTypeID()
+			   && (device == NULL) == (relative == NULL)
+			   && (device == NULL || (CFGetTypeID(device) == CFStringGetTypeID()
+									  && CFGetTypeID(relative) == CFStringGetTypeID()));
+	}
+
+	value = _getValue(action, key->name, "");
+	if (value == NULL) return key->optional;
+
+	switch (key->type) {
+		case kKeyString:
+			return CFGetTypeID(value) == CFStringGetTypeID();
+		case kKeyNumber:
+			return CFGetTypeID(value) == CFNumberGetTypeID();
+		case kKeyData:
+			return CFGetTypeID(value) == CFDataGetTypeID();
+		case kKeyNVRAMValue:
+			return CFGetTypeID(value) == CFStringGetTypeID() || CFGetTypeID(value) == CFDataGetTypeID()
+				   || CFGetTypeID(value) == CFNumberGetTypeID() || CFGetTypeID(value) == CFBooleanGetTypeID();
+		case kKeyWords:
+			if (CFGetTypeID(value) != CFArrayGetTypeID()) return false;
+			count = CFArrayGetCount(value);
+			if (count > 8) return false;
+			for (i = 0; i < count; i++) {
+				if (CFGetTypeID(CFArrayGetValueAtIndex(value, i)) != CFNumberGetTypeID()) return false;
+			}
+			return true;
+		case kKeyTarget:
+			return CFGetTypeID(value) == CFStringGetTypeID()
+				   && (CFEqual(value, kBLPlanActionSetVolumeFinderInfo)
+					   || CFEqual(value, kBLPlanActionSetAPFSBlessData));
+	}
+
+	return false;
+}
+
+static bool _validAction(BLContextPtr context, CFDictionaryRef action)
+{
+	CFStringRef	kind;
+	char		kindName[64];
+	size_t		i, j;
+
+	if (CFGetTypeID(action) != CFDictionaryGetTypeID()) return false;
+
+	kind = CFDictionaryGetValue(action, kBLPlanActionKey);
+	if (kind == NULL || CFGetTypeID(kind) != CFStringGetTypeID()
+		|| !CFStringGetCString(kind, kindName, sizeof kindName, kCFStringEncodingUTF8)) {
+		return false;
+	}
+
+	for (i = 0; i < sizeof(kPlanSchemas) / sizeof(kPlanSchemas[0]); i++) {
+		const BLPlanSchema *schema = &kPlanSchemas[i];
+
+		if (strcmp(schema->kind, kindName) != 0) continue;
+
+		for (j = 0; j < sizeof(schema->keys) / sizeof(schema->keys[0]) && schema->keys[j].name; j++) {
+			if (!_validKey(action, &schema->keys[j])) {
+				contextprintf(context, kBLLogLevelVerbose, "%s action has a missing or mistyped %s\n",
+							  kindName, schema->keys[j].name[0] ? schema->keys[j].name : "location");
+				return false;
+			}
+		}
+		return true;
+	}
+
+	contextprintf(context, kBLLogLevelVerbose, "Unknown plan action %s\n", kindName);
+	return false;
+}
+
+static bool _isNVRAMAction(CFDictionaryRef action)
+{
+	CFStringRef	kind = CFDictionaryGetValue(action, kBLPlanActionKey);
+
+	return CFEqual(kind, kBLPlanActionNVRAMSet) || CFEqual(kind, kBLPlanActionNVRAMDelete)
+		   || CFEqual(kind, kBLPlanActionNVRAMForward);
+}
+
+static int _applyAction(BLContextPtr context, CFDictionaryRef action, BLPlanMounts *mounts)
+{
+	CFStringRef	kind = CFDictionaryGetValue(action, kBLPlanActionKey);
+	char		path[MAXPATHLEN];
+	char		source[MAXPATHLEN];
+	char		parent[MAXPATHLEN];
+	char		directory[MAXPATHLEN];
+	CFArrayRef	words;
+	uint64_t	values[8];
+	CFIndex		i, count = 0;
+	bool		cloned;
+	int			ret;
+
+	contextprintf(context, kBLLogLevelVerbose, "Applying %s\n", BLGetCStringDescription(kind));
+
+	if (CFEqual(kind, kBLPlanActionNVRAMSet)) {
+		return BLNVRAMSetValue(context, CFDictionaryGetValue(action, CFSTR("Name")),
+							   CFDictionaryGetValue(action, CFSTR("Value")));
+	}
+	if (CFEqual(kind, kBLPlanActionNVRAMDelete)) {
+		return BLNVRAMDeleteValue(context, CFDictionaryGetValue(action, CFSTR("Name")));
+	}
+	if (CFEqual(kind, kBLPlanActionNVRAMForward)) {
+		// the source is derived by the store from an earlier write
+		ret = BLNVRAMWriteSetFlush(context);
+		if (ret) return ret;
+		return _forwardNVRAM(context, CFDictionaryGetValue(action, CFSTR("From")),
+							 CFDictionaryGetValue(action, CFSTR("To")));
+	}
+	if (CFEqual(kind, kBLPlanActionSetDiskLabel)) {
+		if (!_getCString(action, CFSTR("Device"), path, sizeof path)) return 1;
+		return BLSetDiskLabelForDevice(context, path, CFDictionaryGetValue(action, CFSTR("Data")),
+									   (int)_getNumber(action, CFSTR("Scale")));
+	}
+
+	ret = _resolveLocation(context, action, CFSTR(""), mounts, path, sizeof path);
+	if (ret) return ret;
+
+	if (CFEqual(kind, kBLPlanActionCreateFile)) {
+		return BLCreateFileWithOptions(context, CFDictionaryGetValue(action, CFSTR("Data")), path,
+									   (int)_getNumber(action, CFSTR("Immutable")),
+									   (uint32_t)_getNumber(action, CFSTR("Type")),
+									   (uint32_t)_getNumber(action, CFSTR("Creator")),
+									   (int)_getNumber(action, CFSTR("Preallocate")));
+	}
+	if (CFEqual(kind, kBLPlanActionCopyFile)) {
+		ret = _resolveLocation(context, action, CFSTR("Source"), mounts, source, sizeof source);
+		if (ret) return ret;
+
+		// dirname() may hand back its own buffer
+		strlcpy(parent, path, sizeof parent);
+		strlcpy(directory, dirname(parent), sizeof directory);
+		ret = mkpath_np(directory, 0755);
+		if (ret && ret != EEXIST) return ret;
+
+		// the same replacement the live run makes, so the target is never
+		// missing and carries the source's times for the next comparison
+		ret = BLReplaceFileWithCopy(context, source, path, NULL, &cloned);
+		if (ret) {
+			contextprintf(context, kBLLogLevelError, "Couldn't copy %s to %s: %s\n", source, path, strerror(ret));
+			return ret;
+		}
+		return BLSyncParentDirectory(context, path);
+	}
+	if (CFEqual(kind, kBLPlanActionDeleteFile)) {
+		ret = _deleteFile(path);
+		return ret == ENOENT ? 0 : ret;
+	}
+	if (CFEqual(kind, kBLPlanActionSetFinderFlag)) {
+		return BLSetFinderFlag(context, path, (uint16_t)_getNumber(action, CFSTR("Flag")),
+							   (int)_getNumber(action, CFSTR("Value")));
+	}
+
+	words = CFDictionaryGetValue(action, CFSTR("Words"));
+	if (words && CFGetTypeID(words) == CFArrayGetTypeID()) {
+		count = CFArrayGetCount(words);
+	}
+	if (count > 8) count = 8;
+	memset(values, 0, sizeof values);
+	for (i = 0; i < count; i++) {
+		CFNumberRef	number = CFArrayGetValueAtIndex(words, i);
+		int64_t		value = 0;
+
+		if (CFGetTypeID(number) == CFNumberGetTypeID()) {
+			CFNumberGetValue(number, kCFNumberSInt64Type, &value);
+		}
+		values[i] = (uint64_t)value;
+	}
+
+	if (CFEqual(kind, kBLPlanActionSetVolumeFinderInfo)) {
+		uint32_t	finderWords[8];
+
+		for (i = 0; i < 8; i++) finderWords[i] = (uint32_t)values[i];
+		return BLSetVolumeFinderInfo(context, path, finderWords);
+	}
+	if (CFEqual(kind, kBLPlanActionSetAPFSBlessData)) {
+		return BLSetAPFSBlessData(context, path, values);
+	}
+	if (CFEqual(kind, kBLPlanActionSetBlessIDsFromPaths)) {
+		bool	haveFile = CFDictionaryContainsKey(action, CFSTR("FileFullPath"));
+		bool	haveFolder = CFDictionaryContainsKey(action, CFSTR("FolderFullPath"));
+
+		// source and parent are free by now
+		if (haveFile) {
+			ret = _resolveLocation(context, action, CFSTR("File"), mounts, source, sizeof source);
+			if (ret) return ret;
+		}
+		if (haveFolder) {
+			ret = _resolveLocation(context, action, CFSTR("Folder"), mounts, parent, sizeof parent);
+			if (ret) return ret;
+		}
+		return BLSetBlessIDsFromPaths(context, CFDictionaryGetValue(action, CFSTR("Target")), path,
+									  values, (int)count, haveFile ? source : NULL, haveFolder ? parent : NULL,
+									  (int)_getNumber(action, CFSTR("Flags")));
+	}
+
+	contextprintf(context, kBLLogLevelError, "Unknown plan action %s\n", BLGetCStringDescription(kind));
+	return 3;
+}
+
+static bool _getCString(CFDictionaryRef dict, CFStringRef key, char *buf, size_t bufLen)
+{
+	CFStringRef	value = CFDictionaryGetValue(dict, key);
+
+	if (value == NULL || CFGetTypeID(value) != CFStringGetTypeID()) return false;
+
+	return CFStringGetCString(value, buf, bufLen, kCFStringEncodingUTF8);
+}
+
+static int64_t _getNumber(CFDictionaryRef dict, CFStringRef key)
+{
+	CFNumberRef	value = CFDictionaryGetValue(dict, key);
+	int64_t		number = 0;
+
+	if (value && CFGetTypeID(value) == CFNumberGetTypeID()) {
+		CFNumberGetValue(value, kCFNumberSInt64Type, &number);
+	}
+
+	return number;
+}
+
+// The immutable flag is cleared through a descriptor opened without
+// following links, so a link swapped in after the check can't redirect
+// chflags to the file it points at (see BLCreateFileWithOptions).  A link
+// itself carries no flags to clear and is simply unlinked.
+static int _deleteFile(const char *path)
+{
+	struct stat	sb;
+	int			fd;
+	int			ret = 0;
+
+	fd = open(path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK);
+	if (fd < 0) {
+		if (errno != ELOOP) return errno;
+	} else {
+		if (fstat(fd, &sb) < 0) {
+			ret = errno;
+		} else if ((sb.st_flags & UF_IMMUTABLE) != 0 && fchflags(fd, sb.st_flags & ~UF_IMMUTABLE) < 0) {
+			ret = errno;
+		}
+		close(fd);
+		if (ret) return ret;
+	}
+
+	return (unlink(path) < 0) ? errno : 0;
+}
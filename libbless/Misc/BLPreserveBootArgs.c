@@ -36,13 +36,6 @@
 #include "bless.h"
 #include "bless_private.h"
 
-static const char *remove_boot_args[] = {
-	"rd",	/* rd=(enet|disk0|md0) */
-	"rp",	/* rp=nfs:1.2.3.4:/foo:bar.dmg, netboot */
-	"boot-uuid",	/* UUID of filesystem/partition for rooting */
-	NULL
-};
-
 int BLPreserveBootArgs(BLContextPtr context,
                        const char *input,
                        char *output,
@@ -57,63 +50,33 @@ int BLPreserveBootArgsIfChanged(BLContextPtr context,
                                 size_t outputLen,
                                 bool *outChanged)
 {
-    char oldbootargs[1024];
-    char bootargs[1024];
-    size_t bootleft=sizeof(bootargs)-1;
-    char *token, *restargs;
-    int firstarg=1;
-    bool changed=false;
+    BLBootArgsRef args;
+    BLBootArgsChanges changes;
+    char *bootargs;
+    int ret;
+    
+    contextprintf(context, kBLLogLevelVerbose,  "Old boot-args: %s\n", input);
     
-    strncpy(oldbootargs, input, sizeof(oldbootargs)-1);
-    oldbootargs[sizeof(oldbootargs)-1] = '\0';
+    ret = BLBootArgsCreate(context, input, &args);
+    if(ret) return ret;
     
-    memset(bootargs, 0, sizeof(bootargs));
+    BLBootArgsFilter(context, args);
+    BLBootArgsGetChanges(args, &changes);
     
-    contextprintf(context, kBLLogLevelVerbose,  "Old boot-args: %s\n", oldbootargs);
+    ret = BLBootArgsCopyString(context, args, &bootargs);
+    BLBootArgsRelease(args);
+    if(ret) return ret;
     
-    restargs = oldbootargs;
-    while((token = strsep(&restargs, " ")) != NULL) {
-        int shouldbesaved = 1, i;
-        contextprintf(context, kBLLogLevelVerbose, "\tGot token: %s\n", token);
-        for(i=0; remove_boot_args[i]; i++) {
-            // see if it's something we want
-            if(remove_boot_args[i][0] == '-') {
-                // -v style
-                if(strcmp(remove_boot_args[i], token) == 0) {
-                    shouldbesaved = 0;
-                    break;
-                }
-            } else {
-                // debug= style
-                size_t keylen = strlen(remove_boot_args[i]);
-                if(strlen(token) >= keylen+1
-                   && strncmp(remove_boot_args[i], token, keylen) == 0
-                   && token[keylen] == '=') {
-                    shouldbesaved = 0;
-                    break;
-                }
-            }
-        }
-        
-        if(!shouldbesaved) {
-            changed = true;
-        } else {
-            // append to bootargs if it should be preserved
-            if(firstarg) {
-                firstarg = 0;
-            } else {
-                strncat(bootargs, " ", bootleft);
-                bootleft--;
-            }
-            
-            contextprintf(context, kBLLogLevelVerbose,  "\tPreserving: %s\n", token);
-            strncat(bootargs, token, bootleft);
-            bootleft -= strlen(token);
-        }
+    // refuse rather than truncate
+    if(strlcpy(output, bootargs, outputLen) >= outputLen) {
+        contextprintf(context, kBLLogLevelError,  "Filtered boot-args (%zu bytes) do not fit in %zu bytes\n",
+                      strlen(bootargs), outputLen);
+        free(bootargs);
+        return 1;
     }
     
-    strlcpy(output, bootargs, outputLen);
-    if (outChanged) *outChanged = changed;
+    free(bootargs);
+    if (outChanged) *outChanged = (changes.removed > 0);
     
     return 0;
 }
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLReplaceFile.c
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/clonefile.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+// One file's reads run a buffer ahead of its writes
+typedef struct {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	char			*buffers[2];
+	ssize_t			lengths[2];	// bytes held, 0 at end of file, -1 while free
+	int				fd;
+	int				error;
+	bool			stop;
+} BLCopyPipe;
+
+static int copyFile(BLContextPtr context, const char *from, const char *to, char *buffers[2], bool *cloned);
+static void *copyReader(void *arg);
+static int writeFully(int fd, const char *buffer, size_t length);
+
+/*
+ * Copy to a temporary name next to the target, give it the source's
+ * times, flush it, then rename it over the target. The target is
+ * always either the old file or the whole new one.
+ */
+int BLReplaceFileWithCopy(BLContextPtr context, const char *from, const char *to, char *buffers[2], bool *cloned)
+{
+	int				ret;
+	char			tempPath[MAXPATHLEN];
+	const char		*name;
+	struct stat		sb;
+	struct timespec	times[2];
+	struct timespec	start, end;
+	double			seconds;
+	char			*ownBuffers[2] = { NULL, NULL };
+	int				fd;
+
+	*cloned = false;
+	if (stat(from, &sb) < 0) {
+		ret = errno;
+		contextprintf(context, kBLLogLevelError, "Couldn't stat %s: %s\n", from, strerror(ret));
+		return ret;
+	}
+
+	name = strrchr(to, '/');
+	name = name ? name + 1 : to;
+	if (snprintf(tempPath, sizeof tempPath, "%.*s.%s" kBLReplaceFileTempSuffix, (int)(name - to), to, name) >= (int)sizeof tempPath) {
+		return ENAMETOOLONG;
+	}
+
+	if (buffers == NULL) {
+		// page aligned, so the copy can go straight to and from the page cache
+		if (posix_memalign((void **)&ownBuffers[0], getpagesize(), kBLReplaceFileBufferSize) ||
+			posix_memalign((void **)&ownBuffers[1], getpagesize(), kBLReplaceFileBufferSize)) {
+			free(ownBuffers[0]);
+			return ENOMEM;
+		}
+		buffers = ownBuffers;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = copyFile(context, from, tempPath, buffers, cloned);
+	if (ret) goto exit;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	times[0] = sb.st_atimespec;
+	times[1] = sb.st_mtimespec;
+	if (utimensat(AT_FDCWD, tempPath, times, 0) < 0) {
+		// only costs a comparison next time
+		contextprintf(context, kBLLogLevelVerbose, "Couldn't set time for %s: %s\n", tempPath, strerror(errno));
+	}
+
+	// The new contents have to be on the disk before they replace the old
+	// file, or a crash could leave the target empty.  This covers clones
+	// as well as copies.
+	fd = open(tempPath, O_RDONLY);
+	if (fd < 0) {
+		ret = errno;
+		contextprintf(context, kBLLogLevelError, "Couldn't open %s to sync it: %s\n", tempPath, strerror(ret));
+		goto exit;
+	}
+	ret = BLFullSync(context, fd, tempPath);
+	close(fd);
+	if (ret) goto exit;
+
+	if (rename(tempPath, to) < 0) {
+		ret = errno;
+		contextprintf(context, kBLLogLevelError, "Couldn't rename %s to %s: %s\n", tempPath, to, strerror(ret));
+		goto exit;
+	}
+
+	seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	contextprintf(context, kBLLogLevelVerbose, "%s %s to %s (%lld bytes, %.3f s, %.1f MB/s)\n",
+				  *cloned ? "Cloned" : "Copied", from, to, (long long)sb.st_size, seconds,
+				  seconds > 0 ? (double)sb.st_size / seconds / 1e6 : 0.0);
+
+exit:
+	if (ret) unlink(tempPath);
+	free(ownBuffers[0]);
+	free(ownBuffers[1]);
+	return ret;
+}
+
+/*
+ * Flush fd to the disk itself, not just to the drive's cache, where the
+ * filesystem supports it.
+ */
+int BLFullSync(BLContextPtr context, int fd, const char *path)
+{
+	int	ret;
+
+	ret = fcntl(fd, F_FULLFSYNC);
+	if (ret == -1 && (errno == ENOTSUP || errno == ENOTTY || errno == EINVAL)) {
+		contextprintf(context, kBLLogLevelVerbose, "F_FULLFSYNC not supported for %s\n", path);
+		ret = fsync(fd);
+	}
+	if (ret == 0) return 0;
+	ret = errno;
+	contextprintf(context, kBLLogLevelError, "Couldn't sync %s: %s\n", path, strerror(ret));
+	return ret;
+}
+
+int BLSyncParentDirectory(BLContextPtr context, const char *path)
+{
+	char	directory[MAXPATHLEN];
+	char	*slash;
+	int		fd;
+	int		ret;
+
+	strlcpy(directory, path, sizeof directory);
+	slash = strrchr(directory, '/');
+	if (slash == NULL) {
+		strlcpy(directory, ".", sizeof directory);
+	} else if (slash == directory) {
+		slash[1] = '\0';
+	} else {
+		*slash = '\0';
+	}
+
+	fd = open(directory, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		ret = errno;
+		contextprintf(context, kBLLogLevelError, "Couldn't open %s to sync it: %s\n", directory, strerror(ret));
+		return ret;
+	}
+	ret = BLFullSync(context, fd, directory);
+	close(fd);
+	return ret;
+}
+
+// Clone the file if both ends are on the same volume.  Otherwise preallocate
+// the target and copy through the caller's buffers, with a reader thread
+// filling one buffer while the other is written.
+static int copyFile(BLContextPtr context, const char *from, const char *to, char *buffers[2], bool *cloned)
+{
+	int			ret = 0;
+	int			fdFrom = -1;
+	int			fdTo = -1;
+	off_t		fileSize;
+	fstore_t	preall;
+	BLCopyPipe	copyPipe;
+	pthread_t	reader;
+	int			slot;
+	ssize_t		bytes;
+
+	*cloned = false;
+	unlink(to);		// left over from an interrupted run
+	if (clonefile(from, to, CLONE_NOFOLLOW | CLONE_NOOWNERCOPY) == 0) {
+		chmod(to, 0644);
+		*cloned = true;
+		return 0;
+	}
+	if (errno != EXDEV && errno != ENOTSUP) {
+		contextprintf(context, kBLLogLevelVerbose, "Couldn't clone %s: %s\n", from, strerror(errno));
+	}
+
+	fdFrom = open(from, O_RDONLY);
+	if (fdFrom < 0) {
+		ret = errno;
+		contextprintf(context, kBLLogLevelError, "Couldn't open %s: %s\n", from, strerror(ret));
+		goto exit;
+	}
+	fileSize = lseek(fdFrom, 0, SEEK_END);
+	if (fileSize < 0) {
+		ret = errno;
+		contextprintf(context, kBLLogLevelError, "Couldn't get size of file %s: %s\n", from, strerror(ret));
+		goto exit;
+	}
+	fdTo = open(to, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fdTo < 0) {
+		ret = errno;
+		contextprintf(context, kBLLogLevelError, "Couldn't create %s: %s\n", to, strerror(ret));
+		goto exit;
+	}
+	preall.fst_length = fileSize;
+	preall.fst_offset = 0;
+	preall.fst_flags = F_ALLOCATECONTIG;
+	preall.fst_posmode = F_PEOFPOSMODE;
+	if (fcntl(fdTo, F_PREALLOCATE, &preall) < 0) {
+		if (errno == ENOTSUP) {
+			contextprintf(context, kBLLogLevelVerbose, "Preallocation not supported on this filesystem for %s\n", to);
+		} else {
+			ret = errno;
+			contextprintf(context, kBLLogLevelError, "Preallocation of %s failed: %s\n", to, strerror(ret));
+			goto exit;
+		}
+	} else {
+		contextprintf(context, kBLLogLevelVerbose, "0x%08X bytes preallocated for %s\n",
+					  (unsigned int)preall.fst_bytesalloc, to);
+	}
+	lseek(fdFrom, 0, SEEK_SET);
+
+	copyPipe.buffers[0] = buffers[0];
+	copyPipe.buffers[1] = buffers[1];
+	copyPipe.lengths[0] = copyPipe.lengths[1] = -1;
+	copyPipe.fd = fdFrom;
+	copyPipe.error = 0;
+	copyPipe.stop = false;
+	pthread_mutex_init(&copyPipe.lock, NULL);
+	pthread_cond_init(&copyPipe.cond, NULL);
+
+	if (pthread_create(&reader, NULL, copyReader, &copyPipe) == 0) {
+		for (slot = 0; ; slot ^= 1) {
+			pthread_mutex_lock(&copyPipe.lock);
+			while (copyPipe.lengths[slot] < 0 && !copyPipe.error) {
+				pthread_cond_wait(&copyPipe.cond, &copyPipe.lock);
+			}
+			bytes = copyPipe.lengths[slot];
+			ret = copyPipe.error;
+			pthread_mutex_unlock(&copyPipe.lock);
+			if (ret) {
+				contextprintf(context, kBLLogLevelError, "Error reading from %s: %s\n", from, strerror(ret));
+				break;
+			}
+			if (bytes <= 0) break;
+
+			ret = writeFully(fdTo, copyPipe.buffers[slot], bytes);
+			if (ret) {
+				contextprintf(context, kBLLogLevelError, "Error writing to %s: %s\n", to, strerror(ret));
+				break;
+			}
+
+			pthread_mutex_lock(&copyPipe.lock);
+			copyPipe.lengths[slot] = -1;
+			pthread_cond_signal(&copyPipe.cond);
+			pthread_mutex_unlock(&copyPipe.lock);
+		}
+
+		pthread_mutex_lock(&copyPipe.lock);
+		copyPipe.stop = true;
+		pthread_cond_signal(&copyPipe.cond);
+		pthread_mutex_unlock(&copyPipe.lock);
+		pthread_join(reader, NULL);
+	} else {
+		// no reader thread; one buffer at a time
+		while ((bytes = read(fdFrom, buffers[0], kBLReplaceFileBufferSize)) != 0) {
+			if (bytes < 0) {
+				if (errno == EINTR) continue;
+				ret = errno;
+				contextprintf(context, kBLLogLevelError, "Error reading from %s: %s\n", from, strerror(ret));
+				break;
+			}
+			ret = writeFully(fdTo, buffers[0], bytes);
+			if (ret) {
+				contextprintf(context, kBLLogLevelError, "Error writing to %s: %s\n", to, strerror(ret));
+				break;
+			}
+		}
+	}
+	pthread_cond_destroy(&copyPipe.cond);
+	pthread_mutex_destroy(&copyPipe.lock);
+
+exit:
+	if (fdFrom >= 0) close(fdFrom);
+	if (fdTo >= 0) close(fdTo);
+	return ret;
+}
+
+// Fill the pipe's buffers in turn, each as soon as the writer frees it
+static void *copyReader(void *arg)
+{
+	BLCopyPipe	*copyPipe = arg;
+	int			slot;
+	ssize_t		bytes, total;
+	int			error;
+	bool		stop;
+
+	for (slot = 0; ; slot ^= 1) {
+		pthread_mutex_lock(&copyPipe->lock);
+		while (copyPipe->lengths[slot] >= 0 && !copyPipe->stop) {
+			pthread_cond_wait(&copyPipe->cond, &copyPipe->lock);
+		}
+		stop = copyPipe->stop;
+		pthread_mutex_unlock(&copyPipe->lock);
+		if (stop) break;
+
+		// a short read isn't the end of the file; only 0 is
+		error = 0;
+		for (total = 0; total < kBLReplaceFileBufferSize; total += bytes) {
+			bytes = read(copyPipe->fd, copyPipe->buffers[slot] + total, kBLReplaceFileBufferSize - total);
+			if (bytes < 0 && errno == EINTR) {
+				bytes = 0;
+				continue;
+			}
+			if (bytes < 0) error = errno;
+			if (bytes <= 0) break;
+		}
+
+		pthread_mutex_lock(&copyPipe->lock);
+		copyPipe->lengths[slot] = total;
+		copyPipe->error = error;
+		pthread_cond_signal(&copyPipe->cond);
+		pthread_mutex_unlock(&copyPipe->lock);
+		if (error || total == 0) break;
+	}
+
+	return NULL;
+}
+
+static int writeFully(int fd, const char *buffer, size_t length)
+{
+	ssize_t		bytes;
+
+	while (length > 0) {
+		bytes = write(fd, buffer, length);
+		if (bytes < 0) {
+			if (errno == EINTR) continue;
+			return errno;
+		}
+		buffer += bytes;
+		length -= bytes;
+	}
+	return 0;
+}
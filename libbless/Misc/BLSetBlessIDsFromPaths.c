@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLSetBlessIDsFromPaths.c
+//
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+static int _getID(BLContextPtr context, bool apfs, const char *path, bool isFile, uint64_t *id);
+
+int BLSetBlessIDsFromPaths(BLContextPtr context, CFStringRef kind, const char *mountpoint,
+						   const uint64_t *words, int count, const char *file, const char *folder, int flags)
+{
+	uint64_t	values[8];
+	uint64_t	id;
+	bool		apfs;
+	int			i, ret;
+
+	// the files may not be written yet, or may still be replaced
+	if (BLPlanIsRecording(context)) {
+		return BLPlanRecordBlessIDsFromPaths(context, kind, mountpoint, words, count, file, folder, flags);
+	}
+
+	apfs = CFEqual(kind, kBLPlanActionSetAPFSBlessData);
+	if (count > 8) count = 8;
+	memset(values, 0, sizeof values);
+	memcpy(values, words, count * sizeof(words[0]));
+
+	if (folder) {
+		ret = _getID(context, apfs, folder, false, &id);
+		if (ret && (flags & kBLBlessIDsRequired)) return ret;
+		if (apfs) {
+			values[1] = id;
+		} else {
+			values[5] = id;
+			if (id && (flags & kBLBlessIDsFolderInWord0)) values[0] = id;
+		}
+	}
+
+	if (file) {
+		ret = _getID(context, apfs, file, true, &id);
+		if (ret && (flags & kBLBlessIDsRequired)) return ret;
+		values[apfs ? 0 : 1] = id;
+	}
+
+	if (apfs) {
+		contextprintf(context, kBLLogLevelVerbose, "blessed file = %llu\n", values[0]);
+		contextprintf(context, kBLLogLevelVerbose, "blessed folder = %llu\n", values[1]);
+
+		return BLSetAPFSBlessData(context, mountpoint, values);
+	} else {
+		uint32_t	finderWords[8];
+
+		for (i = 0; i < 8; i++) finderWords[i] = (uint32_t)values[i];
+
+		contextprintf(context, kBLLogLevelVerbose, "finderinfo[0] = %u\n", finderWords[0]);
+		contextprintf(context, kBLLogLevelVerbose, "finderinfo[1] = %u\n", finderWords[1]);
+		contextprintf(context, kBLLogLevelVerbose, "finderinfo[5] = %u\n", finderWords[5]);
+
+		return BLSetVolumeFinderInfo(context, mountpoint, finderWords);
+	}
+}
+
+// 0 in *id, and the reason, if path can't be blessed
+static int _getID(BLContextPtr context, bool apfs, const char *path, bool isFile, uint64_t *id)
+{
+	struct stat	sb;
+	uint32_t	fileID;
+	int			ret;
+
+	*id = 0;
+
+	if (apfs) {
+		ret = BLGetAPFSInodeNum(context, path, id);
+	} else {
+		ret = BLGetFileID(context, path, &fileID);
+		*id = fileID;
+	}
+	if (ret) {
+		*id = 0;
+		contextprintf(context, kBLLogLevelError, "Error while getting the ID of %s\n", path);
+		return ret;
+	}
+
+	if (isFile && (lstat(path, &sb) < 0 || !S_ISREG(sb.st_mode))) {
+		*id = 0;
+		contextprintf(context, kBLLogLevelError, "%s cannot be accessed, or is not a regular file\n", path);
+		return ENOENT;
+	}
+
+	contextprintf(context, kBLLogLevelVerbose, "Got ID %llu for %s\n", *id, path);
+
+	return 0;
+}
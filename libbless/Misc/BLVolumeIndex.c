@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLVolumeIndex.c
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <paths.h>
+#include <sys/param.h>
+#include <sys/mount.h>
+#include <sys/attr.h>
+#include <uuid/uuid.h>
+#include <IOKit/IOKitLib.h>
+#include <IOKit/IOBSD.h>
+#include <IOKit/storage/IOMedia.h>
+#include <APFS/APFS.h>
+
+#include "bless.h"
+#include "bless_private.h"
+
+struct BLVolumeIndex {
+	bool					isBuilt;
+
+	// CFUUID -> BSD name
+	CFMutableDictionaryRef	byUUID[3];
+
+	// BSD name -> volume CFUUID
+	CFMutableDictionaryRef	volumeUUIDs;
+
+	uint32_t				lookups;
+	uint32_t				hits;
+};
+
+static BLVolumeIndexRef _contextIndex(BLContextPtr context);
+static int _build(BLContextPtr context, BLVolumeIndexRef index);
+static void _addMedia(BLVolumeIndexRef index, io_service_t media);
+static void _addMounts(BLContextPtr context, BLVolumeIndexRef index);
+
+int BLVolumeIndexCreate(BLContextPtr context, BLVolumeIndexRef *index)
+{
+	BLVolumeIndexRef	newIndex;
+	int					i;
+
+	*index = NULL;
+
+	newIndex = calloc(1, sizeof(*newIndex));
+	if (newIndex == NULL) return 2;
+
+	for (i = 0; i < 3; i++) {
+		newIndex->byUUID[i] = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+														&kCFTypeDictionaryKeyCallBacks,
+														&kCFTypeDictionaryValueCallBacks);
+	}
+	newIndex->volumeUUIDs = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+													  &kCFTypeDictionaryKeyCallBacks,
+													  &kCFTypeDictionaryValueCallBacks);
+
+	if (!newIndex->byUUID[0] || !newIndex->byUUID[1] || !newIndex->byUUID[2] || !newIndex->volumeUUIDs) {
+		BLVolumeIndexRelease(context, newIndex);
+		return 2;
+	}
+
+	*index = newIndex;
+
+	return 0;
+}
+
+void BLVolumeIndexRelease(BLContextPtr context, BLVolumeIndexRef index)
+{
+	int i;
+
+	if (index == NULL) return;
+
+	if (index->isBuilt) {
+		contextprintf(context, kBLLogLevelVerbose, "Volume index: %u lookups, %u hits\n",
+					  index->lookups, index->hits);
+	}
+
+	for (i = 0; i < 3; i++) {
+		if (index->byUUID[i]) CFRelease(index->byUUID[i]);
+	}
+	if (index->volumeUUIDs) CFRelease(index->volumeUUIDs);
+	free(index);
+}
+
+int BLVolumeIndexLookup(BLContextPtr context, int kind, CFUUIDRef uuid,
+						char *bsdName, int bsdNameLen)
+{
+	BLVolumeIndexRef	index = _contextIndex(context);
+	CFStringRef			name;
+
+	if (index == NULL || uuid == NULL || kind < 0 || kind > kBLVolumeIndexSystemGroupUUID) {
+		return 1;
+	}
+
+	if (!index->isBuilt && _build(context, index)) {
+		return 2;
+	}
+
+	index->lookups++;
+
+	name = CFDictionaryGetValue(index->byUUID[kind], uuid);
+	if (name == NULL) return 3;
+
+	if (!CFStringGetCString(name, bsdName, bsdNameLen, kCFStringEncodingUTF8)) {
+		return 4;
+	}
+
+	index->hits++;
+
+	return 0;
+}
+
+CFUUIDRef BLVolumeIndexGetVolumeUUID(BLContextPtr context, const char *bsdName)
+{
+	BLVolumeIndexRef	index = _contextIndex(context);
+	CFStringRef			name;
+	CFUUIDRef			uuid;
+
+	if (index == NULL) return NULL;
+
+	if (!index->isBuilt && _build(context, index)) {
+		return NULL;
+	}
+
+	name = CFStringCreateWithCString(kCFAllocatorDefault, bsdName, kCFStringEncodingUTF8);
+	if (name == NULL) return NULL;
+
+	index->lookups++;
+	uuid = CFDictionaryGetValue(index->volumeUUIDs, name);
+	if (uuid) index->hits++;
+
+	CFRelease(name);
+
+	return uuid;
+}
+
+static BLVolumeIndexRef _contextIndex(BLContextPtr context)
+{
+	if (context && context->version >= kBLContextVersionVolumeIndex) {
+		return context->volumeIndex;
+	}
+
+	return NULL;
+}
+
+static int _build(BLContextPtr context, BLVolumeIndexRef index)
+{
+	io_iterator_t	iter;
+	io_service_t	media;
+	kern_return_t	kret;
+
+	kret = IOServiceGetMatchingServices(kIOMasterPortDefault,
+										IOServiceMatching(kIOMediaClass),
+										&iter);
+	if (kret) {
+		contextprintf(context, kBLLogLevelError, "Could not enumerate media: %#x\n", kret);
+		return 1;
+	}
+
+	while ((media = IOIteratorNext(iter))) {
+		_addMedia(index, media);
+		IOObjectRelease(media);
+	}
+	IOObjectRelease(iter);
+
+	_addMounts(context, index);
+
+	index->isBuilt = true;
+
+	contextprintf(context, kBLLogLevelVerbose, "Indexed %ld partition, %ld volume and %ld group UUIDs\n",
+				  (long)CFDictionaryGetCount(index->byUUID[kBLVolumeIndexPartitionUUID]),
+				  (long)CFDictionaryGetCount(index->byUUID[kBLVolumeIndexVolumeUUID]),
+				  (long)CFDictionaryGetCount(index->byUUID[kBLVolumeIndexSystemGroupUUID]));
+
+	return 0;
+}
+
+static CFUUIDRef _copyUUIDProperty(io_service_t media, CFStringRef key)
+{
+	CFStringRef	value;
+	CFUUIDRef	uuid = NULL;
+
+	value = IORegistryEntryCreateCFProperty(media, key, kCFAllocatorDefault, 0);
+	if (value == NULL) return NULL;
+
+	if (CFGetTypeID(value) == CFStringGetTypeID()) {
+		uuid = CFUUIDCreateFromString(kCFAllocatorDefault, value);
+	}
+	CFRelease(value);
+
+	return uuid;
+}
+
+static bool _hasSystemRole(io_service_t media)
+{
+	CFArrayRef	roles;
+	bool		isSystem = false;
+
+	roles = IORegistryEntryCreateCFProperty(media, CFSTR(kAPFSRoleKey), kCFAllocatorDefault, 0);
+	if (roles == NULL) return false;
+
+	if (CFGetTypeID(roles) == CFArrayGetTypeID()) {
+		isSystem = CFArrayContainsValue(roles, CFRangeMake(0, CFArrayGetCount(roles)),
+										CFSTR(kAPFSVolumeRoleSystem));
+	}
+	CFRelease(roles);
+
+	return isSystem;
+}
+
+static void _addMedia(BLVolumeIndexRef index, io_service_t media)
+{
+	CFStringRef	name;
+	CFUUIDRef	uuid;
+
+	// a snapshot shares its UUIDs with the volume it was taken from
+	if (IOObjectConformsTo(media, "AppleAPFSSnapshot")) return;
+
+	name = IORegistryEntryCreateCFProperty(media, CFSTR(kIOBSDNameKey), kCFAllocatorDefault, 0);
+	if (name == NULL) return;
+	if (CFGetTypeID(name) != CFStringGetTypeID()) {
+		CFRelease(name);
+		return;
+	}
+
+	uuid = _copyUUIDProperty(media, CFSTR(kIOMediaUUIDKey));
+	if (uuid) {
+		CFDictionaryAddValue(index->byUUID[kBLVolumeIndexPartitionUUID], uuid, name);
+
+		// APFS publishes the volume UUID as the media UUID
+		if (IOObjectConformsTo(media, APFS_VOLUME_OBJECT)) {
+			CFDictionaryAddValue(index->byUUID[kBLVolumeIndexVolumeUUID], uuid, name);
+			CFDictionarySetValue(index->volumeUUIDs, name, uuid);
+		}
+		CFRelease(uuid);
+	}
+
+	if (_hasSystemRole(media)) {
+		uuid = _copyUUIDProperty(media, CFSTR(kAPFSVolGroupUUIDKey));
+		if (uuid) {
+			CFDictionaryAddValue(index->byUUID[kBLVolumeIndexSystemGroupUUID], uuid, name);
+			CFRelease(uuid);
+		}
+	}
+
+	CFRelease(name);
+}
+
+// other filesystems' volume UUIDs aren't in the registry, but are
+// cheap to ask for once mounted
+static void _addMounts(BLContextPtr context, BLVolumeIndexRef index)
+{
+	struct statfs	*mnts;
+	int				mntsize, i;
+	struct attrlist	alist = {
+		.bitmapcount = ATTR_BIT_MAP_COUNT,
+		.volattr = ATTR_VOL_INFO | ATTR_VOL_UUID,
+	};
+	struct {
+		uint32_t	length;
+		uuid_t		uuid;
+	} __attribute__((aligned(4), packed)) vinfo;
+
+	mntsize = getmntinfo(&mnts, MNT_NOWAIT);
+	for (i = 0; i < mntsize; i++) {
+		CFStringRef	name;
+		CFUUIDRef	uuid;
+		const char	*bsdName;
+
+		if (!(mnts[i].f_flags & MNT_LOCAL)
+			|| strncmp(mnts[i].f_mntfromname, _PATH_DEV, strlen(_PATH_DEV)) != 0) {
+			continue;
+		}
+		bsdName = mnts[i].f_mntfromname + strlen(_PATH_DEV);
+
+		name = CFStringCreateWithCString(kCFAllocatorDefault, bsdName, kCFStringEncodingUTF8);
+		if (name == NULL) continue;
+
+		if (CFDictionaryContainsKey(index->volumeUUIDs, name)
+			|| getattrlist(mnts[i].f_mntonname, &alist, &vinfo, sizeof(vinfo), 0) != 0
+			|| uuid_is_null(vinfo.uuid)) {
+			CFRelease(name);
+			continue;
+		}
+
+		uuid = CFUUIDCreateFromUUIDBytes(kCFAllocatorDefault, *(CFUUIDBytes *)vinfo.uuid);
+		if (uuid) {
+			CFDictionaryAddValue(index->byUUID[kBLVolumeIndexVolumeUUID], uuid, name);
+			CFDictionarySetValue(index->volumeUUIDs, name, uuid);
+			CFRelease(uuid);
+		}
+
+		CFRelease(name);
+	}
+}
@@ -68,19 +68,59 @@ __BEGIN_DECLS
  *    a null <b>logstring</b> member. a null <b>logrefcon</b>
  *    may or may not be allowed depending on the user-defined
  *    <b>logstring</b> function.
- * @field version version of BLContext in use by client. Currently
- *    0
+ * @field version version of BLContext in use by client. Either
+ *    0, <b>kBLContextVersionNVRAMSession</b> if the <b>nvram</b>
+ *    field is valid, <b>kBLContextVersionVolumeIndex</b> if
+ *    <b>volumeIndex</b> is valid as well, or
+ *    <b>kBLContextVersionPlan</b> if <b>plan</b> is valid too
  * @field logstring function used for messages from the library. It
  *    will be called with <b>logrefcon</b> and a log level, which
  *    can be used to tailor the output
  * @field logrefcon arbitrary data passed to <b>logrefcon</b>
- */
+ * @field nvram NVRAM session through which all firmware variables
+ *    are read and written. May be NULL, in which case each access
+ *    goes directly to IODeviceTree:/options
+ * @field volumeIndex index from volume, partition and volume group
+ *    UUIDs to BSD names, built on first use and shared by every
+ *    lookup made with this context. May be NULL, in which case
+ *    each lookup queries IOKit and DiskArbitration directly
+ * @field plan if non-NULL, NVRAM writes and volume modifications
+ *    made with this context are recorded in the plan instead of
+ *    being performed
+ */
+typedef struct BLNVRAMSession *BLNVRAMSessionRef;
+typedef struct BLVolumeIndex *BLVolumeIndexRef;
+typedef struct BLPlan *BLPlanRef;
+
 typedef struct {
   int32_t	version;
   int32_t	(*logstring)(void *refcon, int32_t level, char const *string);
   void		*logrefcon;
+  BLNVRAMSessionRef	nvram;
+  BLVolumeIndexRef	volumeIndex;
+  BLPlanRef			plan;
 } BLContext, *BLContextPtr;
 
+/*!
+ * @define kBLContextVersionNVRAMSession
+ * @discussion BLContext version which carries the <b>nvram</b> field
+ */
+#define kBLContextVersionNVRAMSession	1
+
+/*!
+ * @define kBLContextVersionVolumeIndex
+ * @discussion BLContext version which carries both the <b>nvram</b>
+ *    and <b>volumeIndex</b> fields
+ */
+#define kBLContextVersionVolumeIndex	2
+
+/*!
+ * @define kBLContextVersionPlan
+ * @discussion BLContext version which carries the <b>nvram</b>,
+ *    <b>volumeIndex</b> and <b>plan</b> fields
+ */
+#define kBLContextVersionPlan			3
+
 /*!
  * @define kBLLogLevelNormal
  * @discussion Normal output indicating status
@@ -744,6 +784,30 @@ int BLLookupFileIDOnMount(BLContextPtr context,
 
 
 
+/*!
+ * @function BLLookupFileIDsOnMount
+ * @abstract Get paths of several files by ID on <b>mount</b>
+ * @discussion Like BLLookupFileIDOnMount for each of
+ *    <b>fileIDs</b>, but an HFS+ volume's catalog is read
+ *    once for all of them. A path found there is only used
+ *    if it still names that file ID on the mounted volume;
+ *    otherwise volfs is asked. IDs that can't be resolved
+ *    get an empty path. Returns ENOMEM if out of memory.
+ * @param context Bless Library context
+ * @param mount Mountpoint of volume
+ * @param fileIDs file IDs to look up
+ * @param count number of file IDs
+ * @param out resulting paths, one buffer per file ID
+ *    (up to MAXPATHLEN characeters will be written to each)
+ */
+int BLLookupFileIDsOnMount(BLContextPtr context,
+			  const char * mountpoint,
+			  const uint32_t * fileIDs,
+			  uint32_t count,
+			  char ** out);
+
+
+
 /*!
  * @function BLLookupFileIDOnMount64
  * @abstract Get path of file with ID <b>fileID</b>
@@ -782,6 +846,42 @@ int BLGetDiskSectorsForFile(BLContextPtr context,
                         char * device,
                         int deviceLen);
 
+/*!
+ * @struct BLDiskExtent
+ * @abstract A run of 512-byte sectors, relative to the beginning
+ *    of the partition
+ */
+#ifndef _BLDISKEXTENT_DEFINED
+#define _BLDISKEXTENT_DEFINED
+typedef struct {
+    off_t   start;
+    off_t   length;
+} BLDiskExtent;
+#endif
+
+/*!
+ * @function BLGetDiskExtentsForFile
+ * @abstract Determine the complete on-disk location of a file
+ * @discussion Like BLGetDiskSectorsForFile, but also follows the
+ *    extents overflow file, so files in more than eight pieces
+ *    are described completely. Physically adjacent extents are
+ *    coalesced.
+ * @param context Bless Library context
+ * @param path path to file on a mounted HFS+ volume
+ * @param extents filled in with a malloc'd array of extents, which
+ *    the caller must free
+ * @param extentCount filled in with the number of extents
+ * @param device filled in with the device the extent information applies to
+ * @param length of buffer provided for device parameter
+ */
+
+int BLGetDiskExtentsForFile(BLContextPtr context,
+                        const char * path,
+                        BLDiskExtent ** extents,
+                        uint32_t * extentCount,
+                        char * device,
+                        int deviceLen);
+
 /***** Misc *****/
 
 /*!
@@ -1169,6 +1269,16 @@ int BLUpdateBooter(BLContextPtr context, const char * device,
 				   BLUpdateBooterFileSpec *specs,
 				   int32_t specCount);
 
+/*
+ * Write an XCOFF secondary loader as the HFS+ startup file of device,
+ * an unmounted volume's block device or an image file. Returns 2 if
+ * device isn't HFS+, 3 if it is mounted, 4 if the loader isn't a valid
+ * XCOFF, 5 if there's no room for it, 6 if it reads back wrong, 7 on
+ * an I/O error
+ */
+int BLWriteStartupFile(BLContextPtr context, const char * device,
+					   CFDataRef xcoff);
+
 int BLGetIOServiceForDeviceName(BLContextPtr context, const char * devName,
 								io_service_t *service);
 
@@ -1258,6 +1368,9 @@ int BLValidateXMLBootOption(BLContextPtr context,
 							CFStringRef	 xmlName,
 							CFStringRef	 binaryName);
 
+// decoded snapshot of BootOrder, BootNext and the Boot#### options they name
+int BLCopyEFIBootOptions(BLContextPtr context, CFDictionaryRef *bootOptions);
+
 kern_return_t BLSetEFIBootDevice(BLContextPtr context, char *bsdName);
 kern_return_t BLSetEFIBootDeviceOnce(BLContextPtr context, char *bsdName);
 kern_return_t BLSetEFIBootFileOnce(BLContextPtr context, char *path);
@@ -1279,6 +1392,36 @@ int BLPreserveBootArgsIfChanged(BLContextPtr context,
                                 size_t outputLen,
                                 bool *changed);
 
+// boot-args parsed into a token table, edited in place and written back
+// out without any length limit. Keys are compared exactly; a flag such as
+// -v is a key without a value
+typedef struct BLBootArgs *BLBootArgsRef;
+
+typedef struct {
+    uint32_t    added;
+    uint32_t    removed;
+    uint32_t    replaced;
+} BLBootArgsChanges;
+
+int BLBootArgsCreate(BLContextPtr context, const char *bootArgs, BLBootArgsRef *args);
+void BLBootArgsRelease(BLBootArgsRef args);
+
+// *value points into args and is not NUL-terminated; NULL for a flag
+bool BLBootArgsGetValue(BLBootArgsRef args, const char *key,
+                        const char **value, size_t *valueLength);
+
+// add or replace key; value NULL sets a flag. Later duplicates of key are dropped
+int BLBootArgsSet(BLContextPtr context, BLBootArgsRef args, const char *key, const char *value);
+int BLBootArgsRemove(BLContextPtr context, BLBootArgsRef args, const char *key);
+
+// drop the rooting arguments (rd=, rp=, boot-uuid=) that a bless makes stale
+int BLBootArgsFilter(BLContextPtr context, BLBootArgsRef args);
+
+void BLBootArgsGetChanges(BLBootArgsRef args, BLBootArgsChanges *changes);
+
+// *bootArgs is malloc()ed; caller must free it
+int BLBootArgsCopyString(BLContextPtr context, BLBootArgsRef args, char **bootArgs);
+
 #define kBLDataPartitionsKey        CFSTR("Data Partitions")
 #define kBLAuxiliaryPartitionsKey   CFSTR("Auxiliary Partitions")
 #define kBLSystemPartitionsKey      CFSTR("System Partitions")
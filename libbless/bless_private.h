@@ -121,10 +121,205 @@ int setit(BLContextPtr context, mach_port_t masterPort, const char *bootvar,
 int _forwardNVRAM(BLContextPtr context, CFStringRef from, CFStringRef to);
 
 
-/* Calculate a shift-1-left & add checksum of all
- * 32-bit words
+// EFI_GLOBAL_VARIABLE, the namespace of BootOrder, BootNext and Boot####
+#define kBL_GLOBAL_NVRAM_GUID "8BE4DF61-93CA-11D2-AA0D-00E098032B8C"
+
+/*
+ * NVRAM sessions. A session opens the variable store once, caches
+ * every value it reads, and routes all access through a backend.
+ * Hang one off BLContext (version kBLContextVersionNVRAMSession) to
+ * have every NVRAM access in the library use it; contexts without
+ * one get a transient IOKit session per access.
+ */
+typedef struct {
+	int32_t		version;
+	const char	*name;
+	int			(*open)(BLContextPtr context, const char *location, void **state);
+	void		(*close)(BLContextPtr context, void *state);
+	int			(*copyValue)(BLContextPtr context, void *state, CFStringRef name, CFTypeRef *value);
+	int			(*setValue)(BLContextPtr context, void *state, CFStringRef name, CFTypeRef value);
+	int			(*deleteValue)(BLContextPtr context, void *state, CFStringRef name);
+} BLNVRAMBackend;
+
+// IODeviceTree:/options; location is ignored
+extern const BLNVRAMBackend kBLNVRAMBackendIOKit;
+
+// property list file, as produced by "nvram -xp"; location is its path.
+// Keeps the machine's NVRAM out of tests, but still needs CoreFoundation
+extern const BLNVRAMBackend kBLNVRAMBackendFile;
+
+int BLNVRAMSessionCreate(BLContextPtr context, const BLNVRAMBackend *backend,
+						 const char *location, BLNVRAMSessionRef *session);
+void BLNVRAMSessionRelease(BLContextPtr context, BLNVRAMSessionRef session);
+
+// *value is NULL if the variable is not set. Caller must release it otherwise
+int BLNVRAMCopyValue(BLContextPtr context, CFStringRef name, CFTypeRef *value);
+int BLNVRAMSetValue(BLContextPtr context, CFStringRef name, CFTypeRef value);
+int BLNVRAMDeleteValue(BLContextPtr context, CFStringRef name);
+
+/*
+ * Write sets. Between Begin and Commit, sets and deletes are only
+ * recorded (reads see them); Commit applies them in order, skipping
+ * any that would leave the variable as it already is. efi-boot-next is
+ * still written once the firmware has used the BootNext it set, to arm
+ * the one-shot boot again. Sets nest, and only the outermost Commit
+ * writes. Flush applies what is staged so far without closing the set,
+ * for callers that need to read a value the store derives. Discard
+ * abandons the whole set: any outer levels stay open but refuse further
+ * writes, and their Flush and Commit fail without writing anything.
+ * Without a context session these do nothing and writes go straight
+ * through.
+ */
+int BLNVRAMWriteSetBegin(BLContextPtr context);
+int BLNVRAMWriteSetFlush(BLContextPtr context);
+int BLNVRAMWriteSetCommit(BLContextPtr context);
+void BLNVRAMWriteSetDiscard(BLContextPtr context);
+
+
+/*
+ * Single-pass extractor for the IOCFSerialize form of an EFI boot
+ * device string (an array of dictionaries). Rather than building the
+ * whole CF object graph, it pulls the handful of per-element keys the
+ * interpreters need into an arena owned by the scan. There is no limit
+ * on the length of the string.
+ */
+enum {
+	kBLEFIXMLKeyIOMatch = 0,		// dict, kept in serialized form
+	kBLEFIXMLKeyVolumeUUID,			// BLVolumeUUID
+	kBLEFIXMLKeyLastBSDName,		// BLLastBSDName
+	kBLEFIXMLKeyDevicePathType,		// IOEFIDevicePathType
+	kBLEFIXMLKeyPath,				// Path
+	kBLEFIXMLKeyBootOption,			// IOEFIBootOption, string or data
+	kBLEFIXMLKeyCount
+};
+
+enum {
+	kBLEFIXMLValueNone = 0,
+	kBLEFIXMLValueString,			// UTF-8, entities decoded, NUL-terminated
+	kBLEFIXMLValueData,				// base64 decoded
+	kBLEFIXMLValueDict				// NUL-terminated IOCFSerialize text
+};
+
+typedef struct {
+	uint8_t		type;
+	const char	*bytes;
+	size_t		length;
+} BLEFIXMLValue;
+
+typedef struct {
+	BLEFIXMLValue	values[kBLEFIXMLKeyCount];
+} BLEFIXMLElement;
+
+typedef struct BLEFIXMLScan *BLEFIXMLScanRef;
+
+// 1 if the string can't be converted, 2 if it is not an array of dictionaries
+int BLEFIXMLScanCreate(BLContextPtr context, CFStringRef xmlString, BLEFIXMLScanRef *scan);
+void BLEFIXMLScanRelease(BLEFIXMLScanRef scan);
+
+CFIndex BLEFIXMLScanGetCount(BLEFIXMLScanRef scan);
+const BLEFIXMLElement *BLEFIXMLScanGetElement(BLEFIXMLScanRef scan, CFIndex index);
+
+// the value of key as a C string, or NULL if absent or not a string
+const char *BLEFIXMLElementGetString(const BLEFIXMLElement *element, int key);
+
+// unserialize the IOMatch dictionary of element index, or NULL
+CFDictionaryRef BLEFIXMLScanCopyMatchDictionary(BLContextPtr context, BLEFIXMLScanRef scan, CFIndex index);
+
+// full IOCFUnserialize of the string, for callers which need the object graph
+int BLEFIXMLCopyArray(BLContextPtr context, CFStringRef xmlString, CFArrayRef *array);
+
+
+// IOCFSerialize an array of device path dictionaries into a CFString
+int BLEFIXMLCopySerializedString(BLContextPtr context, CFTypeRef object, CFStringRef *xmlString);
+
+
+/*
+ * Volume index. Maps UUIDs to BSD names from a single enumeration of
+ * IOMedia (plus the UUIDs of mounted volumes), made on first lookup
+ * and reused for the life of the index. Lookups with a context that
+ * carries no index always miss, so callers keep their direct path.
  */
-uint32_t BLBlockChecksum(const void *buf , uint32_t length);
+enum {
+	kBLVolumeIndexVolumeUUID = 0,	// filesystem UUID, as DiskArbitration reports it
+	kBLVolumeIndexPartitionUUID,	// IOMedia UUID
+	kBLVolumeIndexSystemGroupUUID	// APFS volume group, resolving to its System volume
+};
+
+int BLVolumeIndexCreate(BLContextPtr context, BLVolumeIndexRef *index);
+void BLVolumeIndexRelease(BLContextPtr context, BLVolumeIndexRef index);
+
+// 0 and the BSD name (without /dev/) if found, non-zero otherwise
+int BLVolumeIndexLookup(BLContextPtr context, int kind, CFUUIDRef uuid,
+						char *bsdName, int bsdNameLen);
+
+// volume UUID of a BSD name, or NULL if the index doesn't know it. Not retained
+CFUUIDRef BLVolumeIndexGetVolumeUUID(BLContextPtr context, const char *bsdName);
+
+
+/*
+ * Plans. While a plan hangs off BLContext (version kBLContextVersionPlan),
+ * the library's NVRAM writes and volume modifications are recorded as
+ * actions instead of being performed; discovery still runs as usual.
+ * A plan round-trips through a property list and can be applied later,
+ * with any other context, without repeating the discovery.
+ */
+#define kBLPlanActionKey					CFSTR("Action")
+#define kBLPlanActionNVRAMSet				CFSTR("NVRAMSet")
+#define kBLPlanActionNVRAMDelete			CFSTR("NVRAMDelete")
+#define kBLPlanActionNVRAMForward			CFSTR("NVRAMForward")
+#define kBLPlanActionCreateFile				CFSTR("CreateFile")
+#define kBLPlanActionCopyFile				CFSTR("CopyFile")
+#define kBLPlanActionDeleteFile				CFSTR("DeleteFile")
+#define kBLPlanActionSetFinderFlag			CFSTR("SetFinderFlag")
+#define kBLPlanActionSetVolumeFinderInfo	CFSTR("SetVolumeFinderInfo")
+#define kBLPlanActionSetAPFSBlessData		CFSTR("SetAPFSBlessData")
+#define kBLPlanActionSetDiskLabel			CFSTR("SetDiskLabel")
+#define kBLPlanActionSetBlessIDsFromPaths	CFSTR("SetBlessIDsFromPaths")
+
+int BLPlanCreate(BLContextPtr context, BLPlanRef *plan);
+int BLPlanCreateWithPropertyList(BLContextPtr context, CFDataRef data, BLPlanRef *plan);
+void BLPlanRelease(BLPlanRef plan);
+
+// one dictionary per action, keyed by kBLPlanActionKey. Not retained
+CFArrayRef BLPlanGetActions(BLPlanRef plan);
+int BLPlanCopyPropertyList(BLContextPtr context, BLPlanRef plan, CFDataRef *data);
+
+// NVRAM actions run after every other action has succeeded, as one write set
+int BLPlanApply(BLContextPtr context, BLPlanRef plan);
+
+// used by the modifying functions themselves
+bool BLPlanIsRecording(BLContextPtr context);
+int BLPlanRecordNVRAM(BLContextPtr context, CFStringRef name, CFTypeRef value);
+int BLPlanRecordNVRAMForward(BLContextPtr context, CFStringRef from, CFStringRef to);
+int BLPlanRecordCreateFile(BLContextPtr context, const char *path, CFDataRef data,
+						   int setImmutable, uint32_t type, uint32_t creator, int shouldPreallocate);
+int BLPlanRecordCopyFile(BLContextPtr context, const char *from, const char *to);
+int BLPlanRecordDeleteFile(BLContextPtr context, const char *path);
+int BLPlanRecordFinderFlag(BLContextPtr context, const char *path, uint16_t flag, int setval);
+int BLPlanRecordVolumeWords(BLContextPtr context, CFStringRef kind, const char *mountpoint,
+							const uint64_t *words, int count);
+int BLPlanRecordDiskLabel(BLContextPtr context, const char *device, CFDataRef label, int scale);
+int BLPlanRecordBlessIDsFromPaths(BLContextPtr context, CFStringRef kind, const char *mountpoint,
+								  const uint64_t *words, int count, const char *file, const char *folder, int flags);
+
+/*
+ * Set the bless words of a volume (kind is kBLPlanActionSetVolumeFinderInfo
+ * or kBLPlanActionSetAPFSBlessData) with the IDs of file and folder, either
+ * of which may be NULL, filled in. The IDs are looked up when the words are
+ * set, so a plan records the paths: the files may not exist yet, or be
+ * replaced by a later write, when the plan is made. The file goes in Finder
+ * info word 1 or APFS word 0, the folder in Finder info word 5 or APFS word 1.
+ */
+enum {
+	kBLBlessIDsFolderInWord0	= 0x1,	// also Finder info word 0, if the folder has an ID
+	kBLBlessIDsRequired			= 0x2	// fail if a path can't be blessed, rather than use 0
+};
+
+int BLSetBlessIDsFromPaths(BLContextPtr context, CFStringRef kind, const char *mountpoint,
+						   const uint64_t *words, int count, const char *file, const char *folder, int flags);
+
+// secondary loader checksums
+#include "Misc/BLBlockChecksum.h"
 
 /*
  * write the CFData to a file
@@ -137,6 +332,37 @@ enum {
 int BLCopyFileFromCFData(BLContextPtr context, const CFDataRef data,
 	     				 const char * dest, int shouldPreallocate);
 
+/*
+ * ...and how sure to be that it is on disk before returning:
+ * not at all, fsync(2), or F_FULLFSYNC through the drive's cache
+ */
+enum {
+    kBLDurabilityNone,
+    kBLDurabilitySync,
+    kBLDurabilityBarrier
+};
+int BLCopyFileFromCFDataWithDurability(BLContextPtr context, const CFDataRef data,
+									   const char * dest, int shouldPreallocate, int durability);
+
+/*
+ * Replace to with a copy of from, cloned where both are on one volume.
+ * The copy is made under a temporary name next to to (a dot, to's name
+ * and kBLReplaceFileTempSuffix), given from's times, flushed and renamed
+ * into place, so to is never left partial. buffers are two page-aligned
+ * buffers of kBLReplaceFileBufferSize bytes, or NULL to allocate them.
+ * The caller flushes to's directory once its renames are done.
+ */
+#define kBLReplaceFileBufferSize	0x100000	// 1 MiB
+#define kBLReplaceFileTempSuffix	".blesstmp"
+int BLReplaceFileWithCopy(BLContextPtr context, const char *from, const char *to,
+						  char *buffers[2], bool *cloned);
+
+// F_FULLFSYNC, or fsync(2) where the filesystem doesn't support it
+int BLFullSync(BLContextPtr context, int fd, const char *path);
+
+// BLFullSync the directory holding path, so renames into it are durable
+int BLSyncParentDirectory(BLContextPtr context, const char *path);
+
 /*
  * convert to a char * description
  */
@@ -157,12 +383,66 @@ char * blostype2string(uint32_t type, char* buf, uint32_t bufSize);
 // proper dev node
 int blsustatfs(const char *path, struct statfs *buf);
 
+// HFS and HFS+ volumes read (or written) directly on a device node or image
+#include "HFS/BLHFSVolume.h"
+
+/*
+ * One pass over the catalog's leaf records, in key order. A non-zero
+ * return from the function stops the pass and is returned.
+ */
+typedef struct {
+	uint32_t		parentID;		// from the key
+	const uint8_t	*name;			// from the key; UTF-16BE
+	uint16_t		nameLength;		// in UTF-16 units
+	const uint8_t	*data;			// the record proper
+	size_t			dataLength;
+	off_t			position;		// of data, within the catalog file
+} BLHFSCatalogRecord;
+
+typedef int (*BLHFSCatalogRecordFunction)(BLContextPtr context, const BLHFSCatalogRecord *record, void *refcon);
+
+int BLHFSCatalogIterate(BLContextPtr context, BLHFSVolumeRef volume,
+						BLHFSCatalogRecordFunction function, void *refcon);
+
+// a catalog name as a POSIX name: UTF-8, with '/' as ':'. out needs 3 * length + 1 bytes
+size_t BLHFSCatalogNameToUTF8(const uint8_t *name, uint16_t length, char *out);
+
+/*
+ * Index of the catalog's thread records, read in one pass over its leaf
+ * nodes, for resolving file IDs to paths without a mount. Paths are
+ * relative to the volume root ("" for the root itself) and are owned by
+ * the index; each directory's path is built once and reused by everything
+ * beneath it.
+ */
+typedef struct BLHFSCatalogIndex *BLHFSCatalogIndexRef;
+
+int BLHFSCatalogIndexCreate(BLContextPtr context, BLHFSVolumeRef volume, BLHFSCatalogIndexRef *index);
+void BLHFSCatalogIndexRelease(BLHFSCatalogIndexRef index);
+
+// NULL if the catalog has no such ID
+const char *BLHFSCatalogIndexGetPath(BLContextPtr context, BLHFSCatalogIndexRef index, uint32_t fileID);
+
+// paths[i] for fileIDs[i], NULL where unknown. Returns how many were found
+uint32_t BLHFSCatalogIndexGetPaths(BLContextPtr context, BLHFSCatalogIndexRef index,
+								   const uint32_t *fileIDs, uint32_t count, const char **paths);
+
+// El Torito boot catalogs
+#include "Misc/BLElToritoCatalog.h"
+
 // Open raw DVD data and search for the first UEFI boot image; returns false if no for any reason,
 // including if the given disk is not even a DVD, or if no ElTorito header, or if no boot image
 // pointed to by the ElTorito structures. If you get false you should assume the disk to be anything
-// else worthy of consideration, such as even a MacOSX disc. If you get true then output fields
-// give info that, when converted to XML form and put in the IOReg->NVRAM, will command EFI to boot it.
-bool isDVDWithElToritoWithUEFIBootableOS (BLContextPtr inContext, const char* inDevBSD, int* outBootEntry, int* outPartitionStart, int* outPartitionSize);
+// else worthy of consideration, such as even a MacOSX disc. If you get true then outCatalog is the
+// decoded boot catalog, to be passed to BLCreateEFIXMLRepresentationForElToritoCatalog and released.
+bool isDVDWithElToritoWithUEFIBootableOS (BLContextPtr inContext, const char* inDevBSD, BLElToritoCatalog** outCatalog);
+
+/*
+ * EFI boot device XML for the first bootable EFI entry of a catalog on disc bsdName
+ */
+int BLCreateEFIXMLRepresentationForElToritoCatalog(BLContextPtr context,
+                                                   const char *bsdName,
+                                                   const BLElToritoCatalog *catalog,
+                                                   CFStringRef *xmlString);
 
 int GetPrebootBSDForVolumeBSD(BLContextPtr context, const char *volBSD, char *prebootBSD, int prebootBSDLen);
 int GetMountForBSD(BLContextPtr context, const char *bsd, char *mountPoint, int mountPointLen);
@@ -189,6 +189,9 @@ int CopyManifests(BLContextPtr context, const char *destPath, const char *srcPat
 			// If we can't find this "required" manifest, don't fail out, but we do want
 			// to make noise about it.  rdar://problem/61842081
 //			blesscontextprintf(context, kBLLogLevelError, "WARNING: Missing required manifest: \"%s\".  Continuing...\n", [newSrcName UTF8String]);
+		} else if (BLPlanIsRecording(context)) {
+			ret = BLPlanRecordCopyFile(context, [srcPathToUse fileSystemRepresentation], [newDestPath fileSystemRepresentation]);
+			if (ret) break;
 		} else {
 			[fmd removeItemAtPath:newDestPath error:NULL];
 			if ([fmd copyItemAtPath:srcPathToUse toPath:newDestPath error:&nserr] == NO) {
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  modePlan.c
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "enums.h"
+#include "structs.h"
+
+#include "bless.h"
+#include "bless_private.h"
+#include "protos.h"
+
+static void printAction(BLContextPtr context, CFDictionaryRef action);
+
+// Run the requested mode with a plan attached to the context, so that
+// nothing is modified, then print what would have been done
+int modePlan(BLContextPtr context, struct clarg actargs[klast])
+{
+    BLPlanRef   plan;
+    CFArrayRef  actions;
+    CFIndex     i, count;
+    int         ret;
+
+    if (actargs[kinfo].present || actargs[kgetboot].present) {
+        blesscontextprintf(context, kBLLogLevelError, "Info mode doesn't change anything; there is nothing to plan\n");
+        return 1;
+    }
+    if (actargs[kfirmware].present || actargs[kcreatesnapshot].present || actargs[kpersonalize].present ||
+        actargs[kstartupfile].present) {
+        blesscontextprintf(context, kBLLogLevelError, "--plan can't be combined with --firmware, --create-snapshot, --personalize or --startupfile\n");
+        return 1;
+    }
+
+    ret = BLPlanCreate(context, &plan);
+    if (ret) {
+        blesscontextprintf(context, kBLLogLevelError, "Can't create plan\n");
+        return 1;
+    }
+
+    context->plan = plan;
+
+    if (actargs[kdevice].present) {
+        ret = modeDevice(context, actargs);
+    } else if (actargs[knetboot].present) {
+        ret = modeNetboot(context, actargs);
+    } else if (actargs[kunbless].present) {
+        ret = modeUnbless(context, actargs);
+    } else {
+        ret = modeFolder(context, actargs);
+    }
+
+    context->plan = NULL;
+
+    if (ret) {
+        BLPlanRelease(plan);
+        return ret;
+    }
+
+    if (actargs[kplist].present) {
+        CFDataRef   tempData = NULL;
+
+        ret = BLPlanCopyPropertyList(context, plan, &tempData);
+        if (ret == 0) {
+            write(fileno(stdout), CFDataGetBytePtr(tempData), CFDataGetLength(tempData));
+            CFRelease(tempData);
+        }
+        BLPlanRelease(plan);
+        return ret;
+    }
+
+    actions = BLPlanGetActions(plan);
+    count = CFArrayGetCount(actions);
+    if (count == 0) {
+        blesscontextprintf(context, kBLLogLevelNormal, "No changes planned\n");
+    }
+    for (i = 0; i < count; i++) {
+        printAction(context, CFArrayGetValueAtIndex(actions, i));
+    }
+
+    BLPlanRelease(plan);
+
+    return 0;
+}
+
+// Apply a plan saved from "--plan --plist"
+int modeApplyPlan(BLContextPtr context, struct clarg actargs[klast])
+{
+    CFDataRef   data = NULL;
+    BLPlanRef   plan = NULL;
+    int         ret;
+
+    ret = BLLoadFile(context, actargs[kapplyplan].argument, 0, &data);
+    if (ret) {
+        blesscontextprintf(context, kBLLogLevelError, "Can't load plan from %s\n", actargs[kapplyplan].argument);
+        return 1;
+    }
+
+    ret = BLPlanCreateWithPropertyList(context, data, &plan);
+    CFRelease(data);
+    if (ret) {
+        return 1;
+    }
+
+    blesscontextprintf(context, kBLLogLevelVerbose, "Applying %ld planned changes\n",
+                       (long)CFArrayGetCount(BLPlanGetActions(plan)));
+
+    ret = BLPlanApply(context, plan);
+    BLPlanRelease(plan);
+    if (ret) {
+        blesscontextprintf(context, kBLLogLevelError, "Could not apply plan from %s\n", actargs[kapplyplan].argument);
+        return 2;
+    }
+
+    return 0;
+}
+
+static void printAction(BLContextPtr context, CFDictionaryRef action)
+{
+    CFStringRef kind = CFDictionaryGetValue(action, kBLPlanActionKey);
+    CFTypeRef   value;
+    char        first[MAXPATHLEN];
+
+    // BLGetCStringDescription() reuses one buffer, so only the last
+    // description in each message may come straight from it
+    if (CFEqual(kind, kBLPlanActionNVRAMSet)) {
+        strlcpy(first, BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("Name"))), sizeof first);
+        value = CFDictionaryGetValue(action, CFSTR("Value"));
+        if (value && CFGetTypeID(value) == CFDataGetTypeID()) {
+            blesscontextprintf(context, kBLLogLevelNormal, "nvram set %s (%ld bytes)\n",
+                               first, (long)CFDataGetLength(value));
+        } else {
+            blesscontextprintf(context, kBLLogLevelNormal, "nvram set %s=%s\n",
+                               first, value ? BLGetCStringDescription(value) : "");
+        }
+    } else if (CFEqual(kind, kBLPlanActionNVRAMDelete)) {
+        blesscontextprintf(context, kBLLogLevelNormal, "nvram delete %s\n",
+                           BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("Name"))));
+    } else if (CFEqual(kind, kBLPlanActionNVRAMForward)) {
+        strlcpy(first, BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("From"))), sizeof first);
+        blesscontextprintf(context, kBLLogLevelNormal, "nvram copy %s to %s\n",
+                           first, BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("To"))));
+    } else if (CFEqual(kind, kBLPlanActionSetDiskLabel)) {
+        blesscontextprintf(context, kBLLogLevelNormal, "set disk label on %s (%ld bytes)\n",
+                           BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("Device"))),
+                           (long)CFDataGetLength(CFDictionaryGetValue(action, CFSTR("Data"))));
+    } else if (CFEqual(kind, kBLPlanActionCopyFile)) {
+        strlcpy(first, BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("SourceFullPath"))), sizeof first);
+        blesscontextprintf(context, kBLLogLevelNormal, "copy %s to %s\n",
+                           first, BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("FullPath"))));
+    } else if (CFEqual(kind, kBLPlanActionCreateFile)) {
+        value = CFDictionaryGetValue(action, CFSTR("Data"));
+        blesscontextprintf(context, kBLLogLevelNormal, "write %s (%ld bytes)\n",
+                           BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("FullPath"))),
+                           value ? (long)CFDataGetLength(value) : 0L);
+    } else if (CFEqual(kind, kBLPlanActionDeleteFile)) {
+        blesscontextprintf(context, kBLLogLevelNormal, "delete %s\n",
+                           BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("FullPath"))));
+    } else if (CFEqual(kind, kBLPlanActionSetFinderFlag)) {
+        int64_t flag = 0, setval = 0;
+
+        CFNumberGetValue(CFDictionaryGetValue(action, CFSTR("Flag")), kCFNumberSInt64Type, &flag);
+        CFNumberGetValue(CFDictionaryGetValue(action, CFSTR("Value")), kCFNumberSInt64Type, &setval);
+        blesscontextprintf(context, kBLLogLevelNormal, "%s Finder flag 0x%04llx on %s\n",
+                           setval ? "set" : "clear", (long long)flag,
+                           BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("FullPath"))));
+    } else if (CFEqual(kind, kBLPlanActionSetBlessIDsFromPaths)) {
+        char    file[MAXPATHLEN] = "";
+        char    folder[MAXPATHLEN] = "";
+
+        value = CFDictionaryGetValue(action, CFSTR("FileFullPath"));
+        if (value) strlcpy(file, BLGetCStringDescription(value), sizeof file);
+        value = CFDictionaryGetValue(action, CFSTR("FolderFullPath"));
+        if (value) strlcpy(folder, BLGetCStringDescription(value), sizeof folder);
+        strlcpy(first, BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("FullPath"))), sizeof first);
+        blesscontextprintf(context, kBLLogLevelNormal, "set %s on %s to the IDs of%s%s%s%s\n",
+                           CFEqual(CFDictionaryGetValue(action, CFSTR("Target")), kBLPlanActionSetAPFSBlessData) ?
+                           "APFS bless data" : "Finder info", first,
+                           file[0] ? " file " : "", file,
+                           folder[0] ? " folder " : "", folder);
+    } else {
+        char    words[256] = "";
+        CFIndex i;
+
+        value = CFDictionaryGetValue(action, CFSTR("Words"));
+        for (i = 0; value && i < CFArrayGetCount(value); i++) {
+            char    word[24];
+            int64_t number = 0;
+
+            CFNumberGetValue(CFArrayGetValueAtIndex(value, i), kCFNumberSInt64Type, &number);
+            snprintf(word, sizeof word, " %llu", (unsigned long long)number);
+            strlcat(words, word, sizeof words);
+        }
+        blesscontextprintf(context, kBLLogLevelNormal, "%s %s:%s\n", CFEqual(kind, kBLPlanActionSetAPFSBlessData) ?
+                           "set APFS bless data on" : "set Finder info on",
+                           BLGetCStringDescription(CFDictionaryGetValue(action, CFSTR("FullPath"))), words);
+    }
+}
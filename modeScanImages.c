@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  modeScanImages.c
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include "enums.h"
+#include "structs.h"
+
+#include "bless.h"
+#include "bless_private.h"
+#include "protos.h"
+
+#define kMaxScanThreads	16
+
+typedef struct {
+	char					*path;
+	int						ret;
+	bool					done;
+	BLElToritoUEFIRegion	region;
+} ScanImage;
+
+typedef struct {
+	pthread_mutex_t	lock;
+	ScanImage		*images;
+	size_t			count;
+	size_t			next;		// next image to hand to a worker
+	size_t			printed;	// results are printed in list order
+	size_t			found;
+} ScanQueue;
+
+static int addImage(ScanQueue *queue, size_t *capacity, const char *path);
+static int listDirectory(BLContextPtr context, ScanQueue *queue, const char *dir);
+static int listFile(BLContextPtr context, ScanQueue *queue, const char *listPath);
+static void *scanWorker(void *arg);
+static void printImage(ScanImage *image);
+static int utf8SequenceLength(const unsigned char *p);
+static void printJSONString(const char *string);
+static int compareImages(const void *a, const void *b);
+
+// Check each image in a directory, or listed in a file, for an El Torito
+// EFI boot entry. One JSON object per image, then a summary object.
+int modeScanImages(BLContextPtr context, struct clarg actargs[klast])
+{
+	const char		*path = actargs[kscanimages].argument;
+	ScanQueue		queue;
+	pthread_t		threads[kMaxScanThreads];
+	struct stat		sb;
+	struct timespec	start, end;
+	double			seconds;
+	long			ncpu;
+	int				nthreads, i, ret;
+	size_t			n;
+
+	memset(&queue, 0, sizeof(queue));
+
+	if (strcmp(path, "-") != 0 && stat(path, &sb) == 0 && S_ISDIR(sb.st_mode)) {
+		ret = listDirectory(context, &queue, path);
+	} else {
+		ret = listFile(context, &queue, path);
+	}
+	if (ret) goto exit;
+
+	blesscontextprintf(context, kBLLogLevelVerbose, "Scanning %zu images\n", queue.count);
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = (ncpu > 0 && ncpu < kMaxScanThreads) ? (int)ncpu : kMaxScanThreads;
+	if ((size_t)nthreads > queue.count) nthreads = (int)queue.count;
+
+	pthread_mutex_init(&queue.lock, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, scanWorker, &queue)) {
+			blesscontextprintf(context, kBLLogLevelError, "Can't start scan thread\n");
+			break;
+		}
+	}
+	if (i == 0 && queue.count > 0) {
+		// no threads at all; scan inline
+		scanWorker(&queue);
+	}
+	nthreads = i;
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pthread_mutex_destroy(&queue.lock);
+
+	seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("{\"summary\":{\"images\":%zu,\"found\":%zu,\"threads\":%d,\"seconds\":%.3f,\"imagesPerSecond\":%.1f}}\n",
+		   queue.count, queue.found, nthreads, seconds, seconds > 0 ? (double)queue.count / seconds : 0.0);
+	fflush(stdout);
+
+exit:
+	for (n = 0; n < queue.count; n++) {
+		free(queue.images[n].path);
+	}
+	free(queue.images);
+
+	return ret;
+}
+
+static int addImage(ScanQueue *queue, size_t *capacity, const char *path)
+{
+	ScanImage	*images;
+
+	if (queue->count == *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 64;
+		images = realloc(queue->images, *capacity * sizeof(*images));
+		if (images == NULL) return 1;
+		queue->images = images;
+	}
+
+	memset(&queue->images[queue->count], 0, sizeof(ScanImage));
+	queue->images[queue->count].path = strdup(path);
+	if (queue->images[queue->count].path == NULL) return 1;
+	queue->count++;
+
+	return 0;
+}
+
+static int listDirectory(BLContextPtr context, ScanQueue *queue, const char *dir)
+{
+	DIR				*dp;
+	struct dirent	*entry;
+	struct stat		sb;
+	char			path[MAXPATHLEN];
+	size_t			capacity = 0;
+	int				ret = 0;
+
+	dp = opendir(dir);
+	if (dp == NULL) {
+		blesscontextprintf(context, kBLLogLevelError, "Can't open directory %s\n", dir);
+		return 1;
+	}
+
+	while ((entry = readdir(dp)) != NULL) {
+		if (entry->d_name[0] == '.') continue;
+
+		snprintf(path, sizeof path, "%s/%s", dir, entry->d_name);
+		if (stat(path, &sb) < 0 || !S_ISREG(sb.st_mode)) continue;
+
+		if (addImage(queue, &capacity, path)) {
+			blesscontextprintf(context, kBLLogLevelError, "Can't allocate image list\n");
+			ret = 2;
+			break;
+		}
+	}
+	closedir(dp);
+
+	if (queue->count > 1) {
+		qsort(queue->images, queue->count, sizeof(ScanImage), compareImages);
+	}
+
+	return ret;
+}
+
+static int listFile(BLContextPtr context, ScanQueue *queue, const char *listPath)
+{
+	FILE	*fp;
+	char	*line = NULL;
+	size_t	lineCap = 0;
+	ssize_t	len;
+	size_t	capacity = 0;
+	int		ret = 0;
+
+	fp = strcmp(listPath, "-") == 0 ? stdin : fopen(listPath, "r");
+	if (fp == NULL) {
+		blesscontextprintf(context, kBLLogLevelError, "Can't open image list %s\n", listPath);
+		return 1;
+	}
+
+	while ((len = getline(&line, &lineCap, fp)) > 0) {
+		while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = '\0';
+		if (len == 0 || line[0] == '#') continue;
+
+		if (addImage(queue, &capacity, line)) {
+			blesscontextprintf(context, kBLLogLevelError, "Can't allocate image list\n");
+			ret = 2;
+			break;
+		}
+	}
+
+	free(line);
+	if (fp != stdin) fclose(fp);
+
+	return ret;
+}
+
+static void *scanWorker(void *arg)
+{
+	ScanQueue	*queue = arg;
+	ScanImage	*image;
+	size_t		index;
+
+	for (;;) {
+		pthread_mutex_lock(&queue->lock);
+		index = queue->next < queue->count ? queue->next++ : queue->count;
+		pthread_mutex_unlock(&queue->lock);
+
+		if (index == queue->count) break;
+
+		image = &queue->images[index];
+
+		// per-image details go in the output; verbose logging from
+		// every worker at once would be unreadable
+		image->ret = BLElToritoFindUEFIInFile(image->path, &image->region);
+
+		pthread_mutex_lock(&queue->lock);
+		image->done = true;
+		if (image->ret == 0 && image->region.found) queue->found++;
+		while (queue->printed < queue->count && queue->images[queue->printed].done) {
+			printImage(&queue->images[queue->printed++]);
+		}
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	return NULL;
+}
+
+static void printImage(ScanImage *image)
+{
+	const char	*status;
+	uint32_t	i;
+
+	switch (image->ret) {
+		case 0:
+			status = image->region.found ? "found" : "no-efi-entry";
+			break;
+		case 1:
+			status = "not-el-torito";
+			break;
+		case 2:
+			status = "bad-catalog";
+			break;
+		default:
+			status = "io-error";
+			break;
+	}
+
+	printf("{\"path\":");
+	printJSONString(image->path);
+	printf(",\"status\":\"%s\"", status);
+
+	if (image->ret == 0 || image->ret == 2) {
+		printf(",\"checksumValid\":%s,\"platformIDs\":[", image->region.checksumValid ? "true" : "false");
+		for (i = 0; i < image->region.platformCount; i++) {
+			printf("%s%u", i ? "," : "", image->region.platformIDs[i]);
+		}
+		printf("]");
+	}
+	if (image->region.found) {
+		printf(",\"bootEntry\":%u,\"offset\":%u,\"size\":%u", image->region.bootEntry,
+			   image->region.offset, image->region.size);
+	}
+	printf("}\n");
+}
+
+/*
+ * Length of the well-formed UTF-8 sequence at p, or 0 if it isn't one:
+ * no overlong forms, surrogates or code points past U+10FFFF
+ */
+static int utf8SequenceLength(const unsigned char *p)
+{
+	unsigned char	min = 0x80, max = 0xBF;
+	int				length, i;
+
+	if (p[0] < 0x80) return 1;
+	if (p[0] < 0xC2) return 0;
+	if (p[0] < 0xE0) {
+		length = 2;
+	} else if (p[0] < 0xF0) {
+		length = 3;
+		if (p[0] == 0xE0) min = 0xA0;
+		if (p[0] == 0xED) max = 0x9F;
+	} else if (p[0] < 0xF5) {
+		length = 4;
+		if (p[0] == 0xF0) min = 0x90;
+		if (p[0] == 0xF4) max = 0x8F;
+	} else {
+		return 0;
+	}
+
+	// only the second byte has a narrower range; a NUL ends the check too
+	if (p[1] < min || p[1] > max) return 0;
+	for (i = 2; i < length; i++) {
+		if (p[i] < 0x80 || p[i] > 0xBF) return 0;
+	}
+
+	return length;
+}
+
+// Paths are bytes, not necessarily UTF-8; each byte that isn't part of a
+// valid sequence is written as the code point of the same value, so
+// every line still parses
+static void printJSONString(const char *string)
+{
+	const unsigned char	*p;
+	int					length;
+
+	putchar('"');
+	for (p = (const unsigned char *)string; *p; p += length) {
+		length = utf8SequenceLength(p);
+		if (length == 0) {
+			printf("\\u%04x", *p);
+			length = 1;
+		} else if (*p == '"' || *p == '\\') {
+			printf("\\%c", *p);
+		} else if (*p < 0x20) {
+			printf("\\u%04x", *p);
+		} else {
+			fwrite(p, 1, length, stdout);
+		}
+	}
+	putchar('"');
+}
+
+static int compareImages(const void *a, const void *b)
+{
+	return strcmp(((const ScanImage *)a)->path, ((const ScanImage *)b)->path);
+}
@@ -189,7 +189,7 @@ exit:
 		BLUnmountContainerVolume(context, prebootMount);
 	}
 	if (!ret && mustCleanupRoots) {
-		DeleteFileOrDirectory([rootsURL fileSystemRepresentation]);
+		DeleteFileOrDirectory(context, [rootsURL fileSystemRepresentation]);
 	}
 	dispatch_release(wait);
 	[pool release];
@@ -43,6 +43,9 @@ int modeFolder(BLContextPtr context, struct clarg actargs[klast]);
 int modeFirmware(BLContextPtr context, struct clarg actargs[klast]);
 int modeNetboot(BLContextPtr context, struct clarg actargs[klast]);
 int modeUnbless(BLContextPtr context, struct clarg actargs[klast]);
+int modePlan(BLContextPtr context, struct clarg actargs[klast]);
+int modeApplyPlan(BLContextPtr context, struct clarg actargs[klast]);
+int modeScanImages(BLContextPtr context, struct clarg actargs[klast]);
 int extractMountPoint(BLContextPtr context, struct clarg actargs[klast]);
 int extractDiskFromMountPoint(BLContextPtr context, const char *mnt, char *disk, size_t disk_size);
 int isMediaExternal(BLContextPtr context, const char *mnt, bool *external);
@@ -75,4 +78,4 @@ int GetMountForSnapshot(BLContextPtr context, const char *snapshotName, const ch
 int WriteLabelFile(BLContextPtr context, const char *path, CFDataRef labeldata, int doTypeCreator, int scale);
 int GetSnapshotNameFromRootHash(BLContextPtr context, const char *rootHashPath, char *snapName, int nameLen);
 
-int DeleteFileOrDirectory(const char *path);
+int DeleteFileOrDirectory(BLContextPtr context, const char *path);
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+//
+//  BLBlockChecksumTests.c
+//
+//  The one-shot, incremental and multi-buffer checksums are compared
+//  against a plain word-at-a-time loop, over every length and alignment
+//  around a word, and over every split of a buffer into two pieces.
+//
+
+#include <unistd.h>
+
+#include "BLBlockChecksum.h"
+#include "BLTest.h"
+
+#define kMaxLength		300
+
+// MediaKit's loop, one aligned word at a time, ignoring a partial last word
+static uint32_t referenceChecksum(const uint8_t *buf, size_t length)
+{
+	uint32_t	sum = 0, word;
+	size_t		i;
+
+	for (i = 0; i + 4 <= length; i += 4) {
+		memcpy(&word, buf + i, 4);
+		sum = ((sum >> 31) | (sum << 1)) + word;
+	}
+	return sum;
+}
+
+static void fill(uint8_t *buf, size_t length, uint32_t seed)
+{
+	size_t	i;
+
+	for (i = 0; i < length; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (uint8_t)(seed >> 16);
+	}
+}
+
+static void testOneShot(void)
+{
+	uint8_t		buf[kMaxLength + 8];
+	size_t		length, align;
+
+	fill(buf, sizeof buf, 1);
+	for (align = 0; align < 4; align++) {
+		for (length = 0; length <= kMaxLength; length++) {
+			BLTestAssertEqual(BLBlockChecksum(buf + align, (uint32_t)length),
+							  referenceChecksum(buf + align, length));
+		}
+	}
+
+	// the partial last word is left out, as it always was
+	BLTestAssertEqual(BLBlockChecksum(buf, 7), BLBlockChecksum(buf, 4));
+	BLTestAssertEqual(BLBlockChecksum(buf, 3), 0);
+}
+
+static void testIncremental(void)
+{
+	uint8_t					buf[kMaxLength];
+	BLBlockChecksumContext	context;
+	size_t					length, split, offset, chunk;
+	uint32_t				expected;
+
+	fill(buf, sizeof buf, 2);
+	for (length = 0; length <= 64; length++) {
+		expected = referenceChecksum(buf, length);
+		for (split = 0; split <= length; split++) {
+			BLBlockChecksumInit(&context);
+			BLBlockChecksumUpdate(&context, buf, split);
+			BLBlockChecksumUpdate(&context, buf + split, length - split);
+			BLTestAssertEqual(BLBlockChecksumFinal(&context), expected);
+		}
+	}
+
+	// every chunk size, including ones that leave a word pending across several updates
+	for (chunk = 1; chunk <= 9; chunk++) {
+		BLBlockChecksumInit(&context);
+		for (offset = 0; offset < kMaxLength; offset += chunk) {
+			BLBlockChecksumUpdate(&context, buf + offset, chunk < kMaxLength - offset ? chunk : kMaxLength - offset);
+		}
+		BLTestAssertEqual(BLBlockChecksumFinal(&context), referenceChecksum(buf, kMaxLength));
+	}
+}
+
+static void testMulti(void)
+{
+	uint8_t		buf[kMaxLength + 16];
+	const void	*bufs[11];
+	size_t		lengths[11];
+	uint32_t	sums[12], count, i;
+
+	fill(buf, sizeof buf, 3);
+	for (count = 0; count <= 11; count++) {
+		for (i = 0; i < count; i++) {
+			bufs[i] = buf + i;
+			lengths[i] = (kMaxLength - 37 * i) % (kMaxLength + 1);
+		}
+		sums[count] = 0xDEADBEEF;
+
+		BLBlockChecksumMulti(bufs, lengths, sums, count);
+		for (i = 0; i < count; i++) {
+			BLTestAssertEqual(sums[i], referenceChecksum(bufs[i], lengths[i]));
+		}
+
+		// nothing past the last sum is written
+		BLTestAssertEqual(sums[count], 0xDEADBEEF);
+	}
+
+	// one buffer much shorter than the rest of its group
+	bufs[0] = buf;
+	lengths[0] = kMaxLength;
+	bufs[1] = buf + 1;
+	lengths[1] = 5;
+	bufs[2] = buf + 2;
+	lengths[2] = kMaxLength - 1;
+	bufs[3] = buf + 3;
+	lengths[3] = 0;
+	BLBlockChecksumMulti(bufs, lengths, sums, 4);
+	for (i = 0; i < 4; i++) {
+		BLTestAssertEqual(sums[i], referenceChecksum(bufs[i], lengths[i]));
+	}
+}
+
+// a byte changes each round, so no loop can be hoisted
+static volatile uint32_t	gSink;
+
+static void benchmark(void)
+{
+	enum { kLength = 64 * 1024 * 1024, kChunk = 64 * 1024, kBuffers = 8, kRounds = 8 };
+	uint8_t					*buf = malloc(kLength + 1);
+	const void				*bufs[kBuffers];
+	size_t					lengths[kBuffers];
+	uint32_t				sums[kBuffers];
+	BLBlockChecksumContext	context;
+	uint64_t				start;
+	size_t					offset;
+	int						round, i;
+
+	if (buf == NULL) abort();
+	fill(buf, kLength + 1, 4);
+
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		buf[round] ^= 1;
+		gSink = referenceChecksum(buf, kLength);
+	}
+	BLTestReport("word at a time, 64MB", kRounds, BLTestNow() - start, (uint64_t)kRounds * kLength);
+
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		buf[round] ^= 1;
+		gSink = BLBlockChecksum(buf, kLength);
+	}
+	BLTestReport("BLBlockChecksum 64MB", kRounds, BLTestNow() - start, (uint64_t)kRounds * kLength);
+
+	// as a streaming read would deliver it, misaligned
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		buf[round + 1] ^= 1;
+		BLBlockChecksumInit(&context);
+		for (offset = 1; offset < kLength + 1; offset += kChunk - 1) {
+			size_t	chunk = kChunk - 1 < kLength + 1 - offset ? kChunk - 1 : kLength + 1 - offset;
+
+			BLBlockChecksumUpdate(&context, buf + offset, chunk);
+		}
+		gSink = BLBlockChecksumFinal(&context);
+	}
+	BLTestReport("BLBlockChecksumUpdate 64KB chunks", kRounds, BLTestNow() - start, (uint64_t)kRounds * kLength);
+
+	for (i = 0; i < kBuffers; i++) {
+		bufs[i] = buf + (size_t)i * (kLength / kBuffers);
+		lengths[i] = kLength / kBuffers;
+	}
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		buf[round] ^= 1;
+		BLBlockChecksumMulti(bufs, lengths, sums, kBuffers);
+		gSink = sums[0];
+	}
+	BLTestReport("BLBlockChecksumMulti 8 x 8MB", kRounds, BLTestNow() - start, (uint64_t)kRounds * kLength);
+
+	free(buf);
+}
+
+int main(int argc, char *argv[])
+{
+	if (getopt(argc, argv, "b") == 'b') {
+		benchmark();
+		return 0;
+	}
+
+	testOneShot();
+	testIncremental();
+	testMulti();
+
+	return BLTestFinish("BLBlockChecksumTests");
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLBootArgsTests.c
+//
+//  boot-args parsed, edited and written back: key=value splitting,
+//  whitespace, flags and empty values, duplicates, the change counts,
+//  and the rooting arguments a bless filters out, including every short
+//  key that could land in one of their slots.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bless.h"
+#include "bless_private.h"
+#include "BLTest.h"
+
+static BLBootArgsRef create(const char *bootArgs)
+{
+	BLBootArgsRef	args = NULL;
+
+	BLTestAssertEqual(BLBootArgsCreate(NULL, bootArgs, &args), 0);
+	return args;
+}
+
+// what args writes back, compared and freed
+static void checkString(BLBootArgsRef args, const char *expected)
+{
+	char	*string = NULL;
+
+	BLTestAssertEqual(BLBootArgsCopyString(NULL, args, &string), 0);
+	BLTestAssertEqualStrings(string, expected);
+	free(string);
+}
+
+static void checkChanges(BLBootArgsRef args, uint32_t added, uint32_t removed, uint32_t replaced)
+{
+	BLBootArgsChanges	changes;
+
+	BLBootArgsGetChanges(args, &changes);
+	BLTestAssertEqual(changes.added, added);
+	BLTestAssertEqual(changes.removed, removed);
+	BLTestAssertEqual(changes.replaced, replaced);
+}
+
+// value NULL expects a flag
+static void checkValue(BLBootArgsRef args, const char *key, const char *expected)
+{
+	const char	*value = "unset";
+	size_t		valueLength = 99;
+
+	BLTestAssert(BLBootArgsGetValue(args, key, &value, &valueLength));
+	if (expected == NULL) {
+		BLTestAssert(value == NULL);
+		BLTestAssertEqual(valueLength, 0);
+	} else {
+		BLTestAssert(value != NULL);
+		BLTestAssertEqual(valueLength, strlen(expected));
+		if (value) BLTestAssert(memcmp(value, expected, valueLength) == 0);
+	}
+}
+
+/*
+ * Tokens are split on spaces, tabs and newlines, runs of them included,
+ * and written back one space apart. A key ends at its first '='.
+ */
+static void testParse(void)
+{
+	BLBootArgsRef	args;
+	const char		*value;
+	size_t			valueLength;
+
+	args = create("  -v   debug=0x144\tkeepsyms=1\n\r serverperfmode=1 a= b==c  ");
+	checkValue(args, "-v", NULL);
+	checkValue(args, "debug", "0x144");
+	checkValue(args, "keepsyms", "1");
+	checkValue(args, "serverperfmode", "1");
+	checkValue(args, "a", "");
+	checkValue(args, "b", "=c");
+	BLTestAssert(!BLBootArgsGetValue(args, "keep", &value, &valueLength));
+	BLTestAssert(value == NULL);
+	BLTestAssert(!BLBootArgsGetValue(args, "debug=0x144", NULL, NULL));
+	checkString(args, "-v debug=0x144 keepsyms=1 serverperfmode=1 a= b==c");
+	checkChanges(args, 0, 0, 0);
+	BLBootArgsRelease(args);
+
+	args = create(" \t\n ");
+	checkString(args, "");
+	BLBootArgsRelease(args);
+
+	args = create(NULL);
+	checkString(args, "");
+	BLBootArgsRelease(args);
+}
+
+// the first occurrence answers lookups; Set leaves only one
+static void testDuplicates(void)
+{
+	BLBootArgsRef	args;
+
+	args = create("x=1 y x=2 -v x=3");
+	checkValue(args, "x", "1");
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "x", "4"), 0);
+	checkValue(args, "x", "4");
+	checkString(args, "x=4 y -v");
+	checkChanges(args, 0, 2, 1);
+	BLBootArgsRelease(args);
+
+	// already the first value: only the shadowing copies go
+	args = create("x=1 x=2");
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "x", "1"), 0);
+	checkString(args, "x=1");
+	checkChanges(args, 0, 1, 0);
+	BLBootArgsRelease(args);
+
+	// a flag and a value of the same key are the same key
+	args = create("x x=1");
+	checkValue(args, "x", NULL);
+	BLTestAssertEqual(BLBootArgsRemove(NULL, args, "x"), 0);
+	BLTestAssert(!BLBootArgsGetValue(args, "x", NULL, NULL));
+	checkString(args, "");
+	checkChanges(args, 0, 2, 0);
+	BLBootArgsRelease(args);
+}
+
+static void testSet(void)
+{
+	BLBootArgsRef	args;
+
+	args = create("debug=0x144 -v");
+
+	// unchanged
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "debug", "0x144"), 0);
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "-v", NULL), 0);
+	checkChanges(args, 0, 0, 0);
+
+	// replaced in place, added at the end
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "debug", "0x0"), 0);
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "keepsyms", "1"), 0);
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "-s", NULL), 0);
+	checkString(args, "debug=0x0 -v keepsyms=1 -s");
+	checkChanges(args, 2, 0, 1);
+
+	// a flag, an empty value and a value are all different
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "keepsyms", NULL), 0);
+	checkValue(args, "keepsyms", NULL);
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "keepsyms", ""), 0);
+	checkValue(args, "keepsyms", "");
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "keepsyms", ""), 0);
+	checkString(args, "debug=0x0 -v keepsyms= -s");
+	checkChanges(args, 2, 0, 3);
+
+	// nothing that would split into other tokens is accepted
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "", "1"), 1);
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "a=b", "1"), 1);
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "a b", NULL), 1);
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "a", "1 b=2"), 1);
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "a", "1\tb"), 1);
+	checkString(args, "debug=0x0 -v keepsyms= -s");
+	checkChanges(args, 2, 0, 3);
+
+	// removed, then set again: a new token at the end
+	BLTestAssertEqual(BLBootArgsRemove(NULL, args, "debug"), 0);
+	BLTestAssertEqual(BLBootArgsRemove(NULL, args, "missing"), 0);
+	BLTestAssertEqual(BLBootArgsSet(NULL, args, "debug", "0x1"), 0);
+	checkString(args, "-v keepsyms= -s debug=0x1");
+	checkChanges(args, 3, 1, 3);
+
+	BLBootArgsRelease(args);
+}
+
+/*
+ * Only rd=, rp= and boot-uuid= with a value go; flags of those names,
+ * longer or shorter keys, and values that merely mention them stay.
+ */
+static void testFilter(void)
+{
+	BLBootArgsRef	args;
+
+	args = create("rd=disk0 -v rp=nfs:1.2.3.4:/foo:bar.dmg rd rdx=1 xrp=2 boot-uuid=ABCD "
+				  "boot-uuid= boot-uui=1 boot-uuids=1 RD=1 debug=rd=1 rx=1");
+	BLTestAssertEqual(BLBootArgsFilter(NULL, args), 0);
+	checkString(args, "-v rd rdx=1 xrp=2 boot-uui=1 boot-uuids=1 RD=1 debug=rd=1 rx=1");
+	checkChanges(args, 0, 4, 0);
+
+	// a second pass finds nothing
+	BLTestAssertEqual(BLBootArgsFilter(NULL, args), 0);
+	checkChanges(args, 0, 4, 0);
+	BLBootArgsRelease(args);
+}
+
+/*
+ * Every key of one to three characters from the boot-arg alphabet, each
+ * with a value: the known keys' slots are collision-free for their own
+ * names only, so of all of these just rd and rp are filtered.
+ */
+static void testFilterSlots(void)
+{
+	static const char	alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.";
+	const size_t		n = sizeof(alphabet) - 1;
+	BLBootArgsRef		args;
+	char				*text, *p;
+	size_t				i, j, k;
+
+	text = p = malloc((n + n * n + n * n * n) * 6 + 1);
+	BLTestAssert(text != NULL);
+	if (text == NULL) return;
+
+	for (i = 0; i < n; i++) {
+		p += sprintf(p, "%c=1 ", alphabet[i]);
+		for (j = 0; j < n; j++) {
+			p += sprintf(p, "%c%c=1 ", alphabet[i], alphabet[j]);
+			for (k = 0; k < n; k++) {
+				p += sprintf(p, "%c%c%c=1 ", alphabet[i], alphabet[j], alphabet[k]);
+			}
+		}
+	}
+
+	args = create(text);
+	free(text);
+	BLTestAssertEqual(BLBootArgsFilter(NULL, args), 0);
+	checkChanges(args, 0, 2, 0);
+	BLTestAssert(!BLBootArgsGetValue(args, "rd", NULL, NULL));
+	BLTestAssert(!BLBootArgsGetValue(args, "rp", NULL, NULL));
+	checkValue(args, "rx", "1");
+	BLBootArgsRelease(args);
+}
+
+// what the NVRAM path writes back: filtered, and one space apart
+static void testPreserve(void)
+{
+	char	output[64];
+	bool	changed = true;
+
+	BLTestAssertEqual(BLPreserveBootArgsIfChanged(NULL, "debug=1\trd=disk0  -v\n", output, sizeof output, &changed), 0);
+	BLTestAssertEqualStrings(output, "debug=1 -v");
+	BLTestAssert(changed);
+
+	// whitespace alone is not a change
+	BLTestAssertEqual(BLPreserveBootArgsIfChanged(NULL, "a\tb  c", output, sizeof output, &changed), 0);
+	BLTestAssertEqualStrings(output, "a b c");
+	BLTestAssert(!changed);
+
+	BLTestAssertEqual(BLPreserveBootArgs(NULL, "boot-uuid=1234 -s", output, (int)sizeof output), 0);
+	BLTestAssertEqualStrings(output, "-s");
+
+	// refused rather than cut short
+	BLTestAssertEqual(BLPreserveBootArgsIfChanged(NULL, "debug=0x144 -v", output, 8, NULL), 1);
+	BLTestAssertEqual(BLPreserveBootArgsIfChanged(NULL, "debug=0x144 -v", output, 15, NULL), 0);
+	BLTestAssertEqualStrings(output, "debug=0x144 -v");
+}
+
+int main(int argc, char *argv[])
+{
+	testParse();
+	testDuplicates();
+	testSet();
+	testFilter();
+	testFilterSlots();
+	testPreserve();
+
+	return BLTestFinish("BLBootArgsTests");
+}
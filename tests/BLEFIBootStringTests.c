@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+//
+//  BLEFIBootStringTests.c
+//
+//  Round trips through the EFI boot device strings, and the benchmark
+//  for them. BLValidateXMLBootOption is checked against a recorded
+//  NVRAM store; creating and interpreting strings needs the machine's
+//  device tree, so those use the volume at / and the first network
+//  interface, and are skipped if there is none.
+//
+//  With -b each function is timed and the CoreFoundation allocations it
+//  makes are counted through a counting default allocator. malloc calls
+//  made outside CF are not counted.
+//
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <net/if.h>
+#include <arpa/nameser.h>
+
+#include "bless.h"
+#include "bless_private.h"
+#include "BLTest.h"
+
+static uint64_t gAllocations;
+
+static void *countingAllocate(CFIndex size, CFOptionFlags hint, void *info)
+{
+	gAllocations++;
+	return malloc(size);
+}
+
+static void *countingReallocate(void *ptr, CFIndex size, CFOptionFlags hint, void *info)
+{
+	gAllocations++;
+	return realloc(ptr, size);
+}
+
+static void countingDeallocate(void *ptr, void *info)
+{
+	free(ptr);
+}
+
+// a device path of HD(1, GPT) and File(\System\Library\CoreServices\boot.efi)
+static CFDataRef createDevicePath(void)
+{
+	static const char	file[] = "\\System\\Library\\CoreServices\\boot.efi";
+	uint8_t				buf[256];
+	size_t				len = 0, i;
+
+	// hard drive media node: partition 1 at LBA 40, GPT signature
+	memset(buf, 0, 42);
+	buf[0] = 0x04; buf[1] = 0x01; buf[2] = 42;
+	buf[4] = 1;
+	buf[8] = 40;
+	buf[16] = 0x00; buf[17] = 0x40; buf[18] = 0x06;
+	for (i = 0; i < 16; i++) buf[24 + i] = (uint8_t)(0xa0 + i);
+	buf[40] = 0x02; buf[41] = 0x02;
+	len = 42;
+
+	// file path node, UTF-16LE with its NUL
+	buf[len] = 0x04; buf[len + 1] = 0x04;
+	buf[len + 2] = (uint8_t)(4 + 2 * sizeof(file)); buf[len + 3] = 0;
+	for (i = 0; i < sizeof(file); i++) {
+		buf[len + 4 + 2 * i] = (uint8_t)file[i];
+		buf[len + 5 + 2 * i] = 0;
+	}
+	len += 4 + 2 * sizeof(file);
+
+	buf[len] = 0x7f; buf[len + 1] = 0xff; buf[len + 2] = 4; buf[len + 3] = 0;
+	len += 4;
+
+	return CFDataCreate(kCFAllocatorDefault, buf, len);
+}
+
+// EFI_LOAD_OPTION for devicePath, with optionalData stored as a UTF-16 string
+static CFDataRef createLoadOption(CFDataRef devicePath, const char *optionalData)
+{
+	static const char	desc[] = "Mac OS X";
+	CFMutableDataRef	option = CFDataCreateMutable(kCFAllocatorDefault, 0);
+	CFIndex				pathLength = CFDataGetLength(devicePath);
+	uint8_t				header[6] = { 1, 0, 0, 0, (uint8_t)pathLength, (uint8_t)(pathLength >> 8) };
+	size_t				i;
+
+	CFDataAppendBytes(option, header, sizeof header);
+	for (i = 0; i < sizeof(desc); i++) {
+		CFDataAppendBytes(option, (const UInt8 []){ desc[i], 0 }, 2);
+	}
+	CFDataAppendBytes(option, CFDataGetBytePtr(devicePath), pathLength);
+	for (i = 0; optionalData && i <= strlen(optionalData); i++) {
+		CFDataAppendBytes(option, (const UInt8 []){ optionalData[i], 0 }, 2);
+	}
+
+	return option;
+}
+
+// a recorded store where Boot0080 matches efi-boot-device-data and the
+// boot option in efi-boot-device, unless the option data differs
+static int createStore(BLContextPtr context, char *path, const char *optionalData)
+{
+	CFDataRef	devicePath = createDevicePath();
+	CFDataRef	option = createLoadOption(devicePath, optionalData);
+	CFDataRef	order = CFDataCreate(kCFAllocatorDefault, (const UInt8 []){ 0x80, 0x00 }, 2);
+	int			fd, ret;
+
+	strlcpy(path, "/tmp/BLEFIBootStringTests.XXXXXX", MAXPATHLEN);
+	fd = mkstemp(path);
+	if (fd < 0) return errno;
+	close(fd);
+	unlink(path);
+
+	context->version = kBLContextVersionNVRAMSession;
+	ret = BLNVRAMSessionCreate(context, &kBLNVRAMBackendFile, path, &context->nvram);
+	if (ret == 0) {
+		ret = BLNVRAMSetValue(context, CFSTR(kBL_GLOBAL_NVRAM_GUID ":BootOrder"), order)
+			|| BLNVRAMSetValue(context, CFSTR(kBL_GLOBAL_NVRAM_GUID ":Boot0080"), option)
+			|| BLNVRAMSetValue(context, CFSTR("efi-boot-device-data"), devicePath)
+			|| BLNVRAMSetValue(context, CFSTR("efi-boot-device"),
+							   CFSTR("<array><dict><key>IOEFIBootOption</key><string>-v</string></dict></array>"));
+	}
+
+	CFRelease(devicePath);
+	CFRelease(option);
+	CFRelease(order);
+
+	return ret;
+}
+
+static void releaseStore(BLContextPtr context, const char *path)
+{
+	BLNVRAMSessionRelease(context, context->nvram);
+	context->nvram = NULL;
+	unlink(path);
+}
+
+static void testValidate(void)
+{
+	static const char	*optionalData[] = { "-v", "-s", NULL };
+	static const int	expected[] = { 0, 1, 1 };
+	BLContext			context = { 0 };
+	char				path[MAXPATHLEN];
+	size_t				i;
+
+	for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+		BLTestAssertEqual(createStore(&context, path, optionalData[i]), 0);
+		BLTestAssertEqual(BLValidateXMLBootOption(&context, CFSTR("efi-boot-device"),
+												  CFSTR("efi-boot-device-data")), expected[i]);
+		releaseStore(&context, path);
+	}
+}
+
+static bool rootDevice(char *bsdName, size_t size)
+{
+	struct statfs	sb;
+
+	if (statfs("/", &sb) < 0 || strncmp(sb.f_mntfromname, "/dev/", 5) != 0) return false;
+	strlcpy(bsdName, sb.f_mntfromname + 5, size);
+
+	return true;
+}
+
+static bool networkInterface(char *name)
+{
+	struct if_nameindex	*names = if_nameindex(), *n;
+	bool				found = false;
+
+	for (n = names; n && n->if_name && !found; n++) {
+		if (strncmp(n->if_name, "en", 2) == 0) {
+			strlcpy(name, n->if_name, IF_NAMESIZE);
+			found = true;
+		}
+	}
+	if (names) if_freenameindex(names);
+
+	return found;
+}
+
+static void testRoundTrips(void)
+{
+	char					bsdName[MNAMELEN], found[MNAMELEN];
+	char					interface[IF_NAMESIZE], foundInterface[IF_NAMESIZE];
+	char					host[NS_MAXDNAME], path[MAXPATHLEN];
+	BLNetBootProtocolType	protocol;
+	CFStringRef				xml = NULL;
+
+	if (rootDevice(bsdName, sizeof bsdName)) {
+		BLTestAssertEqual(BLCreateEFIXMLRepresentationForDevice(NULL, bsdName, NULL, &xml, false), 0);
+		if (xml) {
+			// / may be mounted from a snapshot, which names its volume
+			BLTestAssertEqual(BLInterpretEFIXMLRepresentationAsDevice(NULL, xml, found, sizeof found), 0);
+			BLTestAssert(strncmp(bsdName, found, strlen(found)) == 0);
+			CFRelease(xml);
+			xml = NULL;
+		}
+
+		BLTestAssertEqual(BLCreateEFIXMLRepresentationForPath(NULL, "/", NULL, &xml, false), 0);
+		if (xml) {
+			BLTestAssertEqual(BLInterpretEFIXMLRepresentationAsDevice(NULL, xml, found, sizeof found), 0);
+			CFRelease(xml);
+			xml = NULL;
+		}
+	} else {
+		printf("no root device, skipping device round trips\n");
+	}
+
+	if (networkInterface(interface)) {
+		BLTestAssertEqual(BLCreateEFIXMLRepresentationForNetworkPath(NULL, kBLNetBootProtocol_PXE, interface,
+																	 "10.0.0.1", NULL, NULL, &xml), 0);
+		if (xml) {
+			BLTestAssertEqual(BLInterpretEFIXMLRepresentationAsNetworkPath(NULL, xml, &protocol, foundInterface,
+																		   host, path), 0);
+			BLTestAssertEqualStrings(foundInterface, interface);
+			BLTestAssertEqualStrings(host, "10.0.0.1");
+			BLTestAssertEqual(protocol, kBLNetBootProtocol_PXE);
+			CFRelease(xml);
+		}
+	} else {
+		printf("no network interface, skipping network round trip\n");
+	}
+}
+
+enum {
+	kBenchCreatePath,
+	kBenchCreateDevice,
+	kBenchCreateNetwork,
+	kBenchInterpretDevice,
+	kBenchInterpretNetwork,
+	kBenchValidate,
+	kBenchCount
+};
+
+static const char *kBenchNames[kBenchCount] = {
+	"BLCreateEFIXMLRepresentationForPath",
+	"BLCreateEFIXMLRepresentationForDevice",
+	"BLCreateEFIXMLRepresentationForNetworkPath",
+	"BLInterpretEFIXMLRepresentationAsDevice",
+	"BLInterpretEFIXMLRepresentationAsNetworkPath",
+	"BLValidateXMLBootOption",
+};
+
+typedef struct {
+	BLContextPtr	context;
+	char			bsdName[MNAMELEN];
+	char			interface[IF_NAMESIZE];
+	CFStringRef		deviceXML;
+	CFStringRef		networkXML;
+} BenchState;
+
+static int runOnce(BenchState *state, int which)
+{
+	char					name[MAXPATHLEN], host[NS_MAXDNAME], path[MAXPATHLEN];
+	BLNetBootProtocolType	protocol;
+	CFStringRef				xml = NULL;
+	int						ret = 0;
+
+	switch (which) {
+		case kBenchCreatePath:
+			ret = BLCreateEFIXMLRepresentationForPath(NULL, "/", NULL, &xml, false);
+			break;
+		case kBenchCreateDevice:
+			ret = BLCreateEFIXMLRepresentationForDevice(NULL, state->bsdName, NULL, &xml, false);
+			break;
+		case kBenchCreateNetwork:
+			ret = BLCreateEFIXMLRepresentationForNetworkPath(NULL, kBLNetBootProtocol_PXE, state->interface,
+															 "10.0.0.1", NULL, NULL, &xml);
+			break;
+		case kBenchInterpretDevice:
+			ret = BLInterpretEFIXMLRepresentationAsDevice(NULL, state->deviceXML, name, sizeof name);
+			break;
+		case kBenchInterpretNetwork:
+			ret = BLInterpretEFIXMLRepresentationAsNetworkPath(NULL, state->networkXML, &protocol, name,
+															   host, path);
+			break;
+		case kBenchValidate:
+			ret = BLValidateXMLBootOption(state->context, CFSTR("efi-boot-device"),
+										  CFSTR("efi-boot-device-data"));
+			break;
+	}
+	if (xml) CFRelease(xml);
+
+	return ret;
+}
+
+static void benchmark(void)
+{
+	enum { kRounds = 2000 };
+	CFAllocatorContext	allocatorContext = { 0, NULL, NULL, NULL, NULL,
+											 countingAllocate, countingReallocate, countingDeallocate, NULL };
+	CFAllocatorRef		allocator, previous;
+	BLContext			context = { 0 };
+	BenchState			state = { &context };
+	char				path[MAXPATHLEN];
+	uint64_t			start, ns, allocations;
+	int					which, round;
+
+	if (createStore(&context, path, "-v")) abort();
+	if (rootDevice(state.bsdName, sizeof state.bsdName)) {
+		BLCreateEFIXMLRepresentationForDevice(NULL, state.bsdName, NULL, &state.deviceXML, false);
+	}
+	if (networkInterface(state.interface)) {
+		BLCreateEFIXMLRepresentationForNetworkPath(NULL, kBLNetBootProtocol_PXE, state.interface,
+												   "10.0.0.1", NULL, NULL, &state.networkXML);
+	}
+
+	allocator = CFAllocatorCreate(kCFAllocatorUseContext, &allocatorContext);
+	previous = CFAllocatorGetDefault();
+	CFRetain(previous);
+	CFAllocatorSetDefault(allocator);
+
+	for (which = 0; which < kBenchCount; which++) {
+		// skip what this machine can't do, rather than timing the failure
+		if (runOnce(&state, which)) {
+			printf("%-40s skipped\n", kBenchNames[which]);
+			continue;
+		}
+
+		gAllocations = 0;
+		start = BLTestNow();
+		for (round = 0; round < kRounds; round++) {
+			if (runOnce(&state, which)) abort();
+		}
+		ns = BLTestNow() - start;
+		allocations = gAllocations;
+
+		BLTestReport(kBenchNames[which], kRounds, ns, 0);
+		printf("%-40s %10.1f allocs/op\n", "", (double)allocations / kRounds);
+	}
+
+	CFAllocatorSetDefault(previous);
+	CFRelease(previous);
+	CFRelease(allocator);
+
+	if (state.deviceXML) CFRelease(state.deviceXML);
+	if (state.networkXML) CFRelease(state.networkXML);
+	releaseStore(&context, path);
+}
+
+int main(int argc, char *argv[])
+{
+	if (getopt(argc, argv, "b") == 'b') {
+		benchmark();
+		return 0;
+	}
+
+	testValidate();
+	testRoundTrips();
+
+	return BLTestFinish("BLEFIBootStringTests");
+}
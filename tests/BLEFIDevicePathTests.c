@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLEFIDevicePathTests.c
+//
+//  Load options are built here byte by byte, the way firmware lays them
+//  out, and then decoded.
+//
+
+#include <unistd.h>
+
+#include "BLEFIDevicePath.h"
+#include "BLTest.h"
+
+typedef struct {
+	uint8_t		bytes[4096];
+	size_t		length;
+} Builder;
+
+static void put8(Builder *b, uint8_t v)
+{
+	b->bytes[b->length++] = v;
+}
+
+static void put16(Builder *b, uint16_t v)
+{
+	put8(b, v & 0xFF);
+	put8(b, v >> 8);
+}
+
+static void put32(Builder *b, uint32_t v)
+{
+	put16(b, v & 0xFFFF);
+	put16(b, v >> 16);
+}
+
+static void put64(Builder *b, uint64_t v)
+{
+	put32(b, (uint32_t)v);
+	put32(b, (uint32_t)(v >> 32));
+}
+
+// ASCII only, which is all the synthetic options use
+static void putUTF16(Builder *b, const char *s, char slash)
+{
+	for (; *s; s++) put16(b, (*s == '/' && slash) ? slash : *s);
+	put16(b, 0);
+}
+
+static void putHeader(Builder *b, uint8_t type, uint8_t subType, uint16_t length)
+{
+	put8(b, type);
+	put8(b, subType);
+	put16(b, length);
+}
+
+static void putHardDrive(Builder *b, uint32_t partition, uint64_t start, uint64_t size, uint8_t seed)
+{
+	int i;
+
+	putHeader(b, kBLEFIDevicePathTypeMedia, kBLEFIDevicePathSubTypeHardDrive, 42);
+	put32(b, partition);
+	put64(b, start);
+	put64(b, size);
+	for (i = 0; i < 16; i++) put8(b, seed + i);
+	put8(b, 2);		// GPT
+	put8(b, 2);		// GUID signature
+}
+
+static void putFilePath(Builder *b, const char *path)
+{
+	putHeader(b, kBLEFIDevicePathTypeMedia, kBLEFIDevicePathSubTypeFilePath, 4 + 2 * (strlen(path) + 1));
+	putUTF16(b, path, '\\');
+}
+
+static void putEnd(Builder *b)
+{
+	putHeader(b, kBLEFIDevicePathTypeEnd, kBLEFIDevicePathSubTypeEndEntire, 4);
+}
+
+// Attributes, FilePathListLength, Description, the path list, then optional data
+static void buildLoadOption(Builder *b, const char *description, const char *path, uint8_t seed,
+							const char *optional)
+{
+	size_t	lengthAt;
+
+	b->length = 0;
+	put32(b, 1);					// LOAD_OPTION_ACTIVE
+	lengthAt = b->length;
+	put16(b, 0);
+	putUTF16(b, description, 0);
+
+	{
+		size_t start = b->length;
+
+		putHardDrive(b, 2, 409640, 0x1d1a94a0ULL + seed, seed);
+		putFilePath(b, path);
+		putEnd(b);
+		b->bytes[lengthAt] = (b->length - start) & 0xFF;
+		b->bytes[lengthAt + 1] = (b->length - start) >> 8;
+	}
+
+	if (optional) {
+		memcpy(b->bytes + b->length, optional, strlen(optional));
+		b->length += strlen(optional);
+	}
+}
+
+static void testLoadOption(void)
+{
+	Builder				b;
+	BLEFILoadOption		option;
+	BLEFIDevicePathNode	node;
+	BLEFIHardDriveNode	hd;
+	BLEFISpan			cursor;
+	char				text[64];
+	int					i;
+
+	buildLoadOption(&b, "Mac OS X", "/System/Library/CoreServices/boot.efi", 0x10, "RC");
+
+	BLTestAssertEqual(BLEFIParseLoadOption(b.bytes, b.length, &option), 0);
+	BLTestAssertEqual(option.attributes, 1);
+	BLTestAssertEqual(option.descriptionChars, 8);
+	BLEFIUTF16ToUTF8(option.description, option.descriptionChars, text, sizeof text);
+	BLTestAssertEqualStrings(text, "Mac OS X");
+	BLTestAssertEqual(option.optionalData.length, 2);
+	BLTestAssert(memcmp(option.optionalData.bytes, "RC", 2) == 0);
+
+	cursor = option.filePathList;
+	BLTestAssertEqual(BLEFIDevicePathNextNode(&cursor, &node), 1);
+	BLTestAssertEqual(BLEFIDecodeHardDriveNode(&node, &hd), 0);
+	BLTestAssertEqual(hd.partitionNumber, 2);
+	BLTestAssertEqual(hd.partitionStart, 409640);
+	BLTestAssertEqual(hd.partitionSize, 0x1d1a94b0ULL);
+	for (i = 0; i < 16; i++) BLTestAssertEqual(hd.signature[i], 0x10 + i);
+	BLTestAssertEqual(hd.signatureType, 2);
+	// a hard drive node is nothing else
+	BLTestAssert(BLEFIDecodeFilePathNode(&node, text, sizeof text) != 0);
+
+	BLTestAssertEqual(BLEFIDevicePathNextNode(&cursor, &node), 1);
+	BLTestAssertEqual(BLEFIDecodeFilePathNode(&node, text, sizeof text), 0);
+	BLTestAssertEqualStrings(text, "/System/Library/CoreServices/boot.efi");
+
+	BLTestAssertEqual(BLEFIDevicePathNextNode(&cursor, &node), 0);
+	BLTestAssertEqual(cursor.length, 0);
+}
+
+// Every truncation of a valid option either fails to parse or parses to
+// spans which stay inside it; run under ASan to catch any overread.
+static void testTruncation(void)
+{
+	Builder				b;
+	BLEFILoadOption		option;
+	BLEFIDevicePathNode	node;
+	BLEFISpan			cursor;
+	uint8_t				*copy;
+	size_t				length;
+	int					ret;
+
+	buildLoadOption(&b, "Recovery", "/com.apple.recovery.boot/boot.efi", 0x40, NULL);
+
+	for (length = 0; length <= b.length; length++) {
+		// exact-size heap copy, so ASan sees the end of the buffer
+		copy = malloc(length ? length : 1);
+		memcpy(copy, b.bytes, length);
+
+		if (BLEFIParseLoadOption(copy, length, &option) == 0) {
+			BLTestAssert(option.filePathList.bytes + option.filePathList.length <= copy + length);
+			BLTestAssert(option.optionalData.bytes + option.optionalData.length == copy + length);
+			cursor = option.filePathList;
+			while ((ret = BLEFIDevicePathNextNode(&cursor, &node)) > 0) {
+				BLTestAssert(node.payload.bytes + node.payload.length <= copy + length);
+			}
+		} else {
+			// the description, or the path list it announces, isn't all there
+			BLTestAssert(length < b.length);
+		}
+		free(copy);
+	}
+}
+
+static void testMalformedNodes(void)
+{
+	Builder				b;
+	BLEFIDevicePathNode	node;
+	BLEFISpan			cursor;
+
+	// a node shorter than its own header would loop forever if accepted
+	b.length = 0;
+	putHeader(&b, kBLEFIDevicePathTypeMedia, kBLEFIDevicePathSubTypeFilePath, 2);
+	cursor.bytes = b.bytes;
+	cursor.length = b.length;
+	BLTestAssertEqual(BLEFIDevicePathNextNode(&cursor, &node), -1);
+
+	// and one longer than what's left
+	b.length = 0;
+	putHeader(&b, kBLEFIDevicePathTypeMedia, kBLEFIDevicePathSubTypeFilePath, 12);
+	put32(&b, 0);
+	cursor.bytes = b.bytes;
+	cursor.length = b.length;
+	BLTestAssertEqual(BLEFIDevicePathNextNode(&cursor, &node), -1);
+
+	// a hard drive node of the wrong size isn't one
+	b.length = 0;
+	putHeader(&b, kBLEFIDevicePathTypeMedia, kBLEFIDevicePathSubTypeHardDrive, 8);
+	put32(&b, 1);
+	cursor.bytes = b.bytes;
+	cursor.length = b.length;
+	BLTestAssertEqual(BLEFIDevicePathNextNode(&cursor, &node), 1);
+	{
+		BLEFIHardDriveNode hd;
+		BLTestAssert(BLEFIDecodeHardDriveNode(&node, &hd) != 0);
+	}
+}
+
+static void testNetworkNodes(void)
+{
+	Builder				b;
+	BLEFIDevicePathNode	node;
+	BLEFISpan			cursor;
+	BLEFIMACNode		mac;
+	BLEFIIPv4Node		ipv4;
+	int					i;
+
+	b.length = 0;
+	putHeader(&b, kBLEFIDevicePathTypeMessaging, kBLEFIDevicePathSubTypeMAC, 37);
+	for (i = 0; i < 32; i++) put8(&b, i < 6 ? 0xA0 + i : 0);
+	put8(&b, 1);
+	// the 19-byte IPv4 form, then the 27-byte one
+	putHeader(&b, kBLEFIDevicePathTypeMessaging, kBLEFIDevicePathSubTypeIPv4, 19);
+	put32(&b, 0x0100A8C0);
+	put32(&b, 0x0200A8C0);
+	put16(&b, 68);
+	put16(&b, 67);
+	put16(&b, 17);
+	put8(&b, 0);
+	putHeader(&b, kBLEFIDevicePathTypeMessaging, kBLEFIDevicePathSubTypeIPv4, 27);
+	put32(&b, 0x0100000A);
+	put32(&b, 0x0200000A);
+	put16(&b, 0);
+	put16(&b, 0);
+	put16(&b, 6);
+	put8(&b, 1);
+	put32(&b, 0xFE00000A);
+	put32(&b, 0x00FFFFFF);
+	putEnd(&b);
+
+	cursor.bytes = b.bytes;
+	cursor.length = b.length;
+
+	BLTestAssertEqual(BLEFIDevicePathNextNode(&cursor, &node), 1);
+	BLTestAssertEqual(BLEFIDecodeMACNode(&node, &mac), 0);
+	BLTestAssertEqual(mac.address[0], 0xA0);
+	BLTestAssertEqual(mac.address[5], 0xA5);
+	BLTestAssertEqual(mac.ifType, 1);
+
+	BLTestAssertEqual(BLEFIDevicePathNextNode(&cursor, &node), 1);
+	BLTestAssertEqual(BLEFIDecodeIPv4Node(&node, &ipv4), 0);
+	BLTestAssertEqual(ipv4.localAddress[0], 192);
+	BLTestAssertEqual(ipv4.remoteAddress[3], 2);
+	BLTestAssertEqual(ipv4.localPort, 68);
+	BLTestAssertEqual(ipv4.protocol, 17);
+	BLTestAssert(!ipv4.hasGatewayAndSubnet);
+
+	BLTestAssertEqual(BLEFIDevicePathNextNode(&cursor, &node), 1);
+	BLTestAssertEqual(BLEFIDecodeIPv4Node(&node, &ipv4), 0);
+	BLTestAssert(ipv4.hasGatewayAndSubnet);
+	BLTestAssertEqual(ipv4.staticAddress, 1);
+	BLTestAssertEqual(ipv4.gatewayAddress[3], 0xFE);
+	BLTestAssertEqual(ipv4.subnetMask[0], 0xFF);
+
+	BLTestAssertEqual(BLEFIDevicePathNextNode(&cursor, &node), 0);
+}
+
+static void testUTF16(void)
+{
+	// "é" (U+00E9), then U+1F600 as a surrogate pair, then "x"
+	const uint8_t	utf16[] = { 0xE9, 0x00, 0x3D, 0xD8, 0x00, 0xDE, 'x', 0x00 };
+	char			out[16];
+
+	BLTestAssertEqual(BLEFIUTF16ToUTF8(utf16, 4, out, sizeof out), 7);
+	BLTestAssertEqualStrings(out, "\xC3\xA9\xF0\x9F\x98\x80x");
+
+	// truncation never splits a character
+	BLTestAssertEqual(BLEFIUTF16ToUTF8(utf16, 4, out, 6), 2);
+	BLTestAssertEqualStrings(out, "\xC3\xA9");
+}
+
+// Decode thousands of synthetic options, the way --info --all-boot-options
+// walks a boot menu
+static void benchmark(void)
+{
+	enum { kOptions = 4096, kRounds = 200 };
+	Builder				*options;
+	char				path[256];
+	char				text[1024];
+	BLEFILoadOption		option;
+	BLEFIDevicePathNode	node;
+	BLEFIHardDriveNode	hd;
+	BLEFISpan			cursor;
+	uint64_t			start, bytes = 0;
+	size_t				checksum = 0;
+	int					i, round;
+
+	options = calloc(kOptions, sizeof(Builder));
+	for (i = 0; i < kOptions; i++) {
+		snprintf(path, sizeof path, "/System/Volumes/Preboot/%08X-%04X/System/Library/CoreServices/boot.efi",
+				 i * 2654435761u, i);
+		buildLoadOption(&options[i], i & 1 ? "Macintosh HD" : "Recovery", path, (uint8_t)i, NULL);
+		bytes += options[i].length;
+	}
+
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		for (i = 0; i < kOptions; i++) {
+			if (BLEFIParseLoadOption(options[i].bytes, options[i].length, &option)) abort();
+			checksum += BLEFIUTF16ToUTF8(option.description, option.descriptionChars, text, sizeof text);
+			cursor = option.filePathList;
+			while (BLEFIDevicePathNextNode(&cursor, &node) > 0) {
+				if (0 == BLEFIDecodeHardDriveNode(&node, &hd)) {
+					checksum += hd.partitionStart;
+				} else if (0 == BLEFIDecodeFilePathNode(&node, text, sizeof text)) {
+					checksum += text[0];
+				}
+			}
+		}
+	}
+	BLTestReport("decode load option", (uint64_t)kOptions * kRounds, BLTestNow() - start, bytes * kRounds);
+
+	if (checksum == 0) printf("(checksum %zu)\n", checksum);
+	free(options);
+}
+
+int main(int argc, char *argv[])
+{
+	if (getopt(argc, argv, "b") == 'b') {
+		benchmark();
+		return 0;
+	}
+
+	testLoadOption();
+	testTruncation();
+	testMalformedNodes();
+	testNetworkNodes();
+	testUTF16();
+
+	return BLTestFinish("BLEFIDevicePathTests");
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLEFIXMLScannerTests.c
+//
+//  Every fixture is scanned and also unserialized with IOCFUnserialize;
+//  whatever the scanner extracts has to match the CF object graph.
+//
+
+#include <unistd.h>
+#include <IOKit/IOCFUnserialize.h>
+
+#include "bless.h"
+#include "bless_private.h"
+#include "BLTest.h"
+
+// what bless writes to efi-boot-device and efi-boot-next, plus the
+// IOKit serializer's ID/IDREF sharing and escaped characters
+static const char *kFixtures[] = {
+	// BLCreateEFIXMLRepresentationForDevice
+	"<array><dict><key>IOMatch</key><dict><key>IOProviderClass</key><string>IOMedia</string>"
+	"<key>IOPropertyMatch</key><dict><key>UUID</key><string>6A3A5C0E-1A4F-4C39-9B5D-1D2F3E4A5B6C</string>"
+	"</dict></dict><key>BLLastBSDName</key><string>disk0s2</string></dict></array>",
+
+	// BLCreateEFIXMLRepresentationForPath, with an APFS volume UUID
+	"<array><dict><key>IOMatch</key><dict><key>IOProviderClass</key><string>IOMedia</string>"
+	"<key>IOPropertyMatch</key><dict><key>UUID</key><string>0F1E2D3C-4B5A-6978-8796-A5B4C3D2E1F0</string>"
+	"</dict></dict><key>BLLastBSDName</key><string>disk1s1</string>"
+	"<key>BLVolumeUUID</key><string>0F1E2D3C-4B5A-6978-8796-A5B4C3D2E1F0</string></dict>"
+	"<dict><key>IOEFIDevicePathType</key><string>MediaFilePath</string>"
+	"<key>Path</key><string>\\System\\Library\\CoreServices\\boot.efi</string></dict></array>",
+
+	// the same, as IOCFSerialize shares repeated values
+	"<array ID=\"0\"><dict ID=\"1\"><key>IOMatch</key><dict ID=\"2\"><key>IOProviderClass</key>"
+	"<string ID=\"3\">IOMedia</string><key>IOPropertyMatch</key><dict ID=\"4\"><key>UUID</key>"
+	"<string ID=\"5\">ABC-DEF</string></dict></dict><key>BLLastBSDName</key><string ID=\"6\">disk0s2</string>"
+	"<key>BLVolumeUUID</key><string IDREF=\"5\"/></dict><dict ID=\"7\"><key>IOEFIDevicePathType</key>"
+	"<string ID=\"8\">MediaFilePath</string><key>Path</key><string ID=\"9\">\\System\\a&amp;b&lt;c&gt;&quot;</string>"
+	"<key>IOEFIBootOption</key><data ID=\"10\">aGVsbG8=</data></dict></array>",
+
+	// BLCreateEFIXMLRepresentationForNetworkPath
+	"<array><dict><key>IOMatch</key><dict><key>BSD Name</key><string>en0</string></dict>"
+	"<key>BLLastBSDName</key><string>en0</string></dict></array>",
+
+	// a path longer than any fixed buffer the old code used
+	"<array><dict><key>IOMatch</key><dict><key>IOProviderClass</key><string>IOMedia</string></dict>"
+	"<key>BLLastBSDName</key><string>disk2s1</string></dict>"
+	"<dict><key>IOEFIDevicePathType</key><string>MediaFilePath</string>"
+	"<key>Path</key><string>\\System\\Library0\\Library1\\Library2\\Library3\\Library4\\Library5\\Library6\\Library7\\Library8\\Library9\\Library10\\Library11\\Library12\\Library13\\Library14\\Library15\\Library16\\Library17\\Library18\\Library19\\Library20\\Library21\\Library22\\Library23\\Library24\\Library25\\Library26\\Library27\\Library28\\Library29\\Library30\\Library31\\Library32\\Library33\\Library34\\Library35\\Library36\\Library37\\Library38\\Library39\\Library40\\Library41\\Library42\\Library43\\Library44\\Library45\\Library46\\Library47\\Library48\\Library49\\Library50\\Library51\\Library52\\Library53\\Library54\\Library55\\Library56\\Library57\\Library58\\Library59\\Library60\\Library61\\Library62\\Library63\\Library64\\Library65\\Library66\\Library67\\Library68\\Library69\\Library70\\Library71\\Library72\\Library73\\Library74\\Library75\\Library76\\Library77\\Library78\\Library79\\Library80\\Library81\\Library82\\Library83\\Library84\\Library85\\Library86\\Library87\\Library88\\Library89\\Library90\\Library91\\Library92\\Library93\\Library94\\Library95\\Library96\\Library97\\Library98\\Library99\\Library100\\Library101\\Library102\\Library103\\Library104\\Library105\\Library106\\Library107\\Library108\\Library109\\Library110\\Library111\\Library112\\Library113\\Library114\\Library115\\Library116\\Library117\\Library118\\Library119\\boot.efi</string></dict></array>",
+
+	// a raw boot option
+	"<array><dict><key>IOEFIBootOption</key><data>AQAAAB4ASABEAEQAAAB/Af8EAA==</data></dict></array>",
+};
+
+static const CFStringRef kKeys[kBLEFIXMLKeyCount] = {
+	CFSTR("IOMatch"),
+	CFSTR("BLVolumeUUID"),
+	CFSTR("BLLastBSDName"),
+	CFSTR("IOEFIDevicePathType"),
+	CFSTR("Path"),
+	CFSTR("IOEFIBootOption"),
+};
+
+static void compareElement(BLEFIXMLScanRef scan, CFIndex index, CFDictionaryRef expected)
+{
+	const BLEFIXMLElement	*element = BLEFIXMLScanGetElement(scan, index);
+	CFTypeRef				value;
+	char					buf[8192];
+	int						key;
+
+	BLTestAssert(element != NULL);
+	if (element == NULL) return;
+
+	for (key = 0; key < kBLEFIXMLKeyCount; key++) {
+		value = CFDictionaryGetValue(expected, kKeys[key]);
+
+		if (value == NULL) {
+			BLTestAssertEqual(element->values[key].type, kBLEFIXMLValueNone);
+		} else if (CFGetTypeID(value) == CFStringGetTypeID()) {
+			BLTestAssertEqual(element->values[key].type, kBLEFIXMLValueString);
+			BLTestAssert(CFStringGetCString(value, buf, sizeof buf, kCFStringEncodingUTF8));
+			BLTestAssertEqualStrings(BLEFIXMLElementGetString(element, key), buf);
+		} else if (CFGetTypeID(value) == CFDataGetTypeID()) {
+			BLTestAssertEqual(element->values[key].type, kBLEFIXMLValueData);
+			BLTestAssertEqual(element->values[key].length, CFDataGetLength(value));
+			BLTestAssert(memcmp(element->values[key].bytes, CFDataGetBytePtr(value),
+								element->values[key].length) == 0);
+		} else if (CFGetTypeID(value) == CFDictionaryGetTypeID()) {
+			CFDictionaryRef match = BLEFIXMLScanCopyMatchDictionary(NULL, scan, index);
+
+			BLTestAssertEqual(element->values[key].type, kBLEFIXMLValueDict);
+			BLTestAssert(match != NULL && CFEqual(match, value));
+			if (match) CFRelease(match);
+		}
+	}
+}
+
+static void testFixtures(void)
+{
+	size_t			i;
+	CFIndex			j;
+	CFStringRef		string;
+	CFArrayRef		expected;
+	BLEFIXMLScanRef	scan;
+
+	for (i = 0; i < sizeof(kFixtures) / sizeof(kFixtures[0]); i++) {
+		string = CFStringCreateWithCString(kCFAllocatorDefault, kFixtures[i], kCFStringEncodingUTF8);
+		expected = IOCFUnserialize(kFixtures[i], kCFAllocatorDefault, 0, NULL);
+		BLTestAssert(string != NULL && expected != NULL);
+		if (string == NULL || expected == NULL) continue;
+
+		BLTestAssertEqual(BLEFIXMLScanCreate(NULL, string, &scan), 0);
+		if (scan) {
+			BLTestAssertEqual(BLEFIXMLScanGetCount(scan), CFArrayGetCount(expected));
+			for (j = 0; j < CFArrayGetCount(expected) && j < BLEFIXMLScanGetCount(scan); j++) {
+				compareElement(scan, j, CFArrayGetValueAtIndex(expected, j));
+			}
+			BLEFIXMLScanRelease(scan);
+		}
+
+		CFRelease(expected);
+		CFRelease(string);
+	}
+}
+
+// not an array of dictionaries, or not well formed
+static void testRejects(void)
+{
+	static const char *bad[] = {
+		"<dict></dict>",
+		"<array><string>x</string></array>",
+		"<array><dict><key>IOMatch</key>",
+		"<array ID=\"0\"><dict ID=\"1\"><key>IOMatch</key><dict IDREF=\"9\"/></dict></array>",
+	};
+	CFStringRef		string;
+	BLEFIXMLScanRef	scan;
+	size_t			i;
+
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		string = CFStringCreateWithCString(kCFAllocatorDefault, bad[i], kCFStringEncodingUTF8);
+		BLTestAssert(BLEFIXMLScanCreate(NULL, string, &scan) != 0);
+		BLTestAssert(scan == NULL);
+		CFRelease(string);
+	}
+}
+
+// what --info needs from a boot device string: the BSD name, the volume
+// UUID and the path, scanned versus pulled out of the IOCFUnserialize graph
+static void benchmark(void)
+{
+	enum { kRounds = 20000 };
+	size_t			i;
+	int				round;
+	CFStringRef		strings[sizeof(kFixtures) / sizeof(kFixtures[0])];
+	BLEFIXMLScanRef	scan;
+	CFArrayRef		array;
+	uint64_t		start;
+	uintptr_t		checksum = 0;
+	char			buf[8192];
+
+	for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+		strings[i] = CFStringCreateWithCString(kCFAllocatorDefault, kFixtures[i], kCFStringEncodingUTF8);
+	}
+
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+			if (BLEFIXMLScanCreate(NULL, strings[i], &scan)) abort();
+			checksum += (uintptr_t)BLEFIXMLElementGetString(BLEFIXMLScanGetElement(scan, 0), kBLEFIXMLKeyLastBSDName);
+			checksum += (uintptr_t)BLEFIXMLElementGetString(BLEFIXMLScanGetElement(scan, 0), kBLEFIXMLKeyVolumeUUID);
+			checksum += (uintptr_t)BLEFIXMLElementGetString(BLEFIXMLScanGetElement(scan, BLEFIXMLScanGetCount(scan) - 1), kBLEFIXMLKeyPath);
+			BLEFIXMLScanRelease(scan);
+		}
+	}
+	BLTestReport("BLEFIXMLScanCreate", (uint64_t)kRounds * i, BLTestNow() - start, 0);
+
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+			CFDictionaryRef	dict;
+			CFStringRef		value;
+			CFStringRef		keys[] = { CFSTR("BLLastBSDName"), CFSTR("BLVolumeUUID") };
+			int				k;
+
+			// the old path: copy out, unserialize everything, then look
+			if (!CFStringGetCString(strings[i], buf, sizeof buf, kCFStringEncodingUTF8)) abort();
+			array = IOCFUnserialize(buf, kCFAllocatorDefault, 0, NULL);
+			if (array == NULL) abort();
+			dict = CFArrayGetValueAtIndex(array, 0);
+			for (k = 0; k < 2; k++) {
+				value = CFDictionaryGetValue(dict, keys[k]);
+				if (value) checksum += CFStringGetCString(value, buf, sizeof buf, kCFStringEncodingUTF8);
+			}
+			dict = CFArrayGetValueAtIndex(array, CFArrayGetCount(array) - 1);
+			value = CFDictionaryGetValue(dict, CFSTR("Path"));
+			if (value) checksum += CFStringGetCString(value, buf, sizeof buf, kCFStringEncodingUTF8);
+			CFRelease(array);
+		}
+	}
+	BLTestReport("IOCFUnserialize", (uint64_t)kRounds * i, BLTestNow() - start, 0);
+
+	if (checksum == 0) printf("(checksum %lu)\n", (unsigned long)checksum);
+	for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+		CFRelease(strings[i]);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (getopt(argc, argv, "b") == 'b') {
+		benchmark();
+		return 0;
+	}
+
+	testFixtures();
+	testRejects();
+
+	return BLTestFinish("BLEFIXMLScannerTests");
+}
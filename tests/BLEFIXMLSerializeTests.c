@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLEFIXMLSerializeTests.c
+//
+//  Golden comparisons for the boot device strings bless writes: the
+//  arrays the BLCreateEFIXMLRepresentation* functions build are turned
+//  into strings by BLEFIXMLCopySerializedString, and the result has to
+//  be byte for byte what IOCFSerialize produced.
+//
+
+#include <unistd.h>
+#include <IOKit/IOCFSerialize.h>
+#include <IOKit/IOCFUnserialize.h>
+
+#include "bless.h"
+#include "bless_private.h"
+#include "BLTest.h"
+
+// both helpers take over the values they are given (constant strings
+// and booleans are never freed, so releasing them is harmless)
+static CFDictionaryRef createDict(CFTypeRef keysAndValues[], int count)
+{
+	CFMutableDictionaryRef	dict;
+	int						i;
+
+	dict = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks,
+									 &kCFTypeDictionaryValueCallBacks);
+	for (i = 0; i < count; i += 2) {
+		CFDictionaryAddValue(dict, keysAndValues[i], keysAndValues[i + 1]);
+		CFRelease(keysAndValues[i + 1]);
+	}
+	return dict;
+}
+#define DICT(...) createDict((CFTypeRef[]){ __VA_ARGS__ }, \
+	sizeof((CFTypeRef[]){ __VA_ARGS__ }) / sizeof(CFTypeRef))
+
+static CFArrayRef createArray(CFTypeRef values[], int count)
+{
+	CFArrayRef	array;
+	int			i;
+
+	array = CFArrayCreate(kCFAllocatorDefault, values, count, &kCFTypeArrayCallBacks);
+	for (i = 0; i < count; i++) {
+		CFRelease(values[i]);
+	}
+	return array;
+}
+#define ARRAY(...) createArray((CFTypeRef[]){ __VA_ARGS__ }, \
+	sizeof((CFTypeRef[]){ __VA_ARGS__ }) / sizeof(CFTypeRef))
+
+#define kFilePath(path)	DICT(CFSTR("IOEFIDevicePathType"), CFSTR("MediaFilePath"), CFSTR("Path"), CFSTR(path))
+#define kBootOption(s)	DICT(CFSTR("IOEFIBootOption"), CFSTR(s))
+
+// the layouts of BLCreateEFIXMLRepresentationForPath, ...ForDevice and ...ForNetworkPath
+static CFArrayRef createFixture(int which)
+{
+	static const UInt8	mac[] = { 0x00, 0x1c, 0x42, 0xa3, 0x5e, 0x01 };
+	CFArrayRef			array = NULL;
+	CFDataRef			macData;
+	CFDictionaryRef		match;
+
+	switch (which) {
+		case 0:	// partition UUID, short form, with a path and boot option
+			match = DICT(CFSTR("IOProviderClass"), CFSTR("IOMedia"),
+						 CFSTR("IOPropertyMatch"), DICT(CFSTR("UUID"), CFSTR("6A3A5C0E-1A4F-4C39-9B5D-1D2F3E4A5B6C")));
+			array = ARRAY(DICT(CFSTR("IOMatch"), match,
+							   CFSTR("BLLastBSDName"), CFSTR("disk0s2"),
+							   CFSTR("IOEFIShortForm"), kCFBooleanTrue),
+						  kFilePath("\\System\\Library\\CoreServices\\boot.efi"),
+						  kBootOption("-v debug=0x144"));
+			break;
+		case 1:	// BSD name match with a volume UUID hint
+			match = DICT(CFSTR("IOProviderClass"), CFSTR("IOMedia"), CFSTR("BSD Name"), CFSTR("disk3s1"));
+			array = ARRAY(DICT(CFSTR("IOMatch"), match,
+							   CFSTR("BLVolumeUUID"), CFSTR("0F1E2D3C-4B5A-6978-8796-A5B4C3D2E1F0")));
+			break;
+		case 2:	// registry path match
+			match = DICT(CFSTR("IOProviderClass"), CFSTR("IOMedia"),
+						 CFSTR("IOPathMatch"), CFSTR("IODeviceTree:/PCI0@0/SATA@1f,2/PRT0@0/PMP@0/@0:2"));
+			array = ARRAY(DICT(CFSTR("IOMatch"), match,
+							   CFSTR("BLVolumeUUID"), CFSTR("0F1E2D3C-4B5A-6978-8796-A5B4C3D2E1F0"),
+							   CFSTR("BLLastBSDName"), CFSTR("disk0s2")),
+						  kFilePath("\\EFI\\BOOT\\BOOTX64.EFI"));
+			break;
+		case 3:	// network, PXE
+			macData = CFDataCreate(kCFAllocatorDefault, mac, sizeof mac);
+			match = DICT(CFSTR("IOProviderClass"), CFSTR("IONetworkInterface"), CFSTR("BSD Name"), CFSTR("en0"));
+			array = ARRAY(DICT(CFSTR("IOMatch"), match, CFSTR("BLMACAddress"), macData),
+						  DICT(CFSTR("IOEFIDevicePathType"), CFSTR("MessagingIPv4"),
+							   CFSTR("RemoteIpAddress"), CFSTR("10.0.1.5")),
+						  kFilePath("\\tftpboot\\boot.efi"),
+						  DICT(CFSTR("IOEFIDevicePathType"), CFSTR("MessagingNetbootProtocol"),
+							   CFSTR("Protocol"), CFSTR("FE3913DB-9AEE-4E40-A294-ABBE93A1A4B7")));
+			break;
+		case 4:	// characters that need escaping, and non-ASCII
+			match = DICT(CFSTR("IOProviderClass"), CFSTR("IOMedia"), CFSTR("BSD Name"), CFSTR("disk1s1"));
+			array = ARRAY(DICT(CFSTR("IOMatch"), match, CFSTR("BLLastBSDName"), CFSTR("disk1s1")),
+						  kFilePath("\\Tom & Jerry\\<boot>\\\"caf\xc3\xa9\".efi"),
+						  kBootOption("a&b<c>d"));
+			break;
+	}
+	return array;
+}
+#define kFixtureCount 5
+
+static void testGolden(void)
+{
+	CFArrayRef	array, roundTrip;
+	CFDataRef	golden;
+	CFStringRef	xmlString;
+	char		buf[4096];
+	size_t		goldenLength;
+	int			i;
+
+	for (i = 0; i < kFixtureCount; i++) {
+		array = createFixture(i);
+		golden = IOCFSerialize(array, 0);
+		BLTestAssert(golden != NULL);
+
+		BLTestAssertEqual(BLEFIXMLCopySerializedString(NULL, array, &xmlString), 0);
+		BLTestAssert(xmlString != NULL);
+		if (golden == NULL || xmlString == NULL) continue;
+
+		goldenLength = strnlen((const char *)CFDataGetBytePtr(golden), CFDataGetLength(golden));
+		BLTestAssert(CFStringGetCString(xmlString, buf, sizeof buf, kCFStringEncodingUTF8));
+		BLTestAssertEqual(strlen(buf), goldenLength);
+		BLTestAssert(memcmp(buf, CFDataGetBytePtr(golden), goldenLength) == 0);
+
+		// and it has to read back as the array it came from
+		roundTrip = IOCFUnserialize(buf, kCFAllocatorDefault, 0, NULL);
+		BLTestAssert(roundTrip != NULL && CFEqual(roundTrip, array));
+
+		if (roundTrip) CFRelease(roundTrip);
+		CFRelease(xmlString);
+		CFRelease(golden);
+		CFRelease(array);
+	}
+}
+
+// what every BLCreateEFIXMLRepresentation* function used to do after IOCFSerialize
+static CFStringRef copyWithCString(CFArrayRef array)
+{
+	CFDataRef	xmlData = IOCFSerialize(array, 0);
+	CFIndex		count = CFDataGetLength(xmlData);
+	UInt8		*outBuffer = calloc(count + 1, sizeof(char));
+	CFStringRef	xmlString;
+
+	memcpy(outBuffer, CFDataGetBytePtr(xmlData), count);
+	CFRelease(xmlData);
+	xmlString = CFStringCreateWithCString(kCFAllocatorDefault, (const char *)outBuffer, kCFStringEncodingUTF8);
+	free(outBuffer);
+	return xmlString;
+}
+
+static void benchmark(void)
+{
+	enum { kRounds = 20000 };
+	CFArrayRef	arrays[kFixtureCount];
+	CFStringRef	xmlString;
+	uint64_t	start;
+	int			i, round;
+
+	for (i = 0; i < kFixtureCount; i++) {
+		arrays[i] = createFixture(i);
+	}
+
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		for (i = 0; i < kFixtureCount; i++) {
+			xmlString = copyWithCString(arrays[i]);
+			CFRelease(xmlString);
+		}
+	}
+	BLTestReport("IOCFSerialize, calloc copy", (uint64_t)kRounds * kFixtureCount, BLTestNow() - start, 0);
+
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		for (i = 0; i < kFixtureCount; i++) {
+			if (BLEFIXMLCopySerializedString(NULL, arrays[i], &xmlString)) abort();
+			CFRelease(xmlString);
+		}
+	}
+	BLTestReport("BLEFIXMLCopySerializedString", (uint64_t)kRounds * kFixtureCount, BLTestNow() - start, 0);
+
+	for (i = 0; i < kFixtureCount; i++) {
+		CFRelease(arrays[i]);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (getopt(argc, argv, "b") == 'b') {
+		benchmark();
+		return 0;
+	}
+
+	testGolden();
+
+	return BLTestFinish("BLEFIXMLSerializeTests");
+}
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+//
+//  BLElToritoCatalogTests.c
+//
+//  .iso images are built here sector by sector: primary volume
+//  descriptor, boot record, and a boot catalog with an x86 section and
+//  an EFI section whose bootable entry carries extension records. Each
+//  test then damages one part of it.
+//
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "BLElToritoCatalog.h"
+#include "BLTest.h"
+
+#define kImageSectors	64
+#define kCatalogSector	19
+#define kEFIImageSector	40
+
+typedef struct {
+	uint8_t		bytes[kImageSectors * kBLElToritoSectorSize];
+	size_t		length;
+} Image;
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v & 0xFFFF);
+	put16(p + 2, v >> 16);
+}
+
+static uint8_t *sector(Image *image, uint32_t n)
+{
+	return image->bytes + (size_t)n * kBLElToritoSectorSize;
+}
+
+static uint8_t *record(Image *image, uint32_t n)
+{
+	return sector(image, kCatalogSector) + 32 * n;
+}
+
+static void fixChecksum(Image *image)
+{
+	uint8_t		*ve = record(image, 0);
+	uint16_t	sum = 0;
+	int			i;
+
+	put16(ve + 28, 0);
+	for (i = 0; i < 32; i += 2) {
+		sum += (uint16_t)(ve[i] | (ve[i + 1] << 8));
+	}
+	put16(ve + 28, (uint16_t)-sum);
+}
+
+static void buildImage(Image *image)
+{
+	uint8_t	*p;
+
+	memset(image, 0, sizeof(*image));
+	image->length = sizeof(image->bytes);
+
+	p = sector(image, 16);
+	p[0] = 1;
+	memcpy(p + 1, "CD001", 5);
+	p[6] = 1;
+	put32(p + 80, kImageSectors);
+	p[84] = 0; p[85] = 0; p[86] = 0; p[87] = kImageSectors;
+
+	p = sector(image, 17);
+	p[0] = 0;
+	memcpy(p + 1, "CD001", 5);
+	p[6] = 1;
+	memcpy(p + 7, "EL TORITO SPECIFICATION", 23);
+	put32(p + 71, kCatalogSector);
+
+	// validation entry (x86) and the default entry
+	p = record(image, 0);
+	p[0] = 1;
+	p[1] = 0;
+	memcpy(p + 4, "bless", 5);
+	p[30] = 0x55;
+	p[31] = 0xaa;
+	fixChecksum(image);
+
+	p = record(image, 1);
+	p[0] = 0x88;
+	put16(p + 6, 4);
+	put32(p + 8, 30);
+
+	// an x86 section with one entry
+	p = record(image, 2);
+	p[0] = 0x90;
+	p[1] = 0;
+	put16(p + 2, 1);
+	p = record(image, 3);
+	p[0] = 0x88;
+	put32(p + 8, 32);
+
+	// the final section, for EFI: a non-bootable entry, then a bootable
+	// one followed by two extension records
+	p = record(image, 4);
+	p[0] = 0x91;
+	p[1] = 0xEF;
+	put16(p + 2, 2);
+	p = record(image, 5);
+	p[0] = 0x00;
+	put32(p + 8, 36);
+	p = record(image, 6);
+	p[0] = 0x88;
+	p[1] = 0x20;
+	put16(p + 6, 8);
+	put32(p + 8, kEFIImageSector);
+	p = record(image, 7);
+	p[0] = 0x44;
+	p[1] = 0x20;
+	p = record(image, 8);
+	p[0] = 0x44;
+}
+
+static void testImage(void)
+{
+	Image					image;
+	BLElToritoCatalog		*catalog;
+	BLElToritoUEFIRegion	region;
+
+	buildImage(&image);
+	BLTestAssertEqual(BLElToritoCatalogCreateWithImage(image.bytes, image.length, &catalog), 0);
+	if (catalog == NULL) return;
+
+	BLTestAssertEqual(catalog->volumeSpaceSize, kImageSectors);
+	BLTestAssertEqual(catalog->bootCatalogSector, kCatalogSector);
+	BLTestAssert(catalog->checksumValid);
+	BLTestAssert(catalog->complete);
+	BLTestAssertEqual(catalog->entryCount, 9);
+	BLTestAssertEqual(catalog->entries[1].type, kBLElToritoEntryDefault);
+	BLTestAssertEqual(catalog->entries[1].count, 4);
+	BLTestAssertEqual(catalog->entries[1].loadRBA, 30);
+	BLTestAssertEqual(catalog->entries[4].type, kBLElToritoEntryHeader);
+	BLTestAssertEqual(catalog->entries[4].count, 2);
+	BLTestAssertEqual(catalog->entries[6].type, kBLElToritoEntrySection);
+	BLTestAssertEqual(catalog->entries[6].header, 4);
+	BLTestAssertEqual(catalog->entries[6].bootEntry, 3);
+	BLTestAssertEqual(catalog->entries[8].type, kBLElToritoEntryExtension);
+	BLTestAssertEqual(catalog->entries[8].platformID, 0xEF);
+
+	BLTestAssertEqual(BLElToritoCatalogGetUEFIRegion(catalog, &region), 0);
+	BLTestAssert(region.found);
+	BLTestAssertEqual(region.bootEntry, 3);
+	BLTestAssertEqual(region.offset, kEFIImageSector);
+	BLTestAssertEqual(region.size, kImageSectors - kEFIImageSector);
+	BLTestAssertEqual(region.platformCount, 2);
+	BLTestAssertEqual(region.platformIDs[0], 0);
+	BLTestAssertEqual(region.platformIDs[1], 0xEF);
+
+	BLElToritoCatalogRelease(catalog);
+}
+
+// each case damages the image, and expects this from BLElToritoCatalogCreateWithImage
+// and then (if that succeeded) from BLElToritoCatalogGetUEFIRegion
+static void testDamage(void)
+{
+	Image					image;
+	BLElToritoCatalog		*catalog;
+	BLElToritoUEFIRegion	region;
+	int						which, ret;
+
+	for (which = 0; which < 9; which++) {
+		int		expectCreate = 0, expectRegion = 0;
+		bool	expectFound = false;
+
+		buildImage(&image);
+		switch (which) {
+			case 0:		// not ISO 9660
+				memcpy(sector(&image, 16) + 1, "CD002", 5);
+				expectCreate = 1;
+				break;
+			case 1:		// no boot record
+				sector(&image, 17)[0] = 2;
+				expectCreate = 1;
+				break;
+			case 2:		// catalog past the end of the image
+				put32(sector(&image, 17) + 71, kImageSectors);
+				expectCreate = 2;
+				break;
+			case 3:		// no validation entry keys
+				record(&image, 0)[30] = 0;
+				expectCreate = 2;
+				break;
+			case 4:		// the checksum is reported, not enforced
+				record(&image, 0)[4] = 'B';
+				expectFound = true;
+				break;
+			case 5:		// damage before the EFI section
+				record(&image, 4)[0] = 0x42;
+				expectRegion = 2;
+				break;
+			case 6:		// damage after the bootable entry
+				record(&image, 8)[0] = 0;
+				expectFound = true;
+				break;
+			case 7:		// EFI image past the end of the volume
+				put32(record(&image, 6) + 8, kImageSectors);
+				expectRegion = 2;
+				break;
+			case 8:		// image shorter than the descriptors
+				image.length = 17 * kBLElToritoSectorSize;
+				expectCreate = 1;
+				break;
+		}
+
+		ret = BLElToritoCatalogCreateWithImage(image.bytes, image.length, &catalog);
+		if (ret != expectCreate) {
+			fprintf(stderr, "damage case %d: create returned %d, expected %d\n", which, ret, expectCreate);
+			gBLTestFailures++;
+		}
+		if (catalog == NULL) continue;
+
+		if (which == 4) BLTestAssert(!catalog->checksumValid);
+		if (which == 5 || which == 6) BLTestAssert(!catalog->complete);
+
+		ret = BLElToritoCatalogGetUEFIRegion(catalog, &region);
+		if (ret != expectRegion || region.found != expectFound) {
+			fprintf(stderr, "damage case %d: region returned %d, found %d\n", which, ret, region.found);
+			gBLTestFailures++;
+		}
+		BLElToritoCatalogRelease(catalog);
+	}
+}
+
+// section counts and extension chains that run off the end of the bytes
+static void testBounds(void)
+{
+	Image				image;
+	BLElToritoCatalog	*catalog;
+	size_t				length;
+
+	buildImage(&image);
+	for (length = 0; length <= 9 * 32; length += 16) {
+		int ret = BLElToritoCatalogCreate(kImageSectors, kCatalogSector, record(&image, 0), length, &catalog);
+
+		BLTestAssertEqual(ret, length < 64 ? 2 : 0);
+		if (catalog == NULL) continue;
+		BLTestAssertEqual(catalog->complete, length == 9 * 32);
+		BLTestAssert(catalog->entryCount <= length / 32);
+		BLElToritoCatalogRelease(catalog);
+	}
+}
+
+static void testFile(void)
+{
+	Image					image;
+	BLElToritoUEFIRegion	region;
+	char					path[] = "/tmp/BLElToritoCatalogTests.XXXXXX";
+	int						fd;
+
+	buildImage(&image);
+	fd = mkstemp(path);
+	BLTestAssert(fd >= 0);
+	if (fd < 0) return;
+
+	BLTestAssertEqual(write(fd, image.bytes, image.length), image.length);
+	BLTestAssertEqual(BLElToritoFindUEFIInFile(path, &region), 0);
+	BLTestAssert(region.found);
+	BLTestAssertEqual(region.offset, kEFIImageSector);
+
+	// truncated to the descriptors: the catalog sector is past the end
+	BLTestAssertEqual(ftruncate(fd, 18 * kBLElToritoSectorSize), 0);
+	BLTestAssertEqual(BLElToritoFindUEFIInFile(path, &region), 2);
+
+	BLTestAssertEqual(ftruncate(fd, 0), 0);
+	BLTestAssertEqual(BLElToritoFindUEFIInFile(path, &region), 1);
+
+	close(fd);
+	unlink(path);
+
+	BLTestAssertEqual(BLElToritoFindUEFIInFile(path, &region), 3);
+	BLTestAssertEqual(errno, ENOENT);
+}
+
+static void benchmark(void)
+{
+	enum { kRounds = 200000 };
+	Image					image;
+	BLElToritoCatalog		*catalog;
+	BLElToritoUEFIRegion	region;
+	uint64_t				start, found = 0;
+	int						round;
+
+	buildImage(&image);
+
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		if (BLElToritoCatalogCreateWithImage(image.bytes, image.length, &catalog)) abort();
+		if (BLElToritoCatalogGetUEFIRegion(catalog, &region)) abort();
+		found += region.found;
+		BLElToritoCatalogRelease(catalog);
+	}
+	BLTestReport("BLElToritoCatalogCreateWithImage", kRounds, BLTestNow() - start, 0);
+
+	if (found != kRounds) abort();
+}
+
+int main(int argc, char *argv[])
+{
+	if (getopt(argc, argv, "b") == 'b') {
+		benchmark();
+		return 0;
+	}
+
+	testImage();
+	testDamage();
+	testBounds();
+	testFile();
+
+	return BLTestFinish("BLElToritoCatalogTests");
+}
@@ -0,0 +1,567 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+//
+//  BLHFSCatalogTests.c
+//
+//  An HFS+ volume with a small, known tree is built block by block, its
+//  catalog spread over several leaf nodes, and written to a temporary
+//  image. BLUpdateBooter finds and rewrites files in it, which are then
+//  read back and checked by hand, and the catalog index resolves IDs in
+//  it to paths.
+//
+
+#include <sys/param.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "bless.h"
+#include "bless_private.h"
+#include "BLTest.h"
+
+#define kBlockSize		4096
+#define kBlocks			64
+#define kNodeSize		1024
+#define kCatalogBlock	3		// two blocks, eight nodes
+#define kCatalogNodes	8
+#define kImageSize		(kBlocks * kBlockSize)
+#define kFill			0xAA	// what every data fork starts out holding
+
+#define kBootXType		0x74627869	// 'tbxi'
+#define kBootXCreator	0x63687270	// 'chrp'
+
+// the tree: / holds System/Library/CoreServices and Other
+enum {
+	kRootID			= 2,
+	kSystemID		= 16,
+	kLibraryID		= 17,
+	kCoreServicesID	= 18,
+	kOtherID		= 19,
+	kBootXID		= 20,		// in CoreServices
+	kBootEFIID		= 21,		// in CoreServices
+	kOtherBootXID	= 22,		// in Other, with the same name, type and creator
+	kCafeID			= 24,		// in /, not ASCII
+	kSlashID		= 25,		// in /, "a/b"
+	kOrphanID		= 30,		// a thread whose parent is nowhere
+	kMaxID			= 32
+};
+
+typedef struct {
+	uint32_t	parentID;
+	const char	*name;		// UTF-8, "" for a thread
+	int16_t		type;		// 1 folder, 2 file, 3 folder thread, 4 file thread
+	uint32_t	id;			// the folder or file; for a thread, its parent
+	const char	*threadName;
+	uint32_t	fileType;
+	uint32_t	startBlock;	// first of a file's blocks
+	uint32_t	blocks;
+} Record;
+
+// in key order: parent ID, then name
+static const Record kRecords[] = {
+	{ 1,				"Test",			1, kRootID },
+	{ kRootID,			"",				3, 1,				"Test" },
+	{ kRootID,			"a/b",			2, kSlashID,		NULL,	0,				14, 1 },
+	{ kRootID,			"Caf\xC3\xA9",	2, kCafeID,			NULL,	0,				15, 1 },
+	{ kRootID,			"Other",		1, kOtherID },
+	{ kRootID,			"System",		1, kSystemID },
+	{ kSystemID,		"",				3, kRootID,			"System" },
+	{ kSystemID,		"Library",		1, kLibraryID },
+	{ kLibraryID,		"",				3, kSystemID,		"Library" },
+	{ kLibraryID,		"CoreServices",	1, kCoreServicesID },
+	{ kCoreServicesID,	"",				3, kLibraryID,		"CoreServices" },
+	{ kCoreServicesID,	"boot.efi",		2, kBootEFIID,		NULL,	0,				12, 1 },
+	{ kCoreServicesID,	"BootX",		2, kBootXID,		NULL,	kBootXType,		10, 2 },
+	{ kOtherID,			"",				3, kRootID,			"Other" },
+	{ kOtherID,			"BootX",		2, kOtherBootXID,	NULL,	kBootXType,		13, 1 },
+	{ kBootXID,			"",				4, kCoreServicesID,	"BootX" },
+	{ kBootEFIID,		"",				4, kCoreServicesID,	"boot.efi" },
+	{ kOtherBootXID,	"",				4, kOtherID,		"BootX" },
+	{ kCafeID,			"",				4, kRootID,			"Caf\xC3\xA9" },
+	{ kSlashID,			"",				4, kRootID,			"a/b" },
+	{ kOrphanID,		"",				4, 31,				"orphan" },
+};
+
+typedef struct {
+	uint8_t		bytes[kImageSize];
+	off_t		fileRecords[kMaxID];	// of each file record, within the image
+	char		path[64];
+} Image;
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v & 0xFF;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v >> 16);
+	put16(p + 2, v & 0xFFFF);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void putFork(uint8_t *fork, uint64_t logicalSize, uint32_t startBlock, uint32_t blocks)
+{
+	put32(fork, (uint32_t)(logicalSize >> 32));
+	put32(fork + 4, (uint32_t)logicalSize);
+	put32(fork + 12, blocks);
+	put32(fork + 16, startBlock);
+	put32(fork + 20, blocks);
+}
+
+// UTF-8 to UTF-16BE, for the names above; returns the length in units
+static uint16_t putName(uint8_t *p, const char *name)
+{
+	const uint8_t	*s = (const uint8_t *)name;
+	uint16_t		length = 0;
+	uint16_t		c;
+
+	while (*s) {
+		if (*s < 0x80) {
+			c = *s++;
+		} else {
+			c = (uint16_t)((s[0] & 0x1F) << 6 | (s[1] & 0x3F));
+			s += 2;
+		}
+		put16(p + 2 * length++, c);
+	}
+	return length;
+}
+
+// key and record at node + offset; returns the offset past them
+static size_t putRecord(Image *image, uint8_t *node, size_t offset, const Record *record)
+{
+	uint8_t		*key = node + offset;
+	uint8_t		*data;
+	uint16_t	nameLength;
+	size_t		length;
+
+	nameLength = putName(key + 8, record->name);
+	put16(key, 6 + 2 * nameLength);
+	put32(key + 2, record->parentID);
+	put16(key + 6, nameLength);
+	data = key + 8 + 2 * nameLength;
+
+	put16(data, record->type);
+	switch (record->type) {
+		case 1:
+			put32(data + 8, record->id);
+			length = 88;
+			break;
+		case 2:
+			put32(data + 8, record->id);
+			put32(data + 48, record->fileType);
+			put32(data + 52, record->fileType ? kBootXCreator : 0);
+			putFork(data + 88, (uint64_t)record->blocks * kBlockSize - 100, record->startBlock, record->blocks);
+			image->fileRecords[record->id] = data - image->bytes;
+			length = 248;
+			break;
+		default:
+			put32(data + 4, record->id);
+			nameLength = putName(data + 10, record->threadName);
+			put16(data + 8, nameLength);
+			length = 10 + 2 * (size_t)nameLength;
+			break;
+	}
+
+	return (data - node) + length;
+}
+
+static size_t recordLength(const Record *record)
+{
+	uint8_t	scratch[520];
+	size_t	dataLength;
+
+	switch (record->type) {
+		case 1:		dataLength = 88; break;
+		case 2:		dataLength = 248; break;
+		default:	dataLength = 10 + 2 * (size_t)putName(scratch, record->threadName); break;
+	}
+	return 8 + 2 * (size_t)putName(scratch, record->name) + dataLength;
+}
+
+// a leaf holding count records, whose offsets end with that of its free space
+static void closeLeaf(uint8_t *node, const uint16_t *offsets, uint16_t count)
+{
+	uint16_t	i;
+
+	node[8] = 0xFF;
+	node[9] = 1;
+	put16(node + 10, count);
+	for (i = 0; i <= count; i++) put16(node + kNodeSize - 2 * (i + 1), offsets[i]);
+}
+
+/*
+ * Blocks 0-4 hold the headers, the allocation file, an empty extents
+ * overflow tree and the catalog; each file's data fork is filled with
+ * kFill. The catalog's leaves are chained from node 1 on, holding as
+ * many records each as fit.
+ */
+static void buildImage(Image *image, uint32_t attributes)
+{
+	uint8_t		*vh = image->bytes + 1024;
+	uint8_t		*catalog = image->bytes + kCatalogBlock * kBlockSize;
+	uint8_t		*node, *header;
+	uint16_t	offsets[32];
+	uint16_t	count = 0;
+	size_t		offset = 14, i;
+	uint32_t	leaf = 1, block;
+
+	memset(image, 0, sizeof *image);
+
+	put16(vh, kBLHFSPlusSigWord);
+	put16(vh + 2, 4);
+	put32(vh + 4, attributes);
+	put32(vh + 40, kBlockSize);
+	put32(vh + 44, kBlocks);
+	put32(vh + 48, kBlocks - 14);
+	putFork(vh + 112, kBlockSize, 1, 1);
+	putFork(vh + 192, kBlockSize, 2, 1);
+	putFork(vh + 272, 2 * kBlockSize, kCatalogBlock, 2);
+	memcpy(image->bytes + kImageSize - 1024, vh, 512);
+
+	for (block = 0; block < 5; block++) image->bytes[kBlockSize + block / 8] |= 0x80 >> (block % 8);
+	for (block = 10; block < 16; block++) {
+		image->bytes[kBlockSize + block / 8] |= 0x80 >> (block % 8);
+		memset(image->bytes + block * kBlockSize, kFill, kBlockSize);
+	}
+
+	// empty extents overflow tree
+	header = image->bytes + 2 * kBlockSize;
+	header[8] = 1;
+	put16(header + 10, 3);
+	put16(header + 14 + 18, kBlockSize);
+	put32(header + 14 + 22, 1);
+	put16(header + kBlockSize - 2, 14);
+
+	node = catalog + leaf * kNodeSize;
+	for (i = 0; i < sizeof(kRecords) / sizeof(kRecords[0]); i++) {
+		// room for this record, and for the offsets of all of them and the free space
+		if (offset + recordLength(&kRecords[i]) + 2 * (count + 2) > kNodeSize) {
+			offsets[count] = (uint16_t)offset;
+			closeLeaf(node, offsets, count);
+			put32(node, leaf + 1);
+			node = catalog + ++leaf * kNodeSize;
+			count = 0;
+			offset = 14;
+		}
+		offsets[count++] = (uint16_t)offset;
+		offset = putRecord(image, node, offset, &kRecords[i]);
+	}
+	offsets[count] = (uint16_t)offset;
+	closeLeaf(node, offsets, count);
+
+	// header: depth, root, leaf records, first and last leaf, node size, total nodes
+	header = catalog;
+	header[8] = 1;
+	put16(header + 10, 3);
+	put16(header + 14, 1);
+	put32(header + 14 + 2, 1);
+	put32(header + 14 + 6, sizeof(kRecords) / sizeof(kRecords[0]));
+	put32(header + 14 + 10, 1);
+	put32(header + 14 + 14, leaf);
+	put16(header + 14 + 18, kNodeSize);
+	put32(header + 14 + 22, kCatalogNodes);
+	put16(header + kNodeSize - 2, 14);
+}
+
+// volume geometry is cached by node and mtime, so each image gets its own mtime
+static int writeImage(Image *image)
+{
+	static time_t	stamp = 1000000000;
+	struct timespec	times[2];
+	int				fd;
+
+	snprintf(image->path, sizeof image->path, "/tmp/BLHFSCatalogTests.XXXXXX");
+	fd = mkstemp(image->path);
+	if (fd < 0) return -1;
+
+	times[0].tv_sec = times[1].tv_sec = ++stamp;
+	times[0].tv_nsec = times[1].tv_nsec = 0;
+	if (write(fd, image->bytes, kImageSize) != kImageSize || futimens(fd, times) < 0) {
+		close(fd);
+		unlink(image->path);
+		return -1;
+	}
+
+	close(fd);
+	return 0;
+}
+
+static int readImage(Image *image)
+{
+	int	fd;
+	int	ret;
+
+	fd = open(image->path, O_RDONLY);
+	if (fd < 0) return -1;
+	ret = pread(fd, image->bytes, kImageSize, 0) == kImageSize ? 0 : -1;
+	close(fd);
+
+	return ret;
+}
+
+static CFDataRef createPayload(size_t length, uint8_t seed)
+{
+	uint8_t		*bytes = malloc(length);
+	CFDataRef	data;
+	size_t		i;
+
+	for (i = 0; i < length; i++) bytes[i] = (uint8_t)(seed + i * 7);
+	data = CFDataCreate(kCFAllocatorDefault, bytes, length);
+	free(bytes);
+
+	return data;
+}
+
+// the fork holds payload, then zeros to the end of its sector, then what was there
+static void checkData(const Image *image, uint32_t startBlock, uint32_t blocks, CFDataRef payload)
+{
+	const uint8_t	*fork = image->bytes + startBlock * kBlockSize;
+	size_t			length = CFDataGetLength(payload);
+	size_t			i;
+
+	BLTestAssert(memcmp(fork, CFDataGetBytePtr(payload), length) == 0);
+	for (i = length; i < roundup(length, 512); i++) {
+		if (fork[i] != 0) break;
+	}
+	BLTestAssertEqual(i, roundup(length, 512));
+	for (i = roundup(length, 512); i < blocks * kBlockSize; i++) {
+		if (fork[i] != kFill) break;
+	}
+	BLTestAssertEqual(i, blocks * kBlockSize);
+}
+
+static void checkUnchanged(const Image *image, uint32_t fileID, uint32_t startBlock, uint32_t blocks)
+{
+	const uint8_t	*record = image->bytes + image->fileRecords[fileID];
+	uint32_t		i;
+
+	BLTestAssertEqual(get32(record + 88 + 4), blocks * kBlockSize - 100);
+	for (i = 0; i < blocks * kBlockSize; i++) {
+		if (image->bytes[startBlock * kBlockSize + i] != kFill) break;
+	}
+	BLTestAssertEqual(i, blocks * kBlockSize);
+}
+
+/*
+ * Type, creator and parent pick CoreServices/BootX; name and parent pick
+ * Other/BootX; boot.efi is found but too small; nothing is called
+ * "missing". Only the files that fit are written, each in place.
+ */
+static void testUpdate(void)
+{
+	Image					image;
+	BLUpdateBooterFileSpec	specs[4];
+	CFDataRef				big, small, tooBig;
+	const uint8_t			*record;
+
+	buildImage(&image, kBLHFSVolumeUnmountedMask);
+	BLTestAssertEqual(writeImage(&image), 0);
+
+	big = createPayload(6000, 1);
+	small = createPayload(100, 2);
+	tooBig = createPayload(kBlockSize + 1, 3);
+
+	memset(specs, 0, sizeof specs);
+	specs[0].reqType = kBootXType;
+	specs[0].reqCreator = kBootXCreator;
+	specs[0].reqParentDir = kCoreServicesID;
+	specs[0].payloadData = big;
+	specs[0].postType = 0x626F6F74;		// 'boot'
+	specs[0].postCreator = 0x6170706C;	// 'appl'
+	specs[1].reqFilename = "BootX";
+	specs[1].reqParentDir = kOtherID;
+	specs[1].payloadData = small;
+	specs[2].reqFilename = "boot.efi";
+	specs[2].payloadData = tooBig;
+	specs[3].reqFilename = "missing";
+	specs[3].payloadData = small;
+
+	BLTestAssertEqual(BLUpdateBooter(NULL, image.path, specs, 4), 0);
+	BLTestAssertEqual(specs[0].foundFile, 1);
+	BLTestAssertEqual(specs[0].updatedFile, 1);
+	BLTestAssertEqual(specs[1].foundFile, 1);
+	BLTestAssertEqual(specs[1].updatedFile, 1);
+	BLTestAssertEqual(specs[2].foundFile, 1);
+	BLTestAssertEqual(specs[2].updatedFile, 0);
+	BLTestAssertEqual(specs[3].foundFile, 0);
+	BLTestAssertEqual(specs[3].updatedFile, 0);
+
+	BLTestAssertEqual(readImage(&image), 0);
+
+	record = image.bytes + image.fileRecords[kBootXID];
+	BLTestAssertEqual(get32(record + 8), kBootXID);
+	BLTestAssertEqual(get32(record + 48), 0x626F6F74);
+	BLTestAssertEqual(get32(record + 52), 0x6170706C);
+	BLTestAssertEqual(get32(record + 88), 0);
+	BLTestAssertEqual(get32(record + 88 + 4), 6000);
+	BLTestAssertEqual(get32(record + 88 + 12), 2);
+	checkData(&image, 10, 2, big);
+
+	// no post type or creator, so only the length changes
+	record = image.bytes + image.fileRecords[kOtherBootXID];
+	BLTestAssertEqual(get32(record + 48), kBootXType);
+	BLTestAssertEqual(get32(record + 52), kBootXCreator);
+	BLTestAssertEqual(get32(record + 88 + 4), 100);
+	checkData(&image, 13, 1, small);
+
+	checkUnchanged(&image, kBootEFIID, 12, 1);
+	checkUnchanged(&image, kCafeID, 15, 1);
+
+	CFRelease(big);
+	CFRelease(small);
+	CFRelease(tooBig);
+	unlink(image.path);
+}
+
+// with nothing but a name, the first match in key order wins
+static void testFirstMatch(void)
+{
+	Image					image;
+	BLUpdateBooterFileSpec	spec;
+
+	buildImage(&image, kBLHFSVolumeUnmountedMask);
+	BLTestAssertEqual(writeImage(&image), 0);
+
+	memset(&spec, 0, sizeof spec);
+	spec.reqFilename = "BootX";
+	spec.payloadData = createPayload(512, 4);
+
+	BLTestAssertEqual(BLUpdateBooter(NULL, image.path, &spec, 1), 0);
+	BLTestAssertEqual(spec.updatedFile, 1);
+	BLTestAssertEqual(readImage(&image), 0);
+	checkData(&image, 10, 2, spec.payloadData);
+	checkUnchanged(&image, kOtherBootXID, 13, 1);
+
+	CFRelease(spec.payloadData);
+	unlink(image.path);
+}
+
+// a volume that wasn't cleanly unmounted, or is mounted now, is left alone
+static void testRefused(void)
+{
+	Image					image;
+	BLUpdateBooterFileSpec	spec;
+	struct statfs			sfs;
+	struct stat				sb;
+	char					raw[MAXPATHLEN];
+
+	memset(&spec, 0, sizeof spec);
+	spec.reqFilename = "BootX";
+	spec.payloadData = createPayload(512, 5);
+
+	buildImage(&image, 0);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLUpdateBooter(NULL, image.path, &spec, 1), 3);
+	BLTestAssertEqual(spec.foundFile, 0);
+	BLTestAssertEqual(readImage(&image), 0);
+	checkUnchanged(&image, kBootXID, 10, 2);
+	unlink(image.path);
+
+	// the root volume, by its block and raw nodes; either would fail to
+	// open unprivileged, but with a different error
+	if (statfs("/", &sfs) == 0 && strncmp(sfs.f_mntfromname, "/dev/", 5) == 0) {
+		BLTestAssertEqual(BLUpdateBooter(NULL, sfs.f_mntfromname, &spec, 1), 1);
+		snprintf(raw, sizeof raw, "/dev/r%s", sfs.f_mntfromname + 5);
+		if (stat(raw, &sb) == 0) BLTestAssertEqual(BLUpdateBooter(NULL, raw, &spec, 1), 1);
+	}
+
+	CFRelease(spec.payloadData);
+}
+
+/*
+ * One batch of IDs, in no particular order: files deep in the tree and
+ * beside each other, the directories above them after they've been
+ * resolved on the way, the root, a repeat, an unknown ID and an orphan.
+ */
+static void testIndex(void)
+{
+	static const uint32_t	fileIDs[] = {
+		kBootXID, kBootEFIID, kOtherBootXID, kCafeID, kCoreServicesID,
+		kRootID, 99, kSystemID, kSlashID, kOrphanID, kBootXID
+	};
+	static const char		*expected[] = {
+		"System/Library/CoreServices/BootX",
+		"System/Library/CoreServices/boot.efi",
+		"Other/BootX",
+		"Caf\xC3\xA9",
+		"System/Library/CoreServices",
+		"",
+		NULL,
+		"System",
+		"a:b",
+		NULL,
+		"System/Library/CoreServices/BootX"
+	};
+	const char				*paths[sizeof(fileIDs) / sizeof(fileIDs[0])];
+	Image					image;
+	BLHFSVolumeRef			volume = NULL;
+	BLHFSCatalogIndexRef	index = NULL;
+	uint32_t				i;
+
+	buildImage(&image, kBLHFSVolumeUnmountedMask);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 0);
+	BLTestAssertEqual(BLHFSCatalogIndexCreate(NULL, volume, &index), 0);
+	if (index == NULL) goto exit;
+
+	BLTestAssertEqual(BLHFSCatalogIndexGetPaths(NULL, index, fileIDs, sizeof(fileIDs) / sizeof(fileIDs[0]), paths), 9);
+	for (i = 0; i < sizeof(fileIDs) / sizeof(fileIDs[0]); i++) {
+		if (expected[i] == NULL) {
+			BLTestAssert(paths[i] == NULL);
+		} else {
+			BLTestAssert(paths[i] != NULL);
+			if (paths[i]) BLTestAssertEqualStrings(paths[i], expected[i]);
+		}
+	}
+
+	// memoized: the same strings come back, owned by the index
+	BLTestAssert(paths[10] == paths[0]);
+	BLTestAssert(BLHFSCatalogIndexGetPath(NULL, index, kCoreServicesID) == paths[4]);
+	BLTestAssert(BLHFSCatalogIndexGetPath(NULL, index, kLibraryID) != NULL);
+	BLTestAssert(BLHFSCatalogIndexGetPath(NULL, index, kOrphanID) == NULL);
+
+exit:
+	if (index) BLHFSCatalogIndexRelease(index);
+	if (volume) BLHFSVolumeRelease(volume);
+	unlink(image.path);
+}
+
+int main(int argc, char *argv[])
+{
+	testUpdate();
+	testFirstMatch();
+	testRefused();
+	testIndex();
+
+	return BLTestFinish("BLHFSCatalogTests");
+}
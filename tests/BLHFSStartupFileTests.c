@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+//
+//  BLHFSStartupFileTests.c
+//
+//  An empty HFS+ volume and an XCOFF loader are built in memory; the
+//  loader is written into the volume's startup file on a temporary
+//  image, which is then read back and checked by hand.
+//
+
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "BLHFSStartupFile.h"
+#include "BLHFSVolume.h"
+#include "BLBlockChecksum.h"
+#include "BLTest.h"
+
+#define kBlockSize		4096
+#define kBlocks			512
+#define kUsedBlocks		5		// headers, bitmap, extents and catalog files
+#define kImageSize		(kBlocks * kBlockSize)
+
+#define kLoadBase		0x00200000
+#define kTextOffset		0x200
+
+typedef struct {
+	uint8_t		*bytes;
+	size_t		length;
+} Buffer;
+
+static char		gPath[64];
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v & 0xFF;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v >> 16);
+	put16(p + 2, v & 0xFFFF);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void putExtent(uint8_t *fork, uint32_t totalBlocks, uint32_t startBlock)
+{
+	put32(fork + 4, totalBlocks * kBlockSize);
+	put32(fork + 12, totalBlocks);
+	put32(fork + 16, startBlock);
+	put32(fork + 20, totalBlocks);
+}
+
+// an empty extents overflow tree in block 2, the allocation file in block 1
+static void buildVolume(Buffer *image, uint32_t attributes)
+{
+	uint8_t		*vh, *node;
+	uint32_t	block;
+
+	image->length = kImageSize;
+	image->bytes = calloc(1, image->length);
+	vh = image->bytes + 1024;
+
+	put16(vh, kBLHFSPlusSigWord);
+	put16(vh + 2, 4);
+	put32(vh + 4, attributes);
+	put32(vh + 40, kBlockSize);
+	put32(vh + 44, kBlocks);
+	put32(vh + 48, kBlocks - kUsedBlocks);
+	put32(vh + 52, kUsedBlocks);
+	put32(vh + 68, 7);
+	putExtent(vh + 112, 1, 1);
+	putExtent(vh + 192, 1, 2);
+	putExtent(vh + 272, 1, 3);
+
+	for (block = 0; block < kUsedBlocks; block++) {
+		image->bytes[kBlockSize + block / 8] |= 0x80 >> (block % 8);
+	}
+
+	node = image->bytes + 2 * kBlockSize;
+	node[8] = 1;
+	put16(node + 10, 3);
+	put16(node + 14 + 18, kBlockSize);
+	put16(node + kBlockSize - 2, 14);
+
+	memcpy(image->bytes + kImageSize - 1024, vh, 512);
+}
+
+static void putSection(uint8_t *section, const char *name, uint32_t vAddr, uint32_t size, uint32_t offset)
+{
+	strncpy((char *)section, name, 8);
+	put32(section + 8, vAddr);
+	put32(section + 12, vAddr);
+	put32(section + 16, size);
+	put32(section + 20, offset);
+}
+
+/*
+ * .text at the load base, .data after it holding the entry point's
+ * descriptor, and .bss after that. The section bodies are a counting
+ * pattern, so a misplaced sector shows
+ */
+static void buildXCOFF(Buffer *xcoff, uint32_t textSize)
+{
+	uint32_t	dataSize = 3001, dataStart = kLoadBase + roundup(textSize, 0x1000);
+	uint8_t		*p, *sections;
+	size_t		i;
+
+	xcoff->length = kTextOffset + textSize + dataSize;
+	xcoff->bytes = calloc(1, xcoff->length);
+	p = xcoff->bytes;
+
+	put16(p, 0x01DF);
+	put16(p + 2, 3);
+	put16(p + 16, 72);
+	put16(p + 18, 0x1002);
+
+	p += 20;
+	put16(p, 0x010B);
+	put32(p + 4, textSize);
+	put32(p + 8, dataSize);
+	put32(p + 12, 0x1000);
+	put32(p + 16, dataStart + 16);
+	put16(p + 34, 1);
+	put16(p + 36, 2);
+	put16(p + 42, 3);
+
+	sections = xcoff->bytes + 20 + 72;
+	putSection(sections, ".text", kLoadBase, textSize, kTextOffset);
+	putSection(sections + 40, ".data", dataStart, dataSize, kTextOffset + textSize);
+	putSection(sections + 80, ".bss", dataStart + roundup(dataSize, 0x1000), 0x1000, 0);
+
+	for (i = kTextOffset; i < xcoff->length; i++) {
+		xcoff->bytes[i] = (uint8_t)(i * 7 + (i >> 9));
+	}
+}
+
+/*
+ * Geometry is cached by node and whole-second times, so each image
+ * written gets times of its own
+ */
+static int writeImage(const Buffer *image)
+{
+	static time_t	stamp = 2000000;
+	struct timespec	times[2];
+	int				fd;
+
+	snprintf(gPath, sizeof gPath, "/tmp/BLHFSStartupFileTests.XXXXXX");
+	fd = mkstemp(gPath);
+	if (fd < 0) return -1;
+
+	times[0].tv_sec = times[1].tv_sec = ++stamp;
+	times[0].tv_nsec = times[1].tv_nsec = 0;
+	if (write(fd, image->bytes, image->length) != (ssize_t)image->length || futimens(fd, times) < 0) {
+		close(fd);
+		unlink(gPath);
+		return -1;
+	}
+
+	close(fd);
+	return 0;
+}
+
+static void readImage(Buffer *image)
+{
+	int	fd = open(gPath, O_RDONLY);
+
+	BLTestAssert(fd >= 0);
+	if (fd < 0) return;
+	BLTestAssertEqual(pread(fd, image->bytes, image->length, 0), image->length);
+	close(fd);
+}
+
+static void testWrite(void)
+{
+	Buffer					image, xcoff, smaller;
+	BLHFSStartupFileInfo	info;
+	const uint8_t			*vh;
+	uint32_t				blocks, start;
+	int						i;
+
+	buildVolume(&image, kBLHFSVolumeUnmountedMask);
+	buildXCOFF(&xcoff, 40000);
+	BLTestAssertEqual(writeImage(&image), 0);
+
+	BLTestAssertEqual(BLHFSStartupFileWrite(gPath, xcoff.bytes, xcoff.length, &info), 0);
+	BLTestAssert(info.problem == NULL);
+	BLTestAssertEqual(info.extentCount, 1);
+	BLTestAssertEqual(info.entryPoint, kLoadBase + 40960 + 16);
+	BLTestAssertEqual(info.checksum, BLBlockChecksum(xcoff.bytes, (uint32_t)xcoff.length));
+
+	readImage(&image);
+	blocks = (uint32_t)((roundup(xcoff.length, 512) + kBlockSize - 1) / kBlockSize);
+	for (i = 0; i < 2; i++) {
+		vh = image.bytes + (i == 0 ? 1024 : kImageSize - 1024);
+		start = get32(vh + 432 + 16);
+
+		BLTestAssertEqual(start, kUsedBlocks);
+		BLTestAssertEqual(get32(vh + 432 + 4), xcoff.length);
+		BLTestAssertEqual(get32(vh + 432 + 12), blocks);
+		BLTestAssertEqual(get32(vh + 432 + 20), blocks);
+		BLTestAssertEqual(get32(vh + 48), kBlocks - kUsedBlocks - blocks);
+		BLTestAssertEqual(get32(vh + 52), kUsedBlocks + blocks);
+		BLTestAssertEqual(get32(vh + 68), 7 + 3);	// allocate, record the fork, then its size
+		BLTestAssert(get32(vh + 20) > 3000000000U);	// after 1999
+	}
+
+	// the loader itself, zero padded
+	BLTestAssert(memcmp(image.bytes + kUsedBlocks * kBlockSize, xcoff.bytes, xcoff.length) == 0);
+	BLTestAssertEqual(image.bytes[kUsedBlocks * kBlockSize + xcoff.length], 0);
+	BLTestAssertEqual(image.bytes[kBlockSize], 0xFF);
+	BLTestAssertEqual(image.bytes[kBlockSize + 1], 0xFF);
+	BLTestAssertEqual(image.bytes[kBlockSize + 2], 0x00);
+
+	// a smaller loader reuses the file; a larger one doesn't fit it
+	buildXCOFF(&smaller, 2000);
+	BLTestAssertEqual(BLHFSStartupFileWrite(gPath, smaller.bytes, smaller.length, &info), 0);
+	readImage(&image);
+	vh = image.bytes + 1024;
+	BLTestAssertEqual(get32(vh + 432 + 4), smaller.length);
+	BLTestAssertEqual(get32(vh + 432 + 12), blocks);
+	BLTestAssertEqual(get32(vh + 48), kBlocks - kUsedBlocks - blocks);
+	BLTestAssert(memcmp(image.bytes + kUsedBlocks * kBlockSize, smaller.bytes, smaller.length) == 0);
+	free(smaller.bytes);
+
+	buildXCOFF(&smaller, 60000);
+	BLTestAssertEqual(BLHFSStartupFileWrite(gPath, smaller.bytes, smaller.length, &info), 5);
+	BLTestAssert(info.problem != NULL);
+	free(smaller.bytes);
+
+	unlink(gPath);
+	free(xcoff.bytes);
+	free(image.bytes);
+}
+
+static void testVolumes(void)
+{
+	Buffer					image, xcoff;
+	BLHFSStartupFileInfo	info;
+
+	buildXCOFF(&xcoff, 40000);
+
+	// mounted, or not cleanly unmounted
+	buildVolume(&image, 0);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSStartupFileWrite(gPath, xcoff.bytes, xcoff.length, &info), 3);
+	unlink(gPath);
+	free(image.bytes);
+
+	// plain HFS
+	buildVolume(&image, kBLHFSVolumeUnmountedMask);
+	memset(image.bytes + 1024, 0, 512);
+	put16(image.bytes + 1024, kBLHFSSigWord);
+	put16(image.bytes + 1024 + 18, kBlocks);
+	put32(image.bytes + 1024 + 20, kBlockSize);
+	put32(image.bytes + 1024 + 130, kBlockSize);
+	put16(image.bytes + 1024 + 134, 2);
+	put16(image.bytes + 1024 + 136, 1);
+	put16(image.bytes + 2 * kBlockSize + 14 + 18, 512);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSStartupFileWrite(gPath, xcoff.bytes, xcoff.length, &info), 2);
+	unlink(gPath);
+	free(image.bytes);
+
+	// full
+	buildVolume(&image, kBLHFSVolumeUnmountedMask);
+	memset(image.bytes + kBlockSize, 0xFF, kBlocks / 8);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSStartupFileWrite(gPath, xcoff.bytes, xcoff.length, &info), 5);
+	unlink(gPath);
+	free(image.bytes);
+
+	BLTestAssertEqual(BLHFSStartupFileWrite(gPath, xcoff.bytes, xcoff.length, &info), 2);
+
+	free(xcoff.bytes);
+}
+
+static void testXCOFF(void)
+{
+	Buffer			xcoff;
+	uint32_t		entryPoint;
+	const char		*problem;
+	uint8_t			*sections;
+
+	buildXCOFF(&xcoff, 40000);
+	sections = xcoff.bytes + 20 + 72;
+	BLTestAssertEqual(BLHFSStartupFileCheckXCOFF(xcoff.bytes, xcoff.length, &entryPoint, &problem), 0);
+	BLTestAssert(problem == NULL);
+
+#define CHECK_DAMAGE(damage) do { \
+		uint8_t	saved[20 + 72 + 3 * 40]; \
+		memcpy(saved, xcoff.bytes, sizeof saved); \
+		damage; \
+		BLTestAssertEqual(BLHFSStartupFileCheckXCOFF(xcoff.bytes, xcoff.length, &entryPoint, &problem), 4); \
+		BLTestAssert(problem != NULL); \
+		memcpy(xcoff.bytes, saved, sizeof saved); \
+	} while (0)
+
+	CHECK_DAMAGE(put16(xcoff.bytes, 0x01F7));				// 64-bit XCOFF
+	CHECK_DAMAGE(put16(xcoff.bytes + 16, 28));				// short auxiliary header
+	CHECK_DAMAGE(put16(xcoff.bytes + 20, 0));				// no auxiliary header magic
+	CHECK_DAMAGE(put16(xcoff.bytes + 2, 0));				// no sections
+	CHECK_DAMAGE(put16(xcoff.bytes + 2, 0x7FFF));			// section table past the end
+	CHECK_DAMAGE(put16(xcoff.bytes + 20 + 34, 0));			// no .text
+	CHECK_DAMAGE(put16(xcoff.bytes + 20 + 34, 4));			// .text past the table
+	CHECK_DAMAGE(put16(xcoff.bytes + 20 + 34, 2));			// .text is .data
+	CHECK_DAMAGE(put32(sections + 20, 0xFFFFFF00));			// .text past the end of the file
+	CHECK_DAMAGE(put32(sections + 12, 0xFFFFF000));			// .text wraps
+	CHECK_DAMAGE(put32(sections + 40 + 12, kLoadBase + 8));	// .data inside .text
+	CHECK_DAMAGE(put32(xcoff.bytes + 20 + 16, 0x100));		// entry point below the image
+	CHECK_DAMAGE(put32(sections + 80 + 12, 0x7F000000));	// .bss far away
+
+	BLTestAssertEqual(BLHFSStartupFileCheckXCOFF(xcoff.bytes, 50, &entryPoint, &problem), 4);
+
+	free(xcoff.bytes);
+}
+
+static void benchmark(void)
+{
+	enum { kRounds = 200 };
+	Buffer					image, xcoff;
+	BLHFSStartupFileInfo	info;
+	uint64_t				start;
+	int						round;
+
+	buildVolume(&image, kBLHFSVolumeUnmountedMask);
+	buildXCOFF(&xcoff, 1024 * 1024);
+	if (writeImage(&image)) abort();
+
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		if (BLHFSStartupFileWrite(gPath, xcoff.bytes, xcoff.length, &info)) abort();
+	}
+	BLTestReport("BLHFSStartupFileWrite 1MB", kRounds, BLTestNow() - start, (uint64_t)kRounds * xcoff.length);
+
+	unlink(gPath);
+	free(xcoff.bytes);
+	free(image.bytes);
+}
+
+int main(int argc, char *argv[])
+{
+	if (getopt(argc, argv, "b") == 'b') {
+		benchmark();
+		return 0;
+	}
+
+	testXCOFF();
+	testWrite();
+	testVolumes();
+
+	return BLTestFinish("BLHFSStartupFileTests");
+}
@@ -0,0 +1,643 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+//
+//  BLHFSVolumeTests.c
+//
+//  Volumes are built here block by block: an HFS+ volume whose test
+//  file spills into a two-level extents overflow tree, the same volume
+//  inside an HFS wrapper, and a plain HFS volume with an HFS-format
+//  overflow tree. Each is written to a temporary file and opened as a
+//  device would be.
+//
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "BLHFSVolume.h"
+#include "BLTest.h"
+
+#define kPlusBlockSize		4096
+#define kPlusBlocks			64
+#define kPlusNodeSize		1024
+#define kPlusExtentsBlock	2		// two blocks, eight nodes
+#define kPlusCatalogBlock	4
+#define kTestFileID			20
+
+#define kWrapperBlockSize	4096
+#define kWrapperAlBlSt		8		// sectors
+#define kWrapperEmbedStart	2		// wrapper blocks
+#define kWrapperOffset		((kWrapperAlBlSt + kWrapperEmbedStart * (kWrapperBlockSize / 512)) * 512)
+
+#define kHFSBlockSize		1024
+#define kHFSBlocks			64
+#define kHFSAlBlSt			6		// sectors
+#define kHFSExtentsBlock	2
+#define kHFSCatalogBlock	3
+
+#define kImageSize			(kWrapperOffset + kPlusBlocks * kPlusBlockSize)
+
+typedef struct {
+	uint8_t		bytes[kImageSize];
+	size_t		length;
+	char		path[64];
+} Image;
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v & 0xFF;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v >> 16);
+	put16(p + 2, v & 0xFFFF);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void putForkData(uint8_t *p, uint64_t logicalSize, uint32_t totalBlocks,
+						const uint32_t (*extents)[2], int count)
+{
+	int	i;
+
+	put32(p, (uint32_t)(logicalSize >> 32));
+	put32(p + 4, (uint32_t)logicalSize);
+	put32(p + 12, totalBlocks);
+	for (i = 0; i < count; i++) {
+		put32(p + 16 + 8 * i, extents[i][0]);
+		put32(p + 20 + 8 * i, extents[i][1]);
+	}
+}
+
+// a node descriptor, and the record offsets that end the node
+static void putNode(uint8_t *node, size_t nodeSize, uint8_t kind, uint8_t height,
+					const uint16_t *offsets, uint16_t count)
+{
+	uint16_t	i;
+
+	node[8] = kind;
+	node[9] = height;
+	put16(node + 10, count);
+	for (i = 0; i < count; i++) {
+		put16(node + nodeSize - 2 * (i + 1), offsets[i]);
+	}
+}
+
+static void putHeaderNode(uint8_t *node, size_t nodeSize, uint32_t rootNode, uint32_t totalNodes)
+{
+	uint16_t	offsets[] = { 14 };
+
+	putNode(node, nodeSize, 1, 0, offsets, 1);
+	put32(node + 14 + 2, rootNode);
+	put16(node + 14 + 18, (uint16_t)nodeSize);
+	put32(node + 14 + 22, totalNodes);
+}
+
+// an HFS+ extent key; returns the offset past it
+static size_t putPlusKey(uint8_t *node, size_t offset, uint32_t fileID, uint32_t startBlock)
+{
+	put16(node + offset, 10);
+	node[offset + 2] = kBLHFSDataForkType;
+	put32(node + offset + 4, fileID);
+	put32(node + offset + 8, startBlock);
+	return offset + 12;
+}
+
+static uint8_t *plusBlock(uint8_t *volume, uint32_t block)
+{
+	return volume + (size_t)block * kPlusBlockSize;
+}
+
+static uint8_t *plusNode(uint8_t *volume, uint32_t node)
+{
+	return plusBlock(volume, kPlusExtentsBlock) + (size_t)node * kPlusNodeSize;
+}
+
+/*
+ * The test file's data fork has ten one-block extents, the first two
+ * contiguous; the last two are in the overflow tree, whose root (node 2)
+ * is an index over two leaves. Blocks 0-9 are used by the volume itself.
+ */
+static const uint32_t kPlusForkExtents[8][2] = {
+	{ 20, 1 }, { 21, 1 }, { 24, 1 }, { 26, 1 }, { 28, 1 }, { 30, 1 }, { 32, 1 }, { 34, 1 }
+};
+static const uint32_t kPlusOverflowExtents[2][2] = { { 36, 1 }, { 38, 1 } };
+
+static void buildPlusVolume(uint8_t *volume)
+{
+	uint8_t		*vh = volume + 1024, *node, *bitmap;
+	uint32_t	extentsFile[1][2] = { { kPlusExtentsBlock, 2 } };
+	uint32_t	allocationFile[1][2] = { { 1, 1 } };
+	uint32_t	catalogFile[1][2] = { { kPlusCatalogBlock, 1 } };
+	uint16_t	offsets[2];
+	size_t		offset;
+	uint32_t	block;
+	int			i;
+
+	memset(volume, 0, kPlusBlocks * kPlusBlockSize);
+
+	put16(vh, kBLHFSPlusSigWord);
+	put16(vh + 2, 4);
+	put32(vh + 4, 1 << 8);			// cleanly unmounted
+	put32(vh + 40, kPlusBlockSize);
+	put32(vh + 44, kPlusBlocks);
+	put32(vh + 48, kPlusBlocks - 22);
+	putForkData(vh + 112, kPlusBlockSize, 1, allocationFile, 1);
+	putForkData(vh + 192, 2 * kPlusBlockSize, 2, extentsFile, 1);
+	putForkData(vh + 272, kPlusBlockSize, 1, catalogFile, 1);
+
+	bitmap = plusBlock(volume, 1);
+	for (block = 0; block < 10; block++) bitmap[block / 8] |= 0x80 >> (block % 8);
+	for (i = 0; i < 8; i++) bitmap[kPlusForkExtents[i][0] / 8] |= 0x80 >> (kPlusForkExtents[i][0] % 8);
+	for (i = 0; i < 2; i++) bitmap[kPlusOverflowExtents[i][0] / 8] |= 0x80 >> (kPlusOverflowExtents[i][0] % 8);
+
+	putHeaderNode(plusNode(volume, 0), kPlusNodeSize, 2, 8);
+
+	// index: everything before file 20 is in node 3, the rest in node 1
+	node = plusNode(volume, 2);
+	offsets[0] = 14;
+	offset = putPlusKey(node, 14, 5, 0);
+	put32(node + offset, 3);
+	offsets[1] = (uint16_t)(offset + 4);
+	offset = putPlusKey(node, offsets[1], kTestFileID, 0);
+	put32(node + offset, 1);
+	putNode(node, kPlusNodeSize, 0x00, 2, offsets, 2);
+
+	node = plusNode(volume, 3);
+	offsets[0] = 14;
+	offset = putPlusKey(node, 14, 5, 3);
+	put32(node + offset, 50);
+	put32(node + offset + 4, 1);
+	putNode(node, kPlusNodeSize, 0xFF, 1, offsets, 1);
+
+	node = plusNode(volume, 1);
+	offsets[0] = 14;
+	offset = putPlusKey(node, 14, kTestFileID, 8);
+	for (i = 0; i < 2; i++) {
+		put32(node + offset + 8 * i, kPlusOverflowExtents[i][0]);
+		put32(node + offset + 8 * i + 4, kPlusOverflowExtents[i][1]);
+	}
+	putNode(node, kPlusNodeSize, 0xFF, 1, offsets, 1);
+
+	// alternate volume header
+	memcpy(volume + kPlusBlocks * kPlusBlockSize - 1024, vh, 512);
+}
+
+static void buildPlusImage(Image *image)
+{
+	memset(image->bytes, 0, sizeof image->bytes);
+	buildPlusVolume(image->bytes);
+	image->length = kPlusBlocks * kPlusBlockSize;
+}
+
+static void buildWrapperImage(Image *image)
+{
+	uint8_t	*mdb = image->bytes + 1024;
+
+	memset(image->bytes, 0, sizeof image->bytes);
+	put16(mdb, kBLHFSSigWord);
+	put16(mdb + 18, (kImageSize - kWrapperAlBlSt * 512) / kWrapperBlockSize);
+	put32(mdb + 20, kWrapperBlockSize);
+	put16(mdb + 28, kWrapperAlBlSt);
+	put16(mdb + 124, kBLHFSPlusSigWord);
+	put16(mdb + 126, kWrapperEmbedStart);
+	put16(mdb + 128, kPlusBlocks * kPlusBlockSize / kWrapperBlockSize);
+
+	buildPlusVolume(image->bytes + kWrapperOffset);
+	image->length = kImageSize;
+}
+
+/*
+ * Plain HFS: allocation blocks start kHFSAlBlSt sectors in. The test
+ * file has three extents in its catalog record and two more blocks in
+ * the overflow tree, keyed at its fourth block
+ */
+static const uint32_t kHFSForkExtents[3][2] = { { 10, 1 }, { 12, 1 }, { 14, 1 } };
+
+static void buildHFSImage(Image *image)
+{
+	uint8_t		*mdb = image->bytes + 1024;
+	uint8_t		*extents = image->bytes + kHFSAlBlSt * 512 + kHFSExtentsBlock * kHFSBlockSize;
+	uint8_t		*node = extents + 512;
+	uint16_t	offsets[] = { 14 };
+
+	memset(image->bytes, 0, sizeof image->bytes);
+	put16(mdb, kBLHFSSigWord);
+	put16(mdb + 10, 1 << 8);
+	put16(mdb + 18, kHFSBlocks);
+	put32(mdb + 20, kHFSBlockSize);
+	put16(mdb + 28, kHFSAlBlSt);
+	put32(mdb + 130, kHFSBlockSize);
+	put16(mdb + 134, kHFSExtentsBlock);
+	put16(mdb + 136, 1);
+	put32(mdb + 146, kHFSBlockSize);
+	put16(mdb + 150, kHFSCatalogBlock);
+	put16(mdb + 152, 1);
+
+	putHeaderNode(extents, 512, 1, 2);
+
+	// key length 7: fork type, file ID, start block, then the record at 22
+	node[14] = 7;
+	node[15] = kBLHFSDataForkType;
+	put32(node + 16, kTestFileID);
+	put16(node + 20, 3);
+	put16(node + 22, 20);
+	put16(node + 24, 2);
+	putNode(node, 512, 0xFF, 1, offsets, 1);
+
+	image->length = kHFSAlBlSt * 512 + kHFSBlocks * kHFSBlockSize;
+}
+
+/*
+ * Geometry is cached by node and whole-second times, so each image
+ * written gets times of its own
+ */
+static int writeImage(Image *image)
+{
+	static time_t	stamp = 1000000;
+	struct timespec	times[2];
+	int				fd;
+
+	snprintf(image->path, sizeof image->path, "/tmp/BLHFSVolumeTests.XXXXXX");
+	fd = mkstemp(image->path);
+	if (fd < 0) return -1;
+
+	times[0].tv_sec = times[1].tv_sec = ++stamp;
+	times[0].tv_nsec = times[1].tv_nsec = 0;
+	if (write(fd, image->bytes, image->length) != (ssize_t)image->length || futimens(fd, times) < 0) {
+		close(fd);
+		unlink(image->path);
+		return -1;
+	}
+
+	close(fd);
+	return 0;
+}
+
+static void plusFork(BLHFSForkData *fork)
+{
+	int	i;
+
+	memset(fork, 0, sizeof(*fork));
+	fork->totalBlocks = 10;
+	for (i = 0; i < 8; i++) {
+		fork->extents[i].startBlock = kPlusForkExtents[i][0];
+		fork->extents[i].blockCount = kPlusForkExtents[i][1];
+	}
+}
+
+// the test file's sectors, for a volume offset sectors into the image
+static void checkPlusExtents(BLHFSVolumeRef volume, off_t offset)
+{
+	BLHFSForkData	fork;
+	BLDiskExtent	*extents;
+	uint32_t		count;
+	int				i;
+
+	plusFork(&fork);
+	BLTestAssertEqual(BLHFSVolumeCopyForkExtents(volume, kTestFileID, kBLHFSDataForkType, &fork,
+												 &extents, &count), 0);
+	BLTestAssertEqual(count, 9);
+	if (count != 9) {
+		free(extents);
+		return;
+	}
+
+	// the first two blocks are contiguous, so are reported as one extent
+	BLTestAssertEqual(extents[0].start, offset + 20 * 8);
+	BLTestAssertEqual(extents[0].length, 16);
+	for (i = 1; i < 7; i++) {
+		BLTestAssertEqual(extents[i].start, offset + kPlusForkExtents[i + 1][0] * 8);
+		BLTestAssertEqual(extents[i].length, 8);
+	}
+	BLTestAssertEqual(extents[7].start, offset + kPlusOverflowExtents[0][0] * 8);
+	BLTestAssertEqual(extents[8].start, offset + kPlusOverflowExtents[1][0] * 8);
+	free(extents);
+}
+
+static void testPlus(void)
+{
+	Image			image;
+	BLHFSVolumeRef	volume;
+
+	buildPlusImage(&image);
+	BLTestAssertEqual(writeImage(&image), 0);
+
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 0);
+	if (volume == NULL) return;
+
+	BLTestAssert(BLHFSVolumeIsHFSPlus(volume));
+	BLTestAssertEqual(BLHFSVolumeGetBlockSize(volume), kPlusBlockSize);
+	BLTestAssertEqual(BLHFSVolumeGetAttributes(volume), 1 << 8);
+	BLTestAssertEqual(BLHFSVolumeGetOffset(volume), 0);
+	BLTestAssertEqual(BLHFSVolumeGetCatalogFork(volume)->extents[0].startBlock, kPlusCatalogBlock);
+	BLTestAssertEqual(BLHFSVolumeGetStartupFork(volume)->totalBlocks, 0);
+	checkPlusExtents(volume, 0);
+	BLHFSVolumeRelease(volume);
+
+	// again, from the cached geometry
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 0);
+	if (volume) checkPlusExtents(volume, 0);
+	BLHFSVolumeRelease(volume);
+
+	unlink(image.path);
+}
+
+static void testWrapper(void)
+{
+	Image			image;
+	BLHFSVolumeRef	volume;
+
+	buildWrapperImage(&image);
+	BLTestAssertEqual(writeImage(&image), 0);
+
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 0);
+	if (volume) {
+		BLTestAssert(BLHFSVolumeIsHFSPlus(volume));
+		BLTestAssertEqual(BLHFSVolumeGetOffset(volume), kWrapperOffset);
+		checkPlusExtents(volume, kWrapperOffset / 512);
+	}
+	BLHFSVolumeRelease(volume);
+
+	unlink(image.path);
+}
+
+static void testHFS(void)
+{
+	Image			image;
+	BLHFSVolumeRef	volume;
+	BLHFSForkData	fork;
+	BLDiskExtent	*extents;
+	uint32_t		count, block;
+	int				i;
+
+	buildHFSImage(&image);
+	BLTestAssertEqual(writeImage(&image), 0);
+
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, true, &volume), 0);
+	if (volume == NULL) return;
+
+	BLTestAssert(!BLHFSVolumeIsHFSPlus(volume));
+	BLTestAssertEqual(BLHFSVolumeGetBlockSize(volume), kHFSBlockSize);
+	BLTestAssertEqual(BLHFSVolumeGetAttributes(volume), 1 << 8);
+	BLTestAssertEqual(BLHFSVolumeGetOffset(volume), kHFSAlBlSt * 512);
+	BLTestAssertEqual(BLHFSVolumeGetCatalogFork(volume)->extents[0].startBlock, kHFSCatalogBlock);
+	BLTestAssertEqual(BLHFSVolumeGetCatalogFork(volume)->totalBlocks, 1);
+
+	memset(&fork, 0, sizeof(fork));
+	fork.totalBlocks = 5;
+	for (i = 0; i < 3; i++) {
+		fork.extents[i].startBlock = kHFSForkExtents[i][0];
+		fork.extents[i].blockCount = kHFSForkExtents[i][1];
+	}
+	BLTestAssertEqual(BLHFSVolumeCopyForkExtents(volume, kTestFileID, kBLHFSDataForkType, &fork,
+												 &extents, &count), 0);
+	BLTestAssertEqual(count, 4);
+	if (count == 4) {
+		for (i = 0; i < 3; i++) {
+			BLTestAssertEqual(extents[i].start, kHFSAlBlSt + kHFSForkExtents[i][0] * 2);
+			BLTestAssertEqual(extents[i].length, 2);
+		}
+		BLTestAssertEqual(extents[3].start, kHFSAlBlSt + 20 * 2);
+		BLTestAssertEqual(extents[3].length, 4);
+	}
+	free(extents);
+
+	// no overflow record for the resource fork
+	fork.totalBlocks = 4;
+	BLTestAssertEqual(BLHFSVolumeCopyForkExtents(volume, kTestFileID, kBLHFSResourceForkType, &fork,
+												 &extents, &count), 5);
+
+	// only HFS+ is written
+	BLTestAssertEqual(BLHFSVolumeAllocateBlocks(volume, 1, &block), 2);
+	BLTestAssertEqual(BLHFSVolumeSetStartupFork(volume, &fork), 2);
+	BLHFSVolumeRelease(volume);
+
+	unlink(image.path);
+}
+
+static void testWrite(void)
+{
+	Image			image;
+	BLHFSVolumeRef	volume;
+	BLHFSForkData	fork;
+	uint8_t			header[512];
+	uint32_t		block;
+	int				fd, i;
+
+	buildPlusImage(&image);
+	BLTestAssertEqual(writeImage(&image), 0);
+
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, true, &volume), 0);
+	if (volume == NULL) return;
+
+	// first fit: 10-13 are free, then 39 is the first run of 11
+	BLTestAssertEqual(BLHFSVolumeAllocateBlocks(volume, 4, &block), 0);
+	BLTestAssertEqual(block, 10);
+	BLTestAssertEqual(BLHFSVolumeAllocateBlocks(volume, 11, &block), 0);
+	BLTestAssertEqual(block, 39);
+	BLTestAssertEqual(BLHFSVolumeAllocateBlocks(volume, 4, &block), 0);
+	BLTestAssertEqual(block, 14);
+	BLTestAssertEqual(BLHFSVolumeAllocateBlocks(volume, kPlusBlocks, &block), 6);
+
+	memset(&fork, 0, sizeof(fork));
+	fork.logicalSize = 5000;
+	fork.totalBlocks = 2;
+	fork.extents[0].startBlock = 14;
+	fork.extents[0].blockCount = 2;
+	BLTestAssertEqual(BLHFSVolumeSetStartupFork(volume, &fork), 0);
+	BLHFSVolumeRelease(volume);
+
+	// both headers have it, and the geometry isn't stale
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 0);
+	if (volume) {
+		BLTestAssertEqual(BLHFSVolumeGetStartupFork(volume)->logicalSize, 5000);
+		BLTestAssertEqual(BLHFSVolumeGetStartupFork(volume)->extents[0].startBlock, 14);
+	}
+	BLHFSVolumeRelease(volume);
+
+	fd = open(image.path, O_RDONLY);
+	BLTestAssert(fd >= 0);
+	for (i = 0; i < 2 && fd >= 0; i++) {
+		off_t	location = i == 0 ? 1024 : kPlusBlocks * kPlusBlockSize - 1024;
+
+		BLTestAssertEqual(pread(fd, header, sizeof header, location), sizeof header);
+		BLTestAssertEqual(get32(header + 48), kPlusBlocks - 22 - 19);
+		BLTestAssertEqual(get32(header + 432 + 12), 2);
+		BLTestAssertEqual(get32(header + 432 + 16), 14);
+	}
+
+	// blocks 10-17 and 39-49 are now marked
+	if (fd >= 0) {
+		BLTestAssertEqual(pread(fd, header, sizeof header, kPlusBlockSize), sizeof header);
+		BLTestAssertEqual(header[1], 0xFF);
+		BLTestAssertEqual(header[2], 0xC0 | (0x80 >> (20 % 8)) | (0x80 >> (21 % 8)));
+		BLTestAssertEqual(header[4], 0xAA | 0x01);
+		BLTestAssertEqual(header[5], 0xFF);
+		BLTestAssertEqual(header[6], 0xC0);
+		close(fd);
+	}
+
+	unlink(image.path);
+}
+
+static void testDamage(void)
+{
+	Image			image;
+	BLHFSVolumeRef	volume;
+	BLHFSForkData	fork;
+	BLDiskExtent	*extents;
+	uint32_t		count;
+
+	// not HFS at all
+	buildPlusImage(&image);
+	put16(image.bytes + 1024, 0x1234);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 2);
+	BLTestAssert(volume == NULL);
+	unlink(image.path);
+
+	// a wrapper whose embedded volume isn't HFS+
+	buildWrapperImage(&image);
+	put16(image.bytes + kWrapperOffset + 1024, 0);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 2);
+	unlink(image.path);
+
+	// block size not a power of two
+	buildPlusImage(&image);
+	put32(image.bytes + 1024 + 40, 3000);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 4);
+	unlink(image.path);
+
+	// overflow tree header with no node size
+	buildPlusImage(&image);
+	put16(plusNode(image.bytes, 0) + 14 + 18, 0);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 4);
+	unlink(image.path);
+
+	// too short to have a volume header
+	buildPlusImage(&image);
+	image.length = 1024;
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 3);
+	unlink(image.path);
+
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 3);
+	BLTestAssertEqual(errno, ENOENT);
+
+	// an index node that points at itself
+	buildPlusImage(&image);
+	put32(plusNode(image.bytes, 2) + 30 + 12, 2);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 0);
+	if (volume) {
+		plusFork(&fork);
+		BLTestAssertEqual(BLHFSVolumeCopyForkExtents(volume, kTestFileID, kBLHFSDataForkType, &fork,
+													 &extents, &count), 4);
+		BLTestAssert(extents == NULL);
+	}
+	BLHFSVolumeRelease(volume);
+	unlink(image.path);
+
+	// a record offset past the record table
+	buildPlusImage(&image);
+	put16(plusNode(image.bytes, 1) + kPlusNodeSize - 2, kPlusNodeSize - 4);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 0);
+	if (volume) {
+		plusFork(&fork);
+		BLTestAssertEqual(BLHFSVolumeCopyForkExtents(volume, kTestFileID, kBLHFSDataForkType, &fork,
+													 &extents, &count), 4);
+	}
+	BLHFSVolumeRelease(volume);
+	unlink(image.path);
+
+	// more blocks than the overflow tree has extents for
+	buildPlusImage(&image);
+	BLTestAssertEqual(writeImage(&image), 0);
+	BLTestAssertEqual(BLHFSVolumeCreate(image.path, false, &volume), 0);
+	if (volume) {
+		plusFork(&fork);
+		fork.totalBlocks = 11;
+		BLTestAssertEqual(BLHFSVolumeCopyForkExtents(volume, kTestFileID, kBLHFSDataForkType, &fork,
+													 &extents, &count), 5);
+	}
+	BLHFSVolumeRelease(volume);
+	unlink(image.path);
+}
+
+static void benchmark(void)
+{
+	enum { kRounds = 20000 };
+	Image			image;
+	BLHFSVolumeRef	volume;
+	BLHFSForkData	fork;
+	BLDiskExtent	*extents;
+	uint32_t		count;
+	uint64_t		start, total = 0;
+	int				round;
+
+	buildWrapperImage(&image);
+	if (writeImage(&image)) abort();
+	plusFork(&fork);
+
+	start = BLTestNow();
+	for (round = 0; round < kRounds; round++) {
+		if (BLHFSVolumeCreate(image.path, false, &volume)) abort();
+		if (BLHFSVolumeCopyForkExtents(volume, kTestFileID, kBLHFSDataForkType, &fork, &extents, &count)) abort();
+		total += count;
+		free(extents);
+		BLHFSVolumeRelease(volume);
+	}
+	BLTestReport("BLHFSVolumeCopyForkExtents", kRounds, BLTestNow() - start, 0);
+
+	unlink(image.path);
+	if (total != 9 * kRounds) abort();
+}
+
+int main(int argc, char *argv[])
+{
+	if (getopt(argc, argv, "b") == 'b') {
+		benchmark();
+		return 0;
+	}
+
+	testPlus();
+	testWrapper();
+	testHFS();
+	testWrite();
+	testDamage();
+
+	return BLTestFinish("BLHFSVolumeTests");
+}
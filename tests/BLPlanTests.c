@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLPlanTests.c
+//
+//  Plans read back with BLPlanCreateWithPropertyList: every action bless
+//  records is accepted, and any action with a key missing or of the wrong
+//  type is rejected before anything could apply or print it.
+//
+
+#include <unistd.h>
+
+#include "bless.h"
+#include "bless_private.h"
+#include "BLTest.h"
+
+#define kLocation	"<key>FullPath</key><string>/Volumes/Test/file</string>" \
+					"<key>Device</key><string>/dev/disk4s1</string>" \
+					"<key>Path</key><string>/file</string>"
+#define kWords		"<key>Words</key><array><integer>2</integer><integer>3</integer></array>"
+
+// one of each kind, as BLPlanCopyPropertyList writes them
+static const char *kValidActions[] = {
+	"<key>Action</key><string>NVRAMSet</string><key>Name</key><string>efi-boot-device</string>"
+	"<key>Value</key><string>&lt;array/&gt;</string>",
+	"<key>Action</key><string>NVRAMSet</string><key>Name</key><string>efi-boot-device-data</string>"
+	"<key>Value</key><data>AQI=</data>",
+	"<key>Action</key><string>NVRAMDelete</string><key>Name</key><string>efi-boot-next</string>",
+	"<key>Action</key><string>NVRAMForward</string><key>From</key><string>a</string><key>To</key><string>b</string>",
+	"<key>Action</key><string>CreateFile</string>" kLocation "<key>Data</key><data>AQI=</data>"
+	"<key>Immutable</key><integer>0</integer><key>Type</key><integer>0</integer>"
+	"<key>Creator</key><integer>0</integer><key>Preallocate</key><integer>1</integer>",
+	"<key>Action</key><string>CopyFile</string>" kLocation "<key>SourceFullPath</key><string>/tmp/x</string>",
+	"<key>Action</key><string>DeleteFile</string><key>FullPath</key><string>/tmp/x</string>",
+	"<key>Action</key><string>SetFinderFlag</string>" kLocation
+	"<key>Flag</key><integer>16384</integer><key>Value</key><integer>1</integer>",
+	"<key>Action</key><string>SetVolumeFinderInfo</string>" kLocation kWords,
+	"<key>Action</key><string>SetAPFSBlessData</string>" kLocation kWords,
+	"<key>Action</key><string>SetDiskLabel</string><key>Device</key><string>/dev/disk0s2</string>"
+	"<key>Data</key><data>AQI=</data><key>Scale</key><integer>1</integer>",
+	"<key>Action</key><string>SetBlessIDsFromPaths</string>" kLocation kWords
+	"<key>Target</key><string>SetAPFSBlessData</string><key>Flags</key><integer>2</integer>"
+	"<key>FileFullPath</key><string>/Volumes/Test/boot.efi</string>"
+	"<key>FolderFullPath</key><string>/Volumes/Test</string>"
+	"<key>FolderDevice</key><string>/dev/disk4s1</string><key>FolderPath</key><string>/</string>",
+};
+
+static const char *kInvalidActions[] = {
+	"<key>Action</key><integer>1</integer>",
+	"<key>Action</key><string>Reboot</string>",
+	"<key>Action</key><string>NVRAMSet</string><key>Name</key><string>efi-boot-device</string>",
+	"<key>Action</key><string>NVRAMSet</string><key>Name</key><data>AQI=</data><key>Value</key><string>x</string>",
+	"<key>Action</key><string>NVRAMSet</string><key>Name</key><string>x</string><key>Value</key><array/>",
+	"<key>Action</key><string>NVRAMForward</string><key>From</key><string>a</string>",
+	"<key>Action</key><string>CreateFile</string>" kLocation "<key>Data</key><string>AQI=</string>"
+	"<key>Immutable</key><integer>0</integer><key>Type</key><integer>0</integer>"
+	"<key>Creator</key><integer>0</integer><key>Preallocate</key><integer>1</integer>",
+	"<key>Action</key><string>CreateFile</string>" kLocation
+	"<key>Immutable</key><integer>0</integer><key>Type</key><integer>0</integer>",
+	"<key>Action</key><string>DeleteFile</string>",
+	"<key>Action</key><string>DeleteFile</string><key>FullPath</key><integer>1</integer>",
+	"<key>Action</key><string>DeleteFile</string><key>FullPath</key><string>/x</string>"
+	"<key>Device</key><string>/dev/disk4s1</string>",
+	"<key>Action</key><string>CopyFile</string>" kLocation,
+	"<key>Action</key><string>SetFinderFlag</string>" kLocation "<key>Flag</key><string>1</string>"
+	"<key>Value</key><integer>1</integer>",
+	"<key>Action</key><string>SetAPFSBlessData</string>" kLocation,
+	"<key>Action</key><string>SetAPFSBlessData</string>" kLocation "<key>Words</key><array><string>1</string></array>",
+	"<key>Action</key><string>SetVolumeFinderInfo</string>" kLocation "<key>Words</key><array>"
+	"<integer>0</integer><integer>0</integer><integer>0</integer><integer>0</integer><integer>0</integer>"
+	"<integer>0</integer><integer>0</integer><integer>0</integer><integer>0</integer></array>",
+	"<key>Action</key><string>SetDiskLabel</string><key>Device</key><string>/dev/disk0s2</string>"
+	"<key>Scale</key><integer>1</integer>",
+	"<key>Action</key><string>SetBlessIDsFromPaths</string>" kLocation kWords
+	"<key>Target</key><string>DeleteFile</string><key>Flags</key><integer>0</integer>",
+	"<key>Action</key><string>SetBlessIDsFromPaths</string>" kLocation kWords
+	"<key>Target</key><string>SetAPFSBlessData</string><key>Flags</key><integer>0</integer>"
+	"<key>FileDevice</key><string>/dev/disk4s1</string><key>FilePath</key><string>/boot.efi</string>",
+};
+
+static int createPlan(const char *actions, BLPlanRef *plan)
+{
+	char		buf[8192];
+	CFDataRef	data;
+	int			ret;
+
+	snprintf(buf, sizeof buf,
+			 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			 "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" "
+			 "\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+			 "<plist version=\"1.0\"><array>%s</array></plist>\n", actions);
+	data = CFDataCreate(kCFAllocatorDefault, (const UInt8 *)buf, strlen(buf));
+	ret = BLPlanCreateWithPropertyList(NULL, data, plan);
+	CFRelease(data);
+
+	return ret;
+}
+
+static void testActions(void)
+{
+	char		dict[2048];
+	BLPlanRef	plan;
+	size_t		i;
+
+	for (i = 0; i < sizeof(kValidActions) / sizeof(kValidActions[0]); i++) {
+		snprintf(dict, sizeof dict, "<dict>%s</dict>", kValidActions[i]);
+		BLTestAssertEqual(createPlan(dict, &plan), 0);
+		BLTestAssert(plan != NULL);
+		if (plan) {
+			BLTestAssertEqual(CFArrayGetCount(BLPlanGetActions(plan)), 1);
+			BLPlanRelease(plan);
+		}
+	}
+
+	for (i = 0; i < sizeof(kInvalidActions) / sizeof(kInvalidActions[0]); i++) {
+		snprintf(dict, sizeof dict, "<dict>%s</dict>", kInvalidActions[i]);
+		if (createPlan(dict, &plan) == 0) {
+			fprintf(stderr, "accepted invalid action %zu\n", i);
+			gBLTestFailures++;
+		}
+		BLTestAssert(plan == NULL);
+	}
+}
+
+// one bad action rejects the whole plan
+static void testWholePlan(void)
+{
+	char		actions[4096];
+	BLPlanRef	plan;
+
+	snprintf(actions, sizeof actions, "<dict>%s</dict><dict>%s</dict><string>x</string>",
+			 kValidActions[0], kValidActions[2]);
+	BLTestAssert(createPlan(actions, &plan) != 0);
+	BLTestAssert(plan == NULL);
+
+	BLTestAssert(createPlan("", &plan) == 0);
+	if (plan) {
+		BLTestAssertEqual(CFArrayGetCount(BLPlanGetActions(plan)), 0);
+		BLPlanRelease(plan);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	testActions();
+	testWholePlan();
+
+	return BLTestFinish("BLPlanTests");
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+//  BLTest.h
+//
+//  Just enough harness for the programs in this directory. Each one is
+//  run with no arguments to test, or with -b to benchmark.
+//
+
+#ifndef _BLTEST_H_
+#define _BLTEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+static int gBLTestFailures;
+
+#define BLTestAssert(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #cond); \
+		gBLTestFailures++; \
+	} \
+} while (0)
+
+#define BLTestAssertEqual(a, b) do { \
+	unsigned long long _a = (unsigned long long)(a), _b = (unsigned long long)(b); \
+	if (_a != _b) { \
+		fprintf(stderr, "%s:%d: %s == %s: 0x%llx != 0x%llx\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+		gBLTestFailures++; \
+	} \
+} while (0)
+
+#define BLTestAssertEqualStrings(a, b) do { \
+	const char *_a = (a), *_b = (b); \
+	if (_a == NULL || _b == NULL || strcmp(_a, _b) != 0) { \
+		fprintf(stderr, "%s:%d: %s == %s: \"%s\" != \"%s\"\n", __FILE__, __LINE__, #a, #b, \
+				_a ? _a : "(null)", _b ? _b : "(null)"); \
+		gBLTestFailures++; \
+	} \
+} while (0)
+
+static inline uint64_t BLTestNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// one line per benchmark: name, ns/op, and throughput when bytes is non-zero
+static inline void BLTestReport(const char *name, uint64_t ops, uint64_t ns, uint64_t bytes)
+{
+	if (bytes) {
+		printf("%-40s %10.1f ns/op %10.2f GB/s\n", name, (double)ns / ops, (double)bytes / ns);
+	} else {
+		printf("%-40s %10.1f ns/op\n", name, (double)ns / ops);
+	}
+}
+
+static inline int BLTestFinish(const char *program)
+{
+	if (gBLTestFailures) {
+		fprintf(stderr, "%s: %d failure(s)\n", program, gBLTestFailures);
+		return 1;
+	}
+	printf("%s: passed\n", program);
+	return 0;
+}
+
+#endif // _BLTEST_H_
@@ -54,6 +54,9 @@ void usage(void) {
               "\t\t\tcurrently active boot volume if <dir> is not specified\n"
               "\t\t\t(For Apple Silicon, --info option is only supported for external devices)\n"
               "\t--getBoot\tSuppress normal output and print the active boot volume\n"
+              "\t--all-boot-options\tPrint every firmware boot option (BootOrder,\n"
+              "\t\t\tBootNext and the Boot#### entries they name), decoded;\n"
+              "\t\t\tonly valid with --info\n"
               "\t--version\tPrint bless version number\n"
               "\t--plist\t\tFor any output type, use a plist representation\n"
               "\t--verbose\tVerbose output\n"
@@ -86,6 +89,8 @@ void usage(void) {
               "Device Mode:\n"
               "\t--device dev\tUse this block device in conjunction with --setBoot\n"
               "\t--setBoot\tSet firmware to boot from this volume\n"
+              "\t--startupfile file\tWrite the XCOFF loader <file> as the HFS+ startup\n"
+              "\t\t\tfile of <dev>, an unmounted volume or an image file\n"
               "\t--user\t Specify a user other than the one who invoked the tool\n"
               "\t--stdinpass\t Collect a local owner password from stdin without prompting.\n"
               "\t--passpromt\t Explicitly ask to be prompted for the password.\n"
@@ -94,7 +99,18 @@ void usage(void) {
               "NetBoot Mode:\n"
               "\t--netboot\tSet firmware to boot from the network\n"
               "\t--server url\tUse BDSP to fetch boot parameters from <url>\n"
-              "\t--verbose\tVerbose output\n",
+              "\t--verbose\tVerbose output\n"
+              "\n"
+              "Plan Mode:\n"
+              "\t--plan\t\tWith any other mode, print the NVRAM and volume changes\n"
+              "\t\t\tit would make instead of making them\n"
+              "\t--plist\t\tPrint the plan as a plist, for --apply-plan\n"
+              "\t--apply-plan file\tMake the changes recorded in <file>\n"
+              "\n"
+              "Image Scan Mode:\n"
+              "\t--scan-images path\tCheck each image file in directory <path>, or listed\n"
+              "\t\t\tone per line in file <path> (- for stdin), for an El Torito\n"
+              "\t\t\tEFI boot entry and print the results as JSON lines\n",
               stderr);
     } else {
         fputs(
@@ -166,7 +182,15 @@ void usage_short(void) {
               "\n"
               "bless --netboot --server url [--verbose]\n"
               "\n"
-              "bless --info [directory] [--getBoot] [--plist] [--verbose] [--version]\n",
+              "bless --info [directory] [--getBoot] [--plist] [--verbose] [--version]\n"
+              "\n"
+              "bless --info --all-boot-options [--plist] [--verbose]\n"
+              "\n"
+              "bless --plan [--plist] <mode options>\n"
+              "\n"
+              "bless --apply-plan file [--verbose]\n"
+              "\n"
+              "bless --scan-images path\n",
               stderr);
     } else {
         fputs(